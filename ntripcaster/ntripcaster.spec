@@ -10,6 +10,7 @@ License:        GPL-2.0+
 URL:            https://igs.bkg.bund.de/ntrip/bkgcaster
 Source:         %{name}-%{version}.tar.bz2
 BuildRequires:  openssl-devel
+BuildRequires:  zlib-devel
 BuildRequires:  systemd
 BuildRequires:  systemd-devel
 BuildRoot:      %{_tmppath}/%{name}-%{version}-root
@@ -88,6 +89,7 @@ echo "d /run/%{name} 0755 root root -" >%{buildroot}%{_tmpfilesdir}/%{name}.conf
 %exclude %{_bindir}/%{name}
 %exclude %{_bindir}/casterwatch
 %{_sbindir}/ntripdaemon
+%{_sbindir}/ntripaccess
 /usr/share/%{name}/
 %{_sysconfdir}/%{name}/groups.aut.dist
 %{_sysconfdir}/%{name}/sourcemounts.aut.dist
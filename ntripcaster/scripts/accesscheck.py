@@ -0,0 +1,161 @@
+#!/usr/bin/env python3
+#
+# Round trip check of the binary access log: runs the caster with
+# access_log_format 2 in a scratch directory, lets a few clients come and
+# go, restarts it so the segment is continued, and compares what
+# ntripaccess exports, as CSV and as JSON, with the CSV access file the
+# caster wrote next to the segment. Every string must be in the segment
+# once, also after the restart.
+#
+# usage: accesscheck.py [-b builddir] [-p port]
+#
+# builddir is the directory holding ntripdaemon and ntripaccess, by
+# default ../src seen from this script, port a free one if not given.
+# Exits 0 if everything matches.
+
+import argparse
+import base64
+import glob
+import json
+import os
+import shutil
+import signal
+import socket
+import struct
+import subprocess
+import sys
+import tempfile
+import time
+
+CONFIG = """name accesscheck
+max_clients 100
+max_sources 10
+encoder_password letmein
+admin_password adm1np8ss
+server_name localhost
+port %(port)d
+logdir %(dir)s/logs
+watchfilename %(dir)s/var/watchdog.check
+pidfilename %(dir)s/var/caster.pid
+templatedir %(dir)s/templates
+console_mode 2
+access_log_format 2
+"""
+
+AGENTS = ["NTRIP plain/1.0", 'NTRIP "quoted" \\back\\slash', "NTRIP " + "x" * 800]
+
+
+def start(builddir, tmp):
+    caster = subprocess.Popen([os.path.join(builddir, "ntripdaemon"), "-d", tmp + "/conf"],
+                              cwd=tmp, stdout=subprocess.DEVNULL, stderr=subprocess.DEVNULL)
+    time.sleep(1)
+    return caster
+
+
+def stop(caster):
+    caster.send_signal(signal.SIGTERM)
+    caster.wait(10)
+
+
+def clients(port):
+    src = socket.create_connection(("127.0.0.1", port))
+    src.sendall(b"SOURCE letmein /CHECK\r\nSource-Agent: NTRIP check\r\n\r\n")
+    src.recv(100)
+    src.sendall(b"x" * 100)
+    for i, agent in enumerate(AGENTS):
+        con = socket.create_connection(("127.0.0.1", port))
+        auth = "Authorization: Basic %s\r\n" % base64.b64encode(b"user%d:pw" % i).decode()
+        con.sendall(("GET /CHECK HTTP/1.0\r\nUser-Agent: %s\r\n%s\r\n" % (agent, auth)).encode())
+        con.settimeout(2)
+        con.recv(100)
+        src.sendall(b"y" * 100)
+        time.sleep(0.3)
+        con.close()
+        time.sleep(0.3)
+    src.close()
+    time.sleep(1)
+
+
+def segment_strings(filename):
+    with open(filename, "rb") as f:
+        data = f.read()
+    used = struct.unpack_from("=Q", data, 16)[0]
+    pos, strings = 24, []
+    while pos < used:
+        length, rtype = struct.unpack_from("=II", data, pos)
+        if rtype == 1:
+            slen = struct.unpack_from("=I", data, pos + 12)[0]
+            strings.append(data[pos + 16:pos + 16 + slen])
+        pos += length
+    return strings
+
+
+def fail(msg):
+    print("FAIL: " + msg)
+    sys.exit(1)
+
+
+def main():
+    here = os.path.dirname(os.path.abspath(__file__))
+    parser = argparse.ArgumentParser(description="binary access log round trip check")
+    parser.add_argument("-b", "--builddir", default=os.path.join(here, "..", "src"))
+    parser.add_argument("-p", "--port", type=int, default=0)
+    args = parser.parse_args()
+
+    if not args.port:
+        probe = socket.socket()
+        probe.bind(("127.0.0.1", 0))
+        args.port = probe.getsockname()[1]
+        probe.close()
+
+    tmp = tempfile.mkdtemp(prefix="accesscheck")
+    try:
+        for d in ("conf", "logs", "var", "templates"):
+            os.mkdir(os.path.join(tmp, d))
+        with open(tmp + "/conf/ntripcaster.conf", "w") as f:
+            f.write(CONFIG % {"port": args.port, "dir": tmp})
+        for name in ("users.aut", "groups.aut", "clientmounts.aut", "sourcemounts.aut", "sourcetable.dat"):
+            open(os.path.join(tmp, "conf", name), "w").close()
+
+        for run in range(2):
+            caster = start(args.builddir, tmp)
+            try:
+                clients(args.port)
+            finally:
+                stop(caster)
+
+        segments = glob.glob(tmp + "/logs/*.acs")
+        csvfiles = glob.glob(tmp + "/logs/access*.log")
+        if len(segments) != 1 or len(csvfiles) != 1:
+            fail("expected one segment and one CSV file, found %s %s" % (segments, csvfiles))
+
+        strings = segment_strings(segments[0])
+        if len(strings) != len(set(strings)):
+            fail("strings written more than once: %s" % [s[:20] for s in strings if strings.count(s) > 1])
+
+        tool = os.path.join(args.builddir, "ntripaccess")
+        csv = subprocess.run([tool, segments[0]], capture_output=True, text=True, check=True).stdout.splitlines()[1:]
+        js = [json.loads(l) for l in
+              subprocess.run([tool, "-j", segments[0]], capture_output=True, text=True, check=True).stdout.splitlines()]
+        with open(csvfiles[0]) as f:
+            logged = [l.rstrip("\n") for l in f if l.strip() and not l.startswith("Date,")]
+
+        if not (len(csv) == len(js) == len(logged) == 2 * len(AGENTS)):
+            fail("%d CSV, %d JSON, %d logged records" % (len(csv), len(js), len(logged)))
+
+        for exported, record, line in zip(csv, js, logged):
+            a, b = exported.split(","), line.split(",")
+            if a[2:6] != b[2:6] or a[7] != b[7] or abs(int(a[6]) - int(b[6])) > 1:
+                fail("CSV differs:\n  %s\n  %s" % (exported[:120], line[:120]))
+            if [record["user"] or "(null)", record["host"], record["mount"], record["agent"]] != b[2:6] \
+                    or record["bytes"] != int(b[7]) or record["seconds"] != int(a[6]):
+                fail("JSON differs:\n  %s\n  %s" % (json.dumps(record)[:120], line[:120]))
+        if not any(record["bytes"] for record in js):
+            fail("no bytes counted")
+        print("OK: %d records, %d strings" % (len(csv), len(strings)))
+    finally:
+        shutil.rmtree(tmp)
+
+
+if __name__ == "__main__":
+    main()
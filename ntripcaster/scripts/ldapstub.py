@@ -0,0 +1,103 @@
+#!/usr/bin/env python3
+#
+# Minimal LDAP server answering simple binds, to test the LDAP
+# authentication of the caster without a directory server.
+#
+# usage: ldapstub.py [-p port] [-d delay] user:password ...
+#
+# A bind succeeds when the value of the first RDN of the DN (the uid)
+# and the password match one of the given users. Every bind is printed,
+# so cached logins are the ones which do not show up. Use -d to answer
+# slowly, and stop the stub to test the grace period.
+# Configure the caster with "ldap_server 127.0.0.1" and "ldap_port <port>".
+
+import argparse
+import socket
+import sys
+import threading
+import time
+
+
+def read_tlv(data, pos):
+    tag = data[pos]
+    length = data[pos + 1]
+    pos += 2
+    if length & 0x80:
+        n = length & 0x7F
+        length = int.from_bytes(data[pos:pos + n], "big")
+        pos += n
+    return tag, data[pos:pos + length], pos + length
+
+
+def encode(tag, value):
+    if len(value) < 0x80:
+        return bytes([tag, len(value)]) + value
+    n = (len(value).bit_length() + 7) // 8
+    return bytes([tag, 0x80 | n]) + len(value).to_bytes(n, "big") + value
+
+
+def bind_response(msgid, code):
+    op = encode(0x0A, bytes([code])) + encode(0x04, b"") + encode(0x04, b"")
+    return encode(0x30, encode(0x02, msgid) + encode(0x61, op))
+
+
+def serve(conn, users, delay):
+    buf = b""
+    with conn:
+        while True:
+            data = conn.recv(4096)
+            if not data:
+                return
+            buf += data
+            while len(buf) >= 2:
+                try:
+                    _, msg, end = read_tlv(buf, 0)
+                except IndexError:
+                    break
+                if end > len(buf):
+                    break
+                buf = buf[end:]
+                _, msgid, pos = read_tlv(msg, 0)
+                tag, op, _ = read_tlv(msg, pos)
+                if tag == 0x42:  # unbind
+                    return
+                if tag != 0x60:  # only binds are supported
+                    conn.sendall(bind_response(msgid, 53))
+                    continue
+                _, _, pos = read_tlv(op, 0)
+                _, dn, pos = read_tlv(op, pos)
+                _, password, _ = read_tlv(op, pos)
+                dn = dn.decode(errors="replace")
+                uid = dn.split(",")[0].split("=", 1)[-1]
+                ok = users.get(uid) == password.decode(errors="replace")
+                print("bind %s %s" % (dn, "ok" if ok else "rejected"), flush=True)
+                if delay:
+                    time.sleep(delay)
+                conn.sendall(bind_response(msgid, 0 if ok else 49))
+
+
+def main():
+    parser = argparse.ArgumentParser(description="LDAP bind stub for testing")
+    parser.add_argument("-p", "--port", type=int, default=3389)
+    parser.add_argument("-d", "--delay", type=float, default=0.0,
+                        help="seconds to wait before each answer")
+    parser.add_argument("users", nargs="+", help="user:password")
+    args = parser.parse_args()
+
+    users = dict(u.split(":", 1) for u in args.users)
+    srv = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    srv.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    srv.bind(("127.0.0.1", args.port))
+    srv.listen(16)
+    print("listening on 127.0.0.1:%d" % args.port, flush=True)
+    try:
+        while True:
+            conn, _ = srv.accept()
+            threading.Thread(target=serve, args=(conn, users, args.delay),
+                             daemon=True).start()
+    except KeyboardInterrupt:
+        sys.exit(0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,98 @@
+/* accessformat.h
+ * - Binary access log segment format, shared by accesslog.c and ntripaccess
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_ACCESSFORMAT_H
+#define NTRIPCASTER_ACCESSFORMAT_H
+
+#include <stdint.h>
+
+/*
+ * A segment starts with an access_segment_header_t followed by records.
+ * Every record starts with an access_record_header_t, its len covers the
+ * whole record and is a multiple of 8. Strings (user, host, mount, agent,
+ * disconnect reason) are written once per segment as ACCESS_RECORD_STRING
+ * and referred to by id from the ACCESS_RECORD_CLIENT records behind them,
+ * id 0 means no string. Numbers are in the byte order of the caster,
+ * which is given by byteorder. Readers must not look beyond used, the
+ * caster raises it only after a record is complete.
+ */
+#define ACCESS_SEGMENT_MAGIC "NTRACS\0\0"
+#define ACCESS_SEGMENT_BYTEORDER 0x01020304
+#define ACCESS_SEGMENT_VERSION 1
+#define ACCESS_SEGMENT_SUFFIX "acs"
+
+#define ACCESS_RECORD_STRING 1
+#define ACCESS_RECORD_CLIENT 2
+
+#define ACCESS_STRING_MAX 1024
+#define ACCESS_RECORD_ALIGN(len) (((len) + 7) & ~7)
+
+typedef struct access_segment_header_St {
+  char magic[8];
+  uint32_t byteorder;
+  uint32_t version;
+  uint64_t used;        /* bytes in use, header included */
+} access_segment_header_t;
+
+typedef struct access_record_header_St {
+  uint32_t len;
+  uint32_t type;
+} access_record_header_t;
+
+typedef struct access_string_record_St {
+  access_record_header_t hdr;
+  uint32_t id;
+  uint32_t length;      /* without the terminating 0 */
+  /* followed by the 0 terminated string */
+} access_string_record_t;
+
+typedef struct access_client_record_St {
+  access_record_header_t hdr;
+  int64_t connect_time;
+  int64_t disconnect_time;
+  uint64_t bytes;
+  int64_t connection_id;
+  uint32_t user;
+  uint32_t host;
+  uint32_t mount;
+  uint32_t agent;
+  uint32_t reason;
+  uint32_t reserved;
+} access_client_record_t;
+
+#endif
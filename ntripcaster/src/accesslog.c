@@ -0,0 +1,460 @@
+/* accesslog.c
+ * - Binary access log written to mmap'd segments
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <stdlib.h>
+#include <errno.h>
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+#include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#include "avl.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "utility.h"
+#include "log.h"
+#include "logtime.h"
+#include "memory.h"
+#include "accessformat.h"
+#include "accesslog.h"
+
+extern server_info_t info;
+
+/*
+ * Segments are named like the access file, with the extension replaced
+ * by .<number>.acs, and are numbered from 0 each day. A segment is
+ * created with access_segment_size KB reserved and mapped as a whole, so
+ * a record costs a memcpy and no system call. When a segment is closed
+ * the file is cut to the used size, a segment which still has room is
+ * continued after a restart.
+ */
+#define ACCESS_SEGMENT_MIN 65536
+#define ACCESS_SEGMENT_FILES 1000
+
+typedef struct access_string_St {
+  char *key;
+  uint32_t id;
+} access_string_t;
+
+typedef struct access_segment_St {
+  char *base;             /* log file name without extension */
+  int number;
+  int fd;
+  char *map;
+  size_t size;
+  access_segment_header_t *hdr;
+  hash_table_t *strings;  /* interned strings of this segment */
+  uint32_t next_id;
+} access_segment_t;
+
+static mutex_t access_mutex;
+static access_segment_t segment = { NULL, 0, -1, NULL, 0, NULL, NULL, 1 };
+static access_log_stats_t access_stats = { 0, 0, 0 };
+
+#if defined (HAVE_SYS_MMAN_H) && defined (HAVE_MMAP)
+
+static void free_access_string(access_string_t *as) {
+  nfree(as->key);
+  nfree(as);
+}
+
+static size_t string_record_len(size_t length) {
+  return ACCESS_RECORD_ALIGN(sizeof(access_string_record_t) + length + 1);
+}
+
+/* Largest size a client record and its strings may take */
+static size_t max_client_record_len() {
+  return sizeof(access_client_record_t) + 5 * string_record_len(ACCESS_STRING_MAX);
+}
+
+/* About one new string per KB, the table grows beyond it */
+static unsigned int get_string_table_size(size_t size) {
+  return size / 1024 > 256 ? size / 1024 : 256;
+}
+
+static size_t get_segment_size() {
+  size_t size = (size_t)info.access_segment_size * 1024;
+
+  if (size < ACCESS_SEGMENT_MIN)
+    size = ACCESS_SEGMENT_MIN;
+  return size;
+}
+
+static int reserve_segment(int fd, size_t size) {
+#ifdef HAVE_POSIX_FALLOCATE
+  /* Reserve the blocks now, a full disk would kill us with SIGBUS later */
+  return posix_fallocate(fd, 0, size) == 0 ? 0 : -1;
+#else
+  return ftruncate(fd, size);
+#endif
+}
+
+/* Register the strings of an existing segment, fails on a broken segment */
+static int scan_segment(access_segment_t *seg) {
+  size_t pos = sizeof(access_segment_header_t);
+  size_t used = seg->hdr->used;
+
+  while (pos + sizeof(access_record_header_t) <= used) {
+    access_record_header_t *rh = (access_record_header_t *)(seg->map + pos);
+
+    if (rh->len < sizeof(access_record_header_t) || (rh->len & 7) || pos + rh->len > used)
+      return -1;
+
+    if (rh->type == ACCESS_RECORD_STRING) {
+      access_string_record_t *sr = (access_string_record_t *)rh;
+      access_string_t *as, *old;
+
+      if (sizeof(access_string_record_t) + sr->length + 1 > rh->len)
+        return -1;
+
+      as = (access_string_t *)nmalloc(sizeof(access_string_t));
+      as->key = nstrdup((char *)(sr + 1));
+      as->id = sr->id;
+      if (as->id >= seg->next_id)
+        seg->next_id = as->id + 1;
+      if ((old = hash_replace(seg->strings, as->key, as)) != NULL)
+        free_access_string(old);
+    }
+    pos += rh->len;
+  }
+
+  return pos == used ? 0 : -1;
+}
+
+static void close_segment(access_segment_t *seg) {
+  if (seg->map) {
+    size_t used = seg->hdr->used;
+
+    msync(seg->map, used, MS_SYNC);
+    munmap(seg->map, seg->size);
+    if (ftruncate(seg->fd, used) == -1)
+      xa_debug(1, "DEBUG: Could not truncate access segment %d [%d]", seg->number, errno);
+    seg->map = NULL;
+    seg->hdr = NULL;
+  }
+
+  if (seg->fd != -1) {
+    fd_close(seg->fd);
+    seg->fd = -1;
+  }
+
+  if (seg->strings) {
+    hash_destroy(seg->strings, (ntripcaster_function *)free_access_string);
+    seg->strings = NULL;
+  }
+}
+
+/*
+ * Map segment number of seg->base. Returns 1 if it is ready for
+ * appending, 0 if it is full or broken and the next one should be tried,
+ * -1 if segments can not be written at all.
+ */
+static int map_segment(access_segment_t *seg, int number) {
+  char filename[BUFSIZE];
+  size_t size = get_segment_size();
+  struct stat st;
+  void *map;
+
+  snprintf(filename, BUFSIZE, "%s.%d.%s", seg->base, number, ACCESS_SEGMENT_SUFFIX);
+
+  if ((seg->fd = open(filename, O_RDWR | O_CREAT, 00644)) == -1) {
+    write_log(LOG_DEFAULT, "WARNING: Could not open access segment %s [%d]", filename, errno);
+    return -1;
+  }
+
+  if (fstat(seg->fd, &st) == -1) {
+    close_segment(seg);
+    return -1;
+  }
+
+  if (st.st_size > 0 && (size_t)st.st_size < sizeof(access_segment_header_t)) {
+    close_segment(seg);
+    return 0;
+  }
+
+  if ((size_t)st.st_size > size)
+    size = st.st_size;
+
+  if ((size_t)st.st_size < size && reserve_segment(seg->fd, size) == -1) {
+    write_log(LOG_DEFAULT, "WARNING: Could not reserve %lu bytes for access segment %s [%d]", (unsigned long)size, filename, errno);
+    if (st.st_size == 0)
+      unlink(filename);
+    else if (ftruncate(seg->fd, st.st_size) == -1)
+      xa_debug(1, "DEBUG: Could not truncate access segment %s [%d]", filename, errno);
+    close_segment(seg);
+    return -1;
+  }
+
+  if ((map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, seg->fd, 0)) == MAP_FAILED) {
+    write_log(LOG_DEFAULT, "WARNING: Could not map access segment %s [%d]", filename, errno);
+    if (st.st_size == 0)
+      unlink(filename);
+    close_segment(seg);
+    return -1;
+  }
+
+  seg->map = (char *)map;
+  seg->size = size;
+  seg->hdr = (access_segment_header_t *)map;
+  seg->number = number;
+  seg->strings = hash_create(get_string_table_size(size));
+  seg->next_id = 1;
+
+  if (st.st_size == 0) {
+    memcpy(seg->hdr->magic, ACCESS_SEGMENT_MAGIC, sizeof(seg->hdr->magic));
+    seg->hdr->byteorder = ACCESS_SEGMENT_BYTEORDER;
+    seg->hdr->version = ACCESS_SEGMENT_VERSION;
+    seg->hdr->used = sizeof(access_segment_header_t);
+    __atomic_fetch_add(&access_stats.segments, 1, __ATOMIC_RELAXED);
+  } else if ((memcmp(seg->hdr->magic, ACCESS_SEGMENT_MAGIC, sizeof(seg->hdr->magic)) != 0)
+      || (seg->hdr->byteorder != ACCESS_SEGMENT_BYTEORDER) || (seg->hdr->version != ACCESS_SEGMENT_VERSION)
+      || (seg->hdr->used < sizeof(access_segment_header_t)) || (seg->hdr->used > (size_t)st.st_size)
+      || (scan_segment(seg) == -1)) {
+    write_log(LOG_DEFAULT, "WARNING: Skipping broken access segment %s", filename);
+    /* Keep the file as it was */
+    munmap(seg->map, seg->size);
+    seg->map = NULL;
+    seg->hdr = NULL;
+    if (ftruncate(seg->fd, st.st_size) == -1)
+      xa_debug(1, "DEBUG: Could not truncate access segment %s [%d]", filename, errno);
+    close_segment(seg);
+    return 0;
+  }
+
+  if (seg->hdr->used + max_client_record_len() > seg->size) {
+    close_segment(seg);
+    return 0;
+  }
+
+  xa_debug(2, "DEBUG: Appending to access segment %s at %lu", filename, (unsigned long)seg->hdr->used);
+
+  return 1;
+}
+
+/* Open the first segment from number on which has room. */
+static int open_segment(access_segment_t *seg, int number) {
+  int ret;
+
+  for (; number < ACCESS_SEGMENT_FILES; number++) {
+    if ((ret = map_segment(seg, number)) != 0)
+      return ret;
+  }
+
+  write_log(LOG_DEFAULT, "WARNING: No room for another access segment of %s", seg->base);
+  return -1;
+}
+
+static void *append_record(access_segment_t *seg, size_t len) {
+  void *rec = seg->map + seg->hdr->used;
+
+  memset(rec, 0, len);
+  ((access_record_header_t *)rec)->len = len;
+  return rec;
+}
+
+/* Make the record behind used visible to readers */
+static void commit_record(access_segment_t *seg) {
+  access_record_header_t *rh = (access_record_header_t *)(seg->map + seg->hdr->used);
+
+  __atomic_store_n(&seg->hdr->used, seg->hdr->used + rh->len, __ATOMIC_RELEASE);
+}
+
+/*
+ * Id of string in seg, writes a string record when it is new there.
+ * Strings are cut to ACCESS_STRING_MAX and known by what was written, as
+ * scan_segment() finds them after a restart.
+ */
+static uint32_t intern_string(access_segment_t *seg, const char *string) {
+  char key[ACCESS_STRING_MAX + 1];
+  access_string_record_t *sr;
+  access_string_t *as;
+  size_t length;
+
+  if (!string)
+    return 0;
+
+  length = strlen(string);
+  if (length > ACCESS_STRING_MAX) {
+    length = ACCESS_STRING_MAX;
+    memcpy(key, string, length);
+    key[length] = '\0';
+    string = key;
+  }
+
+  if ((as = (access_string_t *)hash_find(seg->strings, string)) != NULL)
+    return as->id;
+
+  sr = (access_string_record_t *)append_record(seg, string_record_len(length));
+  sr->hdr.type = ACCESS_RECORD_STRING;
+  sr->id = seg->next_id++;
+  sr->length = length;
+  memcpy(sr + 1, string, length);
+  commit_record(seg);
+
+  as = (access_string_t *)nmalloc(sizeof(access_string_t));
+  as->key = nstrdup(string);
+  as->id = sr->id;
+  hash_replace(seg->strings, as->key, as);
+
+  return as->id;
+}
+
+#endif /* HAVE_SYS_MMAN_H && HAVE_MMAP */
+
+void accesslog_init() {
+  thread_create_mutex(&access_mutex);
+}
+
+/* Only at shutdown, when the other threads are gone */
+void accesslog_cleanup() {
+#if defined (HAVE_SYS_MMAN_H) && defined (HAVE_MMAP)
+  close_segment(&segment);
+#endif
+  if (segment.base) {
+    nfree(segment.base);
+  }
+  thread_mutex_destroy(&access_mutex);
+}
+
+/*
+ * Called from open_log_files(), on startup, a new day or a changed
+ * access file name. Closes the current segment and continues with the
+ * segments of the current access file.
+ */
+void open_access_segment() {
+#if defined (HAVE_SYS_MMAN_H) && defined (HAVE_MMAP)
+  char *filename, *ext;
+
+  thread_mutex_lock(&access_mutex);
+
+  close_segment(&segment);
+  if (segment.base) {
+    nfree(segment.base);
+  }
+
+  if ((info.access_log_format != ACCESS_LOG_CSV) && ((filename = get_log_file(info.accessfilename)) != NULL)) {
+    if (((ext = strrchr(filename, '.')) != NULL) && (strcmp(ext, ".log") == 0))
+      *ext = '\0';
+    segment.base = filename;
+    open_segment(&segment, 0);
+  }
+
+  thread_mutex_unlock(&access_mutex);
+#else
+  if (info.access_log_format != ACCESS_LOG_CSV)
+    write_log(LOG_DEFAULT, "WARNING: Binary access log needs mmap(), writing CSV");
+#endif
+}
+
+/*
+ * Append the access record of client con. Returns 0 if no segment is
+ * open, the caller should write the CSV line instead.
+ */
+int write_access_record(connection_t *con, const char *user, const char *mount, const char *agent, const char *reason) {
+#if defined (HAVE_SYS_MMAN_H) && defined (HAVE_MMAP)
+  access_client_record_t *cr;
+  uint32_t ids[5];
+
+  thread_mutex_lock(&access_mutex);
+
+  if (segment.map && (segment.hdr->used + max_client_record_len() > segment.size)) {
+    int number = segment.number + 1;
+
+    close_segment(&segment);
+    open_segment(&segment, number);
+  }
+
+  if (!segment.map) {
+    thread_mutex_unlock(&access_mutex);
+    __atomic_fetch_add(&access_stats.failed, 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  /* Strings first, a reader knows them when it reaches the client record */
+  ids[0] = intern_string(&segment, user);
+  ids[1] = intern_string(&segment, con->host);
+  ids[2] = intern_string(&segment, mount);
+  ids[3] = intern_string(&segment, agent);
+  ids[4] = intern_string(&segment, reason);
+
+  cr = (access_client_record_t *)append_record(&segment, sizeof(access_client_record_t));
+  cr->hdr.type = ACCESS_RECORD_CLIENT;
+  cr->connect_time = con->connect_time;
+  cr->disconnect_time = get_time();
+  cr->bytes = con->food.client->write_bytes;
+  cr->connection_id = con->id;
+  cr->user = ids[0];
+  cr->host = ids[1];
+  cr->mount = ids[2];
+  cr->agent = ids[3];
+  cr->reason = ids[4];
+  commit_record(&segment);
+
+  thread_mutex_unlock(&access_mutex);
+
+  __atomic_fetch_add(&access_stats.written, 1, __ATOMIC_RELAXED);
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+void get_access_log_stats(access_log_stats_t *as) {
+  as->written = __atomic_load_n(&access_stats.written, __ATOMIC_RELAXED);
+  as->failed = __atomic_load_n(&access_stats.failed, __ATOMIC_RELAXED);
+  as->segments = __atomic_load_n(&access_stats.segments, __ATOMIC_RELAXED);
+}
@@ -98,6 +98,7 @@
 #include "source.h"
 #include "http.h"
 #include "vars.h"
+#include "loginlimit.h"
 
 extern server_info_t info;
 
@@ -163,8 +164,9 @@ int authenticate_admin_request(connection_t *con) {
 
   if (password_match(info.remote_admin_pass, var) == 1)
     return 1;
-  else
-    return 0;
+
+  loginlimit_failure(con->host, NULL);
+  return 0;
 }
 
 /* This is called, as a new thread, to handle local admins */
@@ -312,6 +314,37 @@ thread_mutex_unlock(&info.admin_mutex);
 
 #endif
 
+/*
+ * Same as sock_read_line_nb(), but sends the log lines queued for a
+ * tailing admin while waiting for input.
+ */
+static int
+admin_read_line (connection_t *con, char *buff, const int len)
+{
+  char c = '\0';
+  int read_bytes, pos = 0;
+
+  do {
+    read_bytes = recv (con->sock, &c, 1, 0);
+
+    if (read_bytes <= 0) {
+      if (read_bytes == 0 || !is_recoverable (errno)) {
+        xa_debug (1, "DEBUG: read error on admin socket %d [%d]", con->sock, errno);
+        return 0;
+      }
+      if (!flush_log_queue (con))
+        return 0;
+      my_sleep (30000);
+    } else if (c != '\r')
+      buff[pos++] = c;
+
+  } while (pos < len - 1 && c != '\n');
+
+  buff[pos] = '\0';
+
+  return 1;
+}
+
 /* This is called, as a new thread, to handle remote admins */
 void
 handle_remote_admin(connection_t *con)
@@ -329,7 +362,7 @@ handle_remote_admin(connection_t *con)
   sock_set_blocking (con->sock, SOCK_BLOCKNOT);
 
   while (con->food.admin->alive && thread_alive (mt)) {
-    if (sock_read_line_nb (con->sock, line, BUFSIZE))
+    if (admin_read_line (con, line, BUFSIZE))
       handle_admin_command (con, line, ntripcaster_strlen (line));
     else
       break;
@@ -348,6 +381,7 @@ thread_mutex_unlock(&info.admin_mutex);
 admin_t *create_admin()
 {
   admin_t *admin = (admin_t *)nmalloc(sizeof(admin_t));
+  admin->logqueue = NULL;
   return admin;
 }
 
@@ -363,6 +397,7 @@ void put_admin(connection_t *con)
   adm->alive = 1;
   adm->scheme = default_scheme_e;
   adm->debuglevel = 0;
+  adm->logqueue = create_log_queue ();
   add_admin ();
 }
 
@@ -462,6 +497,9 @@ describe_admin (const com_request_t *req, const connection_t *admcon)
         admin->status ? "yes" : "no");
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_ADMIN_MISC, "NtripCaster operator: %s", admin->oper ? "yes" : "no");
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_ADMIN_MISC, "Tailing logfile: %s", admin->tailing ? "yes" : "no");
+  if (admin->logqueue)
+    admin_write_line (req, ADMIN_SHOW_DESCRIBE_ADMIN_MISC, "Log lines queued: %d, dropped: %lu",
+          admin->logqueue->count, admin->logqueue->dropped);
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_ADMIN_MISC, "Commands executed: %d", admin->commands);
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_ADMIN_MISC, "Debuglevel: %d", admin->debuglevel);
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_ADMIN_END, "End of admin info");
@@ -93,186 +93,466 @@
 #include "group.h"
 #include "mount.h"
 #include "vars.h"
+#include "loginlimit.h"
+#include "metrics.h"
+#ifdef HAVE_LIBLDAP
+#include "ldapAuthenticate.h"
+#endif /* HAVE_LIBLDAP */
 
 extern server_info_t info;
 mutex_t authentication_mutex = {MUTEX_STATE_UNINIT};
-mounttree_t *client_mounttree = NULL;
-mounttree_t *source_mounttree = NULL;
-usertree_t *usertree = NULL;
-bantree_t *bantree = NULL;
-grouptree_t *grouptree = NULL;
 time_t lastrehash = 0;
 
-void rehash_authentication_scheme()
+/*
+ * The published scheme. Readers never lock, they register in the
+ * counter of the current epoch instead. A rehash swaps the pointer,
+ * switches the epoch and frees the old scheme as soon as the readers
+ * of the old epoch are gone.
+ */
+static auth_scheme_t *authentication_scheme = NULL;
+static int authentication_epoch = 0;
+static int authentication_readers[2] = {0, 0};
+
+void init_authentication_scheme()
 {
-  int rehash_it = 0;
-  struct stat st;
+  thread_create_mutex(&authentication_mutex);
+  thread_mutex_profile(&authentication_mutex, "authentication");
+#ifdef HAVE_LIBLDAP
+  ldap_authentication_init();
+#endif /* HAVE_LIBLDAP */
+
+  parse_authentication_scheme();
+}
+
+static void free_authentication_scheme(auth_scheme_t *as) {
+  if (!as)
+    return;
+
+  /* mounts hold pointers to groups, groups to users */
+  if (as->owned & (1 << AUTH_PART_CLIENT_MOUNTS)) {
+    free_access_index(as->client_access);
+    free_mount_tree(as->client_mounttree);
+  }
+  if (as->owned & (1 << AUTH_PART_SOURCE_MOUNTS)) {
+    free_access_index(as->source_access);
+    free_mount_tree(as->source_mounttree);
+  }
+  if (as->owned & (1 << AUTH_PART_GROUPS))
+    free_group_tree(as->grouptree);
+  if (as->owned & (1 << AUTH_PART_USERS)) {
+    hash_destroy(as->userhash, NULL);
+    free_user_tree(as->usertree);
+  }
+  if (as->owned & (1 << AUTH_PART_BANS))
+    free_ban_tree(as->bantree);
+  nfree(as);
+}
+
+static void get_authentication_file(const char *name, auth_file_t *af) {
   char file[BUFSIZE];
+  struct stat st;
 
-  if (get_ntripcaster_file(info.userfile, conf_file_e, R_OK, file) != NULL)
-    if (stat(file, &st) == 0) {
-      if (st.st_mtime > lastrehash)
-        rehash_it = 1;
-    }
-  if (!rehash_it && (get_ntripcaster_file(info.groupfile, conf_file_e, R_OK, file) != NULL))
-    if (stat(file, &st) == 0) {
-      if (st.st_mtime > lastrehash)
-        rehash_it = 1;
-    }
-  if (!rehash_it && (get_ntripcaster_file(info.client_mountfile, conf_file_e, R_OK, file) != NULL))
-    if (stat(file, &st) == 0) {
-      if (st.st_mtime > lastrehash)
-        rehash_it = 1;
-    }
-  if (!rehash_it && (get_ntripcaster_file(info.source_mountfile, conf_file_e, R_OK, file) != NULL))
-    if (stat(file, &st) == 0) {
-      if (st.st_mtime > lastrehash)
-        rehash_it = 1;
-    }
+  memset(af, 0, sizeof(auth_file_t));
+  if (get_ntripcaster_file(name, conf_file_e, R_OK, file) != NULL && stat(file, &st) == 0) {
+    af->mtime = st.st_mtime;
+#ifdef HAVE_STRUCT_STAT_ST_MTIM
+    af->mtime_nsec = st.st_mtim.tv_nsec;
+#endif
+    af->size = st.st_size;
+    af->ino = st.st_ino;
+  }
+}
 
-  if (!rehash_it && (get_ntripcaster_file(info.banlistfile, conf_file_e, R_OK, file) != NULL))
-    if (stat(file, &st) == 0) {
-      if (st.st_mtime > lastrehash)
-        rehash_it = 1;
-    }
+static void get_authentication_files(auth_file_t *files) {
+  get_authentication_file(info.userfile, &files[AUTH_PART_USERS]);
+  get_authentication_file(info.banlistfile, &files[AUTH_PART_BANS]);
+  get_authentication_file(info.groupfile, &files[AUTH_PART_GROUPS]);
+  get_authentication_file(info.client_mountfile, &files[AUTH_PART_CLIENT_MOUNTS]);
+  get_authentication_file(info.source_mountfile, &files[AUTH_PART_SOURCE_MOUNTS]);
+}
+
+/*
+ * Parse the authentication files again if any of them differs from
+ * the loaded version. The whole stamp is compared, so an edit within
+ * the same second as the last rehash is not missed.
+ */
+void rehash_authentication_scheme() {
+  auth_file_t files[AUTH_PARTS];
+  auth_scheme_t *as;
+  int epoch, rehash_it;
+
+  get_authentication_files(files);
+
+  as = acquire_authentication_scheme(&epoch);
+  rehash_it = !as || memcmp(as->files, files, sizeof(files)) != 0;
+  release_authentication_scheme(epoch);
 
   if (rehash_it) parse_authentication_scheme();
 }
 
-void init_authentication_scheme()
-{
-  thread_create_mutex(&authentication_mutex);
+/*
+ * Make as the current scheme and free the previous one once no reader
+ * can use it anymore. Logins are not blocked by this, only the
+ * caller waits for the readers of the old scheme.
+ * Must have authentication_mutex.
+ */
+static void publish_authentication_scheme(auth_scheme_t *as) {
+  auth_scheme_t *old;
+  int epoch;
 
-  parse_authentication_scheme();
+  old = __atomic_exchange_n(&authentication_scheme, as, __ATOMIC_SEQ_CST);
+
+  epoch = __atomic_load_n(&authentication_epoch, __ATOMIC_SEQ_CST);
+  __atomic_store_n(&authentication_epoch, !epoch, __ATOMIC_SEQ_CST);
+
+  while (__atomic_load_n(&authentication_readers[epoch], __ATOMIC_SEQ_CST) > 0)
+    my_sleep(1000);
+
+  free_authentication_scheme(old);
 }
 
 /*
- * Clean and setup authentication scheme.
+ * Get the current scheme for reading. The returned scheme stays valid
+ * until release_authentication_scheme() is called with the returned
+ * epoch. Never blocks, and may be nested.
+ */
+auth_scheme_t *acquire_authentication_scheme(int *epoch) {
+  int e;
+
+  for (;;) {
+    e = __atomic_load_n(&authentication_epoch, __ATOMIC_SEQ_CST);
+    __atomic_add_fetch(&authentication_readers[e], 1, __ATOMIC_SEQ_CST);
+    /* a rehash switched the epoch meanwhile, and may already wait
+       for the old readers. Don't start reading in the old epoch. */
+    if (__atomic_load_n(&authentication_epoch, __ATOMIC_SEQ_CST) == e)
+      break;
+    __atomic_sub_fetch(&authentication_readers[e], 1, __ATOMIC_SEQ_CST);
+  }
+
+  *epoch = e;
+  return __atomic_load_n(&authentication_scheme, __ATOMIC_SEQ_CST);
+}
+
+void release_authentication_scheme(int epoch) {
+  __atomic_sub_fetch(&authentication_readers[epoch], 1, __ATOMIC_SEQ_CST);
+}
+
+/* Current scheme for the writers. Must have authentication_mutex. */
+auth_scheme_t *get_authentication_scheme() {
+  return authentication_scheme;
+}
+
+/*
+ * Build a new authentication scheme and publish it.
+ * With incremental_rehash the parts whose file did not change are taken
+ * over from the current scheme, and only the others (and the parts
+ * pointing into them) are parsed again.
  * Run every time any authentication file changes
  * Assert Class: 1
  */
 void parse_authentication_scheme() {
+  auth_scheme_t *as, *old;
+  long long start = get_time_ms();
+  int reload = 0, i;
 
+  as = (auth_scheme_t *) nmalloc(sizeof(auth_scheme_t));
+  memset(as, 0, sizeof(auth_scheme_t));
+
+  get_authentication_files(as->files);
+
+  /* serializes the writers, readers don't care */
   thread_mutex_lock(&authentication_mutex);
 
-  /*
-   * Make a clean slate
-   */
-  destroy_authentication_scheme();
+  old = authentication_scheme;
+  for (i = 0; i < AUTH_PARTS; i++) {
+    if (!old || !info.incremental_rehash
+    || memcmp(&old->files[i], &as->files[i], sizeof(auth_file_t)) != 0)
+      reload |= 1 << i;
+  }
+  if (reload & (1 << AUTH_PART_USERS))
+    reload |= 1 << AUTH_PART_GROUPS;
+  if (reload & (1 << AUTH_PART_GROUPS))
+    reload |= (1 << AUTH_PART_CLIENT_MOUNTS) | (1 << AUTH_PART_SOURCE_MOUNTS);
+
+  if (!reload) {
+    thread_mutex_unlock(&authentication_mutex);
+    nfree(as);
+    lastrehash = get_time();
+    xa_debug(1, "DEBUG: Authentication files unchanged");
+    return;
+  }
 
   /*
    * Parse user file and flip it into memory
    */
-  parse_user_authentication_file();
+  if (reload & (1 << AUTH_PART_USERS)) {
+    as->usertree = create_user_tree();
+    as->userhash = hash_create(as->files[AUTH_PART_USERS].size / 16);
+    parse_user_authentication_file(as);
+  } else {
+    as->usertree = old->usertree;
+    as->userhash = old->userhash;
+  }
 
   /*
    * Parse ban file and flip it into memory
    */
-  parse_ban_file();
+  if (reload & (1 << AUTH_PART_BANS)) {
+    as->bantree = create_ban_tree();
+    parse_ban_file(as);
+  } else {
+    as->bantree = old->bantree;
+    as->banned = old->banned;
+  }
 
   /*
    * Dito with group file, with pointers to every user
    */
-  parse_group_authentication_file();
+  if (reload & (1 << AUTH_PART_GROUPS)) {
+    as->grouptree = create_group_tree();
+    parse_group_authentication_file(as);
+  } else
+    as->grouptree = old->grouptree;
 
   /*
-   * Dito with mount file, with pointers to every group
+   * Dito with mount file, with pointers to every group, and resolve
+   * it into the mounts of every user
    */
-  parse_mount_authentication_file(info.client_mountfile, client_mounttree);
-  parse_mount_authentication_file(info.source_mountfile, source_mounttree);
+  if (reload & (1 << AUTH_PART_CLIENT_MOUNTS)) {
+    as->client_mounttree = create_mount_tree();
+    parse_mount_authentication_file(info.client_mountfile, as->client_mounttree, as->grouptree);
+    as->client_access = create_access_index(as->client_mounttree, as->grouptree, as->userhash->count);
+  } else {
+    as->client_mounttree = old->client_mounttree;
+    as->client_access = old->client_access;
+  }
+
+  if (reload & (1 << AUTH_PART_SOURCE_MOUNTS)) {
+    as->source_mounttree = create_mount_tree();
+    parse_mount_authentication_file(info.source_mountfile, as->source_mounttree, as->grouptree);
+    as->source_access = create_access_index(as->source_mounttree, as->grouptree, as->userhash->count);
+  } else {
+    as->source_mounttree = old->source_mounttree;
+    as->source_access = old->source_access;
+  }
+
+  /* the parts taken over now belong to the new scheme */
+  as->owned = AUTH_PART_ALL;
+  if (old)
+    old->owned &= reload;
+
+  publish_authentication_scheme(as);
 
   thread_mutex_unlock(&authentication_mutex);
 
   lastrehash = get_time();
+
+  write_log(LOG_DEFAULT, "Loaded authentication in %lld ms: %d users, %d groups, %d client mounts, %d source mounts, %d bans%s",
+      get_time_ms() - start, avl_count(as->usertree), avl_count(as->grouptree),
+      avl_count(as->client_mounttree), avl_count(as->source_mounttree), as->banned,
+      reload == AUTH_PART_ALL ? "" : " (unchanged parts kept)");
 }
 
-void destroy_authentication_scheme() {
-  cleanup_authentication_scheme();
+ntripcaster_user_t *find_user(auth_scheme_t *as, const char *name) {
+  if (!as || !name)
+    return NULL;
 
-  client_mounttree = create_mount_tree();
-  source_mounttree = create_mount_tree();
-  grouptree = create_group_tree();
-  usertree = create_user_tree();
-  bantree = create_ban_tree();
+  return hash_find(as->userhash, name);
 }
 
+/* Only at shutdown, when the other threads are gone. Readers killed
+   inside a read section would make publishing wait forever. */
 void cleanup_authentication_scheme() {
-  free_mount_tree(client_mounttree);
-  free_mount_tree(source_mounttree);
-  free_group_tree(grouptree);
-  free_user_tree(usertree);
-  free_ban_tree(bantree);
+  free_authentication_scheme(__atomic_exchange_n(&authentication_scheme, NULL, __ATOMIC_SEQ_CST));
 }
 
-int authenticate_user_request(connection_t *con, ntrip_request_t *req, contype_t contype) {
-  avl_traverser trav = {0};
+/*
+ * Check the access of user to mount, with mount NULL for mounts without
+ * authentication. *password caches the password check over several
+ * calls, -1 if not checked yet. *congroup gets the granting group if it
+ * has none yet.
+ */
+static int check_mount_access(connection_t *con, auth_scheme_t *as, access_index_t *ai,
+    ntripcaster_user_t *user, mount_t *mount, int *password, char **congroup) {
+  user_access_t *ua = user ? hash_find(ai->users, user->name) : NULL;
+  group_t *group;
+
+  if (mount == NULL) {
+    if (ua && ua->monitor) {
+      if (*congroup == NULL) *congroup = nstrdup(ai->monitor->name);
+      con->ghost = 1;
+    }
+    return 1;
+  }
+
+  if (*password < 0) {
+    if (user != NULL && loginlimit_user_blocked(con->host, user->name)) {
+      xa_debug(1, "DEBUG: User %s is blocked on host %s after too many failed logins", user->name, con->host);
+      *password = 0;
+    } else
+      *password = user != NULL && user_authenticate(as, user->name, user->pass);
+  }
+  if (!*password) {
+    xa_debug(1, "DEBUG: User authentication failed!!!");
+    return 0;
+  }
+
+  group = find_mount_access(ua, mount);
+  if (group == NULL)
+    return 0;
+
+  xa_debug(2, "DEBUG: authenticate_user_request() group %s user %s", group->name, user->name);
+  if (*congroup == NULL) *congroup = nstrdup(group->name);
+  if (strncmp(group->name, "monitor", 7) == 0) con->ghost = 1;
+  return 1;
+}
+
+/*
+ * Mounts missing in the mount file are granted by the mount "default"
+ * if there is one, and mounts not granted by the mount "all". A granted
+ * login is counted only with count_ok, a refused one always.
+ */
+static int check_user_request(connection_t *con, ntrip_request_t *req, contype_t contype, int count_ok) {
   ntripcaster_user_t *checkuser;
-  mounttree_t *mt;
+  auth_scheme_t *as;
+  access_index_t *ai;
   mount_t *mount;
-  group_t *group;
-  int ret = 0;
+  metrics_login_result_t result;
+  int ret = 0, epoch, password = -1;
 
   checkuser = con_get_user(con);
 
-  thread_mutex_lock(&authentication_mutex);
+  as = acquire_authentication_scheme(&epoch);
+  if (as) {
+    if (contype == source_e) {
+      mount = find_auth_mount(req, as->source_mounttree);
+      ai = as->source_access;
+    } else {
+      mount = find_auth_mount(req, as->client_mounttree);
+      ai = as->client_access;
+    }
 
-  if (contype == source_e)
-    mt = source_mounttree;
-  else
-    mt = client_mounttree;
+    xa_debug(2, "DEBUG: authenticate_user_request() mount %s user %s", mount ? mount->name : "<none>",
+    checkuser ? checkuser->name : "<none>");
 
-  mount = need_authentication_with_mutex(req, mt);
+    ret = check_mount_access(con, as, ai, checkuser, mount, &password, &con->group);
 
-  xa_debug(2, "DEBUG: authenticate_user_request() mount %s user %s", mount ? mount->name : "<none>",
-  checkuser ? checkuser->name : "<none>");
-  if (mount == NULL) {
-    group = find_group_from_tree(grouptree, "monitor");
-    if ((group != NULL) && (checkuser != NULL) && (is_member_of(checkuser->name, group))) {
-      if (con->group == NULL) con->group = nstrdup(group->name);
-      con->ghost = 1;
-    }
-    if(strcmp(req->path, "all"))
-      ret = 1;
-  } else if ((checkuser != NULL) && (user_authenticate(checkuser->name, checkuser->pass))) {
-    while ((group = avl_traverse(mount->grouptree, &trav))) {
-      if (is_member_of(checkuser->name, group)) {
-        xa_debug(2, "DEBUG: authenticate_user_request() group %s user %s", group ? group->name : "<none>",
-        checkuser ? checkuser->name : "<none>");
-        if (con->group == NULL) con->group = nstrdup(group->name);
-        if (strncmp(group->name, "monitor", 7) == 0) con->ghost = 1;
-        ret = 1;
-        break;
-      }
+    if(strncmp(req->path, "/admin", 6) && strncmp(req->path, "/oper", 5)
+    && strncmp(req->path, "/home", 5) && strncmp(req->path, "/robots.txt", 11)
+    && strncmp(req->path, "/metrics", 8)) {
+      if (!mount)
+        ret = check_mount_access(con, as, ai, checkuser, ai->default_mount, &password, &con->group);
+      if (!ret)
+        ret = ai->all_mount && check_mount_access(con, as, ai, checkuser, ai->all_mount, &password, &con->group);
     }
-  } else {
-    xa_debug(1, "DEBUG: User authentication failed!!!");
+
+    xa_debug(2, "DEBUG: authenticate_user_request() mount %s ret %d path %s",
+    mount ? mount->name : "<none>", ret, req->path);
   }
 
-  thread_mutex_unlock(&authentication_mutex);
+  release_authentication_scheme(epoch);
+
+  if (ret)
+    result = metrics_login_ok_e;
+  else if (checkuser == NULL)
+    result = metrics_login_no_credentials_e;
+  else if (password == 0)
+    result = loginlimit_user_blocked(con->host, checkuser->name) ? metrics_login_blocked_e : metrics_login_bad_password_e;
+  else
+    result = metrics_login_denied_e;
+  if (!ret || count_ok)
+    metrics_login(con, contype, req->path, result);
 
   if (checkuser != NULL) {
+    if (password == 0)
+      loginlimit_failure(con->host, checkuser->name);
     nfree(checkuser->name);
     nfree(checkuser->pass);
     nfree(checkuser);
   }
 
-  xa_debug(2, "DEBUG: authenticate_user_request() mount %s ret %d path %s",
-  mount ? mount->name : "<none>", ret, req->path);
-
-  if(strncmp(req->path, "/admin", 6) && strncmp(req->path, "/oper", 5)
-  && strncmp(req->path, "/home", 5) && strncmp(req->path, "/robots.txt", 11)
-  && strcmp(req->path, "all") && strcmp(req->path, "default")) {
-    ntrip_request_t r;
-    if(!mount) {
-      generate_request("default", &r);
-      memmove(r.path, r.path+1, strlen(r.path+1)+1);
-      ret = authenticate_user_request(con, &r, contype);
-    }
-    if(!ret) {
-      generate_request("all", &r);
-      memmove(r.path, r.path+1, strlen(r.path+1)+1);
-      ret = authenticate_user_request(con, &r, contype);
-    }
+  return ret;
+}
+
+int authenticate_user_request(connection_t *con, ntrip_request_t *req, contype_t contype) {
+  return check_user_request(con, req, contype, 1);
+}
+
+/*
+ * For requests checked again where the decision is final, the admin pages
+ * and the metrics: a granted login is counted by the second check.
+ */
+int authenticate_user_request_precheck(connection_t *con, ntrip_request_t *req, contype_t contype) {
+  return check_user_request(con, req, contype, 0);
+}
+
+/*
+ * Checks the password of the user of con once, for a client which is
+ * checked against several mounts later, see authorize_user_mount().
+ * Counts as a failed login if the password is wrong.
+ */
+int authenticate_user_password(connection_t *con) {
+  ntripcaster_user_t *checkuser;
+  auth_scheme_t *as;
+  int ok = 0, epoch;
+
+  checkuser = con_get_user(con);
+  if (checkuser == NULL)
+    return 0;
+
+  if (!loginlimit_user_blocked(con->host, checkuser->name)) {
+    as = acquire_authentication_scheme(&epoch);
+    ok = as && user_authenticate(as, checkuser->name, checkuser->pass);
+    release_authentication_scheme(epoch);
+
+    if (!ok)
+      loginlimit_failure(con->host, checkuser->name);
+  }
+
+  nfree(checkuser->name);
+  nfree(checkuser->pass);
+  nfree(checkuser);
+
+  return ok;
+}
+
+/*
+ * Same as authenticate_user_request() for a client mount, but for a
+ * client which already logged in: password is the result of
+ * authenticate_user_password(), and no login is counted. The granting
+ * group goes to *group instead of con->group, the caller decides.
+ */
+int authorize_user_mount(connection_t *con, const char *path, int password, char **group) {
+  ntripcaster_user_t *checkuser;
+  ntrip_request_t req;
+  auth_scheme_t *as;
+  access_index_t *ai;
+  mount_t *mount;
+  int ret = 0, epoch;
+
+  zero_request(&req);
+  strncpy(req.path, path, BUFSIZE - 1);
+  req.path[BUFSIZE - 1] = '\0';
+
+  checkuser = con_get_user(con);
+
+  as = acquire_authentication_scheme(&epoch);
+  if (as) {
+    mount = find_auth_mount(&req, as->client_mounttree);
+    ai = as->client_access;
+
+    ret = check_mount_access(con, as, ai, checkuser, mount, &password, group);
+    if (!mount)
+      ret = check_mount_access(con, as, ai, checkuser, ai->default_mount, &password, group);
+    if (!ret)
+      ret = ai->all_mount && check_mount_access(con, as, ai, checkuser, ai->all_mount, &password, group);
+  }
+  release_authentication_scheme(epoch);
+
+  if (checkuser != NULL) {
+    nfree(checkuser->name);
+    nfree(checkuser->pass);
+    nfree(checkuser);
   }
 
   return ret;
@@ -280,12 +560,14 @@ int authenticate_user_request(connection_t *con, ntrip_request_t *req, contype_t
 
 int authenticate_user_request_ntrip1upload(connection_t *con,
 ntrip_request_t *req, const char *pwd) {
-  mount_t *mount;
-  int ret = 0;
+  auth_scheme_t *as;
+  mount_t *mount = NULL;
+  int ret = 0, epoch;
 
-  thread_mutex_lock(&authentication_mutex);
+  as = acquire_authentication_scheme(&epoch);
 
-  mount = need_authentication_with_mutex(req, source_mounttree);
+  if (as)
+    mount = find_auth_mount(req, as->source_mounttree);
 
   xa_debug(2, "DEBUG: authenticate_user_request_ntrip1upload() mount %s",
   mount ? mount->name : "<none>");
@@ -296,7 +578,7 @@ ntrip_request_t *req, const char *pwd) {
       avl_traverser utrav = {0};
       ntripcaster_user_t *user;
       while (!ret && (user = avl_traverse(group->usertree, &utrav))) {
-        if(user_authenticate(user->name, pwd)) {
+        if(user_authenticate(as, user->name, pwd)) {
           xa_debug(2, "DEBUG: authenticate_user_request() group %s user %s",
           group->name, user->name);
           if (con->group == NULL) con->group = nstrdup(group->name);
@@ -307,23 +589,33 @@ ntrip_request_t *req, const char *pwd) {
     }
   }
 
-  thread_mutex_unlock(&authentication_mutex);
-
   xa_debug(2, "DEBUG: authenticate_user_request_ntrip1upload() mount %s ret "
   "%d path %s", mount ? mount->name : "<none>", ret, req->path);
 
+  release_authentication_scheme(epoch);
+
+  metrics_login(con, source_e, req->path, ret ? metrics_login_ok_e : metrics_login_bad_password_e);
+  if (!ret)
+    loginlimit_failure(con->host, NULL);
+
   return ret;
 }
 
-mount_t *need_authentication(ntrip_request_t * req, mounttree_t *mt) {
-  mount_t *mount;
-  thread_mutex_lock(&authentication_mutex);
-  mount = need_authentication_with_mutex(req, mt);
-  thread_mutex_unlock(&authentication_mutex);
-  return mount;
+/* 1 if the mount of req has an entry in the client or source mount file */
+int need_authentication(ntrip_request_t * req, contype_t contype) {
+  auth_scheme_t *as;
+  int epoch, ret = 0;
+
+  as = acquire_authentication_scheme(&epoch);
+  if (as)
+    ret = find_auth_mount(req, contype == source_e ? as->source_mounttree : as->client_mounttree) != NULL;
+  release_authentication_scheme(epoch);
+
+  return ret;
 }
 
-mount_t *need_authentication_with_mutex(ntrip_request_t * req, mounttree_t *mt) {
+/* mt must belong to an acquired scheme */
+mount_t *find_auth_mount(ntrip_request_t * req, mounttree_t *mt) {
   mount_t *mount;
   mount_t search;
 
@@ -345,6 +637,8 @@ check_ip_restrictions(connection_t *con) {
   group_t *group;
   ntripcaster_user_t *conuser;
   avl_traverser grouptrav = {0};
+  auth_scheme_t *as;
+  int epoch;
 
   if(max_ip <= 0)
   {
@@ -353,9 +647,9 @@ check_ip_restrictions(connection_t *con) {
 
   if((conuser = con_get_user(con)))
   {
-    thread_mutex_lock(&authentication_mutex);
-    while (info.max_ip_connections >= 0 &&
-    (group = avl_traverse (grouptree, &grouptrav))) {
+    as = acquire_authentication_scheme(&epoch);
+    while (as && info.max_ip_connections >= 0 &&
+    (group = avl_traverse (as->grouptree, &grouptrav))) {
       if (group->max_num_con == -1)
       {
         avl_traverser usertrav = {0};
@@ -375,7 +669,7 @@ check_ip_restrictions(connection_t *con) {
         }
       }
     }
-    thread_mutex_unlock(&authentication_mutex);
+    release_authentication_scheme(epoch);
 
     xa_debug(1, "DEBUG: IP connections user %s max %d%s", conuser->name,
     max_ip, max_ip < 0 ? " accepted" : "");
@@ -426,13 +720,15 @@ int
 add_group_connection(connection_t *con) {
   int ret = 1;
   group_t *congroup;
+  auth_scheme_t *as;
+  int epoch;
 
   xa_debug(2, "DEBUG: add_group_connection() id %d group %s",
   con->id, !con->group ? "<none>" : con->group);
   if (con->group != NULL) {
     int maxgroup = -1;
-    thread_mutex_lock(&authentication_mutex);
-    congroup = find_group_from_tree(grouptree, con->group);
+    as = acquire_authentication_scheme(&epoch);
+    congroup = as ? find_group_from_tree(as->grouptree, con->group) : NULL;
     if (congroup != NULL) {
       maxgroup = congroup->max_num_con;
       xa_debug(2, "DEBUG: add_group_connection() check group %s, max connections %d",
@@ -441,7 +737,7 @@ add_group_connection(connection_t *con) {
       xa_debug(2, "DEBUG: add_group_connection() id %d did not find group %s",
       con->id, con->group);
     }
-    thread_mutex_unlock(&authentication_mutex);
+    release_authentication_scheme(epoch);
 
     if(maxgroup >= 0) {
       connection_t *clicon;
@@ -456,13 +752,13 @@ add_group_connection(connection_t *con) {
 
       if (numgroup >= maxgroup) {
         xa_debug(2, "DEBUG: add_group_connection() id %d no remaining connections for group %s (%d of %d used)",
-        con->id, congroup->name, numgroup, maxgroup);
+        con->id, con->group, numgroup, maxgroup);
         ret = 0;
       } else{
         con->groupactive = 1;
         ++numgroup;
         xa_debug(2, "DEBUG: add_group_connection() id %d remaining connections for group %s is %d (%d of %d used)",
-        con->id, congroup->name, maxgroup-numgroup, numgroup, maxgroup);
+        con->id, con->group, maxgroup-numgroup, numgroup, maxgroup);
       }
       thread_mutex_unlock (&info.client_mutex);
     }
@@ -474,8 +770,16 @@ add_group_connection(connection_t *con) {
 int
 is_client_banned (connection_t *con)
 {
-  int result = 0;
-  result = ban_check(con_host(con));
+  auth_scheme_t *as;
+  int result = 0, epoch;
+
+  as = acquire_authentication_scheme(&epoch);
+  if (as)
+    result = ban_check(as->bantree, con_host(con));
+  release_authentication_scheme(epoch);
+
+  if (!result)
+    result = loginlimit_host_blocked(con->host);
   return result;
 }
 
@@ -486,5 +790,12 @@ remove_group_connection(connection_t *con) {
 
 int 
 get_banned_clients (){
-  return get_ban_count();
+  auth_scheme_t *as;
+  int banned = 0, epoch;
+
+  as = acquire_authentication_scheme(&epoch);
+  if (as)
+    banned = as->banned;
+  release_authentication_scheme(epoch);
+  return banned;
 }
\ No newline at end of file
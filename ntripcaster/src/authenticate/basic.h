@@ -61,18 +61,86 @@ typedef struct groupSt {
 
 typedef struct mountSt {
   char *name;
+  int id; /* position in the mount tree, set by create_access_index() */
   grouptree_t *grouptree;
 } mount_t;
 
+/* A mount a user may access, and the group granting it */
+typedef struct mountAccessSt {
+  int mount;
+  group_t *group;
+} mount_access_t;
+
+/* Everything one user may access in one mount file */
+typedef struct userAccessSt {
+  int monitor; /* member of group monitor */
+  int count;
+  mount_access_t *mounts; /* sorted by mount id */
+} user_access_t;
+
+/*
+ * The mount file resolved per user, built together with the mount tree.
+ * Answers the group walk of a login with one lookup.
+ */
+typedef struct accessIndexSt {
+  hash_table_t *users; /* user_access_t by user name */
+  mount_t *default_mount;
+  mount_t *all_mount;
+  group_t *monitor;
+} access_index_t;
+
+/* The parts of a scheme, each loaded from one file */
+#define AUTH_PART_USERS 0
+#define AUTH_PART_BANS 1
+#define AUTH_PART_GROUPS 2
+#define AUTH_PART_CLIENT_MOUNTS 3
+#define AUTH_PART_SOURCE_MOUNTS 4
+#define AUTH_PARTS 5
+#define AUTH_PART_ALL ((1 << AUTH_PARTS) - 1)
+
+/* Identifies the version of a loaded file */
+typedef struct authFileSt {
+  time_t mtime;
+  long mtime_nsec; /* 0 where the system has no st_mtim */
+  off_t size;
+  ino_t ino;
+} auth_file_t;
+
+/*
+ * All authentication data of one rehash. It is never changed after it
+ * has been published, a rehash builds a new one and swaps it in.
+ * Readers use acquire_authentication_scheme() and
+ * release_authentication_scheme() around every access.
+ */
+typedef struct authSchemeSt {
+  usertree_t *usertree;
+  hash_table_t *userhash; /* same users, for lookups by name */
+  grouptree_t *grouptree;
+  mounttree_t *client_mounttree;
+  mounttree_t *source_mounttree;
+  access_index_t *client_access;
+  access_index_t *source_access;
+  bantree_t *bantree;
+  int banned;
+  auth_file_t files[AUTH_PARTS];
+  int owned; /* parts to free with this scheme, the others moved on to the next one */
+} auth_scheme_t;
+
 void init_authentication_scheme(void);
 void parse_authentication_scheme(void);
-void destroy_authentication_scheme(void);
 void cleanup_authentication_scheme(void);
+auth_scheme_t *acquire_authentication_scheme(int *epoch);
+void release_authentication_scheme(int epoch);
+auth_scheme_t *get_authentication_scheme(void);
+ntripcaster_user_t *find_user(auth_scheme_t *as, const char *name);
 int authenticate_user_request(connection_t *con, ntrip_request_t *req, contype_t contype);
+int authenticate_user_request_precheck(connection_t *con, ntrip_request_t *req, contype_t contype);
 int authenticate_user_request_ntrip1upload(connection_t *con, ntrip_request_t *req, const char *pwd);
+int authenticate_user_password(connection_t *con);
+int authorize_user_mount(connection_t *con, const char *path, int password, char **group);
 void rehash_authentication_scheme(void);
-mount_t *need_authentication(ntrip_request_t * req, mounttree_t *mt);
-mount_t *need_authentication_with_mutex(ntrip_request_t * req, mounttree_t *mt);
+int need_authentication(ntrip_request_t * req, contype_t contype);
+mount_t *find_auth_mount(ntrip_request_t * req, mounttree_t *mt);
 int check_ip_restrictions(connection_t *con);
 int add_group_connection(connection_t *con);
 void remove_group_connection(connection_t *con);
@@ -99,34 +99,30 @@
 extern server_info_t info;
 
 extern mutex_t authentication_mutex;
-//extern mounttree_t *client_mounttree;
-//extern mounttree_t *source_mounttree;
-extern usertree_t *usertree;
-extern grouptree_t *grouptree;
 
-void parse_group_authentication_file()
+void parse_group_authentication_file(auth_scheme_t *as)
 {
-  int fd;
+  loaded_file_t *lf;
   char groupfile[BUFSIZE];
   group_t *group;
   char line[FILE_LINE_BUFSIZE];
 
 
 
-  if ((get_ntripcaster_file(info.groupfile, conf_file_e, R_OK, groupfile) == NULL ) || ((fd = open_for_reading(groupfile)) == -1)) {
+  if ((get_ntripcaster_file(info.groupfile, conf_file_e, R_OK, groupfile) == NULL ) || ((lf = load_file(groupfile)) == NULL)) {
 //    if (groupfile)
 //      nfree(groupfile);
     xa_debug(1, "WARNING: Could not open group authentication file");
     return;
   }
-  while (fd_read_line(fd, line, FILE_LINE_BUFSIZE)) {
+  while (loaded_file_read_line(lf, line, FILE_LINE_BUFSIZE)) {
     if (line[0] == '#' || line[0] == ' ')
       continue;
 
-    group = create_group_from_line(line);
+    group = create_group_from_line(line, as);
 
     if (group)
-      add_authentication_group(group);
+      add_authentication_group(as->grouptree, group);
   }
 
   if (line[FILE_LINE_BUFSIZE-1] == '\0') {
@@ -135,11 +131,11 @@ void parse_group_authentication_file()
 
 //  if (groupfile)
 //    nfree(groupfile);
-  fd_close(fd);
+  unload_file(lf);
 }
 
 group_t *
- create_group_from_line(char *line)
+ create_group_from_line(char *line, auth_scheme_t *as)
 {
   group_t *group;
   ntripcaster_user_t *user;
@@ -191,7 +187,7 @@ group_t *
 
       go_on = 0;
     }
-    user = find_user_from_tree(usertree, clean_string(cuser));
+    user = find_user(as, clean_string(cuser));
 
     if (!user) {
       write_log(LOG_DEFAULT, "WARNING: Unrecognized user [%s] specified for group [%s]",
@@ -229,7 +225,7 @@ static void freegroup(group_t *group, void *param)
   nfree(group);
 }
 
-void add_authentication_group(group_t * group)
+void add_authentication_group(grouptree_t *grouptree, group_t * group)
 {
   group_t *out;
 
@@ -289,13 +285,14 @@ void con_display_groups(com_request_t * req)
   {0};
   group_t *group;
   ntripcaster_user_t *user;
-  int listed = 0;
+  auth_scheme_t *as;
+  int listed = 0, epoch;
 
   admin_write_line(req, ADMIN_SHOW_AUTH_GROUP_START, "Listing groups in the authentication module:");
 
-  thread_mutex_lock(&authentication_mutex);
+  as = acquire_authentication_scheme(&epoch);
 
-  while ((group = avl_traverse(grouptree, &trav))) {
+  while (as && (group = avl_traverse(as->grouptree, &trav))) {
     zero_trav(&usertrav);
 
     admin_write(req, ADMIN_SHOW_AUTH_GROUP_ENTRY, "%s: ", group->name ? group->name : "(null)");
@@ -307,7 +304,7 @@ void con_display_groups(com_request_t * req)
     listed++;
   }
 
-  thread_mutex_unlock(&authentication_mutex);
+  release_authentication_scheme(epoch);
 
   admin_write_line(req, ADMIN_SHOW_AUTH_GROUP_END, "End of group listing (%d listed)", listed);
 }
@@ -366,7 +363,7 @@ int runtime_add_group(const char *name)
 
   thread_mutex_lock(&authentication_mutex);
 
-  if (find_group_from_tree(grouptree, name)) {
+  if (get_authentication_scheme() && find_group_from_tree(get_authentication_scheme()->grouptree, name)) {
     thread_mutex_unlock(&authentication_mutex);
     return ICE_ERROR_DUPLICATE;
   }
@@ -408,7 +405,7 @@ int runtime_add_group_with_user(const char *name, char *users)
 
   thread_mutex_lock(&authentication_mutex);
 
-  if (find_group_from_tree(grouptree, name)) {
+  if (get_authentication_scheme() && find_group_from_tree(get_authentication_scheme()->grouptree, name)) {
     thread_mutex_unlock(&authentication_mutex);
     return ICE_ERROR_DUPLICATE;
   }
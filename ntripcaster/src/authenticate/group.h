@@ -38,11 +38,11 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-void parse_group_authentication_file();
-group_t *create_group_from_line(char *line);
+void parse_group_authentication_file(auth_scheme_t *as);
+group_t *create_group_from_line(char *line, auth_scheme_t *as);
 group_t *create_group();
 grouptree_t *create_group_tree();
-void add_authentication_group(group_t * group);
+void add_authentication_group(grouptree_t *grouptree, group_t * group);
 void free_group_tree(grouptree_t * gt);
 int is_member_of(char *user, group_t * group);
 group_t *find_group_from_tree(grouptree_t * gt, const char *name);
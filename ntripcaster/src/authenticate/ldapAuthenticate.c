@@ -1,6 +1,11 @@
 /*
  *  NtripCaster with LDAP authentication
  *
+ *  Binds are done on a small pool of persistent LDAP connections, and
+ *  the results are kept in a cache of salted password hashes. Positive
+ *  results are refreshed in the background when used shortly before
+ *  they expire, and are still used for ldap_grace_period seconds when
+ *  the LDAP server can not be reached.
  */
 
 #ifdef HAVE_CONFIG_H
@@ -16,6 +21,14 @@
 #include <ldap.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/time.h>
+#include <errno.h>
+#include <stdint.h>
+#ifdef HAVE_TLS
+#include <openssl/evp.h>
+#include <openssl/hmac.h>
+#include <openssl/rand.h>
+#endif
 #include "ldapAuthenticate.h"
 
 #include <stdlib.h>
@@ -25,14 +38,497 @@
 #include "ntripcastertypes.h"
 #include "ntripcaster.h"
 #include "log.h"
+#include "logtime.h"
 #include "memory.h"
 #include "ntripcaster_string.h"
+#include "utility.h"
 
 extern server_info_t info;
 
+/* Result of a single bind */
+#define LDAP_BIND_OK 1
+#define LDAP_BIND_REJECTED 0
+#define LDAP_BIND_UNAVAILABLE -1
+
+typedef struct ldap_pool_slot_St {
+  LDAP *ld;
+  int busy;
+  char *server;
+  int port;
+} ldap_pool_slot_t;
+
+/*
+ * Credentials are only kept as salted digests, keyed with a random key
+ * taken at startup: HMAC-SHA256 with OpenSSL, SipHash-2-4 otherwise.
+ * Without a key or salt from a good random source nothing is cached.
+ */
+#define LDAP_SALT_SIZE 16
+#define LDAP_KEY_SIZE 32
+#ifdef HAVE_TLS
+#define LDAP_DIGEST_SIZE 32
+#else
+#define LDAP_DIGEST_SIZE 16
+#endif
+
+typedef struct ldap_cache_entry_St {
+  char *name;
+  unsigned char salt[LDAP_SALT_SIZE];
+  unsigned char digest[LDAP_DIGEST_SIZE];
+  time_t fetched;   /* time of the last answer from the server */
+  time_t used;      /* time of the last login using this entry */
+  int refreshing;
+} ldap_cache_entry_t;
+
+/* A rebind for the refresh thread, the password is wiped after use */
+typedef struct ldap_refresh_job_St {
+  char *name;
+  char *pass;
+} ldap_refresh_job_t;
+
+static ldap_pool_slot_t ldap_pool[LDAP_POOL_MAX];
+static int ldap_pool_used = 0;
+static pthread_mutex_t ldap_pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t ldap_pool_cond = PTHREAD_COND_INITIALIZER;
+
+/* Accepted and rejected credentials are cached apart, one entry per user
+ * each, so a wrong password never replaces a good one */
+static avl_tree *ldap_cache = NULL;
+static avl_tree *ldap_negative_cache = NULL;
+static list_t *ldap_refresh_jobs = NULL;
+static mutex_t ldap_cache_mutex;
+static ldap_stats_t ldap_stats;
+
+static unsigned char ldap_cache_key[LDAP_KEY_SIZE];
+static int ldap_cache_keyed = 0;
+
+/* len bytes from the random source, 0 if there is none */
+static int ldap_random(unsigned char *buf, size_t len)
+{
+#ifdef HAVE_TLS
+  return RAND_bytes(buf, (int)len) == 1;
+#else
+  size_t got = 0;
+  FILE *f;
+
+  if ((f = fopen("/dev/urandom", "rb"))) {
+    got = fread(buf, 1, len, f);
+    fclose(f);
+  }
+  return got == len;
+#endif
+}
+
+#ifndef HAVE_TLS
+#define LDAP_ROTL(x, b) (((x) << (b)) | ((x) >> (64 - (b))))
+#define LDAP_SIPROUND(v0, v1, v2, v3) do { \
+  v0 += v1; v1 = LDAP_ROTL(v1, 13); v1 ^= v0; v0 = LDAP_ROTL(v0, 32); \
+  v2 += v3; v3 = LDAP_ROTL(v3, 16); v3 ^= v2; \
+  v0 += v3; v3 = LDAP_ROTL(v3, 21); v3 ^= v0; \
+  v2 += v1; v1 = LDAP_ROTL(v1, 17); v1 ^= v2; v2 = LDAP_ROTL(v2, 32); \
+} while (0)
+
+static uint64_t ldap_load64(const unsigned char *p)
+{
+  uint64_t v = 0;
+  int i;
+
+  for (i = 7; i >= 0; i--)
+    v = (v << 8) | p[i];
+  return v;
+}
+
+/* SipHash-2-4 of data with the 16 byte key */
+static uint64_t ldap_siphash(const unsigned char *key, const unsigned char *data, size_t len)
+{
+  uint64_t k0 = ldap_load64(key), k1 = ldap_load64(key + 8), m, b = (uint64_t)len << 56;
+  uint64_t v0 = k0 ^ 0x736f6d6570736575ULL, v1 = k1 ^ 0x646f72616e646f6dULL;
+  uint64_t v2 = k0 ^ 0x6c7967656e657261ULL, v3 = k1 ^ 0x7465646279746573ULL;
+  size_t i;
+
+  for (i = 0; i + 8 <= len; i += 8) {
+    m = ldap_load64(data + i);
+    v3 ^= m;
+    LDAP_SIPROUND(v0, v1, v2, v3);
+    LDAP_SIPROUND(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+  for (; i < len; i++)
+    b |= (uint64_t)data[i] << (8 * (i & 7));
+
+  v3 ^= b;
+  LDAP_SIPROUND(v0, v1, v2, v3);
+  LDAP_SIPROUND(v0, v1, v2, v3);
+  v0 ^= b;
+  v2 ^= 0xff;
+  for (i = 0; i < 4; i++)
+    LDAP_SIPROUND(v0, v1, v2, v3);
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+#endif
+
+/* Keyed digest of salt, user name and password */
+static void ldap_digest(const unsigned char *salt, const char *username,
+const char *password, unsigned char *digest)
+{
+  size_t ulen = strlen(username) + 1, plen = strlen(password);
+  size_t len = LDAP_SALT_SIZE + ulen + plen;
+  unsigned char *data = (unsigned char *)nmalloc(len);
+#ifndef HAVE_TLS
+  uint64_t h;
+  int i, j;
+#endif
+
+  memcpy(data, salt, LDAP_SALT_SIZE);
+  memcpy(data + LDAP_SALT_SIZE, username, ulen);
+  memcpy(data + LDAP_SALT_SIZE + ulen, password, plen);
+
+#ifdef HAVE_TLS
+  HMAC(EVP_sha256(), ldap_cache_key, LDAP_KEY_SIZE, data, len, digest, NULL);
+#else
+  /* two halves of the key, 64 bits each */
+  for (i = 0; i < 2; i++) {
+    h = ldap_siphash(ldap_cache_key + 16 * i, data, len);
+    for (j = 0; j < 8; j++)
+      digest[8 * i + j] = (unsigned char)(h >> (8 * j));
+  }
+#endif
+
+  memset(data, 0, len);
+  nfree(data);
+}
+
+/* Does password match the credential of entry? Compares in constant time. */
+static int ldap_entry_matches(const ldap_cache_entry_t *entry, const char *password)
+{
+  unsigned char digest[LDAP_DIGEST_SIZE];
+  unsigned char diff = 0;
+  int i;
+
+  ldap_digest(entry->salt, entry->name, password, digest);
+  for (i = 0; i < LDAP_DIGEST_SIZE; i++)
+    diff |= digest[i] ^ entry->digest[i];
+  return diff == 0;
+}
+
+/* Give entry a new salt and the digest of password, 0 without a salt */
+static int ldap_entry_set(ldap_cache_entry_t *entry, const char *password)
+{
+  if (!ldap_random(entry->salt, LDAP_SALT_SIZE))
+    return 0;
+  ldap_digest(entry->salt, entry->name, password, entry->digest);
+  return 1;
+}
+
+/* Overwrite a plain password before it is freed */
+static void ldap_wipe(char *s)
+{
+  volatile char *p = s;
+
+  while (*p)
+    *p++ = 0;
+}
+
+static int compare_ldap_cache_entries(const void *first, const void *second, void *param)
+{
+  const ldap_cache_entry_t *e1 = (const ldap_cache_entry_t *)first;
+  const ldap_cache_entry_t *e2 = (const ldap_cache_entry_t *)second;
+
+  return ntripcaster_strcmp(e1->name, e2->name);
+}
+
+static void free_ldap_cache_entry(ldap_cache_entry_t *entry, void *param)
+{
+  nfree(entry->name);
+  nfree(entry);
+}
+
+static void free_ldap_refresh_job(ldap_refresh_job_t *job)
+{
+  ldap_wipe(job->pass);
+  nfree(job->pass);
+  nfree(job->name);
+  nfree(job);
+}
+
+void ldap_authentication_init(void)
+{
+  memset(ldap_pool, 0, sizeof(ldap_pool));
+  memset(&ldap_stats, 0, sizeof(ldap_stats));
+  thread_create_mutex(&ldap_cache_mutex);
+  ldap_cache = avl_create(compare_ldap_cache_entries, &info);
+  ldap_negative_cache = avl_create(compare_ldap_cache_entries, &info);
+  ldap_refresh_jobs = list_create();
+
+  ldap_cache_keyed = ldap_random(ldap_cache_key, LDAP_KEY_SIZE);
+  if (!ldap_cache_keyed)
+    write_log(LOG_DEFAULT, "WARNING: No random source, LDAP logins are not cached");
+}
+
+void ldap_authentication_cleanup(void)
+{
+  int i;
+
+  pthread_mutex_lock(&ldap_pool_mutex);
+  for (i = 0; i < LDAP_POOL_MAX; i++) {
+    if (ldap_pool[i].ld && !ldap_pool[i].busy) {
+      ldap_unbind_s(ldap_pool[i].ld);
+      ldap_pool[i].ld = NULL;
+    }
+    if (ldap_pool[i].server && !ldap_pool[i].busy) {
+      nfree(ldap_pool[i].server);
+    }
+  }
+  pthread_mutex_unlock(&ldap_pool_mutex);
+
+  thread_mutex_lock(&ldap_cache_mutex);
+  if (ldap_cache)
+    avl_destroy(ldap_cache, (avl_node_func)free_ldap_cache_entry);
+  if (ldap_negative_cache)
+    avl_destroy(ldap_negative_cache, (avl_node_func)free_ldap_cache_entry);
+  if (ldap_refresh_jobs)
+    list_dispose_with_data(ldap_refresh_jobs, free_ldap_refresh_job);
+  ldap_cache = NULL;
+  ldap_negative_cache = NULL;
+  ldap_refresh_jobs = NULL;
+  thread_mutex_unlock(&ldap_cache_mutex);
+}
+
+static int ldap_pool_size(void)
+{
+  if (info.ldap_pool_size < 1)
+    return 1;
+  if (info.ldap_pool_size > LDAP_POOL_MAX)
+    return LDAP_POOL_MAX;
+  return info.ldap_pool_size;
+}
+
+/*
+ * Take a free slot from the pool, waiting at most ldap_timeout seconds.
+ * Returns the slot index, or -1 if every connection stayed busy.
+ */
+static int ldap_pool_acquire(void)
+{
+  struct timeval now;
+  struct timespec until;
+  int i, slot = -1;
+
+  gettimeofday(&now, NULL);
+  until.tv_sec = now.tv_sec + (info.ldap_timeout > 0 ? info.ldap_timeout : 1);
+  until.tv_nsec = now.tv_usec * 1000;
+
+  pthread_mutex_lock(&ldap_pool_mutex);
+  while (slot < 0) {
+    for (i = 0; i < ldap_pool_size(); i++) {
+      if (!ldap_pool[i].busy) {
+        slot = i;
+        break;
+      }
+    }
+    if (slot >= 0)
+      break;
+    if (pthread_cond_timedwait(&ldap_pool_cond, &ldap_pool_mutex, &until) == ETIMEDOUT)
+      break;
+  }
+  if (slot >= 0) {
+    ldap_pool[slot].busy = 1;
+    ldap_pool_used++;
+  }
+  pthread_mutex_unlock(&ldap_pool_mutex);
+
+  return slot;
+}
+
+static void ldap_pool_release(int slot)
+{
+  pthread_mutex_lock(&ldap_pool_mutex);
+  ldap_pool[slot].busy = 0;
+  ldap_pool_used--;
+  pthread_cond_signal(&ldap_pool_cond);
+  pthread_mutex_unlock(&ldap_pool_mutex);
+}
+
+/* Drop the connection of a slot, it is reopened on the next use */
+static void ldap_pool_close(ldap_pool_slot_t *ps)
+{
+  if (ps->ld)
+    ldap_unbind_s(ps->ld);
+  ps->ld = NULL;
+  if (ps->server) {
+    nfree(ps->server);
+  }
+}
+
+/* Slot must be acquired. Returns 1 if the slot has a usable handle. */
+static int ldap_pool_open(ldap_pool_slot_t *ps)
+{
+  struct timeval tv;
+  int result;
+  int desired_version = LDAP_VERSION3;
+
+  /* server changed by a rehash? */
+  if (ps->ld && (ps->port != info.ldap_port || !ps->server
+  || ntripcaster_strcmp(ps->server, info.ldap_server) != 0))
+    ldap_pool_close(ps);
+
+  if (ps->ld)
+    return 1;
+
+  xa_debug(1, "LDAP session started (%s %d).", info.ldap_server, info.ldap_port);
+  /* initialize LDAP session */
+  if(!(ps->ld = ldap_init(info.ldap_server, info.ldap_port)))
+  {
+    xa_debug(1, "LDAP session initialization failed");
+    return 0;
+  }
+
+  /* set the LDAP version to be 3 */
+  if((result = ldap_set_option(ps->ld, LDAP_OPT_PROTOCOL_VERSION,
+  &desired_version)) != LDAP_OPT_SUCCESS)
+  {
+    xa_debug(1, "LDAP set option error: %s", ldap_err2string(result));
+    ldap_pool_close(ps);
+    return 0;
+  }
+
+  /* never let a dead server hold a login longer than ldap_timeout */
+  tv.tv_sec = info.ldap_timeout > 0 ? info.ldap_timeout : 1;
+  tv.tv_usec = 0;
+  ldap_set_option(ps->ld, LDAP_OPT_NETWORK_TIMEOUT, &tv);
+  ldap_set_option(ps->ld, LDAP_OPT_TIMEOUT, &tv);
+
+  ps->server = nstrdup(info.ldap_server);
+  ps->port = info.ldap_port;
+  xa_debug(1, "New LDAP session initialized");
+
+  return 1;
+}
+
+/*
+ * Do the simple bind for username and password on a pooled connection.
+ * Return LDAP_BIND_OK, LDAP_BIND_REJECTED or LDAP_BIND_UNAVAILABLE.
+ */
+static int ldap_bind_user(const char *username, const char *password)
+{
+  char loginDN[255];
+  int result, slot, tries;
+  ldap_pool_slot_t *ps;
+
+  /* an empty password is an anonymous bind on most servers */
+  if (!password[0])
+    return LDAP_BIND_REJECTED;
+
+  if ((slot = ldap_pool_acquire()) < 0) {
+    xa_debug(1, "LDAP all %d connections busy", ldap_pool_size());
+    return LDAP_BIND_UNAVAILABLE;
+  }
+  ps = &ldap_pool[slot];
+
+  snprintf(loginDN, sizeof(loginDN),"%s=%s,%s", info.ldap_uid_prefix,
+  username, info.ldap_people_context);
+  loginDN[sizeof(loginDN)-1] = 0; // ensure zero termination
+
+  /* a pooled connection may have been closed by the server meanwhile,
+     so retry once on a fresh one */
+  for (tries = 0; tries < 2; tries++) {
+    if (!ldap_pool_open(ps)) {
+      result = LDAP_SERVER_DOWN;
+      break;
+    }
+    xa_debug(1, "LDAP login started (%s).", loginDN);
+    result = ldap_bind_s(ps->ld, loginDN, password, LDAP_AUTH_SIMPLE);
+    if (result != LDAP_SERVER_DOWN && result != LDAP_CONNECT_ERROR)
+      break;
+    ldap_pool_close(ps);
+  }
+
+  ldap_pool_release(slot);
+
+  switch (result) {
+    case LDAP_SUCCESS:
+      xa_debug(1, "Authentication successful!");
+      return LDAP_BIND_OK;
+    case LDAP_INVALID_CREDENTIALS:
+    case LDAP_INVALID_DN_SYNTAX:
+    case LDAP_NO_SUCH_OBJECT:
+    case LDAP_INAPPROPRIATE_AUTH:
+    case LDAP_UNWILLING_TO_PERFORM:
+      xa_debug(1, "LDAP bind authentication unsuccessful: %s",
+      ldap_err2string(result));
+      return LDAP_BIND_REJECTED;
+    default:
+      write_log(LOG_DEFAULT, "WARNING: LDAP server %s:%d not usable: %s",
+      info.ldap_server, info.ldap_port, ldap_err2string(result));
+      return LDAP_BIND_UNAVAILABLE;
+  }
+}
+
+/* Remove the entry of username from tree. Cache mutex must be held. */
+static void ldap_cache_drop(avl_tree *tree, const char *username)
+{
+  ldap_cache_entry_t search, *entry;
+
+  search.name = (char *)username;
+  if ((entry = avl_find(tree, &search))) {
+    avl_delete(tree, entry);
+    free_ldap_cache_entry(entry, NULL);
+  }
+}
+
+/*
+ * Find the entry of username in tree, or create it. The entry gets the
+ * digest of password and the time of the answer. Without a key or salt
+ * the entry is dropped instead. Cache mutex must be held.
+ */
+static void ldap_cache_store(avl_tree *tree, const char *username,
+const char *password)
+{
+  ldap_cache_entry_t search, *entry;
+
+  search.name = (char *)username;
+  entry = avl_find(tree, &search);
+
+  if (!entry) {
+    if (!ldap_cache_keyed)
+      return;
+    entry = (ldap_cache_entry_t *)nmalloc(sizeof(ldap_cache_entry_t));
+    entry->name = nstrdup(username);
+    entry->used = get_time();
+    entry->refreshing = 0;
+    avl_insert(tree, entry);
+  }
+  if (!ldap_entry_set(entry, password)) {
+    ldap_cache_drop(tree, username);
+    return;
+  }
+  entry->fetched = get_time();
+}
+
+/*
+ * Record the answer of the server for username and password. A rejected
+ * password only ends the accepted entry if it is the same credential,
+ * i.e. it was revoked. Cache mutex must be held.
+ */
+static void ldap_cache_answer(const char *username, const char *password, int result)
+{
+  ldap_cache_entry_t search, *entry;
+
+  search.name = (char *)username;
+  if (result == LDAP_BIND_OK) {
+    ldap_cache_store(ldap_cache, username, password);
+    entry = avl_find(ldap_negative_cache, &search);
+    if (entry && ldap_entry_matches(entry, password))
+      ldap_cache_drop(ldap_negative_cache, username);
+  } else {
+    ldap_cache_store(ldap_negative_cache, username, password);
+    entry = avl_find(ldap_cache, &search);
+    if (entry && ldap_entry_matches(entry, password))
+      ldap_cache_drop(ldap_cache, username);
+  }
+}
+
 /*
  * Given username and password, authenticate against the LDAP server a simple
- * bind.
+ * bind, or use the cached result of an earlier bind.
  *
  * Return 1 for successful authentication.
  * Return 0 for unsuccessful authentication.
@@ -40,54 +536,161 @@ extern server_info_t info;
  */
 int ldap_authenticate(const char *username, const char *password)
 {
-    char loginDN[255];
-    LDAP *ld;
-    int result;
-    int ldapPort = 389;
-    int auth_method = LDAP_AUTH_SIMPLE;
-    int desired_version = LDAP_VERSION3;
-
-    xa_debug(1, "LDAP session started (%s %d).", info.ldap_server,
-    ldapPort);
-    /* initialize LDAP session */
-    if(!(ld = ldap_init(info.ldap_server, ldapPort)))
-    {
-        xa_debug(1, "LDAP session initialization failed");
-        return 0;
-    }
-    xa_debug(1, "New LDAP session initialized");
-
-    /* set the LDAP version to be 3 */
-    if((result = ldap_set_option(ld, LDAP_OPT_PROTOCOL_VERSION,
-    &desired_version)) != LDAP_OPT_SUCCESS)
-    {
-       ldap_unbind_s(ld);
-       xa_debug(1, "LDAP set option error: %s", ldap_err2string(result));
-       return 0;
+  ldap_cache_entry_t search, *entry;
+  int res, stale = 0;
+  time_t now = get_time();
+
+  if (!ldap_cache) {
+    xa_debug(1, "WARNING: ldap_authenticate() called before initialization");
+    return 0;
+  }
+
+  search.name = (char *)username;
+
+  thread_mutex_lock(&ldap_cache_mutex);
+  entry = avl_find(ldap_cache, &search);
+  if (entry && ldap_entry_matches(entry, password)) {
+    time_t age = now - entry->fetched;
+
+    entry->used = now;
+    if (age < info.ldap_cache_ttl) {
+      /* rebind in the background during the last quarter of the lifetime,
+         only the refresh job holds the password until then */
+      if (!entry->refreshing && age >= info.ldap_cache_ttl - info.ldap_cache_ttl/4) {
+        ldap_refresh_job_t *job = (ldap_refresh_job_t *)nmalloc(sizeof(ldap_refresh_job_t));
+
+        job->name = nstrdup(username);
+        job->pass = nstrdup(password);
+        list_add(ldap_refresh_jobs, job);
+        entry->refreshing = 1;
+      }
+      ldap_stats.hits++;
+      thread_mutex_unlock(&ldap_cache_mutex);
+      return 1;
     }
+    /* remember in case the server does not answer */
+    stale = age < info.ldap_cache_ttl + info.ldap_grace_period;
+  } else if ((entry = avl_find(ldap_negative_cache, &search))
+  && now - entry->fetched < info.ldap_negative_cache_ttl
+  && ldap_entry_matches(entry, password)) {
+    ldap_stats.hits++;
+    thread_mutex_unlock(&ldap_cache_mutex);
+    return 0;
+  }
+  ldap_stats.misses++;
+  thread_mutex_unlock(&ldap_cache_mutex);
 
-    /* try to authenticate */
-    snprintf(loginDN, sizeof(loginDN),"%s=%s,%s", info.ldap_uid_prefix,
-    username, info.ldap_people_context);
-    loginDN[sizeof(loginDN)-1] = 0; // ensure zero termination
-    xa_debug(1, "LDAP login started (%s).", loginDN);
-    if((result = ldap_bind_s(ld, loginDN, password, auth_method))
-    != LDAP_SUCCESS)
-    {
-       ldap_unbind_s(ld);
-       xa_debug(1, "LDAP bin authentication unsuccessful: %s",
-       ldap_err2string(result));
-       return 0;
+  res = ldap_bind_user(username, password);
+
+  thread_mutex_lock(&ldap_cache_mutex);
+  if (res != LDAP_BIND_UNAVAILABLE) {
+    ldap_cache_answer(username, password, res);
+  } else {
+    ldap_stats.failures++;
+    if (stale) {
+      ldap_stats.grace++;
+      write_log(LOG_DEFAULT, "WARNING: LDAP unavailable, using cached login of %s", username);
+      res = 1;
+    } else {
+      res = 0;
     }
-    xa_debug(1, "Authentication successful!");
+  }
+  thread_mutex_unlock(&ldap_cache_mutex);
+
+  return res;
+}
+
+/*
+ * Rebind the entries queued by logins before they expire, and drop
+ * entries which can't be used anymore. Called from the LDAP refresh thread.
+ */
+static void ldap_cache_refresh(void)
+{
+  avl_traverser trav = {0};
+  ldap_cache_entry_t *entry, search;
+  list_t *todo, *drop = list_create();
+  list_element_t *l;
+  time_t now = get_time();
+  int res;
+
+  thread_mutex_lock(&ldap_cache_mutex);
+  while ((entry = avl_traverse(ldap_cache, &trav))) {
+    if (now - entry->fetched >= info.ldap_cache_ttl + info.ldap_grace_period
+    || now - entry->used >= info.ldap_cache_ttl + info.ldap_grace_period)
+      list_add(drop, entry);
+  }
+  for (l = drop->head; l; l = l->next)
+    avl_delete(ldap_cache, l->data);
+  list_dispose_with_data(drop, free_ldap_cache_entry);
+
+  drop = list_create();
+  memset(&trav, 0, sizeof(trav));
+  while ((entry = avl_traverse(ldap_negative_cache, &trav))) {
+    if (now - entry->fetched >= info.ldap_negative_cache_ttl)
+      list_add(drop, entry);
+  }
+  for (l = drop->head; l; l = l->next)
+    avl_delete(ldap_negative_cache, l->data);
+  list_dispose_with_data(drop, free_ldap_cache_entry);
+
+  todo = ldap_refresh_jobs;
+  ldap_refresh_jobs = list_create();
+  thread_mutex_unlock(&ldap_cache_mutex);
 
-    /* clean up */
-    if((result = ldap_unbind_s(ld)) != 0)
-    {
-      xa_debug(1, "LDAP unbind error: %s", ldap_err2string(result));
+  for (l = todo->head; l; l = l->next) {
+    ldap_refresh_job_t *job = l->data;
+
+    res = ldap_bind_user(job->name, job->pass);
+
+    search.name = job->name;
+    thread_mutex_lock(&ldap_cache_mutex);
+    if ((entry = avl_find(ldap_cache, &search)) && ldap_entry_matches(entry, job->pass)) {
+      entry->refreshing = 0;
+      /* keep the old answer for the grace period if the server is away */
+      if (res == LDAP_BIND_UNAVAILABLE) {
+        ldap_stats.failures++;
+      } else {
+        ldap_cache_answer(job->name, job->pass, res);
+        ldap_stats.refreshes++;
+      }
+    } else if (entry) {
+      entry->refreshing = 0;
     }
-    xa_debug(1, "LDAP session ended.");
+    thread_mutex_unlock(&ldap_cache_mutex);
+  }
+  list_dispose_with_data(todo, free_ldap_refresh_job);
+}
 
-    return 1;
+void *startup_ldap_refresh_thread(void *arg)
+{
+  mythread_t *mt;
+
+  thread_init();
+
+  mt = thread_get_mythread();
+
+  while (thread_alive (mt)) {
+    if (info.ldap_server && info.ldap_server[0] && ldap_cache)
+      ldap_cache_refresh();
+
+    if (mt->ping == 1) mt->ping = 0;
+
+    my_sleep(1000000);
+  }
+
+  thread_exit(0);
+  return NULL;
+}
+
+void ldap_get_stats(ldap_stats_t *stats)
+{
+  thread_mutex_lock(&ldap_cache_mutex);
+  *stats = ldap_stats;
+  stats->entries = ldap_cache ? avl_count(ldap_cache) + avl_count(ldap_negative_cache) : 0;
+  thread_mutex_unlock(&ldap_cache_mutex);
+
+  pthread_mutex_lock(&ldap_pool_mutex);
+  stats->pool_busy = ldap_pool_used;
+  pthread_mutex_unlock(&ldap_pool_mutex);
 }
 #endif
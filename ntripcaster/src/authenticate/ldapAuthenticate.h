@@ -8,6 +8,22 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* Upper limit for ldap_pool_size */
+#define LDAP_POOL_MAX 32
+
+typedef struct ldap_stats_St {
+  unsigned long int hits;      /* answered from the cache */
+  unsigned long int misses;    /* needed a bind */
+  unsigned long int refreshes; /* background rebinds */
+  unsigned long int failures;  /* server not reachable or pool exhausted */
+  unsigned long int grace;     /* logins accepted from the grace period */
+  int entries;
+  int pool_busy;
+} ldap_stats_t;
+
+void ldap_authentication_init(void);
+void ldap_authentication_cleanup(void);
+
 /*
  * Given username and password, authenticate agains the LDAP server a simple bind.
  *
@@ -16,4 +32,7 @@
  *
  */
 int ldap_authenticate(const char *username, const char *password);
+
+void *startup_ldap_refresh_thread(void *arg);
+void ldap_get_stats(ldap_stats_t *stats);
 #endif /* HAVE_LIBLDAP */
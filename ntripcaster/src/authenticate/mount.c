@@ -93,26 +93,22 @@
 extern server_info_t info;
 
 extern mutex_t authentication_mutex;
-extern mounttree_t *client_mounttree;
-extern mounttree_t *source_mounttree;
-extern usertree_t *usertree;
-extern grouptree_t *grouptree;
 
-void parse_mount_authentication_file(char *mountfilename, mounttree_t *mt) {
-  int fd;
+void parse_mount_authentication_file(char *mountfilename, mounttree_t *mt, grouptree_t *grouptree) {
+  loaded_file_t *lf;
   mount_t *mount;
   char line[FILE_LINE_BUFSIZE];
   char file[BUFSIZE];
 
-  if ((get_ntripcaster_file(mountfilename, conf_file_e, R_OK, file) == NULL) || ((fd = open_for_reading(file)) == -1)) {
+  if ((get_ntripcaster_file(mountfilename, conf_file_e, R_OK, file) == NULL) || ((lf = load_file(file)) == NULL)) {
     xa_debug(1, "WARNING: Could not open mount authentication file");
     return;
   }
 
-  while (fd_read_line(fd, line, FILE_LINE_BUFSIZE)) {
+  while (loaded_file_read_line(lf, line, FILE_LINE_BUFSIZE)) {
     if (line[0] == '#' || line[0] == ' ') continue;
 
-    mount = create_mount_from_line(line);
+    mount = create_mount_from_line(line, grouptree);
 
     if (mount) add_authentication_mount(mount, mt);
   }
@@ -121,11 +117,11 @@ void parse_mount_authentication_file(char *mountfilename, mounttree_t *mt) {
     write_log(LOG_DEFAULT, "READ ERROR: too long line in mount authentication file (exceeding FILE_LINE_BUFSIZE)");
   }
 
-  fd_close(fd);
+  unload_file(lf);
 }
 
 mount_t *
- create_mount_from_line(char *line)
+ create_mount_from_line(char *line, grouptree_t *grouptree)
 {
   mount_t *mount;
   group_t *group;
@@ -169,6 +165,7 @@ mount_t *
 
   mount->grouptree = create_group_tree();
   mount->name = NULL;
+  mount->id = 0;
   return mount;
 }
 
@@ -211,6 +208,119 @@ void free_mount_tree(mounttree_t * mt)
     avl_destroy(mt, (avl_node_func)freemount);
 }
 
+static user_access_t *get_user_access(hash_table_t *users, const char *name) {
+  user_access_t *ua = hash_find(users, name);
+
+  if (!ua) {
+    ua = (user_access_t *) nmalloc(sizeof(user_access_t));
+    memset(ua, 0, sizeof(user_access_t));
+    hash_replace(users, name, ua);
+  }
+  return ua;
+}
+
+static void free_user_access(user_access_t *ua) {
+  if (ua->mounts) {
+    nfree(ua->mounts);
+  }
+  nfree(ua);
+}
+
+/*
+ * Resolve mt into the mounts every user may access. A mount is granted
+ * by the first of its groups listing the user, as the login always did.
+ * Numbers the mounts of mt. Keys point into the user tree of the scheme,
+ * users is their number.
+ */
+access_index_t *create_access_index(mounttree_t *mt, grouptree_t *grouptree, unsigned int users) {
+  avl_traverser trav = {0}, gtrav, utrav;
+  access_index_t *ai;
+  user_access_t *ua;
+  mount_t *mount;
+  group_t *group;
+  ntripcaster_user_t *user;
+  mount_t search;
+  int id = 0;
+
+  ai = (access_index_t *) nmalloc(sizeof(access_index_t));
+  ai->users = hash_create(users);
+
+  search.name = "default";
+  ai->default_mount = mt ? avl_find(mt, &search) : NULL;
+  search.name = "all";
+  ai->all_mount = mt ? avl_find(mt, &search) : NULL;
+  ai->monitor = grouptree ? find_group_from_tree(grouptree, "monitor") : NULL;
+
+  if (ai->monitor) {
+    zero_trav(&utrav);
+    while ((user = avl_traverse(ai->monitor->usertree, &utrav)))
+      get_user_access(ai->users, user->name)->monitor = 1;
+  }
+
+  /* count first, a user listed in several groups of a mount is counted twice */
+  while (mt && (mount = avl_traverse(mt, &trav))) {
+    mount->id = id++;
+    zero_trav(&gtrav);
+    while ((group = avl_traverse(mount->grouptree, &gtrav))) {
+      zero_trav(&utrav);
+      while ((user = avl_traverse(group->usertree, &utrav)))
+        get_user_access(ai->users, user->name)->count++;
+    }
+  }
+
+  zero_trav(&trav);
+  while (mt && (mount = avl_traverse(mt, &trav))) {
+    zero_trav(&gtrav);
+    while ((group = avl_traverse(mount->grouptree, &gtrav))) {
+      zero_trav(&utrav);
+      while ((user = avl_traverse(group->usertree, &utrav))) {
+        ua = hash_find(ai->users, user->name);
+        if (!ua->mounts) {
+          ua->mounts = (mount_access_t *) nmalloc(ua->count * sizeof(mount_access_t));
+          ua->count = 0;
+        }
+        /* mounts come in id order, an earlier group has the mount already */
+        if (ua->count > 0 && ua->mounts[ua->count-1].mount == mount->id)
+          continue;
+        ua->mounts[ua->count].mount = mount->id;
+        ua->mounts[ua->count].group = group;
+        ua->count++;
+      }
+    }
+  }
+
+  return ai;
+}
+
+void free_access_index(access_index_t *ai) {
+  if (!ai)
+    return;
+
+  hash_destroy(ai->users, (ntripcaster_function *)free_user_access);
+  nfree(ai);
+}
+
+/* The group granting ua access to mount, NULL if none does */
+group_t *find_mount_access(user_access_t *ua, mount_t *mount) {
+  int low = 0, high, mid;
+
+  if (!ua || !mount)
+    return NULL;
+
+  high = ua->count - 1;
+  while (low <= high) {
+    mid = (low + high) / 2;
+    if (ua->mounts[mid].mount == mount->id)
+      return ua->mounts[mid].group;
+    if (ua->mounts[mid].mount < mount->id)
+      low = mid + 1;
+    else
+      high = mid - 1;
+  }
+
+  return NULL;
+}
+
 grouptree_t *get_grouptree_for_mount(const char *mountname, mounttree_t *mt) {
   mount_t *mount;
   avl_traverser trav = {0};
@@ -225,18 +335,25 @@ grouptree_t *get_grouptree_for_mount(const char *mountname, mounttree_t *mt) {
   return NULL;
 }
 
-void con_display_mounts(com_request_t * req, mounttree_t *mt) {
+static mounttree_t *get_mounttree(auth_scheme_t *as, contype_t contype) {
+  if (!as) return NULL;
+
+  return contype == source_e ? as->source_mounttree : as->client_mounttree;
+}
+
+void con_display_mounts(com_request_t * req, contype_t contype) {
   avl_traverser trav = {0};
   avl_traverser grouptrav = {0};
   mount_t *mount;
   group_t *group;
-  int listed = 0;
+  mounttree_t *mt;
+  int listed = 0, epoch;
 
   admin_write_line(req, ADMIN_SHOW_AUTH_MOUNT_START, "Listing mount points in the authentication module:");
 
-  thread_mutex_lock(&authentication_mutex);
+  mt = get_mounttree(acquire_authentication_scheme(&epoch), contype);
 
-  while ((mount = avl_traverse(mt, &trav))) {
+  while (mt && (mount = avl_traverse(mt, &trav))) {
     zero_trav(&grouptrav);
 
     admin_write(req, ADMIN_SHOW_AUTH_MOUNT_ENTRY, "%s: ", mount->name ? mount->name : "(null)");
@@ -247,7 +364,7 @@ void con_display_mounts(com_request_t * req, mounttree_t *mt) {
     listed++;
   }
 
-  thread_mutex_unlock(&authentication_mutex);
+  release_authentication_scheme(epoch);
 
   admin_write_line(req, ADMIN_SHOW_AUTH_MOUNT_END, "End of mount point listing (%d listed)", listed);
 }
@@ -289,7 +406,7 @@ html_display_mounts(com_request_t *req, mounttree_t *mt) {
 
 }*/
 
-int runtime_add_mount_with_group(const char *name, char *groups, char *mountfilename, mounttree_t *mt) {
+int runtime_add_mount_with_group(const char *name, char *groups, char *mountfilename, contype_t contype) {
   char line[BUFSIZE];
   char file[BUFSIZE];
   char *s;
@@ -307,7 +424,7 @@ int runtime_add_mount_with_group(const char *name, char *groups, char *mountfile
 
   thread_mutex_lock(&authentication_mutex);
 
-  if (get_grouptree_for_mount(name, mt)) {
+  if (get_grouptree_for_mount(name, get_mounttree(get_authentication_scheme(), contype))) {
     thread_mutex_unlock(&authentication_mutex);
     return ICE_ERROR_DUPLICATE;
   }
@@ -324,7 +441,7 @@ int runtime_add_mount_with_group(const char *name, char *groups, char *mountfile
   return 1;
 }
 
-int runtime_add_mount(const char *name, char *mountfilename, mounttree_t *mt) {
+int runtime_add_mount(const char *name, char *mountfilename, contype_t contype) {
   char line[BUFSIZE];
   char file[BUFSIZE];
   int fd;
@@ -338,7 +455,7 @@ int runtime_add_mount(const char *name, char *mountfilename, mounttree_t *mt) {
 
   thread_mutex_lock(&authentication_mutex);
 
-  if (get_grouptree_for_mount(name, mt)) {
+  if (get_grouptree_for_mount(name, get_mounttree(get_authentication_scheme(), contype))) {
     thread_mutex_unlock(&authentication_mutex);
     return ICE_ERROR_DUPLICATE;
   }
@@ -355,10 +472,3 @@ int runtime_add_mount(const char *name, char *mountfilename, mounttree_t *mt) {
   return 1;
 }
 
-mounttree_t *get_client_mounttree() {
-  return client_mounttree;
-}
-
-mounttree_t *get_source_mounttree() {
-  return source_mounttree;
-}
@@ -38,16 +38,17 @@
  * Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
  */
 
-void parse_mount_authentication_file(char *mountfilename, mounttree_t *mt);
-mount_t *create_mount_from_line(char *line);
+void parse_mount_authentication_file(char *mountfilename, mounttree_t *mt, grouptree_t *grouptree);
+mount_t *create_mount_from_line(char *line, grouptree_t *grouptree);
 mount_t *create_mount();
 mounttree_t *create_mount_tree();
 void add_authentication_mount(mount_t * mount, mounttree_t *mt);
 void free_mount_tree(mounttree_t * mt);
+access_index_t *create_access_index(mounttree_t *mt, grouptree_t *grouptree, unsigned int users);
+void free_access_index(access_index_t *ai);
+group_t *find_mount_access(user_access_t *ua, mount_t *mount);
 grouptree_t *get_grouptree_for_mount(const char *mountname, mounttree_t *mt);
-void con_display_mounts(com_request_t * req, mounttree_t *mt);
+void con_display_mounts(com_request_t * req, contype_t contype);
 void html_display_mounts(com_request_t *req, mounttree_t *mt);
-int runtime_add_mount(const char *name, char *mountfile, mounttree_t *mt);
-int runtime_add_mount_with_group(const char *name, char *groups, char *mountfile, mounttree_t *mt);
-mounttree_t *get_client_mounttree();
-mounttree_t *get_source_mounttree();
+int runtime_add_mount(const char *name, char *mountfile, contype_t contype);
+int runtime_add_mount_with_group(const char *name, char *groups, char *mountfile, contype_t contype);
@@ -97,34 +97,28 @@
 extern server_info_t info;
 
 extern mutex_t authentication_mutex;
-//extern mounttree_t *client_mounttree;
-//extern mounttree_t *source_mounttree;
-extern usertree_t *usertree;
-extern grouptree_t *grouptree;
-extern bantree_t *bantree;
-int *banned_clients;
-
-void parse_user_authentication_file()
+
+void parse_user_authentication_file(auth_scheme_t *as)
 {
-  int fd;
+  loaded_file_t *lf;
   ntripcaster_user_t *user;
   char line[BUFSIZE];
   char userfile[BUFSIZE];
 
-  if ((get_ntripcaster_file(info.userfile, conf_file_e, R_OK, userfile) == NULL) || ((fd = open_for_reading(userfile)) == -1)) {
+  if ((get_ntripcaster_file(info.userfile, conf_file_e, R_OK, userfile) == NULL) || ((lf = load_file(userfile)) == NULL)) {
 //    if (userfile)
 //      nfree(userfile);
     xa_debug(1, "WARNING: Could not open user authentication file");
     return;
   }
-  while (fd_read_line(fd, line, BUFSIZE)) {
+  while (loaded_file_read_line(lf, line, BUFSIZE)) {
     if (line[0] == '#' || line[0] == ' ')
       continue;
 
     user = create_user_from_line(line);
 
     if (user)
-      add_authentication_user(user);
+      add_authentication_user(as, user);
   }
 
   if (line[BUFSIZE-1] == '\0') {
@@ -133,36 +127,35 @@ void parse_user_authentication_file()
 
 //  if (userfile)
 //    nfree(userfile);
-  fd_close(fd);
+  unload_file(lf);
 }
 
-void parse_ban_file()
+void parse_ban_file(auth_scheme_t *as)
 {
-  int fd;
+  loaded_file_t *lf;
   ntripcaster_ban_t *ban;
   char line[BUFSIZE];
   char banlistfile[BUFSIZE];
-  banned_clients = 0;
 
-  if ((get_ntripcaster_file(info.banlistfile, conf_file_e, R_OK, banlistfile) == NULL) || ((fd = open_for_reading(banlistfile)) == -1)) {
+  if ((get_ntripcaster_file(info.banlistfile, conf_file_e, R_OK, banlistfile) == NULL) || ((lf = load_file(banlistfile)) == NULL)) {
     xa_debug(1, "WARNING: Could not open banlistfile file");
     return;
   }
-  while (fd_read_line(fd, line, BUFSIZE)) {
+  while (loaded_file_read_line(lf, line, BUFSIZE)) {
     if (line[0] == '#' || line[0] == ' ')
       continue;
 
     ban = create_ban_from_line(line);
 
     if (ban)
-      add_ban_user(ban);
+      add_ban_user(as, ban);
   }
 
   if (line[BUFSIZE-1] == '\0') {
     write_log(LOG_DEFAULT, "READ ERROR: too long line in banlistfile file (exceeding BUFSIZE)");
   }
 
-  fd_close(fd);
+  unload_file(lf);
 }
 
 int runtime_add_user(char *name, char *password)
@@ -181,7 +174,7 @@ int runtime_add_user(char *name, char *password)
 
   thread_mutex_lock(&authentication_mutex);
 
-  if (find_user_from_tree(usertree, name)) {
+  if (find_user(get_authentication_scheme(), name)) {
     thread_mutex_unlock(&authentication_mutex);
     return ICE_ERROR_DUPLICATE;
   }
@@ -291,15 +284,16 @@ static void freeban(ntripcaster_ban_t *ban, void *param)
   nfree(ban);
 }
 
-void add_authentication_user(ntripcaster_user_t * user)
+void add_authentication_user(auth_scheme_t *as, ntripcaster_user_t * user)
 {
   ntripcaster_user_t *out;
 
-  if (!user || !usertree || !user->name || !user->pass) {
+  if (!user || !as || !user->name || !user->pass) {
     xa_debug(1, "ERROR: add_authentication_user() called with NULL pointers");
     return;
   }
-  out = avl_replace(usertree, user);
+  out = avl_replace(as->usertree, user);
+  hash_replace(as->userhash, user->name, user);
 
   if (out) {
     write_log(LOG_DEFAULT, "WARNING: Duplicate user record %s, using latter", user->name);
@@ -308,21 +302,21 @@ void add_authentication_user(ntripcaster_user_t * user)
   xa_debug(1, "DEBUG: add_authentication_user(): Inserted user [%s:%s]", user->name, user->pass);
 }
 
-void add_ban_user(ntripcaster_ban_t * ban)
+void add_ban_user(auth_scheme_t *as, ntripcaster_ban_t * ban)
 {
   ntripcaster_ban_t *out;
 
-  if (!ban || !bantree || !ban->ip) {
+  if (!ban || !as || !ban->ip) {
     xa_debug(1, "ERROR: add_ban_user() called with NULL pointers");
     return;
   }
-  out = avl_replace(bantree, ban);
+  out = avl_replace(as->bantree, ban);
 
   if (out) {
     write_log(LOG_DEFAULT, "WARNING: Duplicate ban list record %s, using latter", ban->ip);
     freeban(out, 0);
   } else {
-    banned_clients = banned_clients + 1;
+    as->banned++;
     xa_debug(1, "DEBUG: add_ban_user(): Inserted banned user [%s]", ban->ip);
   }
 }
@@ -339,12 +333,9 @@ void free_ban_tree(bantree_t * bt)
     avl_destroy(bt, (avl_node_func)freeban);
 }
 
-int user_authenticate(char *cuser, const char *password)
+int user_authenticate(auth_scheme_t *as, char *cuser, const char *password)
 {
   const ntripcaster_user_t *user;
-  ntripcaster_user_t search;
-
-  search.name = cuser;
 
   if (!cuser || !password) {
     xa_debug(1, "WARNING: user_authenticate() called with NULL pointer");
@@ -357,14 +348,14 @@ int user_authenticate(char *cuser, const char *password)
   }
 #endif /* HAVE_LIBLDAP */
 
-  user = avl_find(usertree, &search);
+  user = find_user(as, cuser);
 
   if (!user) return 0;
 
   return password_match(user->pass, password);
 }
 
-int ban_check(char *ip)
+int ban_check(bantree_t *bantree, const char *ip)
 {
   const ntripcaster_ban_t *banned;
   ntripcaster_ban_t search;
@@ -375,7 +366,7 @@ int ban_check(char *ip)
     return 0;
   }
 
-  search.ip = ip;
+  search.ip = (char *)ip;
   banned = avl_find(bantree, &search);
 
   if (banned){
@@ -461,27 +452,23 @@ void con_display_users(com_request_t * req)
   ntripcaster_user_t *user;
   avl_traverser trav =
   {0};
-  int listed = 0;
+  auth_scheme_t *as;
+  int listed = 0, epoch;
 
   admin_write_line(req, ADMIN_SHOW_AUTH_USER_START, "Listing users in the authentication module");
 
-  thread_mutex_lock(&authentication_mutex);
+  as = acquire_authentication_scheme(&epoch);
 
-  while ((user = avl_traverse(usertree, &trav))) {
+  while (as && (user = avl_traverse(as->usertree, &trav))) {
     admin_write_line(req, ADMIN_SHOW_AUTH_USER_ENTRY, "User: [%s]", user->name);
     listed++;
   }
 
-  thread_mutex_unlock(&authentication_mutex);
+  release_authentication_scheme(epoch);
 
   admin_write_line(req, ADMIN_SHOW_AUTH_USER_END, "End of user listing (%d listed)", listed);
 }
 
-int
-get_ban_count (){
-  return banned_clients;
-}
-
 /*void
 html_display_users(com_request_t *req) {
 
@@ -95,16 +95,19 @@
 #include "rtsp.h"
 #include "restrict.h"
 #include "memory.h"
+#include "metrics.h"
 #include "admin.h"
 #include "http.h"
 #include "vars.h"
 #include "commands.h"
 #include "authenticate/basic.h"
 #include "sourcetable.h"
+#include "probes.h"
 #include "match.h"
 #include "pool.h"
 #include "logtime.h"
 #include "sourcetable.h"
+#include "nearest.h"
 
 #include <signal.h>
 
@@ -134,6 +137,7 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
   const char *var;
   char time[50];
   alias_t *wasalias = 0;
+  int authorized;
 
   xa_debug(3, "http client login...");
 
@@ -175,7 +179,7 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
       return;
     }
     send_sourcetable(con);
-    kick_not_connected (con, "Transfer sourcetable");
+    finish_request (con, "Transfer sourcetable");
     return;
   }
 
@@ -186,7 +190,7 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
       return;
     }
     send_sourcetable_filtered(con, (req->path)+1+7,0);
-    kick_not_connected (con, "Transfer filtered sourcetable");
+    finish_request (con, "Transfer filtered sourcetable");
     return;
   }
 
@@ -197,7 +201,18 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
       return;
     }
     send_sourcetable_filtered(con, (req->path)+1+6,1);
-    kick_not_connected (con, "Transfer matched sourcetable");
+    finish_request (con, "Transfer matched sourcetable");
+    return;
+  }
+
+  if (!strncasecmp((req->path)+1,"?nearest",8)) {
+    if(con->udpbuffers && !info.sourcetable_via_udp)
+    {
+      kick_not_connected (con, "No sourcetable via UDP allowed");
+      return;
+    }
+    send_sourcetable_nearest(con, (req->path)+1+8);
+    finish_request (con, "Transfer nearest sourcetable");
     return;
   }
 
@@ -209,7 +224,14 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
     return;
   }
 
-  if (!authenticate_user_request (con, req, client_e)) {
+  /* the admin pages and the metrics check again and count the login there */
+  if ((strncasecmp(get_user_agent(con), "ntrip", 5) != 0)
+      && ((ntripcaster_strncmp(req->path, "/metrics", 8) == 0) || (ntripcaster_strncmp(req->path, "/admin", 6) == 0)))
+    authorized = authenticate_user_request_precheck (con, req, client_e);
+  else
+    authorized = authenticate_user_request (con, req, client_e);
+
+  if (!authorized) {
     ntrip_write_message(con, HTTP_GET_NOT_AUTHORIZED, get_formatted_time(HEADER_TIME, time), req->path, "text/html");
     kick_not_connected (con, "Not authorized");
     return;
@@ -224,6 +246,12 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
       http_get_robots (con);
       kick_not_connected (con, "Robots.txt delivered");
       return;
+    } else if ((ntripcaster_strncmp(req->path, "/metrics", 8) == 0)) {
+      if (http_metrics (con, req))
+        finish_request (con, "Metrics delivered");
+      else
+        kick_not_connected (con, "Metrics not authorized");
+      return;
     } else if ((ntripcaster_strncmp(req->path, "/admin", 6) == 0)) {
 /*      char secfile[BUFSIZE];
 
@@ -236,7 +264,7 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
 
       if (http_admin_command (con, req)) {
         xa_debug (2, "DEBUG: kicking %s, executed admin command", con_host (con));
-        kick_not_connected (con, "Executed admin command");
+        finish_request (con, "Executed admin command");
       } else
         kick_not_connected (con, "Failed to execute admin command");
       return;
@@ -247,6 +275,11 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
     return;
   }
 
+  if (nearest_is_mount(req->path)) {
+    nearest_client_login(con, req);
+    return;
+  }
+
   xa_debug (1, "Looking for mount [%s:%d%s]", req->host, req->port, req->path);
 
   thread_mutex_lock (&info.double_mutex);
@@ -324,6 +357,7 @@ void http_client_login(connection_t *con, ntrip_request_t *req) {
 
     greet_client(con, source->food.source);
     util_increase_total_clients();
+    CASTER_PROBE3(client_login, source->food.source->audiocast.mount, con->id, con_host (con));
     pool_add (con);
 
     if(strcmp(source->food.source->audiocast.mount, req->path)) {
@@ -352,6 +386,7 @@ void put_client(connection_t *con) {
   cli->write_bytes = 0;
   cli->virgin = -1;
   cli->source = NULL;
+  cli->nearest = NULL;
   cli->cid = -1;
   cli->offset = 0;
   cli->alive = CLIENT_ALIVE;
@@ -383,8 +418,11 @@ del_client(connection_t *client, source_t *source)
   if (source && client->food.client && (client->food.client->virgin != 1) && (client->food.client->virgin != -1)) {
     if (source->num_clients == 0)
       write_log (LOG_DEFAULT, "WARNING: Bloody going below limits on client count!");
-    else
+    else {
       source->num_clients--;
+      if (source->metrics)
+        metrics_add (source->metrics->clients, -1);
+    }
   }
   util_decrease_total_clients ();
 }
@@ -445,11 +483,15 @@ describe_client (const com_request_t *req, const connection_t *clicon)
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_START, "Misc client info:");
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_MISC, "Transfer error balance: %d", client_errors (client));
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_MISC, "Transfer chunk id and offset: %d : %d", client->cid, client->offset);
+  admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_MISC, "Current lag: %ld ms", client_lag_ms (client));
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_MISC, "Bytes transfered: %lu", client->write_bytes);
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_MISC, "Virgin: %s", client->virgin ? "yes" : "no");
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_MISC, "Client type: %s", client_type (clicon));
   if (client->source && client->source->audiocast.mount)
     admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_MISC, "Mountpoint: %s", client->source->audiocast.mount);
+  if (client->nearest)
+    admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_MISC, "Nearest station: %.1f km from %.6f/%.6f, moved %lu times",
+          client->nearest->km, client->nearest->lat, client->nearest->lon, client->nearest->moves);
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_CLIENT_END, "End of client info");
 }
 
@@ -468,3 +510,17 @@ client_errors (const client_t *client)
 
   return (CHUNKLEN - (client->cid - client->source->cid)) % CHUNKLEN;
 }
+
+/* How long the chunk a client waits for has been read, 0 if it has all */
+long int
+client_lag_ms (const client_t *client)
+{
+  const source_t *source = client->source;
+  long long int ingest;
+
+  if (!source || client->cid == source->cid)
+    return 0;
+
+  ingest = source->chunk[client->cid].ingest_ns;
+  return ingest ? (long int)((get_time_ns () - ingest) / 1000000) : 0;
+}
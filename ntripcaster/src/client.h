@@ -50,6 +50,7 @@ int client_wants_icy_headers(connection_t *con);
 int client_wants_metadata (connection_t *con);
 int client_wants_udp_info (connection_t *con);
 int client_errors (const client_t *client);
+long int client_lag_ms (const client_t *client);
 void greet_client(connection_t *con, source_t *source);
 void describe_client (const com_request_t *req, const connection_t *clicon);
 const char *client_type (const connection_t *clicon);
@@ -86,6 +86,7 @@
 #include "logtime.h"
 #include "source.h"
 #include "client.h"
+#include "latency.h"
 #include "avl_functions.h"
 #include "timer.h"
 #include "alias.h"
@@ -93,6 +94,14 @@
 #include "memory.h"
 #include "admin.h"
 #include "sourcetable.h"
+#include "loginlimit.h"
+#include "filtercache.h"
+#include "nearest.h"
+#include "template.h"
+#include "status.h"
+#include "metrics.h"
+#include "rtcm.h"
+#include "accesslog.h"
 #include "match.h"
 #include "connection.h"
 #include "item.h"
@@ -100,6 +109,9 @@
 #include "authenticate/user.h"
 #include "authenticate/group.h"
 #include "authenticate/mount.h"
+#ifdef HAVE_LIBLDAP
+#include "authenticate/ldapAuthenticate.h"
+#endif /* HAVE_LIBLDAP */
 #include "pool.h"
 #include "interpreter.h"
 #include "http.h"
@@ -176,7 +188,7 @@ comp_element commands[] =
   { "threads", com_threads,  "Show all program threads", 0, 0,
     "threads [kill <id>]\r\n\tDisplay all the currently running threads in the program, and where and when they were created [kill thread with id].\r\n"},
   { "locks",   com_locks,    "Show status of all locks", 0, 0,
-    "locks [unlock source]\r\n\tDisplay all mutexes, and their status [force unlocking of source_mutex].\r\n"},
+    "locks [unlock source|reset]\r\n\tDisplay all mutexes, their status and with lock_profiling their contention [force unlocking of source_mutex|clear the contention counters].\r\n"},
   { "status",  com_status,   "Turn status info on/off (for you)", 0, 1,
     "status [on|off|show]\r\n\tTurn on or off the periodic status information line.\r\n"},
   { "debug",   com_debug,     "Set debugging output level for this connection.", 0, 0,
@@ -314,6 +326,8 @@ set_element configfile_settings[] =
   { "http_admin", integer_e, "Whether to allow admins on the WWW interface. 1 is yes, 0 means no", NULL},
   { "relay_reconnect_max", integer_e, "How many times to try reconnecting a relay, -1 means forever", NULL},
   { "relay_reconnect_time", integer_e, "Seconds to wait between reconnects", NULL},
+  { "relay_host_connects", integer_e, "Concurrent relay connects to one upstream host, 0 means no limit", NULL},
+  { "relay_backoff_max", integer_e, "Maximum seconds to wait between reconnects after failed connects", NULL},
   { "sleep_ratio", real_e, "Ratio that affects source sleep time. Larger value means sleep more (normal values (0.0 - 1.0)", NULL },
   { "ntrip_info_url", string_e, "Where you find informations about the NTRIP protocol", NULL},
   { "name", string_e, "Name of the NTRIP server", NULL},
@@ -325,12 +339,36 @@ set_element configfile_settings[] =
   { "ldap_server", string_e, "LDAP server name for authentication", NULL},
   { "ldap_uid_prefix", string_e, "LDAP user ID prefix for authentication", NULL},
   { "ldap_people_context", string_e, "LDAP people context for authentication", NULL},
+  { "ldap_port", integer_e, "LDAP server port", NULL},
+  { "ldap_pool_size", integer_e, "Number of persistent LDAP connections", NULL},
+  { "ldap_timeout", integer_e, "Seconds to wait for the LDAP server or a free connection", NULL},
+  { "ldap_cache_ttl", integer_e, "Seconds a successful LDAP login is cached", NULL},
+  { "ldap_negative_cache_ttl", integer_e, "Seconds a failed LDAP login is cached", NULL},
+  { "ldap_grace_period", integer_e, "Seconds to accept expired cached logins when LDAP is unreachable", NULL},
 #endif /* HAVE_LIBLDAP */
 #ifdef USE_CRYPT
   { "encrypt_passwords", string_e, "Encrypt base parameter for password encryption", NULL },
 #endif /* USE_CRYPT */
   { "sourcetable_via_udp", integer_e, "Send Sourcetable via UDP (1) or default not (0)", NULL },
   { "hide_version", integer_e, "Hide version of caster (1) or default not (0)", NULL },
+  { "incremental_rehash", integer_e, "Reparse only changed authentication files on rehash (1) or all (0)", NULL },
+  { "login_failures_host", integer_e, "Failed logins until a host is blocked (0 = no limit)", NULL },
+  { "login_failures_user", integer_e, "Failed logins from one host until a user is blocked on it (0 = no limit)", NULL },
+  { "login_failures_name", integer_e, "Failed logins from all hosts until a user is blocked everywhere (0 = no limit)", NULL },
+  { "login_failure_interval", integer_e, "Seconds until one more failed login is allowed", NULL },
+  { "login_block_time", integer_e, "Seconds a host or user is blocked after too many failed logins", NULL },
+  { "access_log_format", integer_e, "Access log as CSV (0), binary segments (1) or both (2)", NULL },
+  { "access_segment_size", integer_e, "Size of a binary access log segment in KB", NULL },
+  { "thread_stall_budget", integer_e, "Milliseconds a thread's loop may make no progress before it is reported as stalled (0 = no check)", NULL },
+  { "lock_profiling", integer_e, "Count lock acquisitions, contention and wait/hold times (1) or not (0)", NULL },
+  { "filter_cache_size", integer_e, "Number of compiled sourcetable filters kept with their results (0 = no cache)", NULL },
+  { "nearest_mount", string_e, "Mountpoint routing clients to the nearest station by their GGA position (empty = off)", NULL },
+  { "nearest_interval", integer_e, "Seconds between checks whether a nearest_mount client has a closer station (0 = never move)", NULL },
+  { "keepalive_timeout", integer_e, "Seconds an HTTP/1.1 connection may idle between two requests", NULL },
+  { "keepalive_requests", integer_e, "Requests served on one HTTP/1.1 connection before it is closed (0 = no keep-alive)", NULL },
+  { "status_max_age", integer_e, "Seconds a snapshot of the connections is shared by status views (0 = one per view)", NULL },
+  { "stream_analysis", integer_e, "Update format-details, nav-system, bitrate and position of STR entries from the RTCM 3 streams (1) or not (0)", NULL },
+  { "stream_analysis_interval", integer_e, "Seconds a stream is measured before its STR entry is compared and updated", NULL },
   { (char *) NULL, 0, (char *) NULL, NULL }
 };
 
@@ -420,6 +458,8 @@ setup_config_file_settings()
   configfile_settings[x++].setting = &info.allow_http_admin;
   configfile_settings[x++].setting = &info.relay_reconnect_tries;
   configfile_settings[x++].setting = &info.relay_reconnect_time;
+  configfile_settings[x++].setting = &info.relay_host_connects;
+  configfile_settings[x++].setting = &info.relay_backoff_max;
   configfile_settings[x++].setting = &info.sleep_ratio;
   configfile_settings[x++].setting = &info.ntripinfourl;
   configfile_settings[x++].setting = &info.name;
@@ -431,12 +471,36 @@ setup_config_file_settings()
   configfile_settings[x++].setting = &info.ldap_server;
   configfile_settings[x++].setting = &info.ldap_uid_prefix;
   configfile_settings[x++].setting = &info.ldap_people_context;
+  configfile_settings[x++].setting = &info.ldap_port;
+  configfile_settings[x++].setting = &info.ldap_pool_size;
+  configfile_settings[x++].setting = &info.ldap_timeout;
+  configfile_settings[x++].setting = &info.ldap_cache_ttl;
+  configfile_settings[x++].setting = &info.ldap_negative_cache_ttl;
+  configfile_settings[x++].setting = &info.ldap_grace_period;
 #endif /* HAVE_LIBLDAP */
 #ifdef USE_CRYPT
   configfile_settings[x++].setting = &info.encrypt_passwords;
 #endif /* USE_CRYPT */
   configfile_settings[x++].setting = &info.sourcetable_via_udp;
   configfile_settings[x++].setting = &info.hide_version;
+  configfile_settings[x++].setting = &info.incremental_rehash;
+  configfile_settings[x++].setting = &info.login_failures_host;
+  configfile_settings[x++].setting = &info.login_failures_user;
+  configfile_settings[x++].setting = &info.login_failures_name;
+  configfile_settings[x++].setting = &info.login_failure_interval;
+  configfile_settings[x++].setting = &info.login_block_time;
+  configfile_settings[x++].setting = &info.access_log_format;
+  configfile_settings[x++].setting = &info.access_segment_size;
+  configfile_settings[x++].setting = &info.thread_stall_budget;
+  configfile_settings[x++].setting = &info.lock_profiling;
+  configfile_settings[x++].setting = &info.filter_cache_size;
+  configfile_settings[x++].setting = &info.nearest_mount;
+  configfile_settings[x++].setting = &info.nearest_interval;
+  configfile_settings[x++].setting = &info.keepalive_timeout;
+  configfile_settings[x++].setting = &info.keepalive_requests;
+  configfile_settings[x++].setting = &info.status_max_age;
+  configfile_settings[x++].setting = &info.stream_analysis;
+  configfile_settings[x++].setting = &info.stream_analysis_interval;
 }
 
 set_element *
@@ -771,10 +835,10 @@ int
 com_admins (com_request_t *req)
 {
   char *arg = com_arg (req);
-  connection_t *admcon;
-  avl_traverser trav = {0};
+  status_snapshot_t *snap;
+  status_admin_t *admin;
   char pattern[BUFSIZE], buf[BUFSIZE];
-  int listed = 0;
+  int i, listed = 0;
   time_t t = get_time (); /* Might save a few calls to time() */
 
   pattern[0] = '\0';
@@ -796,21 +860,22 @@ com_admins (com_request_t *req)
            item_create ("Connected for", "%s", NULL),
            item_create ("Commands issued", "%s", NULL));
 
-  thread_mutex_lock (&info.admin_mutex);
-  while ((admcon = avl_traverse (info.admins, &trav)))
+  snap = status_acquire ();
+  for (i = 0; i < snap->num_admins; i++)
   {
+    admin = &snap->admins[i];
     if (pattern[0])
-      if (!hostmatch (admcon, pattern))
+      if (!status_hostmatch (admin->host, admin->hostname, pattern))
         continue;
     listed++;
     item_write_formatted_line (req, ADMIN_SHOW_ADMIN_ENTRY, list_item, 4,
-              item_create ("Id", "%d", &admcon->id),
-              item_create ("Host", "%s", con_host (admcon)),
-              item_create ("Connected for", "%s", nntripcaster_time (t - admcon->connect_time, buf)),
-              item_create ("Commands issued", "%d", &admcon->food.admin->commands));
+              item_create ("Id", "%d", &admin->id),
+              item_create ("Host", "%s", status_host (admin->host, admin->hostname)),
+              item_create ("Connected for", "%s", nntripcaster_time (t - admin->connect_time, buf)),
+              item_create ("Commands issued", "%d", &admin->commands));
   }
 
-  thread_mutex_unlock (&info.admin_mutex);
+  status_release (snap);
 
   item_write_formatted_line (req, ADMIN_SHOW_ADMIN_END, list_end, 1, item_create ("End of admin listing", "%d", &listed));
   return 1;
@@ -950,6 +1015,7 @@ com_tail (com_request_t *req)
 {
   admin_write_line (req, ADMIN_SHOW_TAILING_ON, "Now tailing logfile");
   req->con->food.admin->tailing = 1;
+  raise_debug_level (req->con->food.admin->debuglevel);
   return 1;
 }
 
@@ -994,13 +1060,58 @@ conopt_t sourceopts[] =
   { '\0', NULL, -1 }
 };
 
+static void
+build_source_line_with_opts (const status_source_t *source, char *line, int *opt, int maxlen)
+{
+  char buf[BUFSIZE];
+
+  line[0] = '\0';
+  buf[0] = '\0';
+
+  /* Build the line */
+  if (opt[SOURCE_SHOW_ID])
+    catsnprintf (line, maxlen, "[Id: %lu] ", source->id);
+  if (opt[SOURCE_SHOW_SOCKET])
+    catsnprintf (line, maxlen, "[Sock: %d] ", source->sock);
+  if (opt[SOURCE_SHOW_CTIME])
+  {
+    char ct[100];
+    get_string_time (ct, source->connect_time, REGULAR_DATETIME);
+    catsnprintf (line, maxlen, "[Time of connect: %s] ", ct);
+  }
+  if (opt[SOURCE_SHOW_IP] && source->host)
+    catsnprintf (line, maxlen, "[IP: %s] ", source->host);
+  if (opt[SOURCE_SHOW_HOST] && source->hostname)
+    catsnprintf (line, maxlen, "[Host: %s] ", source->hostname);
+  if (opt[SOURCE_SHOW_AGENT])
+    catsnprintf (line, maxlen, "[Source Agent: %s] ", nullcheck_string (source->agent));
+  if (opt[SOURCE_SHOW_STATE])
+    catsnprintf (line, maxlen, "[State: %d] ", source->state);
+  if (opt[SOURCE_SHOW_TYPE])
+    catsnprintf (line, maxlen, "[Type: %s] ", source->type);
+  if (opt[SOURCE_SHOW_CLIENTS])
+    catsnprintf (line, maxlen, "[Clients: %lu] ", source->clients);
+  if (opt[SOURCE_SHOW_PRIO])
+    catsnprintf (line, maxlen, "[Priority: %d] ", source->priority);
+  if (opt[SOURCE_SHOW_MOUNT])
+    catsnprintf (line, maxlen, "[Mountpoint: %s] ", nullcheck_string (source->mount));
+  if (opt[SOURCE_SHOW_READ])
+    catsnprintf (line, maxlen, "[KBytes read: %lu] ", source->read_kilos);
+  if (opt[SOURCE_SHOW_WRITTEN])
+    catsnprintf (line, maxlen, "[KBytes written: %lu] ", source->write_kilos);
+  if (opt[SOURCE_SHOW_CONNECTS])
+    catsnprintf (line, maxlen, "[Client connections: %lu] ", source->client_connections);
+  if (opt[SOURCE_SHOW_TIME])
+    catsnprintf (line, maxlen, "[Connected for: %s] ", nntripcaster_time (get_time() - source->connect_time, buf));
+}
+
 int
 com_sources (com_request_t *req)
 {
-  int opt[SOURCE_OPTS], listed = 0;
+  int opt[SOURCE_OPTS], i, listed = 0;
   char pattern[BUFSIZE], line[BUFSIZE], *arg = com_arg (req);
-  connection_t *source;
-  avl_traverser trav = {0};
+  status_snapshot_t *snap;
+  status_source_t *source;
 
   zero_opts (opt, SOURCE_OPTS);
 
@@ -1041,16 +1152,17 @@ com_sources (com_request_t *req)
            item_create ("Client connections", "%s", NULL),
            item_create ("Connected for", "%s", NULL));
 
-  thread_mutex_lock(&info.source_mutex);
+  snap = status_acquire ();
 
-  while ((source = avl_traverse (info.sources, &trav)))
+  for (i = 0; i < snap->num_sources; i++)
   {
+    source = &snap->sources[i];
     if (pattern[0])
-      if (!hostmatch (source, pattern))
+      if (!status_hostmatch (source->host, source->hostname, pattern))
         continue;
 
     if (admin_scheme (req) == default_scheme_e) {
-      build_source_con_line_with_opts (source, line, opt, BUFSIZE);
+      build_source_line_with_opts (source, line, opt, BUFSIZE);
 
       admin_write_line (req, ADMIN_SHOW_SOURCE_ENTRY, "%s", line);
     } else {
@@ -1062,18 +1174,18 @@ com_sources (com_request_t *req)
       get_string_time (ct, source->connect_time, REGULAR_DATETIME);
 
       item_write_formatted_line (req, ADMIN_SHOW_SOURCE_ENTRY, list_item, 11,
-               item_create ("Mountpoint", "%s", nullcheck_string (source->food.source->audiocast.mount)),
+               item_create ("Mountpoint", "%s", nullcheck_string (source->mount)),
                item_create ("Id", "%d", &source->id),
                item_create ("Host", "%s", nullcheck_string ((source->hostname ? source->hostname : source->host))),
-               item_create ("Source Agent", "%s", get_source_agent(source)),
+               item_create ("Source Agent", "%s", nullcheck_string (source->agent)),
                item_create ("Time of connect", "%s", ct),
                item_create ("IP", "%s", nullcheck_string (source->host)),
-               item_create ("Clients", "%d", &source->food.source->num_clients),
+               item_create ("Clients", "%d", &source->clients),
 
-               item_create ("KBytes read", "%d", &source->food.source->stats.read_kilos),
-               item_create ("KBytes written", "%d", &source->food.source->stats.write_kilos),
+               item_create ("KBytes read", "%d", &source->read_kilos),
+               item_create ("KBytes written", "%d", &source->write_kilos),
 
-               item_create ("Client connections", "%d", &source->food.source->stats.client_connections),
+               item_create ("Client connections", "%d", &source->client_connections),
                item_create ("Connected for", "%s", nntripcaster_time (get_time () - source->connect_time, buf)));
 
     }
@@ -1081,7 +1193,7 @@ com_sources (com_request_t *req)
     listed++;
   }
 
-  thread_mutex_unlock(&info.source_mutex);
+  status_release (snap);
 
   item_write_formatted_line (req, ADMIN_SHOW_SOURCE_END, list_end, 1, item_create ("End of source listing (%d)", "%d", &listed));
 
@@ -1093,7 +1205,7 @@ int com_sourcetable (com_request_t *req) {
   avl_traverser trav = {0};
   sourcetable_entry_t *se;
 
-  admin_write_line (req, ADMIN_SHOW_SOURCETABLE, "Sourcetable");
+  admin_write_line (req, ADMIN_SHOW_SOURCETABLE, "Sourcetable (version %lu)", sourcetable_get_version());
 
   thread_mutex_lock(&info.sourcetable_mutex);
 
@@ -1115,11 +1227,10 @@ int
 com_listeners (com_request_t *req)
 {
   char pattern[BUFSIZE], buf[BUFSIZE], *arg = com_arg (req);
-  connection_t *clicon;
-  avl_traverser trav = {0};
-  int listed = 0;
+  status_snapshot_t *snap;
+  status_client_t *client;
+  int i, listed = 0;
   time_t t = get_time ();
-  ntripcaster_user_t *user;
 
   pattern[0] = '\0';
 
@@ -1132,26 +1243,18 @@ com_listeners (com_request_t *req)
     admin_write_line (req, ADMIN_SHOW_LISTENERS_START, "Listing listeners");
   }
 
-  thread_mutex_lock (&info.client_mutex);
+  snap = status_acquire ();
 
-  while ((clicon = avl_traverse (info.clients, &trav)))
+  for (i = 0; i < snap->num_clients; i++)
   {
-    if (pattern[0]) if (!hostmatch (clicon, pattern)) continue;
+    client = &snap->clients[i];
+    if (pattern[0]) if (!status_hostmatch (client->host, client->hostname, pattern)) continue;
     listed++;
 
-    /* Show the user's names */
-    user = con_get_user(clicon);
-
-    admin_write_line (req, ADMIN_SHOW_LISTENERS_ENTRY, "[Host: %s] [IP: %s] [User: %s] [Mountpoint: %s] [Id: %ld] [Connected for: %s] [Bytes written: %ld] [Errors: %d] [User agent: %s] [Type: %s]", con_host (clicon), nullcheck_string (clicon->host), (user != NULL)?nullcheck_string (user->name):"(null)", clicon->food.client->source->audiocast.mount, clicon->id, nntripcaster_time (t - clicon->connect_time, buf), clicon->food.client->write_bytes, client_errors (clicon->food.client), get_user_agent (clicon), client_type (clicon));
-
-    if (user != NULL) {
-      nfree(user->name);
-      nfree(user->pass);
-      nfree(user);
-    }
+    admin_write_line (req, ADMIN_SHOW_LISTENERS_ENTRY, "[Host: %s] [IP: %s] [User: %s] [Mountpoint: %s] [Id: %ld] [Connected for: %s] [Bytes written: %ld] [Errors: %d] [Lag: %ld ms] [User agent: %s] [Type: %s]", status_host (client->host, client->hostname), nullcheck_string (client->host), nullcheck_string (client->user), nullcheck_string (client->mount), client->id, nntripcaster_time (t - client->connect_time, buf), client->write_bytes, client->errors, client->lag_ms, nullcheck_string (client->user_agent), client->type);
   }
 
-  thread_mutex_unlock (&info.client_mutex);
+  status_release (snap);
 
   admin_write_line (req, ADMIN_SHOW_LISTENERS_END, "End of listener listing");
   return 1;
@@ -1161,8 +1264,8 @@ int
 com_connections (com_request_t *req)
 {
   char buf[BUFSIZE], buf2[BUFSIZE];
-  connection_t *con;
-  avl_traverser trav = {0};
+  status_snapshot_t *snap;
+  int i;
   time_t t = get_time ();
   const char *kicktype = (admin_scheme(req) == html_scheme_e)
     ? "<a href=\"/admin?mode=kick&amp;argument=%d\">%d</a>" : "%d";
@@ -1179,47 +1282,39 @@ com_connections (com_request_t *req)
     item_create ("User", "%s", NULL),
     item_create ("Connected for", "%s", NULL));
 
-  thread_mutex_lock (&info.client_mutex);
+  snap = status_acquire ();
 
-  while ((con = avl_traverse (info.clients, &trav)))
+  for (i = 0; i < snap->num_clients; i++)
   {
-    snprintf(buf2, sizeof(buf2), kicktype, con->id, con->id);
-    ntripcaster_user_t *user = con_get_user(con);
+    status_client_t *client = &snap->clients[i];
 
+    snprintf(buf2, sizeof(buf2), kicktype, client->id, client->id);
     item_write_formatted_line(req, ADMIN_SHOW_CONNECTIONS_ENTRY, list_item, 7,
-      item_create ("Mountpoint", "%s", nullcheck_string(con->food.client->source->audiocast.mount)),
+      item_create ("Mountpoint", "%s", nullcheck_string(client->mount)),
       item_create ("Type", "%s", "listen"),
       item_create ("Id", "%s", buf2),
-      item_create ("Agent", "%s", get_user_agent(con)),
-      item_create ("IP", "%s", nullcheck_string(con->host)),
-      item_create ("User", "%s", (user != NULL) ? nullcheck_string(user->name) : "(null)"),
-      item_create ("Connected for", "%s", nntripcaster_time(t - con->connect_time, buf)));
-
-    if (user != NULL) {
-      nfree(user->name);
-      nfree(user->pass);
-      nfree(user);
-    }
+      item_create ("Agent", "%s", nullcheck_string(client->user_agent)),
+      item_create ("IP", "%s", nullcheck_string(client->host)),
+      item_create ("User", "%s", nullcheck_string(client->user)),
+      item_create ("Connected for", "%s", nntripcaster_time(t - client->connect_time, buf)));
   }
 
-  thread_mutex_unlock (&info.client_mutex);
-
-  thread_mutex_lock(&info.source_mutex);
-
-  while ((con = avl_traverse (info.sources, &trav)))
+  for (i = 0; i < snap->num_sources; i++)
   {
-    snprintf(buf2, sizeof(buf2), kicktype, con->id, con->id);
+    status_source_t *source = &snap->sources[i];
+
+    snprintf(buf2, sizeof(buf2), kicktype, source->id, source->id);
     item_write_formatted_line(req, ADMIN_SHOW_CONNECTIONS_ENTRY, list_item, 7,
-      item_create ("Mountpoint", "%s", nullcheck_string(con->food.source->audiocast.mount)),
+      item_create ("Mountpoint", "%s", nullcheck_string(source->mount)),
       item_create ("Type", "%s", "source"),
       item_create ("Id", "%s", buf2),
-      item_create ("Agent", "%s", get_source_agent(con)),
-      item_create ("IP", "%s", nullcheck_string(con->host)),
+      item_create ("Agent", "%s", nullcheck_string(source->agent)),
+      item_create ("IP", "%s", nullcheck_string(source->host)),
       item_create ("User", "%s", "-"),
-      item_create ("Connected for", "%s", nntripcaster_time(t - con->connect_time, buf)));
+      item_create ("Connected for", "%s", nntripcaster_time(t - source->connect_time, buf)));
   }
 
-  thread_mutex_unlock(&info.source_mutex);
+  status_release (snap);
 
   item_write_formatted_line(req, ADMIN_SHOW_CONNECTIONS_END, list_end, 1,
     item_create("End of connection listing", "%d", NULL));
@@ -1232,6 +1327,7 @@ com_rehash (com_request_t *req) {
   char oldlogfile[BUFSIZE];
   char oldaccessfile[BUFSIZE];
   char oldusagefile[BUFSIZE];
+  int oldaccessformat = info.access_log_format;
   char *arg = com_arg (req);
 
   strncpy(oldlogfile, info.logfilename, BUFSIZE);
@@ -1249,7 +1345,7 @@ com_rehash (com_request_t *req) {
   else
     parse_default_config_file ();
 
-  if ((strncmp(oldlogfile, info.logfilename, BUFSIZE) != 0) || (strncmp(oldusagefile, info.usagefilename, BUFSIZE) != 0) || (strncmp(oldaccessfile, info.accessfilename, BUFSIZE) != 0))
+  if ((strncmp(oldlogfile, info.logfilename, BUFSIZE) != 0) || (strncmp(oldusagefile, info.usagefilename, BUFSIZE) != 0) || (strncmp(oldaccessfile, info.accessfilename, BUFSIZE) != 0) || (oldaccessformat != info.access_log_format))
     open_log_files ();
 
   /* Updating sourcetable. */
@@ -1322,6 +1418,7 @@ com_stats (com_request_t *req)
   char timebuf[BUFSIZE];
   time_t filetime;
   char realstarttime[100];
+  int blocked_hosts, blocked_users;
 
   if(arg && arg[0] && ntripcaster_strcmp (arg, "prom") == 0)
     return com_stats_prom(req);
@@ -1388,6 +1485,8 @@ com_stats (com_request_t *req)
   admin_write_line (req, ADMIN_SHOW_STATS_NUMSOURCES, "Sources: %d", info.num_sources);
   admin_write_line (req, ADMIN_SHOW_STATS_NUMLISTENERS, "Listeners: %d", info.num_clients);
   admin_write_line (req, ADMIN_SHOW_STATS_NUMBAN, "Banned Clients: %d", stat.banned);
+  loginlimit_get_blocked (&blocked_hosts, &blocked_users);
+  admin_write_line (req, ADMIN_SHOW_STATS_NUMBAN, "Blocked after failed logins: %d hosts, %d users", blocked_hosts, blocked_users);
 
   admin_write_line (req, ADMIN_SHOW_STATS_MISC, "Displaying server statistics since last resync at: %s", realstarttime);
   admin_write_line (req, ADMIN_SHOW_STATS_READ, "Total KBytes read: %lu", stat.read_kilos);
@@ -1412,14 +1511,63 @@ com_stats (com_request_t *req)
   return 1;
 }
 
+#define THREAD_NAMES_MAX 32
+
+/* The threads of one name, for the metrics */
+typedef struct
+{
+  char name[64];
+  int threads;
+  double cpu_usage; /* sum */
+  long long int loop_max; /* -1 if none of them has a loop */
+} thread_name_stats_t;
+
+/* Aggregates the threads by name into names, returns their number */
+static int
+get_thread_name_stats (thread_name_stats_t *names, int max)
+{
+  avl_traverser trav = {0};
+  mythread_t *mt;
+  const char *name;
+  int i, count = 0;
+
+  internal_lock_mutex (&info.thread_mutex);
+  while ((mt = avl_traverse (info.threads, &trav)))
+  {
+    name = nullcheck_string (mt->name);
+    for (i = 0; i < count; i++)
+      if (strncmp (names[i].name, name, sizeof (names[i].name) - 1) == 0)
+        break;
+    if (i == count)
+    {
+      if (count == max)
+        continue;
+      strncpy (names[i].name, name, sizeof (names[i].name) - 1);
+      names[i].name[sizeof (names[i].name) - 1] = '\0';
+      names[i].threads = 0;
+      names[i].cpu_usage = 0.0;
+      names[i].loop_max = -1;
+      count++;
+    }
+    names[i].threads++;
+    names[i].cpu_usage += mt->cpu_usage;
+    if (mt->last_progress && (mt->loop_max_last > names[i].loop_max))
+      names[i].loop_max = mt->loop_max_last;
+  }
+  internal_unlock_mutex (&info.thread_mutex);
+
+  return count;
+}
+
 /* expose metrics in Prometheus format see https://prometheus.io/docs/concepts/metric_types/ */
-int
-com_stats_prom (com_request_t *req)
+void
+write_stats_prom (metrics_buf_t *out)
 {
   statistics_t stat;
   time_t t;
   time_t filetime;
   time_t uptime;
+  int blocked_hosts, blocked_users;
  
   zero_stats (&stat);
 
@@ -1436,108 +1584,294 @@ com_stats_prom (com_request_t *req)
   else
     uptime = t - info.server_start_time;
 
-  admin_write_raw (req, "# HELP caster_info Information about the Caster.\n");
-  admin_write_raw (req, "# TYPE caster_info gauge\n");
-  admin_write_raw (req, "caster_info{version=\"%s\",servername=\"%s\",port=\"%d\"} %d\n", info.version, nullcheck_string (info.server_name), info.port[0], 1);
+  metrics_printf (out, "# HELP caster_info Information about the Caster.\n");
+  metrics_printf (out, "# TYPE caster_info gauge\n");
+  metrics_printf (out, "caster_info{version=\"%s\",servername=\"%s\",port=\"%d\"} %d\n", info.version, nullcheck_string (info.server_name), info.port[0], 1);
 
-  admin_write_raw (req, "# HELP caster_uptime_seconds Uptime of the caster process in seconds.\n");
-  admin_write_raw (req, "# TYPE caster_uptime_seconds gauge\n");
-  admin_write_raw (req, "caster_uptime_seconds %lu\n", uptime);
+  metrics_printf (out, "# HELP caster_uptime_seconds Uptime of the caster process in seconds.\n");
+  metrics_printf (out, "# TYPE caster_uptime_seconds gauge\n");
+  metrics_printf (out, "caster_uptime_seconds %lu\n", uptime);
 
-  admin_write_raw (req, "# HELP caster_connected_admins Total number of logged in admins.\n");
-  admin_write_raw (req, "# TYPE caster_connected_admins gauge\n");
-  admin_write_raw (req, "caster_connected_admins %d\n", info.num_admins);
+  metrics_printf (out, "# HELP caster_connected_admins Total number of logged in admins.\n");
+  metrics_printf (out, "# TYPE caster_connected_admins gauge\n");
+  metrics_printf (out, "caster_connected_admins %d\n", info.num_admins);
 
-  admin_write_raw (req, "# HELP caster_connected_sources Total number of connected sources.\n");
-  admin_write_raw (req, "# TYPE caster_connected_sources gauge\n");
-  admin_write_raw (req, "caster_connected_sources %d\n", info.num_sources);
+  metrics_printf (out, "# HELP caster_connected_sources Total number of connected sources.\n");
+  metrics_printf (out, "# TYPE caster_connected_sources gauge\n");
+  metrics_printf (out, "caster_connected_sources %d\n", info.num_sources);
 
-  admin_write_raw (req, "# HELP caster_connected_listeners Total number of connected listeners.\n");
-  admin_write_raw (req, "# TYPE caster_connected_listeners gauge\n");
-  admin_write_raw (req, "caster_connected_listeners %d\n", info.num_clients);
+  metrics_printf (out, "# HELP caster_connected_listeners Total number of connected listeners.\n");
+  metrics_printf (out, "# TYPE caster_connected_listeners gauge\n");
+  metrics_printf (out, "caster_connected_listeners %d\n", info.num_clients);
 
-  admin_write_raw (req, "# HELP caster_received_bytes_total The total number of bytes received.\n");
-  admin_write_raw (req, "# TYPE caster_received_bytes_total counter\n");
-  admin_write_raw (req, "caster_received_bytes_total %lu\n", stat.read_kilos * 1024);
+  metrics_printf (out, "# HELP caster_received_bytes_total The total number of bytes received.\n");
+  metrics_printf (out, "# TYPE caster_received_bytes_total counter\n");
+  metrics_printf (out, "caster_received_bytes_total %lu\n", stat.read_kilos * 1024);
 
-  admin_write_raw (req, "# HELP caster_sent_bytes_total The total number of bytes sent.\n");
-  admin_write_raw (req, "# TYPE caster_sent_bytes_total counter\n");
-  admin_write_raw (req, "caster_sent_bytes_total %lu\n", stat.write_kilos * 1024);
+  metrics_printf (out, "# HELP caster_sent_bytes_total The total number of bytes sent.\n");
+  metrics_printf (out, "# TYPE caster_sent_bytes_total counter\n");
+  metrics_printf (out, "caster_sent_bytes_total %lu\n", stat.write_kilos * 1024);
 
-  admin_write_raw (req, "# HELP caster_bandwidth_usage_KBytesPerSec The currently used bandwidth in KB/s.\n");
-  admin_write_raw (req, "# TYPE caster_bandwidth_usage_KBytesPerSec gauge\n");
-  admin_write_raw (req, "caster_bandwidth_usage_KBytesPerSec %.0f\n", info.bandwidth_usage);
+  metrics_printf (out, "# HELP caster_bandwidth_usage_KBytesPerSec The currently used bandwidth in KB/s.\n");
+  metrics_printf (out, "# TYPE caster_bandwidth_usage_KBytesPerSec gauge\n");
+  metrics_printf (out, "caster_bandwidth_usage_KBytesPerSec %.0f\n", info.bandwidth_usage);
+
+  loginlimit_get_blocked (&blocked_hosts, &blocked_users);
+  metrics_printf (out, "# HELP caster_login_blocked Number of hosts and users blocked after too many failed logins.\n");
+  metrics_printf (out, "# TYPE caster_login_blocked gauge\n");
+  metrics_printf (out, "caster_login_blocked{type=\"host\"} %d\n", blocked_hosts);
+  metrics_printf (out, "caster_login_blocked{type=\"user\"} %d\n", blocked_users);
+
+  metrics_printf (out, "# HELP caster_sourcetable_version Version of the rendered sourcetable, increased on every change.\n");
+  metrics_printf (out, "# TYPE caster_sourcetable_version gauge\n");
+  metrics_printf (out, "caster_sourcetable_version %lu\n", sourcetable_get_version());
 
-  if (stat.client_connections > 0)
   {
-    admin_write_raw (req, "# HELP caster_clients_connect_duration_seconds The total duration each client has been connected and the number of client connects.\n");
-    admin_write_raw (req, "# TYPE caster_clients_connect_duration_seconds summary\n");
-    admin_write_raw (req, "caster_clients_connect_duration_seconds_sum %lu\n", stat.client_connect_time * 60);
-    admin_write_raw (req, "caster_clients_connect_duration_seconds_count %lu\n", stat.client_connections);
+    sourcetable_response_stats_t rs;
+
+    sourcetable_get_response_stats (&rs);
+    metrics_printf (out, "# HELP caster_sourcetable_responses_total Sourcetable responses, by whether they were sent plain, gzip compressed or as not modified.\n");
+    metrics_printf (out, "# TYPE caster_sourcetable_responses_total counter\n");
+    metrics_printf (out, "caster_sourcetable_responses_total{encoding=\"identity\"} %lu\n", rs.full);
+    metrics_printf (out, "caster_sourcetable_responses_total{encoding=\"gzip\"} %lu\n", rs.gzip);
+    metrics_printf (out, "caster_sourcetable_responses_total{encoding=\"not_modified\"} %lu\n", rs.not_modified);
+    metrics_printf (out, "# HELP caster_sourcetable_sent_bytes_total Body bytes of all sourcetable responses.\n");
+    metrics_printf (out, "# TYPE caster_sourcetable_sent_bytes_total counter\n");
+    metrics_printf (out, "caster_sourcetable_sent_bytes_total %lu\n", rs.bytes);
   }
 
-  if (stat.source_connections > 0)
   {
-    admin_write_raw (req, "# HELP caster_sources_connect_duration_seconds The total duration each source has been connected and the number of source connects.\n");
-    admin_write_raw (req, "# TYPE caster_sources_connect_duration_seconds summary\n");
-    admin_write_raw (req, "caster_sources_connect_duration_seconds_sum %lu\n", stat.source_connect_time * 60);
-    admin_write_raw (req, "caster_sources_connect_duration_seconds_count %lu\n", stat.source_connections );
+    filter_cache_stats_t fs;
+
+    filtercache_get_stats (&fs);
+    metrics_printf (out, "# HELP caster_filter_cache_lookups_total Sourcetable filter requests, by whether the filter was found compiled.\n");
+    metrics_printf (out, "# TYPE caster_filter_cache_lookups_total counter\n");
+    metrics_printf (out, "caster_filter_cache_lookups_total{result=\"hit\"} %lu\n", fs.hits);
+    metrics_printf (out, "caster_filter_cache_lookups_total{result=\"miss\"} %lu\n", fs.misses);
+    metrics_printf (out, "# HELP caster_filter_cache_result_hits_total Sourcetable filter requests answered from the result of the same sourcetable version.\n");
+    metrics_printf (out, "# TYPE caster_filter_cache_result_hits_total counter\n");
+    metrics_printf (out, "caster_filter_cache_result_hits_total %lu\n", fs.result_hits);
+    metrics_printf (out, "# HELP caster_filter_cache_evictions_total Compiled filters dropped to stay within filter_cache_size.\n");
+    metrics_printf (out, "# TYPE caster_filter_cache_evictions_total counter\n");
+    metrics_printf (out, "caster_filter_cache_evictions_total %lu\n", fs.evictions);
+    metrics_printf (out, "# HELP caster_filter_cache_entries Number of compiled filters in the cache.\n");
+    metrics_printf (out, "# TYPE caster_filter_cache_entries gauge\n");
+    metrics_printf (out, "caster_filter_cache_entries %d\n", fs.entries);
   }
- 
+
   {
-    statisticsentry_t *e;
-    connection_t *source;
-    avl_traverser trav = {0};
+    template_stats_t ts;
 
-    admin_write_raw (req, "# HELP caster_sources_received_bytes_total The number of bytes received for the mountpoint.\n");
-    admin_write_raw (req, "# TYPE caster_sources_received_bytes_total counter\n");
-    admin_write_raw (req, "# HELP caster_sources_sent_bytes_total The number of bytes sent for the mountpoint.\n");
-    admin_write_raw (req, "# TYPE caster_sources_sent_bytes_total counter\n");
-    admin_write_raw (req, "# HELP caster_sources_clients_num The number of clients connected to the mountpoint.\n");
-    admin_write_raw (req, "# TYPE caster_sources_clients_num gauge\n");
-    admin_write_raw (req, "# HELP caster_sources_connections_total The number of connections of the mountpoint.\n");
-    admin_write_raw (req, "# TYPE caster_sources_connections_total counter\n");
-    admin_write_raw (req, "# HELP caster_sources_clients_connections_total The number of client connections to the mountpoint.\n");
-    admin_write_raw (req, "# TYPE caster_sources_clients_connections_total counter\n");
-    admin_write_raw (req, "# HELP caster_sources_duration_seconds The activity time of the mountpoint.\n");
-    admin_write_raw (req, "# TYPE caster_sources_duration_seconds gauge\n");
-
-    while ((e = avl_traverse (info.sourcesstats, &trav)))
-    {
-      const char * mp = nullcheck_string (e->mount);
-      if (*mp == '/')
-        ++mp;
-      admin_write_raw (req, "caster_sources_received_bytes_total{mp=\"%s\"} %lu\n", mp, e->stats.read_kilos*1024);
-      admin_write_raw (req, "caster_sources_sent_bytes_total{mp=\"%s\"} %lu\n", mp, e->stats.write_kilos*1024);
-      admin_write_raw (req, "caster_sources_connections_total{mp=\"%s\"} %lu\n", mp, e->stats.source_connections);
-      admin_write_raw (req, "caster_sources_clients_connections_total{mp=\"%s\"} %lu\n", mp, e->stats.client_connections);
+    template_get_stats (&ts);
+    metrics_printf (out, "# HELP caster_template_lookups_total Page templates rendered, by whether the compiled template was current or the file had to be compiled.\n");
+    metrics_printf (out, "# TYPE caster_template_lookups_total counter\n");
+    metrics_printf (out, "caster_template_lookups_total{result=\"hit\"} %lu\n", ts.hits);
+    metrics_printf (out, "caster_template_lookups_total{result=\"compile\"} %lu\n", ts.compiles);
+  }
+
+  {
+    keepalive_stats_t ks;
+
+    keepalive_get_stats (&ks);
+    metrics_printf (out, "# HELP caster_http_keepalive_reused_total Requests served on a connection kept open after an earlier one.\n");
+    metrics_printf (out, "# TYPE caster_http_keepalive_reused_total counter\n");
+    metrics_printf (out, "caster_http_keepalive_reused_total %lu\n", ks.reused);
+    metrics_printf (out, "# HELP caster_http_keepalive_closed_total Kept connections closed, by whether they were idle, reached keepalive_requests or were closed by the client.\n");
+    metrics_printf (out, "# TYPE caster_http_keepalive_closed_total counter\n");
+    metrics_printf (out, "caster_http_keepalive_closed_total{reason=\"idle\"} %lu\n", ks.closed_idle);
+    metrics_printf (out, "caster_http_keepalive_closed_total{reason=\"limit\"} %lu\n", ks.closed_limit);
+    metrics_printf (out, "caster_http_keepalive_closed_total{reason=\"peer\"} %lu\n", ks.closed_peer);
+  }
+
+  {
+    status_stats_t ss;
+
+    status_get_stats (&ss);
+    metrics_printf (out, "# HELP caster_status_snapshots_total Status views and metrics, by whether they took a new snapshot of the connections or shared a recent one.\n");
+    metrics_printf (out, "# TYPE caster_status_snapshots_total counter\n");
+    metrics_printf (out, "caster_status_snapshots_total{result=\"build\"} %lu\n", ss.builds);
+    metrics_printf (out, "caster_status_snapshots_total{result=\"reuse\"} %lu\n", ss.reuses);
+    metrics_printf (out, "# HELP caster_status_snapshot_build_seconds_total Time spent copying the connections into snapshots.\n");
+    metrics_printf (out, "# TYPE caster_status_snapshot_build_seconds_total counter\n");
+    metrics_printf (out, "caster_status_snapshot_build_seconds_total %.6f\n", ss.build_us / 1e6);
+  }
+
+  {
+    nearest_stats_t ns;
+
+    nearest_get_stats (&ns);
+    metrics_printf (out, "# HELP caster_nearest_routed_total Clients of the nearest mountpoint attached to their nearest station.\n");
+    metrics_printf (out, "# TYPE caster_nearest_routed_total counter\n");
+    metrics_printf (out, "caster_nearest_routed_total %lu\n", ns.routed);
+    metrics_printf (out, "# HELP caster_nearest_moves_total Clients of the nearest mountpoint moved to a closer station.\n");
+    metrics_printf (out, "# TYPE caster_nearest_moves_total counter\n");
+    metrics_printf (out, "caster_nearest_moves_total %lu\n", ns.moves);
+    metrics_printf (out, "# HELP caster_nearest_failed_total Clients of the nearest mountpoint dropped without position or station.\n");
+    metrics_printf (out, "# TYPE caster_nearest_failed_total counter\n");
+    metrics_printf (out, "caster_nearest_failed_total %lu\n", ns.failed);
+  }
+
+  {
+    rtcm_stats_t rs;
+
+    rtcm_get_stats (&rs);
+    metrics_printf (out, "# HELP caster_stream_analysis_frames_total RTCM 3 frames found in the streams, by whether their CRC was valid.\n");
+    metrics_printf (out, "# TYPE caster_stream_analysis_frames_total counter\n");
+    metrics_printf (out, "caster_stream_analysis_frames_total{result=\"ok\"} %lu\n", rs.frames);
+    metrics_printf (out, "caster_stream_analysis_frames_total{result=\"crc_error\"} %lu\n", rs.crc_errors);
+    metrics_printf (out, "# HELP caster_stream_analysis_updates_total STR entries rewritten from what their stream carries.\n");
+    metrics_printf (out, "# TYPE caster_stream_analysis_updates_total counter\n");
+    metrics_printf (out, "caster_stream_analysis_updates_total %lu\n", rs.updates);
+  }
+
+  {
+    relay_stats_t rls;
+
+    relay_get_stats (&rls);
+    metrics_printf (out, "# HELP caster_relay_connects_total Relay connects, by whether the remote side accepted the login.\n");
+    metrics_printf (out, "# TYPE caster_relay_connects_total counter\n");
+    metrics_printf (out, "caster_relay_connects_total{result=\"ok\"} %lu\n", rls.connects);
+    metrics_printf (out, "caster_relay_connects_total{result=\"failed\"} %lu\n", rls.failures);
+    metrics_printf (out, "# HELP caster_relay_connects_deferred_total Due relay connects postponed because relay_host_connects connects to the host were running.\n");
+    metrics_printf (out, "# TYPE caster_relay_connects_deferred_total counter\n");
+    metrics_printf (out, "caster_relay_connects_deferred_total %lu\n", rls.deferred);
+    metrics_printf (out, "# HELP caster_relay_connects_running Relay connects in progress.\n");
+    metrics_printf (out, "# TYPE caster_relay_connects_running gauge\n");
+    metrics_printf (out, "caster_relay_connects_running %d\n", rls.in_flight);
+  }
+
+  {
+    thread_name_stats_t names[THREAD_NAMES_MAX];
+    int i, count, stalled;
+    unsigned long int stalls;
+
+    thread_get_stall_stats (&stalled, &stalls);
+    metrics_printf (out, "# HELP caster_threads_stalled Number of threads whose loop made no progress within thread_stall_budget.\n");
+    metrics_printf (out, "# TYPE caster_threads_stalled gauge\n");
+    metrics_printf (out, "caster_threads_stalled %d\n", stalled);
+    metrics_printf (out, "# HELP caster_thread_stalls_total Number of times a thread was found stalled.\n");
+    metrics_printf (out, "# TYPE caster_thread_stalls_total counter\n");
+    metrics_printf (out, "caster_thread_stalls_total %lu\n", stalls);
+
+    /* By name, thread ids come and go with every connection */
+    count = get_thread_name_stats (names, THREAD_NAMES_MAX);
+
+    metrics_printf (out, "# HELP caster_threads Number of threads of the name.\n");
+    metrics_printf (out, "# TYPE caster_threads gauge\n");
+    for (i = 0; i < count; i++)
+      metrics_printf (out, "caster_threads{name=\"%s\"} %d\n", names[i].name, names[i].threads);
+
+    metrics_printf (out, "# HELP caster_thread_cpu_usage_percent CPU time of the threads of the name in the last sample interval.\n");
+    metrics_printf (out, "# TYPE caster_thread_cpu_usage_percent gauge\n");
+    for (i = 0; i < count; i++)
+      metrics_printf (out, "caster_thread_cpu_usage_percent{name=\"%s\"} %.1f\n", names[i].name, names[i].cpu_usage);
+
+    metrics_printf (out, "# HELP caster_thread_loop_max_seconds Longest loop iteration of the threads of the name in the last sample interval.\n");
+    metrics_printf (out, "# TYPE caster_thread_loop_max_seconds gauge\n");
+    for (i = 0; i < count; i++)
+      if (names[i].loop_max >= 0)
+        metrics_printf (out, "caster_thread_loop_max_seconds{name=\"%s\"} %.3f\n", names[i].name, names[i].loop_max / 1000.0);
+  }
+
+  if (info.lock_profiling)
+  {
+    mutex_stats_t locks[LOCK_PROFILE_MAX];
+    int i, j, count = thread_mutex_get_stats (locks, LOCK_PROFILE_MAX);
+
+    metrics_printf (out, "# HELP caster_lock_acquisitions_total Number of times the lock was taken.\n");
+    metrics_printf (out, "# TYPE caster_lock_acquisitions_total counter\n");
+    for (i = 0; i < count; i++)
+      metrics_printf (out, "caster_lock_acquisitions_total{lock=\"%s\"} %lu\n", locks[i].name, locks[i].acquired);
+
+    metrics_printf (out, "# HELP caster_lock_contended_total Number of times the lock was already held by another thread.\n");
+    metrics_printf (out, "# TYPE caster_lock_contended_total counter\n");
+    for (i = 0; i < count; i++)
+      metrics_printf (out, "caster_lock_contended_total{lock=\"%s\"} %lu\n", locks[i].name, locks[i].contended);
+
+    /* every second bucket, powers of 4 microseconds */
+    metrics_printf (out, "# HELP caster_lock_wait_seconds Time spent waiting for a contended lock.\n");
+    metrics_printf (out, "# TYPE caster_lock_wait_seconds histogram\n");
+    for (i = 0; i < count; i++) {
+      unsigned long int sum = 0;
+
+      for (j = 0; j < LOCK_HIST_BUCKETS - 1; j++) {
+        sum += locks[i].wait_hist[j];
+        if (j % 2 == 0)
+          metrics_printf (out, "caster_lock_wait_seconds_bucket{lock=\"%s\",le=\"%.6f\"} %lu\n", locks[i].name, (1UL << j) / 1e6, sum);
+      }
+      metrics_printf (out, "caster_lock_wait_seconds_bucket{lock=\"%s\",le=\"+Inf\"} %lu\n", locks[i].name, locks[i].contended);
+      metrics_printf (out, "caster_lock_wait_seconds_sum{lock=\"%s\"} %.9f\n", locks[i].name, locks[i].wait_ns / 1e9);
+      metrics_printf (out, "caster_lock_wait_seconds_count{lock=\"%s\"} %lu\n", locks[i].name, locks[i].contended);
     }
-    zero_trav (&trav);
 
-    while ((source = avl_traverse (info.sources, &trav)))
-    {
-      const char * mp = nullcheck_string (source->food.source->audiocast.mount);
-      if (*mp == '/')
-        ++mp;
-      admin_write_raw (req, "caster_sources_clients_num{mp=\"%s\"} %lu\n", mp, source->food.source->num_clients);
-      admin_write_raw (req, "caster_sources_duration_seconds{mp=\"%s\"} %lu\n", mp, get_time () - source->connect_time);
+    metrics_printf (out, "# HELP caster_lock_hold_seconds Time the lock was held, sampled for one in %d acquisitions.\n", LOCK_HOLD_SAMPLE);
+    metrics_printf (out, "# TYPE caster_lock_hold_seconds histogram\n");
+    for (i = 0; i < count; i++) {
+      unsigned long int sum = 0;
+
+      for (j = 0; j < LOCK_HIST_BUCKETS - 1; j++) {
+        sum += locks[i].hold_hist[j];
+        if (j % 2 == 0)
+          metrics_printf (out, "caster_lock_hold_seconds_bucket{lock=\"%s\",le=\"%.6f\"} %lu\n", locks[i].name, (1UL << j) / 1e6, sum);
+      }
+      metrics_printf (out, "caster_lock_hold_seconds_bucket{lock=\"%s\",le=\"+Inf\"} %lu\n", locks[i].name, locks[i].hold_samples);
+      metrics_printf (out, "caster_lock_hold_seconds_sum{lock=\"%s\"} %.9f\n", locks[i].name, locks[i].hold_ns / 1e9);
+      metrics_printf (out, "caster_lock_hold_seconds_count{lock=\"%s\"} %lu\n", locks[i].name, locks[i].hold_samples);
     }
   }
+
+  {
+    latency_hist_t h;
+
+    source_get_latency (&h);
+    metrics_printf (out, "# HELP caster_delivery_delay_seconds Time from reading the first byte of a chunk to having written it to a client.\n");
+    metrics_printf (out, "# TYPE caster_delivery_delay_seconds histogram\n");
+    metrics_write_histogram (out, "caster_delivery_delay_seconds", NULL, &h);
+  }
+
+  if (stat.client_connections > 0)
+  {
+    metrics_printf (out, "# HELP caster_clients_connect_duration_seconds The total duration each client has been connected and the number of client connects.\n");
+    metrics_printf (out, "# TYPE caster_clients_connect_duration_seconds summary\n");
+    metrics_printf (out, "caster_clients_connect_duration_seconds_sum %lu\n", stat.client_connect_time * 60);
+    metrics_printf (out, "caster_clients_connect_duration_seconds_count %lu\n", stat.client_connections);
+  }
+
+  if (stat.source_connections > 0)
+  {
+    metrics_printf (out, "# HELP caster_sources_connect_duration_seconds The total duration each source has been connected and the number of source connects.\n");
+    metrics_printf (out, "# TYPE caster_sources_connect_duration_seconds summary\n");
+    metrics_printf (out, "caster_sources_connect_duration_seconds_sum %lu\n", stat.source_connect_time * 60);
+    metrics_printf (out, "caster_sources_connect_duration_seconds_count %lu\n", stat.source_connections );
+  }
+ 
+  metrics_write (out);
+
   #ifdef _DEFAULT_SOURCE
   {
     double load[3];
     if (getloadavg(load, 3) != -1)
     {
-      admin_write_raw (req, "# HELP system_load1 The system load average.\n");
-      admin_write_raw (req, "# TYPE system_load1 gauge\n");
-      admin_write_raw (req, "system_load1 %.2f\n", load[0]);
-      admin_write_raw (req, "# TYPE system_load5 gauge\n");
-      admin_write_raw (req, "system_load5 %.2f\n", load[1]);
-      admin_write_raw (req, "# TYPE system_load15 gauge\n");
-      admin_write_raw (req, "system_load15 %.2f\n", load[2]);
+      metrics_printf (out, "# HELP system_load1 The system load average.\n");
+      metrics_printf (out, "# TYPE system_load1 gauge\n");
+      metrics_printf (out, "system_load1 %.2f\n", load[0]);
+      metrics_printf (out, "# TYPE system_load5 gauge\n");
+      metrics_printf (out, "system_load5 %.2f\n", load[1]);
+      metrics_printf (out, "# TYPE system_load15 gauge\n");
+      metrics_printf (out, "system_load15 %.2f\n", load[2]);
     }
   }
   #endif
+}
+
+int
+com_stats_prom (com_request_t *req)
+{
+  metrics_buf_t *out = metrics_buf_acquire ();
+
+  write_stats_prom (out);
+  sock_write_bytes (req->con->sock, out->data + METRICS_HEADER_SPACE, out->len - METRICS_HEADER_SPACE);
+  metrics_buf_release (out);
 
   return 1;
 }
@@ -1699,9 +2033,8 @@ int
 com_list (com_request_t *req)
 {
   char pattern[BUFSIZE], *arg = com_arg (req), buf[BUFSIZE];
-  connection_t *con, *sourcecon;
-  avl_traverser trav = {0}, sourcetrav = {0};
-  int listed = 0;
+  status_snapshot_t *snap;
+  int i, listed = 0;
   time_t t = get_time ();
 
   pattern[0] = '\0';
@@ -1715,45 +2048,41 @@ com_list (com_request_t *req)
     admin_write_line (req, ADMIN_SHOW_LIST_START, "Listing connections:", pattern);
   }
 
-  thread_mutex_lock(&info.admin_mutex);
+  snap = status_acquire ();
 
-  while ((con = avl_traverse (info.admins, &trav)))
+  for (i = 0; i < snap->num_admins; i++)
   {
+    status_admin_t *admin = &snap->admins[i];
+
     if (pattern[0])
-      if (!hostmatch (con, pattern))
+      if (!status_hostmatch (admin->host, admin->hostname, pattern))
         continue;
     listed++;
     admin_write_line (req, ADMIN_SHOW_LIST_ENTRY, "[Id: %lu] [Host: %s] [Type: admin] [Connected for: %s]",
-          con->id, con_host (con), nntripcaster_time (t - con->connect_time, buf));
+          admin->id, status_host (admin->host, admin->hostname), nntripcaster_time (t - admin->connect_time, buf));
   }
 
-  thread_mutex_unlock (&info.admin_mutex);
-
-  zero_trav (&trav);
-
-  thread_mutex_lock (&info.client_mutex);
-
-  while ((con = avl_traverse (info.clients, &trav)))
+  for (i = 0; i < snap->num_clients; i++)
   {
-    if (pattern[0]) if (!hostmatch (con, pattern)) continue;
+    status_client_t *client = &snap->clients[i];
 
-    admin_write_line (req, ADMIN_SHOW_LIST_ENTRY, "[Id: %lu] [Host: %s] [Type: client] [Connected for: %s]", con->id, con_host (con), nntripcaster_time (t - con->connect_time, buf));
+    if (pattern[0]) if (!status_hostmatch (client->host, client->hostname, pattern)) continue;
+
+    admin_write_line (req, ADMIN_SHOW_LIST_ENTRY, "[Id: %lu] [Host: %s] [Type: client] [Connected for: %s]", client->id, status_host (client->host, client->hostname), nntripcaster_time (t - client->connect_time, buf));
     listed++;
   }
 
-  thread_mutex_unlock (&info.client_mutex);
-
-  thread_mutex_lock (&info.source_mutex);
-
-  while ((sourcecon = avl_traverse (info.sources, &sourcetrav)))
+  for (i = 0; i < snap->num_sources; i++)
   {
-    if (pattern[0]) if (!hostmatch (sourcecon, pattern)) continue;
+    status_source_t *source = &snap->sources[i];
+
+    if (pattern[0]) if (!status_hostmatch (source->host, source->hostname, pattern)) continue;
 
-    admin_write_line (req, ADMIN_SHOW_LIST_ENTRY, "[Id: %lu] [Host: %s] [Type: source] [Connected for: %s]", sourcecon->id, con_host (sourcecon), nntripcaster_time (t - sourcecon->connect_time, buf));
+    admin_write_line (req, ADMIN_SHOW_LIST_ENTRY, "[Id: %lu] [Host: %s] [Type: source] [Connected for: %s]", source->id, status_host (source->host, source->hostname), nntripcaster_time (t - source->connect_time, buf));
     listed++;
   }
 
-  thread_mutex_unlock(&info.source_mutex);
+  status_release (snap);
 
   admin_write_line (req, ADMIN_SHOW_LIST_END, "End of list listing (%d listed)", listed);
   return 1;
@@ -1938,13 +2267,24 @@ com_alias (com_request_t *req)
   }
 }
 
+#define THREADS_TOP_CPU 5
+
+static int
+compare_thread_cpu (const void *first, const void *second)
+{
+  const mythread_t *a = *(mythread_t * const *) first, *b = *(mythread_t * const *) second;
+
+  return (a->cpu_usage < b->cpu_usage) - (a->cpu_usage > b->cpu_usage);
+}
+
 int
 com_threads(com_request_t *req)
 {
   avl_traverser trav = {0};
-  mythread_t *mt;
+  mythread_t *mt, **top;
   char time[100];
-  int listed = 0;
+  int listed = 0, i;
+  long long int now;
   char *arg = com_arg (req);
   char command[BUFSIZE];
 
@@ -1970,16 +2310,29 @@ com_threads(com_request_t *req)
 
   zero_trav (&trav);
 
+  now = get_time_ns () / 1000000;
+  top = (mythread_t **) nmalloc ((avl_count (info.threads) + 1) * sizeof (mythread_t *));
+
   while ((mt = avl_traverse (info.threads, &trav)))
   {
     get_string_time (time, mt->created, REGULAR_DATETIME);
 
-    admin_write_line (req, ADMIN_SHOW_THREADS_ENTRY, "%d\tType: [%23s]\tStarted [File: %10s Line: %d] Stuck: %s Started: %s",
-                      mt->id, mt->name, mt->file, mt->line, mt->ping == 0 ? "no" : "yes", time);
+    if (mt->last_progress)
+      admin_write_line (req, ADMIN_SHOW_THREADS_ENTRY, "%d\tType: [%23s]\tStarted [File: %10s Line: %d] Stuck: %s Started: %s CPU: [%.1f%%] Loop: [avg %lld ms, max %lld ms] Progress: [%lld ms ago]%s",
+                        mt->id, mt->name, mt->file, mt->line, mt->ping == 0 ? "no" : "yes", time, mt->cpu_usage,
+                        mt->loops ? mt->loop_total / (long long int) mt->loops : 0, mt->loop_max_last, now - mt->last_progress, mt->stalled ? " STALLED" : "");
+    else
+      admin_write_line (req, ADMIN_SHOW_THREADS_ENTRY, "%d\tType: [%23s]\tStarted [File: %10s Line: %d] Stuck: %s Started: %s CPU: [%.1f%%]",
+                        mt->id, mt->name, mt->file, mt->line, mt->ping == 0 ? "no" : "yes", time, mt->cpu_usage);
 
-    listed++;
+    top[listed++] = mt;
   }
 
+  qsort (top, listed, sizeof (mythread_t *), compare_thread_cpu);
+  for (i = 0; i < listed && i < THREADS_TOP_CPU && top[i]->cpu_usage > 0; i++)
+    admin_write_line (req, ADMIN_SHOW_THREADS_TOP, "Top CPU %d: [%.1f%%] %d [%s]", i + 1, top[i]->cpu_usage, top[i]->id, top[i]->name);
+  nfree (top);
+
   internal_unlock_mutex (&info.thread_mutex);
 
   admin_write_line (req, ADMIN_SHOW_THREADS_END, "End of threads listing (%d listed)", listed);
@@ -2218,12 +2571,39 @@ show_lock_status (com_request_t *req, char *name, mutex_t *mutex)
     admin_write_line (req, ADMIN_SHOW_LOCKS_ENTRY, "Mutex: [%21s] Status: [%8s]", name, mutex->thread_id >= 0 ? "locked" : "unlocked");
 }
 
+void
+show_lock_stats (com_request_t *req)
+{
+  mutex_stats_t stats[LOCK_PROFILE_MAX];
+  int i, count = thread_mutex_get_stats (stats, LOCK_PROFILE_MAX);
+
+  if (!info.lock_profiling)
+    admin_write_line (req, ADMIN_SHOW_LOCKS_STATS, "Lock profiling is off, turn it on with \"set lock_profiling 1\"");
+
+  for (i = 0; i < count; i++) {
+    mutex_stats_t *ms = &stats[i];
+
+    if (ms->acquired == 0)
+      continue;
+    admin_write_line (req, ADMIN_SHOW_LOCKS_STATS, "Lock: [%14s] Acquired: [%lu] Contended: [%lu] (%.2f%%) Wait: [avg %.1f us, p99 < %lu us] Hold: [avg %.1f us, p99 < %lu us]",
+          ms->name, ms->acquired, ms->contended, 100.0 * ms->contended / ms->acquired,
+          ms->contended ? ms->wait_ns / 1000.0 / ms->contended : 0.0, lock_hist_percentile (ms->wait_hist, 0.99),
+          ms->hold_samples ? ms->hold_ns / 1000.0 / ms->hold_samples : 0.0, lock_hist_percentile (ms->hold_hist, 0.99));
+  }
+}
+
 int
 com_locks (com_request_t *req)
 {
   char *arg = com_arg (req);
   char command[BUFSIZE];
 
+  if ((arg != NULL) && (ntripcaster_strcmp (arg, "reset") == 0)) {
+    thread_mutex_reset_stats ();
+    admin_write_line (req, ADMIN_SHOW_LOCKS_RESET, "Lock statistics cleared");
+    return 1;
+  }
+
   if ((arg != NULL) && (splitc (command, arg, ' ') != NULL)) {
     if (ntripcaster_strncmp (command, "unlock", 6) == 0) {
       thread_force_mutex_unlock(arg);
@@ -2231,6 +2611,8 @@ com_locks (com_request_t *req)
     return 1;
   }
 
+  show_lock_stats (req);
+
 #ifdef NTRIP_NUMBER
   admin_write_line (req, ADMIN_SHOW_LOCKS_NOT_AVAIL, "Server is compiled with optimization, no mutex information available");
   return 1;
@@ -2273,6 +2655,8 @@ com_debug (com_request_t *req)
   }
 
   req->con->food.admin->debuglevel = atoi (arg);
+  if (req->con->food.admin->tailing)
+    raise_debug_level (req->con->food.admin->debuglevel);
 
   admin_write_line (req, ADMIN_SHOW_DEBUG_CHANGED_TO, "Your debugging level is now [%d]", req->con->food.admin->debuglevel);
   return 0;
@@ -2346,14 +2730,14 @@ com_auth_add (com_request_t *req, char *arg)
   else if (ntripcaster_strncmp (type, "clientmount", 11) == 0)
   {
     if (count == 2)
-      return runtime_add_mount_with_group (firstarg, arg, info.client_mountfile, get_client_mounttree());
-    return runtime_add_mount (firstarg, info.client_mountfile, get_client_mounttree());
+      return runtime_add_mount_with_group (firstarg, arg, info.client_mountfile, client_e);
+    return runtime_add_mount (firstarg, info.client_mountfile, client_e);
   }
   else if (ntripcaster_strncmp (type, "sourcemount", 11) == 0)
   {
     if (count == 2)
-      return runtime_add_mount_with_group (firstarg, arg, info.source_mountfile, get_source_mounttree());
-    return runtime_add_mount (firstarg, info.source_mountfile, get_source_mounttree());
+      return runtime_add_mount_with_group (firstarg, arg, info.source_mountfile, source_e);
+    return runtime_add_mount (firstarg, info.source_mountfile, source_e);
   }
 
   admin_write (req, ADMIN_SHOW_AUTH_INVALID_SYNTAX, AUTHSYNTAX);
@@ -2368,9 +2752,9 @@ com_auth_list (com_request_t *req, char *arg)
   else if (ntripcaster_strncmp (arg, "group", 5) == 0)
     con_display_groups (req);
   else if (ntripcaster_strncmp (arg, "clientmount", 5) == 0)
-    con_display_mounts (req, get_client_mounttree());
+    con_display_mounts (req, client_e);
   else if (ntripcaster_strncmp (arg, "sourcemount", 5) == 0)
-    con_display_mounts (req, get_source_mounttree());
+    con_display_mounts (req, source_e);
   return 1;
 }
 
@@ -2583,12 +2967,34 @@ com_runtime (com_request_t *req)
     admin_write_line (req, ADMIN_SHOW_RUNTIME_USE_CRYPT, "Using crypted passwords.");
 #endif
 #ifdef HAVE_LIBLDAP
-  if(info.ldap_server)
+  if(info.ldap_server && info.ldap_server[0]) {
+    ldap_stats_t ls;
+
+    ldap_get_stats(&ls);
     admin_write_line (req, ADMIN_SHOW_RUNTIME_HAVE_LIBLDAP, "Using LDAP for authentication.");
+    admin_write_line (req, ADMIN_SHOW_RUNTIME_HAVE_LIBLDAP, "LDAP connections busy: %d of %d, cached logins: %d",
+          ls.pool_busy, info.ldap_pool_size, ls.entries);
+    admin_write_line (req, ADMIN_SHOW_RUNTIME_HAVE_LIBLDAP, "LDAP cache hits: %lu misses: %lu refreshes: %lu failures: %lu grace logins: %lu",
+          ls.hits, ls.misses, ls.refreshes, ls.failures, ls.grace);
+  }
 #endif
 #ifdef HAVE_LIBWRAP
   admin_write_line (req, ADMIN_SHOW_RUNTIME_HAVE_LIBWRAP, "Using tcp wrapper support for incoming connections.");
 #endif
+  {
+    log_stats_t ls;
+
+    get_log_stats (&ls);
+    admin_write_line (req, ADMIN_SHOW_RUNTIME_START, "Log records written: %lu, pending: %d, written directly (queue full): %lu, dropped for admins: %lu",
+          ls.written, ls.pending, ls.overflowed, ls.dropped);
+  }
+  if (info.access_log_format != ACCESS_LOG_CSV) {
+    access_log_stats_t as;
+
+    get_access_log_stats (&as);
+    admin_write_line (req, ADMIN_SHOW_RUNTIME_START, "Binary access records written: %lu, written as CSV: %lu, segments created: %d",
+          as.written, as.failed, as.segments);
+  }
   return 1;
 }
 
@@ -72,12 +72,15 @@ int
   com_describe (), com_acl (), com_auth (), com_scheme (),
   com_runtime ();
 
+struct metrics_buf_St;
+
 void handle_admin_command(connection_t *con, char *command, int command_len);
 void show_settings(com_request_t *req);
 void setup_admin_settings();
 void setup_config_file_settings();
 int parse_config_file(char *file);
 void log_command (const char *command, const com_request_t *req);
+void write_stats_prom (struct metrics_buf_St *out);
 char *clean_string(char *string);
 void tell_admins(void *data, void *param);
 void move_to (void *clientarg, void *sourcetargetarg);
@@ -254,6 +257,7 @@ char *settings_generator (char *text, int state);
 #define ADMIN_SHOW_THREADS_START 340
 #define ADMIN_SHOW_THREADS_ENTRY 341
 #define ADMIN_SHOW_THREADS_END   342
+#define ADMIN_SHOW_THREADS_TOP   343
 
 /* com_status() */
 #define ADMIN_SHOW_STATUS_INVALID_SYNTAX 350
@@ -288,6 +292,8 @@ char *settings_generator (char *text, int state);
 /* com_locks() */
 #define ADMIN_SHOW_LOCKS_ENTRY 410
 #define ADMIN_SHOW_LOCKS_NOT_AVAIL 411
+#define ADMIN_SHOW_LOCKS_STATS 412
+#define ADMIN_SHOW_LOCKS_RESET 413
 
 /* com_debug () */
 #define ADMIN_SHOW_DEBUG_CURRENT 420
@@ -94,6 +94,7 @@
 #include "logtime.h"
 #include "restrict.h"
 #include "memory.h"
+#include "metrics.h"
 #include "http.h"
 #include "vars.h"
 #include "commands.h"
@@ -101,6 +102,105 @@
 extern server_info_t info;
 const char cnull[] = "(null)";
 
+static keepalive_stats_t keepalive_stats;
+
+/* Set by finish_request() when the connection of this thread stays open */
+static __thread connection_t *kept_connection = NULL;
+
+/* Only HTTP/1.1 GET requests without "Connection: close" may be followed
+   by another one. served counts the requests including this one. */
+static void keepalive_offer(connection_t *con, ntrip_request_t *req, int http11, int served)
+{
+  const char *var;
+
+  con->keepalive = 0;
+
+  if (!http11 || info.keepalive_requests <= 0 || con->sock <= 0)
+    return;
+  if ((req->method->protocol != http_e) || strcmp(req->method->method, "GET"))
+    return;
+  var = get_con_variable(con, "Connection");
+  if (var && strcasestr(var, "close"))
+    return;
+
+  con->keepalive = info.keepalive_requests - served;
+  if (con->keepalive <= 0) {
+    con->keepalive = 0;
+    __atomic_add_fetch(&keepalive_stats.closed_limit, 1, __ATOMIC_RELAXED);
+  }
+}
+
+/* Waits for the next request on a kept connection, closes it when none
+   comes within keepalive_timeout */
+static int keepalive_wait(connection_t *con)
+{
+  if (readable_timeo(con->sock, info.keepalive_timeout) <= 0) {
+    xa_debug(2, "DEBUG: connection %d idle for %d seconds, closing", con->id, info.keepalive_timeout);
+    __atomic_add_fetch(&keepalive_stats.closed_idle, 1, __ATOMIC_RELAXED);
+    kick_not_connected(con, NULL);
+    return 0;
+  }
+  return 1;
+}
+
+/* The request line (first line of the header) asks for HTTP/1.1 */
+static int request_is_http11(const char *header)
+{
+  const char *end = strchr(header, '\n');
+  int len = end ? (int)(end - header) : (int)strlen(header);
+
+  return (len >= 8) && (strncmp(header + len - 8, "HTTP/1.1", 8) == 0);
+}
+
+/*
+ * Called instead of kick_not_connected() after a complete, non-streaming
+ * response. Keeps the connection for handle_connection() to read the next
+ * request when the response announced keep-alive.
+ */
+void finish_request(connection_t *con, char *reason)
+{
+  if (con->keepalive <= 0 || con->sock <= 0) {
+    kick_not_connected(con, reason);
+    return;
+  }
+
+  xa_debug(2, "DEBUG: connection %d [%s] kept alive after [%s], %d more requests", con->id, con_host(con), reason, con->keepalive);
+
+  if (con->type == admin_e) {
+    free_log_queue(con->food.admin->logqueue);
+    nfree(con->food.admin);
+  }
+  con->type = unknown_connection_e;
+  con->food.admin = NULL;
+
+  free_con_variables(con);
+  if (con->group != NULL) {
+    nfree(con->group);
+    con->group = NULL;
+  }
+  con->groupactive = 0;
+  con->ghost = 0;
+
+  kept_connection = con;
+}
+
+/* The Connection header line(s) of a response, from con->keepalive */
+void keepalive_header(connection_t *con, char *buf, int size)
+{
+  if (con->keepalive > 0)
+    snprintf(buf, size, "Connection: keep-alive\r\nKeep-Alive: timeout=%d, max=%d\r\n", info.keepalive_timeout, con->keepalive);
+  else
+    snprintf(buf, size, "Connection: close\r\n");
+}
+
+void keepalive_get_stats(keepalive_stats_t *stats)
+{
+  stats->reused = __atomic_load_n(&keepalive_stats.reused, __ATOMIC_RELAXED);
+  stats->closed_idle = __atomic_load_n(&keepalive_stats.closed_idle, __ATOMIC_RELAXED);
+  stats->closed_limit = __atomic_load_n(&keepalive_stats.closed_limit, __ATOMIC_RELAXED);
+  stats->closed_peer = __atomic_load_n(&keepalive_stats.closed_peer, __ATOMIC_RELAXED);
+}
+
 /*
  * This is called to handle a brand new connection, in it's own thread.
  * Nothing is know about the type of the connection.
@@ -110,7 +210,7 @@ void *handle_connection(void *arg) {
   connection_t *con = (connection_t *)arg;
   char line[BUFSIZE];
   ntrip_request_t req;
-  int res;
+  int res, http11 = 0, served = 0;
   char time[50];
 
   thread_init();
@@ -130,54 +230,72 @@ void *handle_connection(void *arg) {
     return NULL;
   }
 
-  if(con->sock > 0)
-  {
-    sock_set_blocking(con->sock, SOCK_BLOCKNOT);
-
-    /* Fill line[] with the user header, ends with \n\n */
-    if ((res = sock_read_lines_with_timeout(con->sock, line, BUFSIZE)) <= BUFSIZE) {
-      write_log(LOG_DEFAULT, "handle_connnection(): Socket error on connection %d", con->id);
-      kick_not_connected(con, "Socket error");
+  do {
+    if (served++ > 0 && !keepalive_wait(con)) {
       thread_exit(0);
       return NULL;
     }
-  }
-  else
-  {
-    int i, pos = 0;
-    for(i = 0; i < con->udpbuffers->len; ++i)
+
+    if(con->sock > 0)
     {
-      if(con->udpbuffers->buffer[i] != '\r')
-        line[pos++] = con->udpbuffers->buffer[i];
-      line[pos] = '\0';
+      sock_set_blocking(con->sock, SOCK_BLOCKNOT);
+
+      /* Fill line[] with the user header, ends with \n\n */
+      if ((res = sock_read_lines_with_timeout(con->sock, line, BUFSIZE)) <= BUFSIZE) {
+        if (served > 1) {
+          __atomic_add_fetch(&keepalive_stats.closed_peer, 1, __ATOMIC_RELAXED);
+          kick_not_connected(con, NULL);
+        } else {
+          write_log(LOG_DEFAULT, "handle_connnection(): Socket error on connection %d", con->id);
+          kick_not_connected(con, "Socket error");
+        }
+        thread_exit(0);
+        return NULL;
+      }
+      http11 = request_is_http11(line);
     }
-    line[con->udpbuffers->len] = 0;
-  }
-/*
-  if (strncmp(line, "SOURCE ", 7) == 0) {
-    if (ntrip_read_old_source_header(con, line, &req) != 1) {
+    else
+    {
+      int i, pos = 0;
+      for(i = 0; i < con->udpbuffers->len; ++i)
+      {
+        if(con->udpbuffers->buffer[i] != '\r')
+          line[pos++] = con->udpbuffers->buffer[i];
+        line[pos] = '\0';
+      }
+      line[con->udpbuffers->len] = 0;
+    }
+    /*
+    if (strncmp(line, "SOURCE ", 7) == 0) {
+      if (ntrip_read_old_source_header(con, line, &req) != 1) {
+        ntrip_write_message(con, HTTP_BAD_REQUEST, get_formatted_time(HEADER_TIME, time));
+        kick_not_connected(con, "Invalid header");
+        thread_exit(0);
+        return NULL;
+      }
+    } else {*/
+    if (ntrip_read_header(con, line, &req) != 1) {
       ntrip_write_message(con, HTTP_BAD_REQUEST, get_formatted_time(HEADER_TIME, time));
       kick_not_connected(con, "Invalid header");
       thread_exit(0);
       return NULL;
     }
-  } else {*/
-  if (ntrip_read_header(con, line, &req) != 1) {
-    ntrip_write_message(con, HTTP_BAD_REQUEST, get_formatted_time(HEADER_TIME, time));
-    kick_not_connected(con, "Invalid header");
-    thread_exit(0);
-    return NULL;
-  }
-//  }
+    //  }
 
-  if (req.method != NULL) {
-    ((*(req.method->login_func))(con, &req));
-    thread_exit(0);
-    return NULL;
-  }
+    if (req.method == NULL) {
+      ntrip_write_message(con, HTTP_NOT_IMPLEMENTED, get_formatted_time(HEADER_TIME, time));
+      kick_not_connected(con, "Method not implemented");
+      thread_exit(0);
+      return NULL;
+    }
 
-  ntrip_write_message(con, HTTP_NOT_IMPLEMENTED, get_formatted_time(HEADER_TIME, time));
-  kick_not_connected(con, "Method not implemented");
+    if (served > 1)
+      __atomic_add_fetch(&keepalive_stats.reused, 1, __ATOMIC_RELAXED);
+    keepalive_offer(con, &req, http11, served);
+
+    kept_connection = NULL;
+    ((*(req.method->login_func))(con, &req));
+  } while (kept_connection == con);
 
   thread_exit(0);
   return NULL;
@@ -198,6 +316,7 @@ create_connection()
   con->group = NULL; // added. IMPORTANT!!!. ajd
   con->res = NULL;
   con->ghost = 0; // added. ajd
+  con->keepalive = 0;
   con->sock = -1;
   con->sinlen = 0;
 
@@ -372,51 +491,6 @@ const char *get_source_agent (connection_t *con) {
     return res;
 }
 
-void
-build_source_con_line_with_opts (connection_t *con, char *line, int *opt, int maxlen)
-{
-  char buf[BUFSIZE];
-
-  line[0] = '\0';
-  buf[0] = '\0';
-
-  /* Build the line */
-  if (opt[SOURCE_SHOW_ID])
-    catsnprintf (line, BUFSIZE, "[Id: %d] ", con->id);
-  if (opt[SOURCE_SHOW_SOCKET])
-    catsnprintf (line, BUFSIZE, "[Sock: %d] ", con->sock);
-  if (opt[SOURCE_SHOW_CTIME])
-  {
-    char ct[100];
-    get_string_time (ct, con->connect_time, REGULAR_DATETIME);
-    catsnprintf (line, BUFSIZE, "[Time of connect: %s] ", ct);
-  }
-  if (opt[SOURCE_SHOW_IP] && con->host)
-    catsnprintf (line, BUFSIZE, "[IP: %s] ", con->host);
-  if (opt[SOURCE_SHOW_HOST] && con->hostname)
-    catsnprintf (line, BUFSIZE, "[Host: %s] ", con->hostname);
-  if (opt[SOURCE_SHOW_AGENT])
-    catsnprintf (line, BUFSIZE, "[Source Agent: %s] ", get_source_agent(con));
-  if (opt[SOURCE_SHOW_STATE])
-    catsnprintf (line, BUFSIZE, "[State: %d] ", con->food.source->connected);
-  if (opt[SOURCE_SHOW_TYPE])
-    catsnprintf (line, BUFSIZE, "[Type: %s] ", source_type(con));
-  if (opt[SOURCE_SHOW_CLIENTS])
-    catsnprintf (line, BUFSIZE, "[Clients: %d] ", con->food.source->num_clients);
-  if (opt[SOURCE_SHOW_PRIO])
-    catsnprintf (line, BUFSIZE, "[Priority: %d] ", con->food.source->priority);
-  if (opt[SOURCE_SHOW_MOUNT])
-    catsnprintf (line, BUFSIZE, "[Mountpoint: %s] ", nullcheck_string (con->food.source->audiocast.mount));
-  if (opt[SOURCE_SHOW_READ])
-    catsnprintf (line, BUFSIZE, "[KBytes read: %lu] ", con->food.source->stats.read_kilos);
-  if (opt[SOURCE_SHOW_WRITTEN])
-    catsnprintf (line, BUFSIZE, "[KBytes written: %lu] ", con->food.source->stats.write_kilos);
-  if (opt[SOURCE_SHOW_CONNECTS])
-    catsnprintf (line, BUFSIZE, "[Client connections: %lu] ", con->food.source->stats.client_connections);
-  if (opt[SOURCE_SHOW_TIME])
-    catsnprintf (line, BUFSIZE, "[Connected for: %s] ", nntripcaster_time (get_time() - con->connect_time, buf));
-}
-
 connection_t *get_nontrip_connection() { // nontrip.
   int sockfd;
   socklen_t sin_len;
@@ -521,6 +595,7 @@ void *handle_nontrip_connection(void *arg) { // nontrip. ajd
     snprintf(slash, BUFSIZE, "/%s", con->nontripsrc->mount);
     source->audiocast.mount = my_strdup(slash);
   }
+  add_global_stats(source);
 
   thread_mutex_lock(&info.source_mutex);
 
@@ -538,6 +613,7 @@ void *handle_nontrip_connection(void *arg) { // nontrip. ajd
 
   add_source();
   avl_insert(info.sources, con);
+  metrics_source_attached (source->metrics);
 
   thread_mutex_unlock(&info.source_mutex);
 
@@ -39,14 +39,24 @@
 #ifndef __NTRIPCASTER_CONNECTION_H
 #define __NTRIPCASTER_CONNECTION_H
 
+/* Fate of HTTP/1.1 connections offered keep-alive */
+typedef struct keepalive_stats_St {
+  unsigned long int reused;       /* requests after the first on a connection */
+  unsigned long int closed_idle;  /* no request within keepalive_timeout */
+  unsigned long int closed_limit; /* keepalive_requests reached */
+  unsigned long int closed_peer;  /* closed by the client */
+} keepalive_stats_t;
+
 void *handle_connection(void *data);
+void finish_request(connection_t *con, char *reason);
+void keepalive_header(connection_t *con, char *buf, int size);
+void keepalive_get_stats(keepalive_stats_t *stats);
 connection_t *get_connection(int *sock);
 connection_t *create_connection();
 void describe_connection (const com_request_t *req, const connection_t *describecon);
 const char *get_user_agent (connection_t *con);
 const char *get_source_agent (connection_t *con);
 void build_con_line_with_opts (connection_t *con, char *line, int *opt, int maxlen);
-void build_source_con_line_with_opts (connection_t *con, char *line, int *opt, int maxlen);
 
 /* nontrip. ajd */
 connection_t *get_nontrip_connection();
@@ -0,0 +1,231 @@
+/* filtercache.c
+ * - cache of compiled sourcetable filters and their results
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <stdlib.h>
+
+#include "avl.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "sourcetable.h"
+#include "match.h"
+#include "utility.h"
+#include "log.h"
+#include "memory.h"
+#include "filtercache.h"
+
+extern server_info_t info;
+
+/*
+ * Filters of /?filter and /?match requests are normalized and kept
+ * compiled in a table of at most filter_cache_size entries, the least
+ * recently used one is dropped first. Each entry also keeps the lines it
+ * matched for one sourcetable version, so repeated requests against an
+ * unchanged sourcetable are answered without scanning it.
+ */
+static mutex_t filter_cache_mutex;
+static hash_table_t *filter_cache = NULL;
+static filter_cache_entry_t *lru_head = NULL, *lru_tail = NULL;
+static filter_cache_stats_t filter_stats;
+
+static void free_filter_cache_entry(filter_cache_entry_t *e) {
+  dispose_compiled_filter(e->filter);
+  sourcetable_release(e->result);
+  nfree(e->key);
+  nfree(e);
+}
+
+static void lru_unlink(filter_cache_entry_t *e) {
+  if (e->prev) e->prev->next = e->next;
+  else lru_head = e->next;
+  if (e->next) e->next->prev = e->prev;
+  else lru_tail = e->prev;
+  e->prev = e->next = NULL;
+}
+
+static void lru_push(filter_cache_entry_t *e) {
+  e->prev = NULL;
+  e->next = lru_head;
+  if (lru_head) lru_head->prev = e;
+  lru_head = e;
+  if (!lru_tail) lru_tail = e;
+}
+
+/* must have filter_cache_mutex. */
+static void evict_entries(int keep) {
+  filter_cache_entry_t *e;
+
+  while ((filter_stats.entries > keep) && ((e = lru_tail) != NULL)) {
+    lru_unlink(e);
+    hash_remove(filter_cache, e->key);
+    e->cached = 0;
+    filter_stats.entries--;
+    filter_stats.evictions++;
+    if (e->refcount == 0) free_filter_cache_entry(e);
+  }
+}
+
+/* Leading blanks of a field and trailing empty fields do not change the
+ * parsed filter, drop them so equal filters share one entry. */
+static char *normalize_filter(const char *filter, int matchonly) {
+  char *key = nmalloc(strlen(filter) + 2);
+  char *p = key;
+  int fieldstart = 1;
+
+  *p++ = matchonly ? 'm' : 'f';
+  for (; *filter; filter++) {
+    if (fieldstart && (*filter == ' ')) continue;
+    fieldstart = (*filter == ';');
+    *p++ = *filter;
+  }
+  while ((p > key + 1) && (p[-1] == ';')) p--;
+  *p = '\0';
+
+  return key;
+}
+
+void filtercache_init(void) {
+  thread_create_mutex(&filter_cache_mutex);
+  thread_mutex_profile(&filter_cache_mutex, "filter cache");
+  filter_cache = hash_create(64);
+  memset(&filter_stats, 0, sizeof(filter_stats));
+}
+
+/* Only at shutdown, when the other threads are gone */
+void filtercache_cleanup(void) {
+  thread_mutex_lock(&filter_cache_mutex);
+  evict_entries(0);
+  hash_destroy(filter_cache, NULL);
+  filter_cache = NULL;
+  thread_mutex_unlock(&filter_cache_mutex);
+  thread_mutex_destroy(&filter_cache_mutex);
+}
+
+/* Compiled filter for a request, release with filtercache_release(). */
+filter_cache_entry_t *filtercache_get(const char *filter, int matchonly) {
+  filter_cache_entry_t *e;
+  char *key = normalize_filter(filter, matchonly);
+
+  thread_mutex_lock(&filter_cache_mutex);
+
+  e = hash_find(filter_cache, key);
+  if (e != NULL) {
+    filter_stats.hits++;
+    lru_unlink(e);
+    lru_push(e);
+    e->refcount++;
+    thread_mutex_unlock(&filter_cache_mutex);
+    nfree(key);
+    return e;
+  }
+
+  filter_stats.misses++;
+  e = nmalloc(sizeof(filter_cache_entry_t));
+  e->key = key;
+  e->filter = compile_filter(key + 1, matchonly);
+  e->result = NULL;
+  e->refcount = 1;
+  e->cached = 0;
+  e->prev = e->next = NULL;
+
+  if (info.filter_cache_size > 0) {
+    evict_entries(info.filter_cache_size - 1);
+    hash_replace(filter_cache, e->key, e);
+    lru_push(e);
+    e->cached = 1;
+    filter_stats.entries++;
+  }
+
+  thread_mutex_unlock(&filter_cache_mutex);
+
+  xa_debug (2, "DEBUG: filtercache_get: compiled [%s]", key + 1);
+
+  return e;
+}
+
+void filtercache_release(filter_cache_entry_t *e) {
+  thread_mutex_lock(&filter_cache_mutex);
+  e->refcount--;
+  if ((e->refcount == 0) && !e->cached) free_filter_cache_entry(e);
+  thread_mutex_unlock(&filter_cache_mutex);
+}
+
+/* Referenced result of e for the sourcetable version, or NULL. */
+sourcetable_render_t *filtercache_get_result(filter_cache_entry_t *e, unsigned long int version) {
+  sourcetable_render_t *r = NULL;
+
+  thread_mutex_lock(&filter_cache_mutex);
+  if ((e->result != NULL) && (e->result->version == version)) {
+    r = e->result;
+    __atomic_add_fetch(&r->refcount, 1, __ATOMIC_SEQ_CST);
+    filter_stats.result_hits++;
+  }
+  thread_mutex_unlock(&filter_cache_mutex);
+
+  return r;
+}
+
+/* Keep r as the result of e unless a newer one is already there. */
+void filtercache_set_result(filter_cache_entry_t *e, sourcetable_render_t *r) {
+  thread_mutex_lock(&filter_cache_mutex);
+  if ((e->result == NULL) || (e->result->version < r->version)) {
+    sourcetable_release(e->result);
+    __atomic_add_fetch(&r->refcount, 1, __ATOMIC_SEQ_CST);
+    e->result = r;
+  }
+  thread_mutex_unlock(&filter_cache_mutex);
+}
+
+void filtercache_get_stats(filter_cache_stats_t *stats) {
+  thread_mutex_lock(&filter_cache_mutex);
+  *stats = filter_stats;
+  thread_mutex_unlock(&filter_cache_mutex);
+}
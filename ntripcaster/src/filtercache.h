@@ -0,0 +1,66 @@
+/* filtercache.h
+ * - cache of compiled sourcetable filters, function headers
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_FILTERCACHE_H
+#define NTRIPCASTER_FILTERCACHE_H
+
+typedef struct filter_cache_entry_St {
+  char *key;                     /* 'f' or 'm' followed by the normalized filter */
+  struct compiled_filter_St *filter; /* see match.h */
+  sourcetable_render_t *result;  /* matching lines at result->version */
+  int refcount;                  /* requests using the entry */
+  int cached;                    /* still in the table */
+  struct filter_cache_entry_St *prev, *next; /* LRU list, most recent first */
+} filter_cache_entry_t;
+
+typedef struct filter_cache_stats_St {
+  unsigned long int hits;       /* filter found compiled */
+  unsigned long int misses;     /* filter had to be parsed */
+  unsigned long int result_hits; /* result of the current sourcetable version found */
+  unsigned long int evictions;
+  int entries;
+} filter_cache_stats_t;
+
+void filtercache_init(void);
+void filtercache_cleanup(void);
+filter_cache_entry_t *filtercache_get(const char *filter, int matchonly);
+void filtercache_release(filter_cache_entry_t *e);
+sourcetable_render_t *filtercache_get_result(filter_cache_entry_t *e, unsigned long int version);
+void filtercache_set_result(filter_cache_entry_t *e, sourcetable_render_t *r);
+void filtercache_get_stats(filter_cache_stats_t *stats);
+#endif
@@ -99,7 +99,8 @@
 #include "match.h"
 #include "vars.h"
 #include "authenticate/basic.h"
-#include "http.h"
+#include "template.h"
+#include "metrics.h"
 
 #include "authenticate/user.h"
 #include "authenticate/group.h"
@@ -182,27 +183,13 @@ http_link_t http_links[] =
   { "/admin?mode=listeners", "listeners", " | " },
   { "/admin?mode=sources", "sources", " | " },
   { "/admin?mode=connections", "connections", " | " },
-  { "/admin?mode=admins", "admins", " || " },
+  { "/admin?mode=admins", "admins", " | " },
+  { "/admin?mode=locks", "locks", " || " },
 //  { "/admin?mode=auth", "authentication", " | " },
   { "/admin?mode=set", "settings", "" },
   { (char *) NULL, (char *) NULL }
 };
 
-/* Functions to call for the server-parsed language */
-const char * http_foreach ();
-const char * http_include ();
-htf http_even (), http_odd();
-
-
-http_parsable_t http_parsables[] =
-{
-  { "FOREACH", http_foreach },
-  { "INCLUDE", http_include },
-  { "EVEN", http_even },
-  { "ODD", http_odd },
-  { (char *) NULL, (HttpFunction *) NULL}
-};
-
 void
 write_http_code_page (connection_t *con, int code, const char *msg)
 {
@@ -264,18 +251,6 @@ write_401 (connection_t *con, char *realm)
 }
 
 
-http_parsable_t *
-find_http_element (char *name, http_parsable_t *el)
-{
-  register int i;
-  for (i = 0; el[i].name; i++)
-    {
-      if (ntripcaster_strncmp (name, el[i].name, ntripcaster_strlen (el[i].name)) == 0)
-        return (&el[i]);
-    }
-  return ((http_parsable_t *)NULL);
-}
-
 const http_variable_t *
 find_http_variable (const char *name, const http_variable_t *el)
 {
@@ -406,6 +381,58 @@ url_encode (const char *str, char **result_p)
   return result;
 }
 
+/*
+ * Sends the response collected since sock_capture_start() with a
+ * Content-Length and the Connection header for con->keepalive, so the
+ * connection can be used for another request.
+ */
+static void
+http_send_captured (connection_t *con)
+{
+  char *buf, *out, *line, *eol, *body;
+  int len, bodylen, outlen = 0;
+
+  buf = sock_capture_stop (&len);
+  if (buf == NULL)
+    return;
+
+  body = strstr (buf, "\r\n\r\n");
+  if (body == NULL)
+  {
+    con->keepalive = 0;
+    if (len > 0)
+      sock_write_bytes (con->sock, buf, len);
+    nfree (buf);
+    return;
+  }
+  body += 4;
+  bodylen = len - (body - buf);
+
+  out = (char *) nmalloc (len + BUFSIZE);
+
+  /* the header lines, except the ones replaced below */
+  for (line = buf; line < body - 2; line = eol + 2)
+  {
+    eol = strstr (line, "\r\n");
+    if (strncasecmp (line, "Connection:", 11) && strncasecmp (line, "Content-Length:", 15))
+    {
+      memcpy (out + outlen, line, eol - line + 2);
+      outlen += eol - line + 2;
+    }
+  }
+
+  keepalive_header (con, out + outlen, BUFSIZE / 2);
+  outlen += strlen (out + outlen);
+  outlen += snprintf (out + outlen, BUFSIZE / 2, "Content-Length: %d\r\n\r\n", bodylen);
+  memcpy (out + outlen, body, bodylen);
+  outlen += bodylen;
+
+  sock_write_bytes (con->sock, out, outlen);
+
+  nfree (out);
+  nfree (buf);
+}
+
 int http_admin_command (connection_t *con, ntrip_request_t *req)
 {
   if (!req || !req->path[0])
@@ -435,12 +462,67 @@ int http_admin_command (connection_t *con, ntrip_request_t *req)
   {
     thread_rename ("HTTP Admin Thread");
     put_http_admin (con);
+    sock_capture_start (con->sock);
     display_admin_page (con, req);
+    http_send_captured (con);
     return 1;
   }
   return 0;
 }
 
+/*
+ * GET /metrics, the statistics of "stats prom" for Prometheus, with the
+ * access rules and credentials of the admin pages.
+ */
+int
+http_metrics (connection_t *con, ntrip_request_t *req)
+{
+  ntrip_request_t checkreq;
+  metrics_buf_t *out;
+  char header[METRICS_HEADER_SPACE];
+  int len;
+
+#ifdef HAVE_LIBWRAP
+  if (!sock_check_libwrap (con->sock, admin_e))
+  {
+    write_http_code_page (con, 403, "Forbidden");
+    return 0;
+  }
+#endif
+  if (!allowed (con, admin_e) || !info.allow_http_admin)
+  {
+    write_http_code_page (con, 403, "Forbidden");
+    return 0;
+  }
+
+  zero_request (&checkreq);
+  strncpy (checkreq.path, "/admin", BUFSIZE);
+
+  if (need_authentication (&checkreq, client_e) && !authenticate_user_request (con, &checkreq, client_e))
+  {
+    write_401 (con, checkreq.path);
+    return 0;
+  }
+
+  thread_rename ("HTTP Metrics Thread");
+
+  out = metrics_buf_acquire ();
+  write_stats_prom (out);
+
+  /* the header goes right before the metrics, for a single write */
+  len = format_http_header (header, sizeof (header), 200, "OK");
+  len += snprintf (header + len, sizeof (header) - len, "Content-Type: text/plain; version=0.0.4\r\n");
+  keepalive_header (con, header + len, sizeof (header) - len);
+  len += strlen (header + len);
+  len += snprintf (header + len, sizeof (header) - len, "Content-Length: %d\r\n\r\n", out->len - METRICS_HEADER_SPACE);
+
+  memcpy (out->data + METRICS_HEADER_SPACE - len, header, len);
+  sock_write_bytes (con->sock, out->data + METRICS_HEADER_SPACE - len, out->len - METRICS_HEADER_SPACE + len);
+
+  metrics_buf_release (out);
+  return 1;
+}
+
 void
 display_admin_page (connection_t *con, ntrip_request_t *req)
 {
@@ -536,7 +618,7 @@ display_admin_page (connection_t *con, ntrip_request_t *req)
   else
     strncpy(checkreq.path, "/admin", BUFSIZE);
 
-  if (info.allow_http_admin == 0 || (need_authentication (&checkreq, get_client_mounttree()) != NULL)) {
+  if (info.allow_http_admin == 0 || (need_authentication (&checkreq, client_e))) {
     if (info.allow_http_admin == 0 || !authenticate_user_request (con, &checkreq, client_e))
     {
       write_401 (con, checkreq.path);
@@ -643,87 +725,37 @@ display_generic_admin_page (connection_t *con)
   }
 }
 
-void
-write_http_header(sock_t sockfd, int error, const char *msg)
+/* The status line and common header lines, returns their length */
+int
+format_http_header (char *buf, int size, int error, const char *msg)
 {
-  sock_write_line (sockfd, "HTTP/1.1 %i %s", error, msg);
-  sock_write_line (sockfd, "Ntrip-Version: Ntrip/%s", NTRIP_VERSION);
-  sock_write_line (sockfd, "Access-Control-Allow-Origin: *");
+  int len;
+
+  len = snprintf (buf, size, "HTTP/1.1 %i %s\r\nNtrip-Version: Ntrip/%s\r\nAccess-Control-Allow-Origin: *\r\n",
+      error, msg, NTRIP_VERSION);
   /* Hide Server Version */
-  if (info.hide_version) {
-    sock_write_line (sockfd, "Server: NTRIP Caster");
-  } else {
-    sock_write_line (sockfd, "Server: NTRIP Caster/%s", VERSION);
-  }
+  if (info.hide_version)
+    len += snprintf (buf + len, size - len, "Server: NTRIP Caster\r\n");
+  else
+    len += snprintf (buf + len, size - len, "Server: NTRIP Caster/%s\r\n", VERSION);
+
+  return len;
 }
 
-int
-print_http_variable (vartree_t *request_vars, const char *name, connection_t *clicon, int fd)
+void
+write_http_header(sock_t sockfd, int error, const char *msg)
 {
-  const char *out = get_variable (request_vars, name);
-
-  if (out)
-  {
-    if (fd < 0)
-      sock_write (clicon->sock, "%s", out);
-    else
-      fd_write (fd, out);
+  char buf[BUFSIZE];
 
-    return 1;
-  } else {
-    const http_variable_t *var = find_http_variable (name, http_variables);
-    if (!var)
-      return 0;
-    if (var->type == integer_e)
-    {
-      if (fd < 0)
-        sock_write (clicon->sock, "%d", *(int *)var->valueptr);
-      else
-        fd_write (fd, "%d", *(int *)var->valueptr);
-    }
-    else if (var->type == real_e)
-    {
-      if (fd < 0)
-        sock_write (clicon->sock, "%d", (int)*(double *)var->valueptr);
-      else
-        fd_write (fd, "%f", *(double *)var->valueptr);
-    }
-    else if (var->type == function_e)
-    {
-      /* Nice.. isn't it? ;) */
-      char *ptr = (char *)((*((HttpFunction *) (var->valueptr))) ());
-      if (fd < 0)
-        sock_write (clicon->sock, "%s", ptr);
-      else
-        fd_write (fd, "%s", ptr);
-      nfree (ptr);
-    }
-    else
-    {
-      char *ptr;
-      if (!var->valueptr)
-        ptr = "(null)";
-      else
-        ptr = *(char **)var->valueptr;
-
-      if (fd < 0)
-        sock_write (clicon->sock, "%s", ptr);
-      else
-        fd_write (fd, "%s", ptr);
-    }
-    return 1;
-  }
+  format_http_header (buf, sizeof (buf), error, msg);
+  sock_write_string (sockfd, buf);
 }
 
 int
 write_template_parsed_html_page (connection_t *clicon, connection_t *sourcecon, const char *template_file, int fd,
          vartree_t *variables)
 {
-  int len, ffd = open_for_reading (template_file);
-  struct stat st;
-  char *fileptr = NULL;
-  const char *res;
-  int count = 0, readlen = 0;
+  int res;
 
   xa_debug (2, "DEBUG: wtphp(): Entering function with file=%s fd=%d", template_file, fd);
 
@@ -734,491 +766,12 @@ write_template_parsed_html_page (connection_t *clicon, connection_t *sourcecon,
     sock_write_line (clicon->sock, "Content-Type: text/html\r\n");
   }
 
-  if (ffd < 0)
-  {
-    xa_debug (1, "ERROR: Cannot open file [%s]", template_file);
-    if (fd < 0)
-      sock_write_line (clicon->sock, "ERROR: Cannot open file [%s]", template_file);
-    return 0;
-  }
-
-  if (fstat (ffd, &st) == -1)
-  {
-    xa_debug (1, "ERROR: Cannot stat file [%s]", template_file);
-    if (fd < 0)
-      sock_write_line (clicon->sock, "ERROR: Cannot stat file [%s]", template_file);
-    return 0;
-  }
-
-  xa_debug (3, "DEBUG: wtphp(): Parsing page %s", template_file);
-
-  /* Don't use nmalloc here, we want our own error handling */
-  fileptr = (char *) malloc (st.st_size + 2);
-  if (fileptr == NULL)
-  {
-    if (fd < 0)
-      sock_write_line (clicon->sock, "ERROR: Cannot allocate enough memory, try again later");
-    return 0;
-  }
-
-  count = readlen = 0;
-  while (count < st.st_size) {
-    len = min(2048, st.st_size - count);
-    readlen = read(ffd, &fileptr[count], len);
-    if (readlen > 0) {
-      count += readlen;
-    } else {
-      xa_debug (1, "Read error while parsing %s", template_file);
-
-      free (fileptr);
-
-      return 0;
-    }
-  }
+  res = template_render_file (clicon, template_file, fd, variables);
 
-  fileptr[count] = '\0';
+  if (variables)
+    free_variables (variables);
 
-  if (!variables)
-    variables = avl_create (compare_vars, &info);
-
-  xa_debug (3, "DEBUG: wtphp(): Done reading template file into memory, read %d bytes, starting parsing", count);
-
-  res = parse_template_file (clicon, sourcecon, fileptr, fd, variables);
-
-  xa_debug (3, "DEBUG: wtphp(): Done parsing, freeing variables and saying goodbye");
-
-  if (fileptr != NULL)
-    free (fileptr);
-
-  fd_close (ffd);
-  free_variables (variables);
-
-  return res ? 1 : 0;
-}
-
-/*
- * This is rather ugly.. but it will have to do for now
- */
-const char *
-parse_template_file (connection_t *clicon, connection_t *sourcecon, const char *ptr, int fd, vartree_t *variables)
-{
-  const char *start = ptr;
-  char line[BUFSIZE];
-  const char *tmpptr, *nextptr;
-
-  http_parsable_t *ht;
-
-  xa_debug (6, "DEBUG: parsing template file starting at [%s], fd: %d", ptr, fd);
-
-  while (ptr && *ptr)
-  {
-    if (ptr[0] == '@')
-    {
-      memset (line, 0, BUFSIZE);
-      if ((nextptr = strchr (ptr + 1, '@')))
-      {
-        if (nextptr - ptr < BUFSIZE)
-          memcpy (line, ptr + 1, nextptr - (ptr + 1));
-        else
-        {
-          if (fd < 0)
-            sock_write_bytes (clicon->sock, ptr, 1);
-          else
-            fd_write_bytes (fd, ptr, 1);
-          ptr++;
-          continue;
-        }
-
-        ht = find_http_element (line, http_parsables);
-
-        if (ht)
-        {
-          xa_debug (4, "DEBUG: parse_template_file(): Calling function for [%s]", line);
-          tmpptr = ((*(ht->func)) (line, clicon, sourcecon, nextptr + 1, fd, variables));
-
-          if (tmpptr)
-          {
-            ptr = tmpptr;
-          }
-          else
-            {
-              ptr = nextptr + 1;
-            }
-        }
-        else if (print_http_variable (variables, line, clicon, fd))
-        {
-          xa_debug (4, "DEBUG: parse_template_file(): Evaluated variable [%s]", line);
-          ptr = nextptr + 1;
-        }
-        else if (ntripcaster_strncmp (line, "ENDFOR", 6) == 0)
-        {
-          xa_debug (4, "DEBUG: parse_tempate_file(): Returning from For-loop [%s:%s]", line, nextptr + 1);
-          return nextptr + 1;
-        } else { /* @something but we should output it asis */
-          if (fd < 0)
-            sock_write (clicon->sock, "@%s@", line);
-          else
-            fd_write (fd, "@%s@", line);
-          ptr = nextptr + 1;
-        }
-      }
-      else /* @something with no ending @ */
-      {
-        if (fd < 0)
-          sock_write_bytes (clicon->sock, ptr, 1);
-        else
-          fd_write_bytes (fd, ptr, 1);
-        ptr++;
-      }
-    }
-    else /* Any other character */
-    {
-      if (fd < 0)
-        sock_write_bytes (clicon->sock, ptr, 1);
-      else
-        fd_write_bytes (fd, ptr, 1);
-      ptr++;
-    }
-  }
-  return start;
-}
-
-const char *
-http_odd (char *command, connection_t *clicon, connection_t *sourcecon,
-const char *ptr, int fd, vartree_t *variables)
-{
-  const void *varptr;
-  char endat[BUFSIZE];
-  const char *nextline;
-
-  if (!command || !clicon || !ptr || !variables)
-  {
-    xa_debug (1, "ERROR: http_odd() called with NULL arguments");
-    return NULL;
-  }
-
-  splitc (NULL, command, ' ');
-
-  varptr = get_http_variable (variables, command);
-
-  if (!varptr)
-  {
-    xa_debug (3, "ERROR: http_odd() called with invalid counter variable");
-    if (fd < 0)
-      sock_write_line (clicon->sock, "No such variable [%s]", command);
-    else
-      fd_write_line (fd, "No such variable [%s]", command);
-    return NULL;
-  }
-
-  snprintf(endat, BUFSIZE, "@ENDFOR %s@", command);
-
-  nextline = strchr (ptr, '\n');
-
-  xa_debug (3, "DEBUG: http_odd(): Checking %d", atoi ((char *)varptr));
-
-  if (nextline && atoi ((char *)varptr) % 2 != 0)
-  {
-    parse_template_file (clicon, sourcecon, ptr, fd, variables);
-    return skip_before (ptr, endat);
-  }
-
-  if (nextline)
-  {
-    nextline = strchr (nextline + 1, '\n');
-  }
-  return nextline ? nextline + 1 : NULL;
-}
-
-const char *
-http_even (char *command, connection_t *clicon, connection_t *sourcecon, const char *ptr, int fd, vartree_t *variables)
-{
-  const void *varptr;
-  char endat[BUFSIZE];
-  const char *nextline;
-
-  if (!command || !clicon || !ptr || !variables)
-  {
-    xa_debug (1, "ERROR: http_even() called with NULL arguments");
-    return NULL;
-  }
-
-  splitc (NULL, command, ' ');
-
-  varptr = get_http_variable (variables, command);
-
-  if (!varptr)
-  {
-    xa_debug (3, "ERROR: http_even() called with invalid counter variable");
-    if (fd < 0)
-      sock_write_line (clicon->sock, "No such variable [%s]", command);
-    else
-      fd_write_line (fd, "No such variable [%s]", command);
-    return NULL;
-  }
-
-  snprintf(endat, BUFSIZE, "@ENDFOR %s@", command);
-
-  nextline = strchr (ptr, '\n');
-
-  xa_debug (3, "DEBUG: http_even(): Checking %d", atoi ((char *)varptr));
-
-  if (nextline && (atoi ((char *)varptr) % 2 == 0))
-  {
-    parse_template_file (clicon, sourcecon, ptr, fd, variables);
-    return skip_before (ptr, endat);
-  }
-
-  if (nextline)
-    {
-      nextline = strchr (nextline + 1, '\n');
-    }
-  return nextline ? nextline + 1 : NULL;
-}
-
-const char *
-http_include (char *command, connection_t *clicon, connection_t *sourcecon, const char *ptr, int fd, vartree_t *variables)
-{
-  int ffd, len;
-  struct stat st;
-  char *fileptr;
-  char filename[BUFSIZE];
-  int count = 0, readlen = 0;
-
-  splitc (NULL, command, ' ');
-
-  if (get_ntripcaster_file (command, template_file_e, R_OK, filename) == NULL)
-  {
-    xa_debug (1, "ERROR: Cannot find template file [%s]", command);
-    if (fd < 0)
-      sock_write_line (clicon->sock, "ERROR: Cannot find template file %s", command);
-    else
-      fd_write_line (fd, "ERROR: Cannot find template file %s", command);
-    return NULL;
-  }
-
-  xa_debug (5, "DEBUG: http_include(): including file [%s]", command);
-  ffd = open_for_reading (filename);
-
-  if (ffd < 0)
-    {
-      xa_debug (1, "ERROR: Cannot open file [%s]", filename);
-      if (fd < 0)
-        sock_write_line (clicon->sock, "ERROR: Cannot open file [%s]", filename);
-      else
-        fd_write_line (fd, "ERROR: Cannot open file [%s]", filename);
-      return NULL;
-    }
-
-  if (fstat (ffd, &st) == -1)
-    {
-      xa_debug (1, "ERROR: Cannot stat file [%s]", filename);
-      if (fd < 0)
-        sock_write_line (clicon->sock, "ERROR: Cannot stat file [%s]", filename);
-      else
-        fd_write_line (fd, "ERROR: Cannot stat file [%s]", filename);
-      return NULL;
-    }
-
-  /* Don't use nmalloc here, we want our own error handling */
-  fileptr = (char *) malloc (st.st_size + 2);
-  if (fileptr == NULL)
-  {
-    if (fd < 0)
-      sock_write_line (clicon->sock, "ERROR: Cannot allocate enough memory, try again later");
-    else
-      fd_write_line (fd, "ERROR: Cannot allocate enough memory, try again later");
-    return NULL;
-  }
-
-  count = readlen = 0;
-  while (count < st.st_size)
-  {
-    len = min (2048, st.st_size - count);
-    readlen = read (ffd, &fileptr[count], len);
-    if (readlen >= 0)
-      count += readlen;
-    else if (!is_recoverable (errno))
-    {
-      xa_debug (1, "Read error while parsing %s", filename);
-
-      free (fileptr);
-
-      return NULL;
-    }
-  }
-
-  fileptr[count] = '\0';
-
-  parse_template_file (clicon, sourcecon, fileptr, fd, variables);
-
-  if (fileptr != NULL)
-    free (fileptr);
-
-  fd_close (ffd);
-
-  return NULL;
-}
-
-/* FOREACH ident SOURCES|LISTENERS|ADMINS */
-const char *
-http_foreach (char *command, connection_t *clicon, connection_t *sourcecon, const char *ptr, int fd, vartree_t *variables)
-{
-  char ident[BUFSIZE];
-
-  if (splitc (NULL, command, ' ') == NULL)
-    return NULL;
-
-  if (splitc (ident, command, ' ') == NULL)
-    return NULL;
-
-  xa_debug (6, "DEBUG: http_foreach: called with [%s] [%s]", command, ptr);
-
-  if (ntripcaster_strcasecmp (command, "SOURCES") == 0)
-    return http_loop_sources (ident, clicon, ptr, fd, variables);
-  else if (ntripcaster_strcasecmp (command, "LISTENERS") == 0)
-    return http_loop_listeners (ident, clicon, ptr, fd, variables);
-  else if (ntripcaster_strcasecmp (command, "ADMINS") == 0)
-    return http_loop_admins (ident, clicon, ptr, fd, variables);
-  else {
-    xa_debug (1, "WARNING: Unknown Traverse type for FOREACH [%s]", command);
-    if (fd < 0)
-      sock_write (clicon->sock, "Unknown Traverse type [%s]", command);
-    else
-      fd_write (fd, "Unknown Traverse type [%s]", command);
-    return NULL;
-  }
-}
-
-const char *
-http_loop_sources (char *ident, connection_t *clicon, const char *ptr, int fd, vartree_t *variables)
-{
-  const char *runptr = ptr, *endptr = NULL;
-  char buf[BUFSIZE];
-  int i = 0;
-  connection_t *travcon;
-
-  avl_traverser trav = {0};
-
-  xa_debug (3, "DEBUG: http_loop_sources(): Traversing sources");
-
-  if (info.num_sources <= 0)
-    {
-      xa_debug (3, "DEBUG: http_loop_sources(): Empty tree");
-      if (fd < 0)
-        sock_write (clicon->sock, "No sources available<br>");
-      else
-        fd_write (fd, "No sources available<br>");
-      snprintf(buf, BUFSIZE, "@ENDFOR %s@", ident);
-      return skip_after (ptr, buf);
-    }
-
-  thread_mutex_lock (&info.source_mutex);
-
-  while ((travcon = avl_traverse (info.sources, &trav)))
-    {
-      xa_debug (3, "DEBUG: http_loop_sources(): Running for source [%s]", con_host (travcon));
-      runptr = ptr;
-
-      add_varpair2 (variables, nstrdup (ident), ntripcaster_itoa (i));
-      add_varpair2 (variables, ntripcaster_cat (ident, ".host"), nstrdup (con_host (travcon)));
-      add_varpair2 (variables, ntripcaster_cat (ident, ".clients"), ntripcaster_utoa (travcon->food.source->num_clients));
-      add_varpair2 (variables, ntripcaster_cat (ident, ".mount"), nstrdup (travcon->food.source->audiocast.mount));
-      add_varpair2 (variables, ntripcaster_cat (ident, ".connecttime"), nstrdup (nntripcaster_time (get_time() - travcon->connect_time, buf)));
-      endptr = parse_template_file (clicon, NULL, runptr, fd, variables);
-      i++;
-
-    }
-
-  thread_mutex_unlock (&info.source_mutex);
-
-  return endptr;
-}
-
-const char *
-http_loop_admins (char *ident, connection_t *clicon, const char *ptr, int fd, vartree_t *variables)
-{
-  const char *runptr = ptr, *endptr = NULL;
-  char buf[BUFSIZE];
-  int i = 0;
-  connection_t *travcon;
-
-  avl_traverser trav = {0};
-
-  xa_debug (3, "DEBUG: http_loop_admins(): Traversing admins");
-
-  if (info.num_admins <= 0)
-    {
-      xa_debug (3, "DEBUG: http_loop_admins(): Empty tree");
-      if (fd < 0)
-        sock_write (clicon->sock, "No admins available<br>");
-      else
-        fd_write (fd, "No admins available<br>");
-      snprintf(buf, BUFSIZE, "@ENDFOR %s@", ident);
-      return skip_after (ptr, buf);
-    }
-
-  thread_mutex_lock (&info.admin_mutex);
-
-  while ((travcon = avl_traverse (info.admins, &trav)))
-  {
-    xa_debug (3, "DEBUG: http_loop_admins(): Running for admins [%s]", con_host (travcon));
-    runptr = ptr;
-
-    add_varpair2 (variables, nstrdup (ident), ntripcaster_itoa (i));
-    add_varpair2 (variables, ntripcaster_cat (ident, ".host"), nstrdup (con_host (travcon)));
-    add_varpair2 (variables, ntripcaster_cat (ident, ".connecttime"), nstrdup (nntripcaster_time (get_time() - travcon->connect_time, buf)));
-    endptr = parse_template_file (clicon, NULL, runptr, fd, variables);
-    i++;
-
-  }
-
-  thread_mutex_unlock (&info.admin_mutex);
-
-  return endptr;
-
-}
-
-const char *
-http_loop_listeners (char *ident, connection_t *clicon, const char *ptr, int fd, vartree_t *variables)
-{
-  const char *runptr = ptr, *endptr = NULL;
-  char buf[BUFSIZE];
-  int i = 0;
-  connection_t *travclients;
-
-  avl_traverser travc = {0};
-
-  xa_debug (3, "DEBUG: http_loop_listeners(): Traversing clients");
-
-  if (info.num_clients <= 0)
-    {
-      xa_debug (3, "DEBUG: http_loop_listeners(): Empty tree");
-      if (fd < 0)
-        sock_write (clicon->sock, "No listeners available<br>");
-      else
-        fd_write (fd, "No listeners available<br>");
-      snprintf(buf, BUFSIZE, "@ENDFOR %s@", ident);
-      return skip_after (ptr, buf);
-    }
-
-  thread_mutex_lock (&info.client_mutex);
-
-  while ((travclients = avl_traverse (info.clients, &travc)))
-  {
-    add_varpair2 (variables, nstrdup (ident), ntripcaster_itoa (i));
-    add_varpair2 (variables, ntripcaster_cat (ident, ".id"), ntripcaster_itoa (travclients->id));
-    add_varpair2 (variables, ntripcaster_cat (ident, ".host"), nstrdup (con_host (travclients)));
-    add_varpair2 (variables, ntripcaster_cat (ident, ".user_agent"), nstrdup (get_user_agent (travclients)));
-    add_varpair2 (variables, ntripcaster_cat (ident, ".writebytes"), ntripcaster_utoa (travclients->food.client->write_bytes));
-    add_varpair2 (variables, ntripcaster_cat (ident, ".connecttime"), nstrdup (nntripcaster_time (get_time() - travclients->connect_time, buf)));
-    endptr = parse_template_file (clicon, NULL, runptr, fd, variables);
-    i++;
-  }
-
-  thread_mutex_unlock (&info.client_mutex);
-
-  return endptr;
+  return res;
 }
 
 char *
@@ -1247,22 +800,6 @@ ntripcaster_starttime ()
   return nstrdup(ptr);
 }
 
-const void *
-get_http_variable (vartree_t *request_vars, const char *name)
-{
-  const char *out = get_variable (request_vars, name);
-
-  if (out)
-    return out;
-  else
-    {
-      const http_variable_t *var = find_http_variable (name, http_variables);
-      if (!var)
-  return NULL;
-      return var->valueptr;
-    }
-}
-
 void
 write_didnt_find_html_page (connection_t *con, char *file)
 {
@@ -62,22 +62,19 @@ typedef struct
 } http_link_t;
 
 int http_admin_command (connection_t *con, ntrip_request_t *req);
+int http_metrics (connection_t *con, ntrip_request_t *req);
 void display_admin_page (connection_t *con, ntrip_request_t *req);
 void http_display_home_page (connection_t *con);
 void http_get_robots (connection_t *con);
+int format_http_header (char *buf, int size, int error, const char *msg);
 void write_http_header (sock_t sockfd, int error, const char *msg);
-http_parsable_t *find_http_element (char *name, http_parsable_t *el);
-int print_http_variable (vartree_t *request_vars, const char *name, connection_t *clicon, int fd);
 char *url_encode(const char *string, char **result_p);
 char *url_decode (const char *string);
-const char *parse_template_file (connection_t *clicon, connection_t *sourcecon, const char *ptr, int fd, vartree_t *variables);
 int write_template_parsed_html_page (connection_t *clicon, connection_t *sourcecon, const char *template_file, int fd, vartree_t *variables);
-const char *http_loop_sources (char *ident, connection_t *clicon, const char *ptr, int fd, vartree_t *variables);
-const char *http_loop_admins (char *ident, connection_t *clicon, const char *ptr, int fd, vartree_t *variables);
-const char *http_loop_listeners (char *ident, connection_t *clicon, const char *ptr, int fd, vartree_t *variables);
 char *ntripcaster_uptime ();
 char *ntripcaster_starttime ();
-const void *get_http_variable (vartree_t *request_vars, const char *name);
+const http_variable_t *find_http_variable (const char *name, const http_variable_t *el);
+extern http_variable_t http_variables[];
 void write_http_code_page (connection_t *con, int code, const char *msg);
 void write_http_ban (connection_t *con);
 void write_401 (connection_t *con, char *realm);
@@ -0,0 +1,159 @@
+/* latency.c
+ * - Log-linear latency histograms
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <stdlib.h>
+
+#include "avl.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "utility.h"
+#include "log.h"
+#include "logtime.h"
+#include "memory.h"
+#include "latency.h"
+
+extern server_info_t info;
+
+/*
+ * Like HdrHistogram the values below LATENCY_SUB_BUCKETS microseconds get
+ * a bucket each, above that every power of two is split into
+ * LATENCY_SUB_BUCKETS buckets, so a bucket is at most 25% wide. Several
+ * threads may record into one histogram, the counters are added atomically.
+ */
+static int latency_bucket(unsigned long long int us)
+{
+  int msb, shift, i;
+
+  if (us < LATENCY_SUB_BUCKETS)
+    return (int)us;
+
+  msb = 63 - __builtin_clzll(us);
+  shift = msb - LATENCY_SUB_BITS;
+  i = (shift + 1) * LATENCY_SUB_BUCKETS + (int)((us >> shift) - LATENCY_SUB_BUCKETS);
+
+  return i < LATENCY_BUCKETS ? i : LATENCY_BUCKETS - 1;
+}
+
+/* First microsecond value above bucket i */
+unsigned long long int latency_bucket_limit(int i)
+{
+  int shift;
+
+  if (i < LATENCY_SUB_BUCKETS)
+    return i + 1;
+
+  shift = i / LATENCY_SUB_BUCKETS - 1;
+  return (unsigned long long int)(LATENCY_SUB_BUCKETS + i % LATENCY_SUB_BUCKETS + 1) << shift;
+}
+
+void latency_record(latency_hist_t *h, long long int us)
+{
+  if (us < 0)
+    us = 0;
+
+  __atomic_fetch_add(&h->buckets[latency_bucket(us)], 1, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->sum_us, us, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&h->count, 1, __ATOMIC_RELAXED);
+  if ((unsigned long long int)us > __atomic_load_n(&h->max_us, __ATOMIC_RELAXED))
+    __atomic_store_n(&h->max_us, us, __ATOMIC_RELAXED);
+}
+
+void latency_copy(latency_hist_t *to, const latency_hist_t *from)
+{
+  int i;
+
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    to->buckets[i] = __atomic_load_n(&from->buckets[i], __ATOMIC_RELAXED);
+  to->sum_us = __atomic_load_n(&from->sum_us, __ATOMIC_RELAXED);
+  to->max_us = __atomic_load_n(&from->max_us, __ATOMIC_RELAXED);
+
+  /* the buckets are the truth, count may run ahead of them */
+  to->count = 0;
+  for (i = 0; i < LATENCY_BUCKETS; i++)
+    to->count += to->buckets[i];
+}
+
+/* Upper bound in microseconds of the p-th fraction of the values */
+unsigned long long int latency_percentile(const latency_hist_t *h, double p)
+{
+  unsigned long int seen = 0, target;
+  int i;
+
+  if (h->count == 0)
+    return 0;
+
+  target = (unsigned long int)(h->count * p);
+  if (target < 1)
+    target = 1;
+
+  for (i = 0; i < LATENCY_BUCKETS - 1; i++) {
+    seen += h->buckets[i];
+    if (seen >= target)
+      break;
+  }
+
+  if (i == LATENCY_BUCKETS - 1 || latency_bucket_limit(i) > h->max_us)
+    return h->max_us;
+  return latency_bucket_limit(i);
+}
+
+/* Number of values below us, counting whole buckets only */
+unsigned long int latency_count_below(const latency_hist_t *h, unsigned long long int us)
+{
+  unsigned long int n = 0;
+  int i;
+
+  for (i = 0; i < LATENCY_BUCKETS - 1 && latency_bucket_limit(i) <= us; i++)
+    n += h->buckets[i];
+  return n;
+}
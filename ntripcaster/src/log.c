@@ -68,6 +68,15 @@
 #endif
 
 #include <fcntl.h>
+#include <sys/stat.h>
+#ifdef HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#else
+struct iovec {
+  void *iov_base;
+  size_t iov_len;
+};
+#endif
 
 #include "avl.h"
 #include "threads.h"
@@ -89,24 +98,461 @@
 #include "connection.h"
 #include "authenticate/basic.h"
 #include "authenticate/user.h"
+#include "accesslog.h"
 
 
 extern int errno, running;
 extern server_info_t info;
 
-/* logs client accesses. */
+int debuglevel_max = 0;
+
+/*
+ * While the log writer thread runs, write_log(), xa_debug() and
+ * write_clf() only format the line and put it into log_ring. The writer
+ * thread writes the lines in batches to the log files and the console,
+ * and queues them for the tailing admins, whose own threads send them.
+ * So no thread waits for the disk or for an admin connection while
+ * logging.
+ */
+#define LOG_RING_SIZE 4096 /* power of 2 */
+#define LOG_BATCH 256
+#define LOG_ADMIN_QUEUE 512
+#define LOG_WRITER_IDLE 1000000 /* us the writer waits without a wakeup */
+#define LOG_EVERY_ADMIN ((unsigned long) -1)
+
+typedef struct logRecordSt {
+  int whichlog;
+  int level;       /* debug level admins need to get it, 0 for all */
+  int to_file;
+  int to_console;  /* 1 without, 2 with the thread */
+  unsigned long not_admin; /* admin connection not to send it to, or LOG_EVERY_ADMIN */
+  int timelen;     /* length of "[time]" at the start of text */
+  int msg;         /* offset of the message in text */
+  int len;
+  char text[1];
+} log_record_t;
+
+typedef struct logSlotSt {
+  unsigned long seq;
+  log_record_t *rec;
+} log_slot_t;
+
+/* Bounded multi producer, single consumer ring, see log_ring_put() */
+static log_slot_t log_ring[LOG_RING_SIZE];
+static unsigned long log_ring_head = 0;
+static unsigned long log_ring_tail = 0;
+static int log_writer_running = 0;
+static int log_writer_waiting = 0;
+static int log_producers = 0; /* in log_submit() right now */
+static wakeup_t log_writer_wakeup;
+static log_stats_t log_stats = {0, 0, 0, 0};
+
+static void log_ring_init() {
+  unsigned long i;
+
+  for (i = 0; i < LOG_RING_SIZE; i++)
+    log_ring[i].seq = i;
+}
+
+/*
+ * A slot is free for the producer at position pos when its sequence is
+ * pos, and filled for the consumer when it is pos + 1.
+ * 0 if the ring is full.
+ */
+static int log_ring_put(log_record_t *rec) {
+  unsigned long pos = __atomic_load_n(&log_ring_head, __ATOMIC_RELAXED);
+  log_slot_t *slot;
+  long diff;
+
+  for (;;) {
+    slot = &log_ring[pos & (LOG_RING_SIZE - 1)];
+    diff = (long)(__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) - pos);
+    if (diff == 0) {
+      if (__atomic_compare_exchange_n(&log_ring_head, &pos, pos + 1, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        break;
+    } else if (diff < 0)
+      return 0;
+    else
+      pos = __atomic_load_n(&log_ring_head, __ATOMIC_RELAXED);
+  }
+
+  slot->rec = rec;
+  __atomic_store_n(&slot->seq, pos + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/* Only the log writer thread */
+static log_record_t *log_ring_get() {
+  log_slot_t *slot = &log_ring[log_ring_tail & (LOG_RING_SIZE - 1)];
+  log_record_t *rec;
+
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_ring_tail + 1)
+    return NULL;
+
+  rec = slot->rec;
+  __atomic_store_n(&slot->seq, log_ring_tail + LOG_RING_SIZE, __ATOMIC_RELEASE);
+  log_ring_tail++;
+  return rec;
+}
+
+/*
+ * Hand a formatted line to the log writer thread. Without logtime the
+ * line is written as it is. 0 if the thread does not run, the caller
+ * has to write it itself then.
+ */
+static int log_submit(int whichlog, int level, int to_file, int to_console, unsigned long not_admin,
+    const char *logtime, mythread_t *mt, const char *buf) {
+  log_record_t *rec;
+  char prefix[200];
+  int plen = 0, blen;
+
+  /* counted first, so the writer can wait for us when it stops */
+  __atomic_add_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
+  if (!__atomic_load_n(&log_writer_running, __ATOMIC_SEQ_CST) || !is_server_running()) {
+    __atomic_sub_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
+    return 0;
+  }
+
+  if (logtime && mt)
+    plen = snprintf(prefix, sizeof(prefix), "[%s] [%ld:%s] ", logtime, mt->id, nullcheck_string(mt->name));
+  else if (logtime)
+    plen = snprintf(prefix, sizeof(prefix), "[%s] ", logtime);
+  if (plen >= (int)sizeof(prefix))
+    plen = sizeof(prefix) - 1;
+
+  blen = strlen(buf);
+  rec = (log_record_t *)nmalloc(sizeof(log_record_t) + plen + blen + 1);
+  rec->whichlog = whichlog;
+  rec->level = level;
+  rec->to_file = to_file;
+  rec->to_console = to_console;
+  rec->not_admin = not_admin;
+  rec->timelen = logtime ? strlen(logtime) + 2 : 0;
+  rec->msg = plen;
+  rec->len = plen + blen + 1;
+  memcpy(rec->text, prefix, plen);
+  memcpy(rec->text + plen, buf, blen);
+  rec->text[plen + blen] = '\n';
+  rec->text[rec->len] = '\0';
+
+  if (!log_ring_put(rec)) {
+    /* the writer is behind, keep the file complete and skip the rest */
+    if (to_file) {
+      thread_mutex_lock(&info.logfile_mutex);
+      if (get_log_fd(whichlog) > -1)
+        fd_write_bytes(get_log_fd(whichlog), rec->text, rec->len);
+      thread_mutex_unlock(&info.logfile_mutex);
+    }
+    __atomic_add_fetch(&log_stats.overflowed, 1, __ATOMIC_RELAXED);
+    nfree(rec);
+  } else {
+    /* pairs with the check of the ring in log_writer_wait() */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&log_writer_waiting, __ATOMIC_RELAXED))
+      thread_wakeup(&log_writer_wakeup);
+  }
+
+  __atomic_sub_fetch(&log_producers, 1, __ATOMIC_SEQ_CST);
+  return 1;
+}
+
+static void write_log_iov(int fd, struct iovec *iov, int cnt) {
+#if defined(HAVE_SYS_UIO_H) && defined(HAVE_WRITEV)
+  ssize_t done, total = 0;
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    total += iov[i].iov_len;
+
+  done = writev(fd, iov, cnt);
+  if (done == total || done < 0)
+    return;
+
+  /* short write, write what is left line by line */
+  for (i = 0; i < cnt; i++) {
+    if (done >= (ssize_t)iov[i].iov_len) {
+      done -= iov[i].iov_len;
+      continue;
+    }
+    fd_write_bytes(fd, (char *)iov[i].iov_base + done, iov[i].iov_len - done);
+    done = 0;
+  }
+#else
+  int i;
+
+  for (i = 0; i < cnt; i++)
+    fd_write_bytes(fd, iov[i].iov_base, iov[i].iov_len);
+#endif
+}
+
+static void write_log_records_to_files(log_record_t **recs, int n) {
+  struct iovec iov[LOG_BATCH];
+  int whichlog, cnt, fd, i;
+
+  for (whichlog = LOG_DEFAULT; whichlog <= LOG_ACCESS; whichlog++) {
+    for (i = 0, cnt = 0; i < n; i++) {
+      if (recs[i]->to_file && recs[i]->whichlog == whichlog) {
+        iov[cnt].iov_base = recs[i]->text;
+        iov[cnt].iov_len = recs[i]->len;
+        cnt++;
+      }
+    }
+    if (cnt == 0)
+      continue;
+
+    thread_mutex_lock(&info.logfile_mutex);
+    fd = get_log_fd(whichlog);
+    if (fd > -1)
+      write_log_iov(fd, iov, cnt);
+    thread_mutex_unlock(&info.logfile_mutex);
+  }
+}
+
+log_queue_t *create_log_queue() {
+  log_queue_t *q = (log_queue_t *)nmalloc(sizeof(log_queue_t));
+
+  q->size = LOG_ADMIN_QUEUE;
+  q->lines = (char **)nmalloc(q->size * sizeof(char *));
+  q->first = q->count = 0;
+  q->dropped = 0;
+  thread_create_mutex(&q->mutex);
+  return q;
+}
+
+static void queue_log_line(log_queue_t *q, log_record_t *rec) {
+  char *line;
+  int msglen = rec->len - rec->msg - 1;
+
+  thread_mutex_lock(&q->mutex);
+
+  if (q->count == q->size) {
+    q->dropped++;
+    thread_mutex_unlock(&q->mutex);
+    __atomic_add_fetch(&log_stats.dropped, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  /* "[time] message\r\n->" */
+  line = (char *)nmalloc(rec->timelen + msglen + 7);
+  memcpy(line, rec->text, rec->timelen);
+  line[rec->timelen] = ' ';
+  memcpy(line + rec->timelen + 1, rec->text + rec->msg, msglen);
+  strcpy(line + rec->timelen + 1 + msglen, rec->level ? "\r\n-> " : "\r\n->");
+
+  q->lines[(q->first + q->count) % q->size] = line;
+  q->count++;
+
+  thread_mutex_unlock(&q->mutex);
+}
+
+/*
+ * Send the queued log lines of an admin. Only called by the thread of
+ * the admin, which is the only one writing to its socket, so the lines
+ * never get mixed with the output of its commands.
+ * 0 if the connection broke.
+ */
+int flush_log_queue(connection_t *con) {
+  log_queue_t *q = con->food.admin->logqueue;
+  char *line;
+  int ok = 1;
+
+  while (q) {
+    thread_mutex_lock(&q->mutex);
+    if (q->count == 0) {
+      thread_mutex_unlock(&q->mutex);
+      break;
+    }
+    line = q->lines[q->first];
+    q->first = (q->first + 1) % q->size;
+    q->count--;
+    thread_mutex_unlock(&q->mutex);
+
+    if (ok && sock_write_string(con->sock, line) != 1) {
+      /* the read of the admin thread will notice */
+      ok = 0;
+    }
+    if (!ok) {
+      q->dropped++;
+      __atomic_add_fetch(&log_stats.dropped, 1, __ATOMIC_RELAXED);
+    }
+    nfree(line);
+  }
+
+  return ok;
+}
+
+void free_log_queue(log_queue_t *q) {
+  if (!q)
+    return;
+
+  while (q->count > 0) {
+    nfree(q->lines[q->first]);
+    q->first = (q->first + 1) % q->size;
+    q->count--;
+  }
+  thread_mutex_destroy(&q->mutex);
+  nfree(q->lines);
+  nfree(q);
+}
+
+static void write_log_records_to_admins(log_record_t **recs, int n) {
+  avl_traverser trav = {0};
+  connection_t *con;
+  admin_t *admin;
+  log_record_t *rec;
+  int i;
+
+  thread_mutex_lock(&info.admin_mutex);
+
+  while ((con = avl_traverse(info.admins, &trav)) != NULL) {
+    admin = (admin_t *)con->food.admin;
+    if (con->type != admin_e || !admin->alive)
+      continue;
+
+    for (i = 0; admin->tailing && i < n; i++) {
+      rec = recs[i];
+      if (rec->whichlog != LOG_DEFAULT || rec->level > admin->debuglevel || rec->not_admin == con->id)
+        continue;
+
+      if (ntripcaster_strcmp(con->host, "NtripCaster console") == 0) {
+        if (rec->level)
+          printf("%.*s\n-> ", rec->len - 1, rec->text);
+        else
+          printf("%.*s %.*s\n-> ", rec->timelen, rec->text, rec->len - rec->msg - 1, rec->text + rec->msg);
+        fflush(stdout);
+      } else if (admin->logqueue)
+        queue_log_line(admin->logqueue, rec);
+    }
+  }
+
+  thread_mutex_unlock(&info.admin_mutex);
+}
+
+static void write_log_records(log_record_t **recs, int n) {
+  int i;
+
+  if (n > 0)
+    write_log_records_to_files(recs, n);
+
+  for (i = 0; i < n; i++) {
+    if (recs[i]->to_console == 2)
+      printf("\r%s", recs[i]->text);
+    else if (recs[i]->to_console == 1)
+      printf("\r%.*s %s", recs[i]->timelen, recs[i]->text, recs[i]->text + recs[i]->msg);
+  }
+  if (n > 0)
+    fflush(stdout);
+
+  if (n > 0 && info.admins)
+    write_log_records_to_admins(recs, n);
+
+  for (i = 0; i < n; i++) {
+    nfree(recs[i]);
+  }
+
+  __atomic_add_fetch(&log_stats.written, n, __ATOMIC_RELAXED);
+}
+
+static int get_log_records(log_record_t **recs) {
+  int n = 0;
+
+  while (n < LOG_BATCH && (recs[n] = log_ring_get()) != NULL)
+    n++;
+  return n;
+}
+
+/* Wait until log_submit() puts a record into the empty ring */
+static void log_writer_wait(mythread_t *mt) {
+  log_slot_t *slot = &log_ring[log_ring_tail & (LOG_RING_SIZE - 1)];
+
+  __atomic_store_n(&log_writer_waiting, 1, __ATOMIC_SEQ_CST);
+  /* pairs with the fence in log_submit(), one of us sees the other */
+  __atomic_thread_fence(__ATOMIC_SEQ_CST);
+  if (__atomic_load_n(&slot->seq, __ATOMIC_ACQUIRE) != log_ring_tail + 1)
+    thread_wait_wakeup(mt, &log_writer_wakeup, LOG_WRITER_IDLE);
+  __atomic_store_n(&log_writer_waiting, 0, __ATOMIC_RELAXED);
+}
+
+void *
+startup_log_writer_thread (void *arg)
+{
+  log_record_t *recs[LOG_BATCH];
+  mythread_t *mt;
+  int n;
+
+  (void) arg;
+
+  thread_init ();
+
+  mt = thread_get_mythread ();
+
+  log_ring_init ();
+  thread_create_wakeup (&log_writer_wakeup);
+  __atomic_store_n (&log_writer_running, 1, __ATOMIC_SEQ_CST);
+
+  while (thread_alive (mt)) {
+    n = get_log_records (recs);
+    write_log_records (recs, n);
+
+    if (n < LOG_BATCH)
+      log_writer_wait (mt);
+    else
+      thread_progress (mt);
+  }
+
+  __atomic_store_n (&log_writer_running, 0, __ATOMIC_SEQ_CST);
+
+  /* producers which saw the writer running may still put records,
+     later ones write directly. Drain once all of them are through. */
+  while (__atomic_load_n (&log_producers, __ATOMIC_SEQ_CST) > 0)
+    my_sleep (1000);
+  while ((n = get_log_records (recs)) > 0)
+    write_log_records (recs, n);
+
+  thread_exit (0);
+  return NULL;
+}
+
 void
-write_clf (connection_t *clicon, source_t *source) {
-  char *mount;
+get_log_stats (log_stats_t *ls)
+{
+  ls->written = __atomic_load_n (&log_stats.written, __ATOMIC_RELAXED);
+  ls->overflowed = __atomic_load_n (&log_stats.overflowed, __ATOMIC_RELAXED);
+  ls->dropped = __atomic_load_n (&log_stats.dropped, __ATOMIC_RELAXED);
+  ls->pending = (int)(__atomic_load_n (&log_ring_head, __ATOMIC_RELAXED) - __atomic_load_n (&log_ring_tail, __ATOMIC_RELAXED));
+}
 
+static void
+write_clf_line (connection_t *clicon, ntripcaster_user_t *user, const char *mount, const char *uaptr) {
   char time[100];
   char date[100];
-  const char *uaptr;
-  ntripcaster_user_t *user;
+  char line[BUFSIZE];
+
+  if (info.accessfile == -1) {
+    write_log(LOG_DEFAULT, "WARNING: Could not write access file (invalid file descriptor)");
+    return;
+  }
 
   get_regular_time(time);
   get_regular_date(date);
 
+  snprintf (line, BUFSIZE, "%s,%s,%s,%s,%s,%s,%d,%lu", date, time, (user != NULL)?nullcheck_string(user->name):"(null)", clicon->host ? clicon->host : "?", mount ? mount : "n/a", uaptr ? uaptr : "?", (int)(get_time () - clicon->connect_time), clicon->food.client->write_bytes);
+  if (!log_submit (LOG_ACCESS, 0, 1, 0, LOG_EVERY_ADMIN, NULL, NULL, line)) {
+    thread_mutex_lock(&info.logfile_mutex);
+    fd_write_line (info.accessfile, "%s", line);
+    thread_mutex_unlock(&info.logfile_mutex);
+  }
+}
+
+/* logs client accesses. A binary record which could not be written
+   falls back to the CSV line. */
+void
+write_clf (connection_t *clicon, source_t *source, const char *reason) {
+  char *mount;
+  const char *uaptr;
+  ntripcaster_user_t *user;
+  int written = 0;
+
   if (!clicon) {
     write_log(LOG_DEFAULT, "WARNING: Could not write access file (client connection NULL)");
     return;
@@ -114,22 +560,17 @@ write_clf (connection_t *clicon, source_t *source) {
 
   if (clicon->ghost == 1) return; // no logging.
 
-  if (info.accessfile == -1) {
-    write_log(LOG_DEFAULT, "WARNING: Could not write access file (invalid file descriptor)");
-    return;
-  }
-
   user = con_get_user (clicon);
 
-  mount = (source && source->audiocast.mount) ? source->audiocast.mount+1 : "n/a";
+  mount = (source && source->audiocast.mount) ? source->audiocast.mount+1 : NULL;
 
   uaptr = get_user_agent (clicon);
 
-  if (info.accessfile > -1) {
-    thread_mutex_lock(&info.logfile_mutex);
-    fd_write_line (info.accessfile, "%s,%s,%s,%s,%s,%s,%d,%lu", date, time, (user != NULL)?nullcheck_string(user->name):"(null)", clicon->host ? clicon->host : "?", mount, uaptr ? uaptr : "?", get_time () - clicon->connect_time, clicon->food.client->write_bytes);
-    thread_mutex_unlock(&info.logfile_mutex);
-  }
+  if (info.access_log_format != ACCESS_LOG_CSV)
+    written = write_access_record (clicon, (user != NULL) ? user->name : NULL, mount, uaptr, reason);
+
+  if (!written || (info.access_log_format == ACCESS_LOG_BOTH))
+    write_clf_line (clicon, user, mount, uaptr);
 
   if (user != NULL) {
     nfree(user->name);
@@ -176,6 +617,12 @@ write_log (int whichlog, char *fmt, ...)
     return;
   }
 
+  if (log_submit (whichlog, 0, mt && (fd > -1), (whichlog == LOG_DEFAULT && info.console_mode == CONSOLE_LOG) ? 1 : 0,
+        LOG_EVERY_ADMIN, logtime, mt, buf)) {
+    va_end (ap);
+    return;
+  }
+
   if (mt && (fd > -1)) {
     int retval;
     thread_mutex_lock(&info.logfile_mutex);
@@ -317,6 +764,12 @@ write_log_not_me (int whichlog, connection_t *nothim, char *fmt, ...)
     return;
   }
 
+  if (log_submit (whichlog, 0, fd != -1, (whichlog == LOG_DEFAULT && info.console_mode == CONSOLE_LOG) ? 1 : 0,
+        nothim->id, logtime, NULL, buf)) {
+    va_end (ap);
+    return;
+  }
+
   if (fd != -1) {
     thread_mutex_lock(&info.logfile_mutex);
     fd_write (fd, "[%s] %s\n", logtime, buf);
@@ -361,8 +814,47 @@ write_log_not_me (int whichlog, connection_t *nothim, char *fmt, ...)
   va_end (ap);
 }
 
+/*
+ * Recalculate debuglevel_max from the logfile, the console and the
+ * tailing admins. Called regularly by the timer thread, which is how the
+ * level goes down again.
+ */
 void
-xa_debug (int level, char *fmt, ...)
+update_debug_level ()
+{
+  avl_traverser trav = {0};
+  connection_t *con;
+  admin_t *admin;
+  int level;
+
+  level = info.logfiledebuglevel > info.consoledebuglevel ? info.logfiledebuglevel : info.consoledebuglevel;
+
+  if (info.admins) {
+    thread_mutex_lock (&info.admin_mutex);
+    while ((con = avl_traverse (info.admins, &trav)) != NULL) {
+      admin = (admin_t *)con->food.admin;
+      if (con->type == admin_e && admin->tailing && admin->alive && admin->debuglevel > level)
+        level = admin->debuglevel;
+    }
+    thread_mutex_unlock (&info.admin_mutex);
+  }
+
+  __atomic_store_n (&debuglevel_max, level, __ATOMIC_RELAXED);
+}
+
+/* Make level visible right away, without waiting for the timer thread */
+void
+raise_debug_level (int level)
+{
+  int old = __atomic_load_n (&debuglevel_max, __ATOMIC_RELAXED);
+
+  while (old < level && !__atomic_compare_exchange_n (&debuglevel_max, &old, level, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+    ;
+}
+
+/* Use xa_debug(), which checks the level before formatting anything */
+void
+xa_debug_c (int level, char *fmt, ...)
 {
   char buf[BUFSIZE];
   va_list ap;
@@ -396,6 +888,11 @@ xa_debug (int level, char *fmt, ...)
     return;
   }
 
+  if (log_submit (LOG_DEFAULT, level, info.logfiledebuglevel >= level && info.logfile != -1,
+        (info.consoledebuglevel >= level && info.console_mode == CONSOLE_LOG) ? 2 : 0, LOG_EVERY_ADMIN, logtime, mt, buf)) {
+    va_end (ap);
+    return;
+  }
 
   if (info.logfiledebuglevel >= level) {
     if (info.logfile != -1) {
@@ -477,6 +974,8 @@ void open_log_files() {
 #endif
 
   thread_mutex_unlock(&info.logfile_mutex);
+
+  open_access_segment();
 }
 
 /* Opens the ntripcaster server logfiles. If it fails, let the user know, but let
@@ -520,6 +1019,9 @@ fd_write_bytes (int fd, const char *buff, const int len)
     return -1;
   }
 
+  if (sock_capture (fd, buff, len))
+    return len;
+
   return write (fd, buff, len);
 }
 
@@ -544,6 +1046,9 @@ fd_write (int fd, const char *fmt, ...)
   vsnprintf(buff, BUFSIZE, fmt, ap);
   va_end (ap);
 
+  if (sock_capture (fd, buff, ntripcaster_strlen (buff)))
+    return 1;
+
   if (fd == 1 || fd == 0) {
     if (is_server_running() && ((info.console_mode == CONSOLE_ADMIN) || (info.console_mode == CONSOLE_ADMIN_TAIL))) {
       fprintf(stdout, "%s", buff);
@@ -616,6 +1121,102 @@ fd_read_line (int fd, char *buff, const int len)
   return ((pos > 0) || (c == '\n')) ? 1 : 0;
 }
 
+/* Read a whole file into memory, to read it with loaded_file_read_line()
+   instead of one read() per byte with fd_read_line(). The file is copied
+   rather than mapped, so rewriting it meanwhile can't hurt the caster. */
+loaded_file_t *
+load_file (const char *filename)
+{
+  loaded_file_t *lf;
+  struct stat st;
+  size_t alloc;
+  int fd, read_bytes;
+
+  if ((fd = open_for_reading (filename)) == -1)
+    return NULL;
+
+  if (fstat (fd, &st) == -1) {
+    xa_debug (1, "DEBUG: fstat error on %s [%d]", filename, errno);
+    fd_close (fd);
+    return NULL;
+  }
+
+  lf = (loaded_file_t *) nmalloc (sizeof (loaded_file_t));
+  lf->size = 0;
+  lf->pos = 0;
+
+  /* the file may grow while it is read */
+  alloc = st.st_size > 0 ? (size_t) st.st_size + 1 : BUFSIZE;
+  lf->data = (char *) nmalloc (alloc);
+  while ((read_bytes = read (fd, lf->data + lf->size, alloc - lf->size)) > 0) {
+    lf->size += read_bytes;
+    if (lf->size == alloc) {
+      char *data = (char *) nmalloc (alloc * 2);
+
+      memcpy (data, lf->data, lf->size);
+      nfree (lf->data);
+      lf->data = data;
+      alloc *= 2;
+    }
+  }
+
+  fd_close (fd);
+
+  return lf;
+}
+
+/* Same as fd_read_line(), but on a loaded file */
+int
+loaded_file_read_line (loaded_file_t *lf, char *buff, const int len)
+{
+  const char *start, *end;
+  size_t linelen, i;
+  int pos = 0;
+
+  if (!buff) {
+    xa_debug (1, "ERROR: loaded_file_read_line () called with NULL storage pointer");
+    return 0;
+  } else if (len <= 0) {
+    xa_debug (1, "ERROR: loaded_file_read_line () called with invalid length");
+    return 0;
+  }
+
+  buff[len-1] = ' ';
+  buff[0] = '\0';
+
+  if (!lf || lf->pos >= lf->size)
+    return 0;
+
+  start = lf->data + lf->pos;
+  end = memchr (start, '\n', lf->size - lf->pos);
+  linelen = end ? (size_t)(end - start) : lf->size - lf->pos;
+  lf->pos += end ? linelen + 1 : linelen;
+
+  for (i = 0; i < linelen; i++) {
+    if (start[i] == '\r')
+      continue;
+    if (pos >= len - 1) {
+      buff[len-1] = '\0';
+      xa_debug(1, "ERROR: read line too long (exceeding BUFSIZE)");
+      return 0;
+    }
+    buff[pos++] = start[i];
+  }
+  buff[pos] = '\0';
+
+  return ((pos > 0) || end) ? 1 : 0;
+}
+
+void
+unload_file (loaded_file_t *lf)
+{
+  if (!lf)
+    return;
+
+  nfree (lf->data);
+  nfree (lf);
+}
+
 int
 fd_read_line_nb (int fd, char *buff, const int len)
 {
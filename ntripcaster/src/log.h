@@ -40,8 +40,29 @@
 #define __NTRIPCASTER_LOG_H
 
 void write_log(int whichlog, char *fmt, ...);
-void write_clf (connection_t *clicon, source_t *source);
-void xa_debug (int level, char *fmt, ...);
+void write_clf (connection_t *clicon, source_t *source, const char *reason);
+void xa_debug_c (int level, char *fmt, ...);
+void update_debug_level ();
+void *startup_log_writer_thread (void *arg);
+log_queue_t *create_log_queue ();
+int flush_log_queue (connection_t *con);
+void free_log_queue (log_queue_t *q);
+void get_log_stats (log_stats_t *ls);
+void raise_debug_level (int level);
+
+/* Highest debug level anybody listens to */
+extern int debuglevel_max;
+
+/* Arguments are not even evaluated when nobody listens to level */
+#ifdef NTRIP_NUMBER
+#define xa_debug(level, ...) do { } while (0)
+#else
+#define xa_debug(level, ...) \
+  do { \
+    if (__atomic_load_n (&debuglevel_max, __ATOMIC_RELAXED) >= (level)) \
+      xa_debug_c ((level), __VA_ARGS__); \
+  } while (0)
+#endif
 void my_perror(char *where);
 void stats_write(server_info_t *info);
 void clear_logfile(char *logfilename);
@@ -51,6 +72,9 @@ void open_log_files ();
 int fd_write (int fd, const char *fmt, ...);
 int fd_read_line (int fd, char *buff, const int len);
 int fd_read_line_nb (int fd, char *buff, const int len);
+loaded_file_t *load_file (const char *filename);
+int loaded_file_read_line (loaded_file_t *lf, char *buff, const int len);
+void unload_file (loaded_file_t *lf);
 int fd_close (int fd);
 int fd_write_line (int fd, const char *fmt, ...);
 int fd_write_bytes (int fd, const char *buff, const int len);
@@ -0,0 +1,290 @@
+/* loginlimit.c
+ * - Rate limiting of failed logins per host and per user on a host
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <time.h>
+#include <stdlib.h>
+
+#include "avl.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "utility.h"
+#include "log.h"
+#include "logtime.h"
+#include "memory.h"
+#include "loginlimit.h"
+
+extern server_info_t info;
+
+/*
+ * Every host and every user name on a host has a bucket of
+ * login_failures_host or login_failures_user tokens. A failed login takes
+ * one, one comes back every login_failure_interval seconds. An empty
+ * bucket blocks the host or the user on that host for login_block_time
+ * seconds. The users are kept per host so a few failures from other hosts
+ * can't lock a user out, a user name guessed from many hosts still runs
+ * dry its own larger bucket of login_failures_name tokens. Entries with a
+ * full bucket are dropped by the periodic sweep of their shard.
+ */
+#define LOGIN_LIMIT_SHARD_BITS 4
+#define LOGIN_LIMIT_SHARDS (1 << LOGIN_LIMIT_SHARD_BITS)
+#define LOGIN_LIMIT_SWEEP 60
+
+typedef struct loginLimitSt {
+  char *key;
+  double tokens;
+  time_t last;
+  time_t blocked_until;
+} login_limit_t;
+
+typedef struct loginLimitShardSt {
+  mutex_t mutex;
+  hash_table_t *entries;
+  time_t lastsweep;
+} login_limit_shard_t;
+
+static login_limit_shard_t host_limits[LOGIN_LIMIT_SHARDS];
+static login_limit_shard_t user_limits[LOGIN_LIMIT_SHARDS];
+static login_limit_shard_t name_limits[LOGIN_LIMIT_SHARDS];
+
+static void free_login_limit(login_limit_t *ll) {
+  nfree(ll->key);
+  nfree(ll);
+}
+
+static void init_shards(login_limit_shard_t *shards) {
+  int i;
+
+  for (i = 0; i < LOGIN_LIMIT_SHARDS; i++) {
+    thread_create_mutex(&shards[i].mutex);
+    shards[i].entries = hash_create(256);
+    shards[i].lastsweep = get_time();
+  }
+}
+
+static void cleanup_shards(login_limit_shard_t *shards) {
+  int i;
+
+  for (i = 0; i < LOGIN_LIMIT_SHARDS; i++) {
+    hash_destroy(shards[i].entries, (ntripcaster_function *)free_login_limit);
+    shards[i].entries = NULL;
+    thread_mutex_destroy(&shards[i].mutex);
+  }
+}
+
+void loginlimit_init() {
+  init_shards(host_limits);
+  init_shards(user_limits);
+  init_shards(name_limits);
+}
+
+/* Only at shutdown, when the other threads are gone */
+void loginlimit_cleanup() {
+  cleanup_shards(host_limits);
+  cleanup_shards(user_limits);
+  cleanup_shards(name_limits);
+}
+
+static int get_interval() {
+  return info.login_failure_interval > 0 ? info.login_failure_interval : 1;
+}
+
+/* Tokens of ll at now */
+static double get_tokens(login_limit_t *ll, int limit, time_t now) {
+  double tokens = ll->tokens + (double)(now - ll->last) / get_interval();
+
+  return tokens > limit ? limit : tokens;
+}
+
+static int is_expired(login_limit_t *ll, void *arg) {
+  time_t now = get_time();
+  int limit = *(int *)arg;
+
+  return ll->blocked_until <= now && get_tokens(ll, limit, now) >= limit;
+}
+
+/* The tables of the shards use the low bits of the hash, pick the shard by the high ones */
+static login_limit_shard_t *get_shard(login_limit_shard_t *shards, const char *key) {
+  return &shards[(hash_string(key) >> (32 - LOGIN_LIMIT_SHARD_BITS)) & (LOGIN_LIMIT_SHARDS - 1)];
+}
+
+static int is_blocked(login_limit_shard_t *shards, const char *key, int limit) {
+  login_limit_shard_t *shard;
+  login_limit_t *ll;
+  int blocked;
+
+  if (limit <= 0 || !key)
+    return 0;
+
+  shard = get_shard(shards, key);
+
+  thread_mutex_lock(&shard->mutex);
+  ll = hash_find(shard->entries, key);
+  blocked = ll && ll->blocked_until > get_time();
+  thread_mutex_unlock(&shard->mutex);
+
+  return blocked;
+}
+
+/* Take a token from the bucket of key, 1 if this blocked key */
+static int take_token(login_limit_shard_t *shards, const char *key, int limit) {
+  login_limit_shard_t *shard;
+  login_limit_t *ll;
+  time_t now = get_time();
+  int blocked = 0;
+
+  if (limit <= 0 || !key)
+    return 0;
+
+  shard = get_shard(shards, key);
+
+  thread_mutex_lock(&shard->mutex);
+
+  if (now - shard->lastsweep >= LOGIN_LIMIT_SWEEP) {
+    hash_remove_if(shard->entries, (hash_match_func *)is_expired, &limit,
+      (ntripcaster_function *)free_login_limit);
+    shard->lastsweep = now;
+  }
+
+  ll = hash_find(shard->entries, key);
+  if (!ll) {
+    ll = (login_limit_t *) nmalloc(sizeof(login_limit_t));
+    ll->key = nstrdup(key);
+    ll->tokens = limit;
+    ll->last = now;
+    ll->blocked_until = 0;
+    hash_replace(shard->entries, ll->key, ll);
+  }
+
+  if (ll->blocked_until <= now) {
+    ll->tokens = get_tokens(ll, limit, now) - 1;
+    ll->last = now;
+    if (ll->tokens < 1) {
+      ll->tokens = 0;
+      ll->blocked_until = now + info.login_block_time;
+      blocked = 1;
+    }
+  }
+
+  thread_mutex_unlock(&shard->mutex);
+
+  return blocked;
+}
+
+/* Key of user on host, no host name contains a '/' */
+static void get_user_key(const char *host, const char *user, char *key, int len) {
+  snprintf(key, len, "%s/%s", host ? host : "", user);
+}
+
+/* 1 if logins from host are blocked */
+int loginlimit_host_blocked(const char *host) {
+  return is_blocked(host_limits, host, info.login_failures_host);
+}
+
+/* 1 if logins as user from host, or from anywhere, are blocked */
+int loginlimit_user_blocked(const char *host, const char *user) {
+  char key[BUFSIZE];
+
+  if (!user)
+    return 0;
+
+  if (is_blocked(name_limits, user, info.login_failures_name))
+    return 1;
+
+  get_user_key(host, user, key, BUFSIZE);
+  return is_blocked(user_limits, key, info.login_failures_user);
+}
+
+/* Count a failed login from host, user may be NULL */
+void loginlimit_failure(const char *host, const char *user) {
+  char key[BUFSIZE];
+
+  if (take_token(host_limits, host, info.login_failures_host))
+    write_log(LOG_DEFAULT, "Blocking host %s for %d seconds after too many failed logins",
+      host, info.login_block_time);
+  if (!user)
+    return;
+
+  get_user_key(host, user, key, BUFSIZE);
+  if (take_token(user_limits, key, info.login_failures_user))
+    write_log(LOG_DEFAULT, "Blocking user %s on host %s for %d seconds after too many failed logins",
+      user, host, info.login_block_time);
+  if (take_token(name_limits, user, info.login_failures_name))
+    write_log(LOG_DEFAULT, "Blocking user %s on all hosts for %d seconds after too many failed logins",
+      user, info.login_block_time);
+}
+
+static int count_blocked(login_limit_shard_t *shards) {
+  hash_entry_t *e;
+  login_limit_t *ll;
+  time_t now = get_time();
+  unsigned int i, j;
+  int count = 0;
+
+  for (i = 0; i < LOGIN_LIMIT_SHARDS; i++) {
+    thread_mutex_lock(&shards[i].mutex);
+    for (j = 0; j < shards[i].entries->size; j++) {
+      for (e = shards[i].entries->buckets[j]; e; e = e->next) {
+        ll = e->data;
+        if (ll->blocked_until > now)
+          count++;
+      }
+    }
+    thread_mutex_unlock(&shards[i].mutex);
+  }
+
+  return count;
+}
+
+void loginlimit_get_blocked(int *hosts, int *users) {
+  *hosts = count_blocked(host_limits);
+  *users = count_blocked(user_limits) + count_blocked(name_limits);
+}
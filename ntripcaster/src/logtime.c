@@ -84,35 +84,143 @@
 
 extern server_info_t info;
 
+/*
+ * The current second and the strings every log line and HTTP reply
+ * needs are formatted once per second into one of CLOCK_SLOTS slots.
+ * The first caller in a new second formats the next slot and publishes
+ * it, everybody else copies from the current one. A slot's seq is odd
+ * while it is written, readers retry or format themselves when it
+ * changed under them.
+ */
+#define CLOCK_SLOTS 4
+#define CLOCK_STRING_LEN 40
+
+enum { CLOCK_LOG, CLOCK_CLF, CLOCK_HEADER, CLOCK_TIME, CLOCK_DATE, CLOCK_SHORT_DATE, CLOCK_STRINGS };
+
+static char *clock_formats[CLOCK_STRINGS] = { REGULAR_DATETIME, CLF_TIME, HEADER_TIME, REGULAR_TIME, REGULAR_DATE, SHORT_DATE };
+
+typedef struct clockSlotSt {
+  unsigned long seq;
+  time_t now;
+  char text[CLOCK_STRINGS][CLOCK_STRING_LEN];
+} clock_slot_t;
+
+static clock_slot_t clock_slots[CLOCK_SLOTS];
+static int clock_current = 0;
+static int clock_updating = 0;
+
+/* Seconds since the epoch. The coarse clock is read without a system call. */
 long get_time()
 {
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_REALTIME_COARSE)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_REALTIME_COARSE, &ts) == 0)
+    return ts.tv_sec;
+#endif
   return time(NULL);
 }
 
+static void update_clock_slot(time_t now) {
+  int expected = 0, next, i;
+  clock_slot_t *cs;
+
+  /* One formats, the others do not wait for it */
+  if (!__atomic_compare_exchange_n(&clock_updating, &expected, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED))
+    return;
+
+  next = (__atomic_load_n(&clock_current, __ATOMIC_RELAXED) + 1) % CLOCK_SLOTS;
+  cs = &clock_slots[next];
+
+  __atomic_store_n(&cs->seq, cs->seq + 1, __ATOMIC_RELAXED);
+  __atomic_thread_fence(__ATOMIC_RELEASE);
+  for (i = 0; i < CLOCK_STRINGS; i++)
+    get_string_time(cs->text[i], now, clock_formats[i]);
+  cs->now = now;
+  __atomic_store_n(&cs->seq, cs->seq + 1, __ATOMIC_RELEASE);
+
+  __atomic_store_n(&clock_current, next, __ATOMIC_RELEASE);
+  __atomic_store_n(&clock_updating, 0, __ATOMIC_RELEASE);
+}
+
+/* Copy string which of the current second into s */
+static void get_clock_string(int which, char *s) {
+  time_t now = get_time();
+  clock_slot_t *cs;
+  unsigned long seq;
+  size_t len;
+  int tries;
+
+  for (tries = 0; tries < 2; tries++) {
+    cs = &clock_slots[__atomic_load_n(&clock_current, __ATOMIC_ACQUIRE)];
+    seq = __atomic_load_n(&cs->seq, __ATOMIC_ACQUIRE);
+
+    if (!(seq & 1) && cs->now == now) {
+      len = strnlen(cs->text[which], CLOCK_STRING_LEN - 1);
+      memcpy(s, cs->text[which], len);
+      s[len] = '\0';
+      __atomic_thread_fence(__ATOMIC_ACQUIRE);
+      if (__atomic_load_n(&cs->seq, __ATOMIC_RELAXED) == seq)
+        return;
+    } else
+      update_clock_slot(now);
+  }
+
+  get_string_time(s, now, clock_formats[which]);
+}
+
+/* Milliseconds since the epoch, for measuring durations */
+long long get_time_ms()
+{
+#ifdef HAVE_GETTIMEOFDAY
+  struct timeval tv;
+
+  gettimeofday(&tv, NULL);
+  return (long long)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+#else
+  return (long long)time(NULL) * 1000;
+#endif
+}
+
+/* Nanoseconds of the monotonic clock, for short intervals */
+long long get_time_ns()
+{
+#if defined(HAVE_CLOCK_GETTIME) && defined(CLOCK_MONOTONIC)
+  struct timespec ts;
+
+  if (clock_gettime(CLOCK_MONOTONIC, &ts) == 0)
+    return (long long)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#endif
+  return get_time_ms() * 1000000;
+}
+
 void get_regular_time(char *s) {
-  get_string_time(s, get_time(), REGULAR_TIME);
+  get_clock_string(CLOCK_TIME, s);
 }
 
 void get_log_time(char *s)
 {
-  get_string_time(s, get_time(), REGULAR_DATETIME);
+  get_clock_string(CLOCK_LOG, s);
 }
 
 void get_clf_log_time(char *s)
 {
-  get_string_time(s, get_time(), CLF_TIME);
+  get_clock_string(CLOCK_CLF, s);
 }
 
 void get_regular_date(char *s) {
-  get_string_time(s, get_time(), REGULAR_DATE);
+  get_clock_string(CLOCK_DATE, s);
 }
 
 void get_short_date(char *s) {
-
-  get_string_time(s, get_time(), SHORT_DATE);
+  get_clock_string(CLOCK_SHORT_DATE, s);
 }
 
 char *get_formatted_time(char *format, char *buf) {
+  if (strcmp(format, HEADER_TIME) == 0) {
+    get_clock_string(CLOCK_HEADER, buf);
+    return buf;
+  }
   return get_string_time_buf(get_time(), format, buf);
 }
 
@@ -112,9 +112,19 @@
 #include "memory.h"
 #include "relay.h"
 #include "authenticate/basic.h"
+#ifdef HAVE_LIBLDAP
+#include "authenticate/ldapAuthenticate.h"
+#endif /* HAVE_LIBLDAP */
 #include "pool.h"
 #include "interpreter.h"
 #include "match.h"
+#include "loginlimit.h"
+#include "filtercache.h"
+#include "template.h"
+#include "status.h"
+#include "metrics.h"
+#include "rtcm.h"
+#include "accesslog.h"
 
 #ifndef _WIN32
 #include <signal.h>
@@ -212,12 +222,14 @@ int main (int argc, char **argv) {
 
   /* Override the default values with the ones defined in this configfile */
   parse_default_config_file ();
+  update_debug_level ();
 
   /* Read sourcetable.dat and build avl tree. ajd */
   read_sourcetable();
 
   /* Override them again, with the values from the command line */
   parse_args (argc, argv);
+  update_debug_level ();
 
   /* Initialize some platform dependant network stuff */
   initialize_network ();
@@ -227,6 +239,13 @@ int main (int argc, char **argv) {
 
   /* Parse all authentication files */
   init_authentication_scheme ();
+  loginlimit_init ();
+  accesslog_init ();
+  filtercache_init ();
+  template_init ();
+  status_init ();
+  metrics_init ();
+  rtcm_init ();
 
   /* Initialize protocol messages. rtsp. ajd */
   ntrip_init();
@@ -443,6 +462,23 @@ void setup_defaults() {
   thread_create_mutex(&info.session_mutex);
   thread_create_mutex(&info.header_mutex);
 
+  /* Counted while lock_profiling is set */
+  thread_mutex_profile(&info.double_mutex, "double");
+  thread_mutex_profile(&info.source_mutex, "source");
+  thread_mutex_profile(&info.sourcesstats_mutex, "sourcesstats");
+  thread_mutex_profile(&info.admin_mutex, "admin");
+  thread_mutex_profile(&info.misc_mutex, "misc");
+  thread_mutex_profile(&info.alias_mutex, "alias");
+  thread_mutex_profile(&info.hostname_mutex, "hostname");
+  thread_mutex_profile(&info.resolvmutex, "dns");
+  thread_mutex_profile(&info.relay_mutex, "relay");
+  thread_mutex_profile(&info.acl_mutex, "acl");
+  thread_mutex_profile(&info.sourcetable_mutex, "sourcetable");
+  thread_mutex_profile(&info.client_mutex, "client");
+  thread_mutex_profile(&info.logfile_mutex, "logfile");
+  thread_mutex_profile(&info.session_mutex, "session");
+  thread_mutex_profile(&info.header_mutex, "header");
+
 #ifdef DEBUG_SOCKETS
   thread_create_mutex(&sock_mutex);
 #endif
@@ -589,6 +625,8 @@ void setup_defaults() {
   info.kick_relays = DEFAULT_KICK_RELAYS;
   info.relay_reconnect_time = DEFAULT_RELAY_RECONNECT_TIME;
   info.relay_reconnect_tries = DEFAULT_RELAY_RECONNECT_TRIES;
+  info.relay_host_connects = DEFAULT_RELAY_HOST_CONNECTS;
+  info.relay_backoff_max = DEFAULT_RELAY_BACKOFF_MAX;
   info.kick_clients = DEFAULT_KICK_CLIENTS;
 
   /* Server meta info */
@@ -598,11 +636,35 @@ void setup_defaults() {
 
   info.session_timeout = DEFAULT_SESSION_TIMEOUT;
   info.hide_version = DEFAULT_HIDE_VERSION;
+  info.incremental_rehash = DEFAULT_INCREMENTAL_REHASH;
+  info.login_failures_host = DEFAULT_LOGIN_FAILURES_HOST;
+  info.login_failures_user = DEFAULT_LOGIN_FAILURES_USER;
+  info.login_failures_name = DEFAULT_LOGIN_FAILURES_NAME;
+  info.login_failure_interval = DEFAULT_LOGIN_FAILURE_INTERVAL;
+  info.login_block_time = DEFAULT_LOGIN_BLOCK_TIME;
+  info.access_log_format = DEFAULT_ACCESS_LOG_FORMAT;
+  info.access_segment_size = DEFAULT_ACCESS_SEGMENT_SIZE;
+  info.lock_profiling = DEFAULT_LOCK_PROFILING;
+  info.thread_stall_budget = DEFAULT_THREAD_STALL_BUDGET;
+  info.filter_cache_size = DEFAULT_FILTER_CACHE_SIZE;
+  info.nearest_mount = nstrdup(DEFAULT_NEAREST_MOUNT);
+  info.nearest_interval = DEFAULT_NEAREST_INTERVAL;
+  info.keepalive_timeout = DEFAULT_KEEPALIVE_TIMEOUT;
+  info.keepalive_requests = DEFAULT_KEEPALIVE_REQUESTS;
+  info.status_max_age = DEFAULT_STATUS_MAX_AGE;
+  info.stream_analysis = DEFAULT_STREAM_ANALYSIS;
+  info.stream_analysis_interval = DEFAULT_STREAM_ANALYSIS_INTERVAL;
 
 #ifdef HAVE_LIBLDAP
   info.ldap_server = nstrdup(NC_LDAP_HOST);
   info.ldap_uid_prefix = nstrdup(NC_LDAP_UID_PREFIX);
   info.ldap_people_context = nstrdup(NC_LDAP_PEOPLE_CONTEXT);
+  info.ldap_port = DEFAULT_LDAP_PORT;
+  info.ldap_pool_size = DEFAULT_LDAP_POOL_SIZE;
+  info.ldap_timeout = DEFAULT_LDAP_TIMEOUT;
+  info.ldap_cache_ttl = DEFAULT_LDAP_CACHE_TTL;
+  info.ldap_negative_cache_ttl = DEFAULT_LDAP_NEGATIVE_CACHE_TTL;
+  info.ldap_grace_period = DEFAULT_LDAP_GRACE_PERIOD;
 #endif /* HAVE_LIBLDAP */
 
   /* Point variables, bit of a mess */
@@ -612,6 +674,11 @@ void setup_defaults() {
   info.sourcetable.length = 0;
 //  info.sourcetable.show_length = 0;
   info.sourcetable.lines = 0;
+  info.sourcetable.rendered = NULL;
+  info.sourcetable.retired = NULL;
+  info.sourcetable.readers = 0;
+  info.sourcetable.index = NULL;
+  info.sourcetable.version = 0;
 }
 
 /* Allocate all the avl trees for admins, directory servers
@@ -729,7 +796,17 @@ clean_resync (server_info_t *info)
   thread_mutex_unlock(&info->source_mutex);
 
   cleanup_authentication_scheme();
+  loginlimit_cleanup();
+  accesslog_cleanup();
+#ifdef HAVE_LIBLDAP
+  ldap_authentication_cleanup();
+#endif /* HAVE_LIBLDAP */
   cleanup_sourcetable();
+  filtercache_cleanup();
+  template_cleanup();
+  status_cleanup();
+  metrics_cleanup();
+  rtcm_cleanup();
 
   thread_mutex_lock(&info->sourcesstats_mutex);
   if (info->sourcesstats)
@@ -786,6 +863,9 @@ threaded_server_proc (void *infoarg)
   /* Just print some runtime server info */
   print_startup_server_info();
 
+  /* One to write the log files, so no other thread waits for the disk */
+  thread_create("Log Writer Thread", startup_log_writer_thread, NULL);
+
   write_log (LOG_DEFAULT, "Starting Calender Thread...");
   /* Fork another thread that handles stats dumping, directory servers and other time based stuff */
   thread_create("Calendar Thread", startup_timer_thread, NULL);
@@ -810,6 +890,11 @@ threaded_server_proc (void *infoarg)
 
   thread_create("Relay Connector Thread", startup_relay_connector_thread, NULL);
 
+#ifdef HAVE_LIBLDAP
+  /* And one to keep cached LDAP logins fresh */
+  thread_create("LDAP Refresh Thread", startup_ldap_refresh_thread, NULL);
+#endif /* HAVE_LIBLDAP */
+
 //  update_sourcetable(); // update 'sourcetable.dat.utd' at startup of the server. ajd
 
   thread_create("NoNTRIP Listen Thread", listen_to_nontrip_sources, NULL); // nontrip. ajd
@@ -822,12 +907,18 @@ threaded_server_proc (void *infoarg)
     con = get_connection(info.listen_sock);
 
     if (con) {
-      // Ok, we got one, handle it in a new thread
-      thread_create("Connection Handler", handle_connection, (void *)con);
+      if (loginlimit_host_blocked(con->host)) {
+        // Too many failed logins, don't spend a thread on it
+        xa_debug (2, "DEBUG: Dropping connection from blocked host %s", con->host);
+        kick_silently(con);
+      } else {
+        // Ok, we got one, handle it in a new thread
+        thread_create("Connection Handler", handle_connection, (void *)con);
+      }
     }
 
 
-    if (mt->ping == 1) mt->ping = 0;
+    thread_progress (mt);
   }
 
   /* I guess the user pressed ^C */
@@ -990,7 +1081,7 @@ static int store_udp_data(connection_t *con, unsigned char *buffer, int len, uns
       }
       thread_mutex_unlock(&con->udpbuffers->buffer_mutex);
     }
-    con->udpbuffers->lastactive = time(0);
+    con->udpbuffers->lastactive = get_time();
   }
   else
   {
@@ -1075,7 +1166,7 @@ static void handle_udp_packet(unsigned char *buffer, int len, unsigned int seq,
     memcpy(con->udpbuffers->buffer, buffer, len);
     con->udpbuffers->len = len;
     con->udpbuffers->sock = sockfd;
-    con->udpbuffers->lastsend = con->udpbuffers->lastactive = time(0);
+    con->udpbuffers->lastsend = con->udpbuffers->lastactive = get_time();
     con->data_protocol = udp_e;
     con->rtp = rtp_create();
     con->rtp->host_seq = rand();
@@ -1098,7 +1189,10 @@ static void handle_udp_packet(unsigned char *buffer, int len, unsigned int seq,
 
 static unsigned char udpbuffer[2048];
 void *listen_to_udp(void *arg) {
+  mythread_t *mt;
+
   thread_init();
+  mt = thread_get_mythread();
   while (is_server_running()) {
     int sockfd;
     socklen_t sin_len;
@@ -1143,6 +1237,8 @@ void *listen_to_udp(void *arg) {
         }
       }
     }
+
+    thread_progress(mt);
   }
 
   thread_exit(0);
@@ -1151,13 +1247,16 @@ void *listen_to_udp(void *arg) {
 
 void *listen_to_nontrip_sources(void *arg) { // nontrip. ajd
   connection_t *con;
+  mythread_t *mt;
 
   thread_init();
+  mt = thread_get_mythread();
   setup_nontrip_listen_sockets();
 
   while (is_server_running()) {
     con = get_nontrip_connection();
     if (con) thread_create("NoNtrip Source Connection Handler", handle_nontrip_connection, (void *)con);
+    thread_progress(mt);
   }
 
   thread_exit(0);
@@ -51,6 +51,7 @@
 #include <time.h>
 #include <ctype.h>
 #include <string.h>
+#include <math.h>
 
 #ifndef _WIN32
 #include <sys/socket.h>
@@ -391,6 +392,230 @@ list_t *get_filter_expression_list(char *filter,int matchonly) {
   return l;
 }
 
+static int count_parse_tree(expression_t *root) {
+  if ((root == NULL) || (root->type == CONSTANT)) return 1;
+
+  switch (root->type) {
+    case LOGIC_AND:
+    case LOGIC_OR:
+      return 1 + count_parse_tree(root->left) + count_parse_tree(root->right);
+    case LOGIC_NOT:
+      return 1 + count_parse_tree(root->left);
+    default:
+      return 1;
+  }
+}
+
+static int emit_instr(filter_program_t *prog, int op, int cmp, sourcetable_field_t *constant) {
+  filter_instr_t *in = &prog->code[prog->len];
+
+  in->op = op;
+  in->cmp = cmp;
+  in->constant = constant;
+  in->target = 0;
+
+  return prog->len++;
+}
+
+/* emits the code for root, mirrors match_sourcetable_field(). */
+static void compile_parse_tree(filter_program_t *prog, expression_t *root) {
+  int jump;
+
+  if (root == NULL) {
+    emit_instr(prog, FILTER_FALSE, 0, NULL);
+    return;
+  }
+
+  switch (root->type) {
+    case LOGIC_AND:
+    case LOGIC_OR:
+      compile_parse_tree(prog, root->left);
+      jump = emit_instr(prog, (root->type == LOGIC_AND) ? FILTER_JZ : FILTER_JNZ, 0, NULL);
+      compile_parse_tree(prog, root->right);
+      prog->code[jump].target = prog->len;
+      break;
+    case LOGIC_NOT:
+      compile_parse_tree(prog, root->left);
+      emit_instr(prog, FILTER_NOT, 0, NULL);
+      break;
+    case EQUAL:
+    case NOT_EQUAL:
+    case LESS:
+    case GREATER:
+    case LESS_EQUAL:
+    case GREATER_EQUAL:
+      if ((root->left != NULL) && (((expression_t *)root->left)->type == CONSTANT))
+        emit_instr(prog, FILTER_CMP, root->type, (sourcetable_field_t *)((expression_t *)root->left)->left);
+      else
+        emit_instr(prog, FILTER_FALSE, 0, NULL);
+      break;
+    case CONSTANT:
+      emit_instr(prog, FILTER_CMP, EQUAL, (sourcetable_field_t *)root->left);
+      break;
+    default:
+      emit_instr(prog, FILTER_FALSE, 0, NULL);
+      break;
+  }
+}
+
+/* parses the filter once and turns each field expression into a program
+ * that match_compiled_filter() runs without recursion. */
+compiled_filter_t *compile_filter(char *filter, int matchonly) {
+  compiled_filter_t *cf = nmalloc(sizeof(compiled_filter_t));
+  list_enum_t *en;
+  expression_t *root;
+  int i = 0;
+
+  cf->trees = get_filter_expression_list(filter, matchonly);
+  cf->nfields = cf->trees->size;
+  cf->fields = nmalloc(cf->nfields * sizeof(filter_program_t));
+
+  en = list_get_enum(cf->trees);
+  while (i < cf->nfields) {
+    root = list_next(en);
+    cf->fields[i].len = 0;
+    cf->fields[i].code = NULL;
+    if (root != NULL) {
+      cf->fields[i].code = nmalloc(2 * count_parse_tree(root) * sizeof(filter_instr_t));
+      compile_parse_tree(&cf->fields[i], root);
+    }
+    i++;
+  }
+  nfree(en);
+
+  return cf;
+}
+
+void dispose_compiled_filter(compiled_filter_t *cf) {
+  int i;
+
+  for (i = 0; i < cf->nfields; i++) {
+    if (cf->fields[i].code != NULL)
+    {
+      nfree(cf->fields[i].code);
+    }
+  }
+  nfree(cf->fields);
+  list_dispose_with_data(cf->trees, dispose_parse_tree);
+  nfree(cf);
+}
+
+static int run_filter_program(filter_program_t *prog, sourcetable_field_t *field) {
+  filter_instr_t *in;
+  int pc = 0, acc = 0, res;
+
+  while (pc < prog->len) {
+    in = &prog->code[pc++];
+    switch (in->op) {
+      case FILTER_CMP:
+        res = compare_entry_fields(in->constant, field);
+        switch (in->cmp) {
+          case EQUAL: acc = (res == 0); break;
+          case NOT_EQUAL: acc = (res != 0); break;
+          case LESS: acc = (res > 0); break;
+          case GREATER: acc = (res < 0); break;
+          case LESS_EQUAL: acc = (res >= 0); break;
+          case GREATER_EQUAL: acc = (res <= 0); break;
+          default: acc = 0; break;
+        }
+        break;
+      case FILTER_JZ:
+        if (!acc) pc = in->target;
+        break;
+      case FILTER_JNZ:
+        if (acc) pc = in->target;
+        break;
+      case FILTER_NOT:
+        acc = !acc;
+        break;
+      default:
+        acc = 0;
+        break;
+    }
+  }
+
+  return acc;
+}
+
+/* Interval [lo, hi] containing every value the program of field index can
+ * match. Only for programs which are a conjunction of comparisons with
+ * numbers, returns 0 for all other programs and unfiltered fields. */
+int filter_field_range(compiled_filter_t *cf, int index, double *lo, double *hi) {
+  filter_program_t *prog;
+  filter_instr_t *in;
+  double value;
+  int pc;
+
+  if ((index >= cf->nfields) || (cf->fields[index].code == NULL)) return 0;
+
+  prog = &cf->fields[index];
+  *lo = -HUGE_VAL;
+  *hi = HUGE_VAL;
+
+  for (pc = 0; pc < prog->len; pc++) {
+    in = &prog->code[pc];
+    if (in->op == FILTER_JZ) continue;
+    if (in->op != FILTER_CMP) return 0;
+
+    if (in->constant->type == integer_e)
+      value = *(int *)in->constant->data;
+    else if (in->constant->type == real_e)
+      value = *(double *)in->constant->data;
+    else
+      return 0;
+
+    switch (in->cmp) {
+      case EQUAL:
+        if (value > *lo) *lo = value;
+        if (value < *hi) *hi = value;
+        break;
+      case LESS:
+      case LESS_EQUAL:
+        if (value < *hi) *hi = value;
+        break;
+      case GREATER:
+      case GREATER_EQUAL:
+        if (value > *lo) *lo = value;
+        break;
+      default:
+        return 0;
+    }
+  }
+
+  return 1;
+}
+
+/* 1 if field index only matches value (no wildcards, any case). */
+int filter_field_is(compiled_filter_t *cf, int index, const char *value) {
+  filter_program_t *prog;
+
+  if ((index >= cf->nfields) || (cf->fields[index].code == NULL)) return 0;
+
+  prog = &cf->fields[index];
+  return (prog->len == 1) && (prog->code[0].op == FILTER_CMP) && (prog->code[0].cmp == EQUAL)
+    && (prog->code[0].constant->type == string_e) && (strcasecmp((char *)prog->code[0].constant->data, value) == 0);
+}
+
+/* same result as match_sourcetable_entry() with the uncompiled list. */
+int match_compiled_filter(compiled_filter_t *cf, sourcetable_entry_t *entry) {
+  sourcetable_field_t *field;
+  int i = 0;
+
+  if (entry->type == unknown_e)
+    return 0;
+
+  field = (sourcetable_field_t *)entry->fields;
+
+  while (!((field->type == unknown_type_e) && (field->name == NULL)) && (i < cf->nfields)) {
+    if ((cf->fields[i].code != NULL) && (run_filter_program(&cf->fields[i], field) != 1))
+      return 0;
+    field++;
+    i++;
+  }
+
+  return 1;
+}
+
 /* parses an expression represented by a string and
  * returns the root of the parse tree. ajd */
 expression_t *parse_expression(char *expr) {
@@ -57,11 +57,41 @@ typedef struct expression_St {
         void *right;
 } expression_t;
 
+/* Filter expressions compiled into a flat program, see compile_filter() */
+#define FILTER_FALSE 0 /* acc = 0 */
+#define FILTER_CMP 1   /* acc = cmp(constant, field) */
+#define FILTER_JZ 2    /* jump to target if acc is 0 */
+#define FILTER_JNZ 3   /* jump to target if acc is not 0 */
+#define FILTER_NOT 4   /* acc = !acc */
+
+typedef struct filter_instr_St {
+        int op;
+        int cmp; /* EQUAL, LESS, ... for FILTER_CMP */
+        sourcetable_field_t *constant;
+        int target;
+} filter_instr_t;
+
+typedef struct filter_program_St {
+        filter_instr_t *code; /* NULL: field is not filtered */
+        int len;
+} filter_program_t;
+
+typedef struct compiled_filter_St {
+        list_t *trees; /* parse trees, own the constants */
+        filter_program_t *fields;
+        int nfields;
+} compiled_filter_t;
+
 int wild_match(register unsigned const char *m, register unsigned const char *n);
 int match_sourcetable_entry(list_t *expression_list, sourcetable_entry_t *entry);
 int match_sourcetable_field(expression_t *root, sourcetable_field_t *field);
 list_t *get_filter_expression_list(char *filter, int matchonly);
 expression_t *parse_expression(char *expr);
+compiled_filter_t *compile_filter(char *filter, int matchonly);
+void dispose_compiled_filter(compiled_filter_t *cf);
+int match_compiled_filter(compiled_filter_t *cf, sourcetable_entry_t *entry);
+int filter_field_range(compiled_filter_t *cf, int index, double *lo, double *hi);
+int filter_field_is(compiled_filter_t *cf, int index, const char *value);
 void dispose_parse_tree(expression_t *root);
 list_t *get_token_list(char *expr);
 token_t *get_next_token(char **pp);
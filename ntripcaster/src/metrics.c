@@ -0,0 +1,481 @@
+/* metrics.c
+ * - lock-free metrics registry for /metrics
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "avl.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "utility.h"
+#include "logtime.h"
+#include "latency.h"
+#include "memory.h"
+#include "metrics.h"
+
+extern server_info_t info;
+
+/*
+ * The data path adds to the series it found when the source registered
+ * with atomic operations only. The registry mutex is taken to create
+ * series, once per mountpoint, group or login type, and for the buffers.
+ * /metrics renders all families into a buffer that is kept for the next
+ * scrape and written with one call.
+ */
+static mutex_t metrics_mutex;
+static metrics_family_t *families = NULL;
+static metrics_family_t *last_family = NULL;
+static hash_table_t *mounts = NULL;   /* metrics_mount_t by mountpoint */
+static hash_table_t *groups = NULL;   /* login series by its labels */
+static metrics_series_t *logins[METRICS_LOGIN_TYPES][METRICS_LOGIN_PROTOCOLS][METRICS_LOGIN_RESULTS];
+static metrics_buf_t *spare = NULL;
+static int spares = 0;
+
+static metrics_family_t clients_num = { "caster_sources_clients_num",
+  "The number of clients connected to the mountpoint.", metrics_gauge_e, NULL, NULL, NULL };
+static metrics_family_t received_bytes = { "caster_sources_received_bytes_total",
+  "The number of bytes received for the mountpoint.", metrics_counter_e, NULL, NULL, NULL };
+static metrics_family_t sent_bytes = { "caster_sources_sent_bytes_total",
+  "The number of bytes sent for the mountpoint.", metrics_counter_e, NULL, NULL, NULL };
+static metrics_family_t source_connections = { "caster_sources_connections_total",
+  "The number of connections of the mountpoint.", metrics_counter_e, NULL, NULL, NULL };
+static metrics_family_t client_connections = { "caster_sources_clients_connections_total",
+  "The number of client connections to the mountpoint.", metrics_counter_e, NULL, NULL, NULL };
+static metrics_family_t duration = { "caster_sources_duration_seconds",
+  "The activity time of the mountpoint.", metrics_elapsed_e, NULL, NULL, NULL };
+static metrics_family_t delivery_delay = { "caster_sources_delivery_delay_seconds",
+  "Time from reading the first byte of a chunk to having written it to a client, for the mountpoint.", metrics_histogram_e, NULL, NULL, NULL };
+static metrics_family_t kicks = { "caster_kicks_total",
+  "Clients and sources disconnected from the mountpoint, by reason.", metrics_counter_e, NULL, NULL, NULL };
+static metrics_family_t login_results = { "caster_logins_total",
+  "Authentication results of clients, sources and admins, by protocol.", metrics_counter_e, NULL, NULL, NULL };
+static metrics_family_t group_logins = { "caster_group_logins_total",
+  "Successful logins of the users of the group.", metrics_counter_e, NULL, NULL, NULL };
+
+static const char *kick_type_names[2] = { "client", "source" };
+static const char *kick_reason_names[METRICS_KICK_REASONS] = {
+  "closed", "broken", "timeout", "slow", "stream_ended", "rejected", "admin", "shutdown", "other" };
+
+/* Reasons given to kick_connection(), by their beginning */
+static const struct {
+  const char *prefix;
+  metrics_kick_reason_t reason;
+} kick_reasons[] = {
+  { "Client signed off", metrics_kick_closed_e },
+  { "Client closed connection", metrics_kick_closed_e },
+  { "Close packet received", metrics_kick_closed_e },
+  { "Source died", metrics_kick_closed_e },
+  { "Session deleted", metrics_kick_closed_e },
+  { "RTSP teardown", metrics_kick_closed_e },
+  { "Closing relay", metrics_kick_closed_e },
+  { "Broken connection", metrics_kick_broken_e },
+  { "Relay: ", metrics_kick_broken_e },
+  { "UDP connection timeout", metrics_kick_timeout_e },
+  { "Too many errors", metrics_kick_slow_e },
+  { "Stream ended", metrics_kick_stream_ended_e },
+  { "Invalid Mount Point", metrics_kick_rejected_e },
+  { "Server Full", metrics_kick_rejected_e },
+  { "Source with existing Mountpoint", metrics_kick_rejected_e },
+  { "Relay source", metrics_kick_rejected_e },
+  { "Setup session with existing connection", metrics_kick_rejected_e },
+  { "Kicked by admin", metrics_kick_admin_e },
+  { "Masskick by admin", metrics_kick_admin_e },
+  { "Server resync", metrics_kick_shutdown_e },
+  { NULL, metrics_kick_other_e }
+};
+
+static const char *login_type_names[METRICS_LOGIN_TYPES] = { "client", "source", "admin" };
+static const char *login_protocol_names[METRICS_LOGIN_PROTOCOLS] = { "ntrip1", "ntrip2", "rtsp", "http", "other" };
+static const char *login_result_names[METRICS_LOGIN_RESULTS] = {
+  "ok", "no_credentials", "bad_password", "blocked", "denied" };
+
+static void register_family(metrics_family_t *f) {
+  f->series = NULL;
+  f->last = NULL;
+  f->next = NULL;
+  if (last_family)
+    last_family->next = f;
+  else
+    families = f;
+  last_family = f;
+}
+
+/* Label value with \, " and newlines escaped */
+static void label_value(char *buf, int size, const char *value) {
+  int len = 0;
+
+  for (; value && *value && (len < size - 2); value++) {
+    if ((*value == '\\') || (*value == '"')) {
+      buf[len++] = '\\';
+      buf[len++] = *value;
+    } else if (*value == '\n') {
+      buf[len++] = '\\';
+      buf[len++] = 'n';
+    } else
+      buf[len++] = *value;
+  }
+  buf[len] = '\0';
+}
+
+/* New series of f, with the registry mutex held */
+static metrics_series_t *add_series(metrics_family_t *f, const char *labels, latency_hist_t *hist) {
+  metrics_series_t *s = (metrics_series_t *)nmalloc(sizeof(metrics_series_t));
+
+  s->labels = nstrdup(labels);
+  s->value = 0;
+  s->hist = hist;
+  s->next = NULL;
+
+  /* readers may be walking the list, publish the filled in series */
+  if (f->last)
+    __atomic_store_n(&f->last->next, s, __ATOMIC_RELEASE);
+  else
+    __atomic_store_n(&f->series, s, __ATOMIC_RELEASE);
+  f->last = s;
+
+  return s;
+}
+
+void metrics_init(void) {
+  thread_create_mutex(&metrics_mutex);
+  thread_mutex_profile(&metrics_mutex, "metrics");
+
+  mounts = hash_create(256);
+  groups = hash_create(64);
+  memset(logins, 0, sizeof(logins));
+
+  register_family(&clients_num);
+  register_family(&received_bytes);
+  register_family(&sent_bytes);
+  register_family(&source_connections);
+  register_family(&client_connections);
+  register_family(&duration);
+  register_family(&delivery_delay);
+  register_family(&kicks);
+  register_family(&login_results);
+  register_family(&group_logins);
+}
+
+static void free_mount(metrics_mount_t *m) {
+  nfree(m->mount);
+  nfree(m);
+}
+
+void metrics_cleanup(void) {
+  metrics_family_t *f;
+  metrics_series_t *s;
+  metrics_buf_t *b;
+
+  thread_mutex_lock(&metrics_mutex);
+  for (f = families; f; f = f->next) {
+    while ((s = f->series)) {
+      f->series = s->next;
+      nfree(s->labels);
+      nfree(s);
+    }
+    f->last = NULL;
+  }
+  families = last_family = NULL;
+
+  hash_destroy(mounts, (ntripcaster_function *)free_mount);
+  hash_destroy(groups, NULL);
+  mounts = groups = NULL;
+
+  while ((b = spare)) {
+    spare = b->next;
+    nfree(b->data);
+    nfree(b);
+  }
+  spares = 0;
+  thread_mutex_unlock(&metrics_mutex);
+  thread_mutex_destroy(&metrics_mutex);
+}
+
+/* Series of the mountpoint, created on its first source, never NULL */
+metrics_mount_t *metrics_mount(const char *mount) {
+  metrics_mount_t *m;
+  char mp[BUFSIZE], labels[2 * BUFSIZE];
+
+  if (!mount)
+    mount = "";
+
+  thread_mutex_lock(&metrics_mutex);
+  if ((m = hash_find(mounts, mount)) == NULL) {
+    m = (metrics_mount_t *)nmalloc(sizeof(metrics_mount_t));
+    memset(m, 0, sizeof(metrics_mount_t));
+    m->mount = nstrdup(mount);
+
+    label_value(mp, sizeof(mp), (mount[0] == '/') ? mount + 1 : mount);
+    snprintf(labels, sizeof(labels), "mp=\"%s\"", mp);
+    m->clients = add_series(&clients_num, labels, NULL);
+    m->received = add_series(&received_bytes, labels, NULL);
+    m->sent = add_series(&sent_bytes, labels, NULL);
+    m->connections = add_series(&source_connections, labels, NULL);
+    m->client_connections = add_series(&client_connections, labels, NULL);
+    m->since = add_series(&duration, labels, NULL);
+    m->delay = add_series(&delivery_delay, labels, &m->latency);
+
+    hash_replace(mounts, m->mount, m);
+  }
+  thread_mutex_unlock(&metrics_mutex);
+
+  return m;
+}
+
+/* The source of m went live, after the mountpoint checks */
+void metrics_source_attached(metrics_mount_t *m) {
+  if (!m)
+    return;
+  metrics_set(m->since, get_time());
+}
+
+void metrics_source_detached(metrics_mount_t *m) {
+  if (!m)
+    return;
+  metrics_set(m->since, 0);
+}
+
+/* Counts the kick of a client or source of m, reason as given to kick_connection() */
+void metrics_kick(metrics_mount_t *m, contype_t type, const char *reason) {
+  metrics_series_t *s;
+  int i, t = (type == source_e) ? 1 : 0;
+
+  if (!m || !reason || ((type != client_e) && (type != source_e)))
+    return;
+
+  for (i = 0; kick_reasons[i].prefix; i++)
+    if (strncmp(reason, kick_reasons[i].prefix, strlen(kick_reasons[i].prefix)) == 0)
+      break;
+
+  if ((s = __atomic_load_n(&m->kicks[t][kick_reasons[i].reason], __ATOMIC_ACQUIRE)) == NULL) {
+    char labels[2 * BUFSIZE], mp[BUFSIZE];
+
+    thread_mutex_lock(&metrics_mutex);
+    if ((s = m->kicks[t][kick_reasons[i].reason]) == NULL) {
+      label_value(mp, sizeof(mp), (m->mount[0] == '/') ? m->mount + 1 : m->mount);
+      snprintf(labels, sizeof(labels), "mp=\"%s\",type=\"%s\",reason=\"%s\"", mp,
+          kick_type_names[t], kick_reason_names[kick_reasons[i].reason]);
+      s = add_series(&kicks, labels, NULL);
+      __atomic_store_n(&m->kicks[t][kick_reasons[i].reason], s, __ATOMIC_RELEASE);
+    }
+    thread_mutex_unlock(&metrics_mutex);
+  }
+
+  metrics_add(s, 1);
+}
+
+/* Counts an authentication of con for path, the successful ones also by con->group */
+void metrics_login(connection_t *con, contype_t type, const char *path, metrics_login_result_t result) {
+  metrics_series_t *s;
+  int t, p;
+
+  if (path && ((strncmp(path, "/admin", 6) == 0) || (strncmp(path, "/oper", 5) == 0)
+      || (strncmp(path, "/metrics", 8) == 0)))
+    t = 2;
+  else
+    t = (type == source_e) ? 1 : 0;
+
+  switch (con->com_protocol) {
+    case ntrip1_0_e: p = 0; break;
+    case ntrip2_0_e: p = 1; break;
+    case rtsp_e: p = 2; break;
+    case http_e: p = 3; break;
+    default: p = 4; break;
+  }
+
+  if ((s = __atomic_load_n(&logins[t][p][result], __ATOMIC_ACQUIRE)) == NULL) {
+    char labels[BUFSIZE];
+
+    thread_mutex_lock(&metrics_mutex);
+    if ((s = logins[t][p][result]) == NULL) {
+      snprintf(labels, sizeof(labels), "type=\"%s\",protocol=\"%s\",result=\"%s\"",
+          login_type_names[t], login_protocol_names[p], login_result_names[result]);
+      s = add_series(&login_results, labels, NULL);
+      __atomic_store_n(&logins[t][p][result], s, __ATOMIC_RELEASE);
+    }
+    thread_mutex_unlock(&metrics_mutex);
+  }
+  metrics_add(s, 1);
+
+  if ((result == metrics_login_ok_e) && con->group) {
+    char labels[2 * BUFSIZE], group[BUFSIZE];
+
+    label_value(group, sizeof(group), con->group);
+    snprintf(labels, sizeof(labels), "group=\"%s\"", group);
+
+    thread_mutex_lock(&metrics_mutex);
+    if ((s = hash_find(groups, labels)) == NULL) {
+      s = add_series(&group_logins, labels, NULL);
+      hash_replace(groups, s->labels, s);
+    }
+    thread_mutex_unlock(&metrics_mutex);
+    metrics_add(s, 1);
+  }
+}
+
+/* Empty buffer, METRICS_HEADER_SPACE bytes are left free for the header */
+metrics_buf_t *metrics_buf_acquire(void) {
+  metrics_buf_t *out;
+
+  thread_mutex_lock(&metrics_mutex);
+  if ((out = spare)) {
+    spare = out->next;
+    spares--;
+  }
+  thread_mutex_unlock(&metrics_mutex);
+
+  if (!out) {
+    out = (metrics_buf_t *)nmalloc(sizeof(metrics_buf_t));
+    out->size = METRICS_BUFFER_SIZE;
+    out->data = (char *)nmalloc(out->size);
+  }
+  out->len = METRICS_HEADER_SPACE;
+  out->next = NULL;
+
+  return out;
+}
+
+void metrics_buf_release(metrics_buf_t *out) {
+  if (!out)
+    return;
+
+  thread_mutex_lock(&metrics_mutex);
+  if (spares < METRICS_SPARE_BUFFERS) {
+    out->next = spare;
+    spare = out;
+    spares++;
+    out = NULL;
+  }
+  thread_mutex_unlock(&metrics_mutex);
+
+  if (out) {
+    nfree(out->data);
+    nfree(out);
+  }
+}
+
+void metrics_printf(metrics_buf_t *out, const char *fmt, ...) {
+  va_list ap;
+  int len;
+
+  va_start(ap, fmt);
+  len = vsnprintf(out->data + out->len, out->size - out->len, fmt, ap);
+  va_end(ap);
+
+  if (len < 0)
+    return;
+
+  if (out->len + len >= out->size) {
+    char *grown;
+
+    while (out->len + len >= out->size)
+      out->size *= 2;
+    grown = (char *)nmalloc(out->size);
+    memcpy(grown, out->data, out->len);
+    nfree(out->data);
+    out->data = grown;
+
+    va_start(ap, fmt);
+    vsnprintf(out->data + out->len, out->size - out->len, fmt, ap);
+    va_end(ap);
+  }
+
+  out->len += len;
+}
+
+/* Buckets from 250us in powers of 4, labels without braces or NULL */
+void metrics_write_histogram(metrics_buf_t *out, const char *name, const char *labels, const latency_hist_t *h) {
+  const char *sep = (labels && labels[0]) ? "," : "";
+  unsigned long long int le;
+
+  if (!labels)
+    labels = "";
+
+  for (le = 250; le <= 16384000; le *= 4)
+    metrics_printf(out, "%s_bucket{%s%sle=\"%g\"} %lu\n", name, labels, sep, le / 1e6, latency_count_below(h, le));
+  metrics_printf(out, "%s_bucket{%s%sle=\"+Inf\"} %lu\n", name, labels, sep, h->count);
+  if (labels[0]) {
+    metrics_printf(out, "%s_sum{%s} %.6f\n", name, labels, h->sum_us / 1e6);
+    metrics_printf(out, "%s_count{%s} %lu\n", name, labels, h->count);
+  } else {
+    metrics_printf(out, "%s_sum %.6f\n", name, h->sum_us / 1e6);
+    metrics_printf(out, "%s_count %lu\n", name, h->count);
+  }
+}
+
+/* All families of the registry, without taking the registry mutex */
+void metrics_write(metrics_buf_t *out) {
+  const char *types[] = { "counter", "gauge", "gauge", "histogram" };
+  metrics_family_t *f;
+  metrics_series_t *s;
+  time_t now = get_time();
+
+  for (f = families; f; f = f->next) {
+    metrics_printf(out, "# HELP %s %s\n", f->name, f->help);
+    metrics_printf(out, "# TYPE %s %s\n", f->name, types[f->type]);
+
+    for (s = __atomic_load_n(&f->series, __ATOMIC_ACQUIRE); s; s = __atomic_load_n(&s->next, __ATOMIC_ACQUIRE)) {
+      long int value = __atomic_load_n(&s->value, __ATOMIC_RELAXED);
+
+      if (f->type == metrics_histogram_e) {
+        latency_hist_t h;
+
+        latency_copy(&h, s->hist);
+        metrics_write_histogram(out, f->name, s->labels, &h);
+      } else if (f->type == metrics_elapsed_e) {
+        if (value)
+          metrics_printf(out, "%s{%s} %ld\n", f->name, s->labels, now - value);
+      } else
+        metrics_printf(out, "%s{%s} %ld\n", f->name, s->labels, value);
+    }
+  }
+}
@@ -0,0 +1,142 @@
+/* metrics.h
+ * - lock-free metrics registry for /metrics, function headers
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_METRICS_H
+#define NTRIPCASTER_METRICS_H
+
+/* Room before the rendered metrics for the HTTP header */
+#define METRICS_HEADER_SPACE 1024
+/* Initial size of a render buffer, grown as needed and kept for reuse */
+#define METRICS_BUFFER_SIZE 65536
+/* Buffers kept for the next scrapes */
+#define METRICS_SPARE_BUFFERS 4
+
+typedef enum {
+  metrics_counter_e,
+  metrics_gauge_e,
+  metrics_elapsed_e,   /* gauge of the seconds since the time stored, left out while 0 */
+  metrics_histogram_e  /* latency_hist_t in microseconds, written in seconds */
+} metrics_type_t;
+
+typedef struct metrics_series_St {
+  char *labels;                  /* rendered label pairs without braces, "" for none */
+  long int value;                /* counter, gauge or time, changed atomically */
+  latency_hist_t *hist;          /* histogram, recorded with latency_record() */
+  struct metrics_series_St *next;
+} metrics_series_t;
+
+/*
+ * A metric and its labelled series. Series are only ever appended, under
+ * the registry mutex, and read without it.
+ */
+typedef struct metrics_family_St {
+  const char *name;
+  const char *help;
+  metrics_type_t type;
+  metrics_series_t *series;
+  metrics_series_t *last;
+  struct metrics_family_St *next;
+} metrics_family_t;
+
+typedef enum {
+  metrics_kick_closed_e,       /* client or source went away */
+  metrics_kick_broken_e,       /* write or read error */
+  metrics_kick_timeout_e,
+  metrics_kick_slow_e,         /* client not reading fast enough */
+  metrics_kick_stream_ended_e, /* source of the client is gone */
+  metrics_kick_rejected_e,     /* mountpoint taken, server full, ... */
+  metrics_kick_admin_e,
+  metrics_kick_shutdown_e,
+  metrics_kick_other_e,
+  METRICS_KICK_REASONS
+} metrics_kick_reason_t;
+
+typedef enum {
+  metrics_login_ok_e,
+  metrics_login_no_credentials_e,
+  metrics_login_bad_password_e,
+  metrics_login_blocked_e,     /* too many failed logins, see loginlimit.c */
+  metrics_login_denied_e,      /* user has no access to the mountpoint */
+  METRICS_LOGIN_RESULTS
+} metrics_login_result_t;
+
+/* Types and protocols of logins, see metrics_login() */
+#define METRICS_LOGIN_TYPES 3
+#define METRICS_LOGIN_PROTOCOLS 5
+
+/* Series of a mountpoint, found once when a source registers */
+typedef struct metrics_mount_St {
+  char *mount;
+  metrics_series_t *clients;
+  metrics_series_t *received;
+  metrics_series_t *sent;
+  metrics_series_t *connections;
+  metrics_series_t *client_connections;
+  metrics_series_t *since;
+  metrics_series_t *delay;
+  metrics_series_t *kicks[2][METRICS_KICK_REASONS]; /* client, source; created on first use */
+  latency_hist_t latency;        /* ingest to delivery */
+} metrics_mount_t;
+
+/* Reusable buffer the metrics are rendered into, after METRICS_HEADER_SPACE bytes */
+typedef struct metrics_buf_St {
+  char *data;
+  int len;
+  int size;
+  struct metrics_buf_St *next;
+} metrics_buf_t;
+
+void metrics_init(void);
+void metrics_cleanup(void);
+
+metrics_mount_t *metrics_mount(const char *mount);
+void metrics_source_attached(metrics_mount_t *m);
+void metrics_source_detached(metrics_mount_t *m);
+void metrics_kick(metrics_mount_t *m, contype_t type, const char *reason);
+void metrics_login(connection_t *con, contype_t type, const char *path, metrics_login_result_t result);
+
+/* Lock-free updates for the data path */
+#define metrics_add(s, n) __atomic_add_fetch(&(s)->value, (n), __ATOMIC_RELAXED)
+#define metrics_set(s, n) __atomic_store_n(&(s)->value, (n), __ATOMIC_RELAXED)
+
+metrics_buf_t *metrics_buf_acquire(void);
+void metrics_buf_release(metrics_buf_t *out);
+void metrics_printf(metrics_buf_t *out, const char *fmt, ...);
+void metrics_write_histogram(metrics_buf_t *out, const char *name, const char *labels, const latency_hist_t *h);
+void metrics_write(metrics_buf_t *out);
+#endif
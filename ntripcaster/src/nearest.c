@@ -0,0 +1,478 @@
+/* nearest.c
+ * - Routing of rovers to the nearest station
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <math.h>
+
+#ifndef _WIN32
+#include <sys/socket.h>
+#endif
+
+#include "avl.h"
+#include "avl_functions.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "ntrip.h"
+#include "client.h"
+#include "commands.h"
+#include "sourcetable.h"
+#include "match.h"
+#include "stindex.h"
+#include "authenticate/basic.h"
+#include "ntripcaster_string.h"
+#include "logtime.h"
+#include "utility.h"
+#include "sock.h"
+#include "vars.h"
+#include "pool.h"
+#include "probes.h"
+#include "log.h"
+#include "memory.h"
+#include "nearest.h"
+
+extern server_info_t info;
+
+/*
+ * Clients of the nearest_mount are not tied to a source of their own.
+ * After the response header the rover sends its GGA position, the caster
+ * looks up the closest connected STR mountpoint in the sourcetable index
+ * and attaches the client to that source. The source thread keeps reading
+ * the rover's sentences and every nearest_interval seconds moves it to a
+ * station that became clearly closer, at the end of a chunk so the stream
+ * is not cut inside a message.
+ */
+static nearest_stats_t nearest_stats;
+
+int nearest_is_mount(const char *path) {
+  const char *mount = info.nearest_mount;
+
+  if (!path || !mount || !mount[0])
+    return 0;
+  if (mount[0] != '/')
+    return path[0] == '/' && ntripcaster_strcmp(path + 1, mount) == 0;
+  return ntripcaster_strcmp(path, mount) == 0;
+}
+
+/* Latitude or longitude of a GGA field, ddmm.mmmm or dddmm.mmmm */
+static double nmea_degrees(const char *value, const char *hemisphere) {
+  double v = atof(value), deg = floor(v / 100.0);
+
+  v = deg + (v - deg * 100.0) / 60.0;
+  return (hemisphere[0] == 'S' || hemisphere[0] == 'W') ? -v : v;
+}
+
+/* Position of a GGA sentence of any talker, 0 without a valid fix */
+int nearest_parse_gga(const char *line, double *lat, double *lon) {
+  char sentence[NEAREST_BUFSIZE], *field[15], *p;
+  unsigned char sum = 0;
+  int n = 0;
+
+  while (*line == ' ') line++;
+  if (line[0] != '$' || strlen(line) < 7 || strncmp(line + 3, "GGA,", 4) != 0)
+    return 0;
+
+  for (p = (char *)line + 1; *p && *p != '*'; p++)
+    sum ^= (unsigned char)*p;
+  if (*p == '*' && strtol(p + 1, NULL, 16) != sum)
+    return 0;
+
+  strncpy(sentence, line, NEAREST_BUFSIZE - 1);
+  sentence[NEAREST_BUFSIZE - 1] = '\0';
+  if ((p = strchr(sentence, '*')) != NULL)
+    *p = '\0';
+
+  p = sentence;
+  while (p && n < 15) {
+    field[n++] = p;
+    if ((p = strchr(p, ',')) != NULL)
+      *p++ = '\0';
+  }
+
+  /* time, lat, N/S, lon, E/W, quality */
+  if (n < 7 || !field[2][0] || !field[4][0] || atoi(field[6]) <= 0)
+    return 0;
+
+  *lat = nmea_degrees(field[2], field[3]);
+  *lon = nmea_degrees(field[4], field[5]);
+  return fabs(*lat) <= 90.0 && fabs(*lon) <= 180.0;
+}
+
+static void nearest_parse_line(nearest_t *nr, const char *line) {
+  double lat, lon;
+
+  if (nearest_parse_gga(line, &lat, &lon)) {
+    nr->lat = lat;
+    nr->lon = lon;
+    nr->fix = 1;
+  }
+}
+
+/* Reads what the rover sent without blocking and keeps its last position.
+ * Returns -1 when the rover closed the connection. */
+static int nearest_read(connection_t *con, nearest_t *nr) {
+  char *line, *end;
+  int n, total = 0;
+
+  for (;;) {
+    n = recv(con->sock, nr->buf + nr->len, NEAREST_BUFSIZE - 1 - nr->len, MSG_DONTWAIT);
+    if (n == 0)
+      return -1;
+    if (n < 0)
+      return (errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR) ? total : -1;
+
+    total += n;
+    nr->len += n;
+    nr->buf[nr->len] = '\0';
+
+    line = nr->buf;
+    while ((end = strchr(line, '\n')) != NULL) {
+      *end = '\0';
+      if (end > line && end[-1] == '\r')
+        end[-1] = '\0';
+      nearest_parse_line(nr, line);
+      line = end + 1;
+    }
+
+    nr->len -= line - nr->buf;
+    memmove(nr->buf, line, nr->len);
+
+    /* no line end in a whole buffer, not NMEA */
+    if (nr->len == NEAREST_BUFSIZE - 1)
+      nr->len = 0;
+  }
+}
+
+/* Connected mountpoints around the rover, nearest first */
+static int nearest_candidates(const nearest_t *nr, char mounts[][BUFSIZE], double *km) {
+  sourcetable_entry_t *found[NEAREST_CANDIDATES];
+  int i, count;
+
+  thread_mutex_lock(&info.sourcetable_mutex);
+
+  count = stindex_nearest(nr->lat, nr->lon, NEAREST_CANDIDATES, 0, found, km);
+  for (i = 0; i < count; i++) {
+    strncpy(mounts[i], found[i]->id, BUFSIZE - 1);
+    mounts[i][BUFSIZE - 1] = '\0';
+  }
+
+  thread_mutex_unlock(&info.sourcetable_mutex);
+  return count;
+}
+
+/*
+ * Without a login, the password was checked once in nearest_client_login().
+ * *group gets the group granting mount, for nearest_join_group().
+ */
+static int nearest_allowed(connection_t *con, const nearest_t *nr, const char *mount, char **group) {
+  *group = NULL;
+  if (authorize_user_mount(con, mount, nr->password, group))
+    return 1;
+
+  if (*group) {
+    nfree(*group);
+  }
+  return 0;
+}
+
+/*
+ * Make group, taken over, the group of con if it has room for it. A client
+ * keeping its group keeps its place in it. Needs info.double_mutex and
+ * info.source_mutex, so no other nearest client takes the last place.
+ */
+static int nearest_join_group(connection_t *con, char *group) {
+  char *oldgroup;
+  int oldactive;
+
+  if (con->groupactive && con->group && group && !strcmp(con->group, group)) {
+    nfree(group);
+    return 1;
+  }
+
+  thread_mutex_lock(&info.client_mutex);
+  oldgroup = con->group;
+  oldactive = con->groupactive;
+  con->group = group;
+  con->groupactive = 0;
+  thread_mutex_unlock(&info.client_mutex);
+
+  if (add_group_connection(con)) {
+    if (oldgroup) {
+      nfree(oldgroup);
+    }
+    return 1;
+  }
+
+  thread_mutex_lock(&info.client_mutex);
+  con->group = oldgroup;
+  con->groupactive = oldactive;
+  thread_mutex_unlock(&info.client_mutex);
+
+  if (group) {
+    nfree(group);
+  }
+  return 0;
+}
+
+/* Needs info.source_mutex */
+static connection_t *nearest_find_source(const char *mount) {
+  avl_traverser trav = {0};
+  connection_t *sourcecon;
+
+  while ((sourcecon = avl_traverse(info.sources, &trav)))
+    if ((sourcecon->food.source->connected == SOURCE_CONNECTED) && sourcecon->food.source->audiocast.mount &&
+        (ntripcaster_strcmp(sourcecon->food.source->audiocast.mount, mount) == 0))
+      return sourcecon;
+
+  return NULL;
+}
+
+/*
+ * The nearest station the rover may use and that has room for it and in
+ * the group granting it, or NULL when there is none or current is about
+ * as close. A station is returned with con in its group and with
+ * info.double_mutex and info.source_mutex locked.
+ */
+static connection_t *nearest_pick(connection_t *con, nearest_t *nr, source_t *current, double *km) {
+  char mounts[NEAREST_CANDIDATES][BUFSIZE];
+  double dist[NEAREST_CANDIDATES], current_km = HUGE_VAL;
+  connection_t *sourcecon;
+  char *group;
+  int i, count;
+
+  count = nearest_candidates(nr, mounts, dist);
+
+  for (i = 0; current && i < count; i++)
+    if (ntripcaster_strcmp(mounts[i], current->audiocast.mount) == 0) {
+      current_km = nr->km = dist[i];
+      break;
+    }
+
+  for (i = 0; i < count; i++) {
+    if (dist[i] >= current_km * NEAREST_HYSTERESIS)
+      break;
+    if (nearest_is_mount(mounts[i]) || !nearest_allowed(con, nr, mounts[i], &group))
+      continue;
+
+    thread_mutex_lock(&info.double_mutex);
+    thread_mutex_lock(&info.source_mutex);
+
+    sourcecon = nearest_find_source(mounts[i]);
+    if (sourcecon && (sourcecon->food.source->num_clients < info.max_clients_per_source)) {
+      if (nearest_join_group(con, group)) {
+        *km = dist[i];
+        return sourcecon;
+      }
+    } else if (group) {
+      nfree(group);
+    }
+
+    thread_mutex_unlock(&info.source_mutex);
+    thread_mutex_unlock(&info.double_mutex);
+  }
+
+  return NULL;
+}
+
+void nearest_client_login(connection_t *con, ntrip_request_t *req) {
+  char time[50];
+  const char *var;
+  connection_t *sourcecon;
+  nearest_t *nr;
+  time_t timeout;
+  double km = 0.0;
+
+  if (con->udpbuffers) {
+    ntrip_write_message(con, HTTP_NOT_IMPLEMENTED, get_formatted_time(HEADER_TIME, time));
+    kick_not_connected(con, "Nearest mountpoint not available via UDP");
+    return;
+  }
+
+  thread_mutex_lock(&info.double_mutex);
+  thread_mutex_lock(&info.source_mutex);
+
+  if (info.num_clients >= info.max_clients) {
+    thread_mutex_unlock(&info.source_mutex);
+    thread_mutex_unlock(&info.double_mutex);
+    ntrip_write_message(con, HTTP_SERVICE_UNAVAILABLE, get_formatted_time(HEADER_TIME, time));
+    kick_not_connected(con, "Server Full (too many listeners)");
+    return;
+  }
+
+  thread_mutex_unlock(&info.source_mutex);
+  thread_mutex_unlock(&info.double_mutex);
+
+  put_client(con);
+  con->food.client->type = http_client_e;
+  nr = con->food.client->nearest = (nearest_t *)nmalloc(sizeof(nearest_t));
+  memset(nr, 0, sizeof(nearest_t));
+
+  /* NTRIP 2 rovers may send their position with the request, the
+   * others send it once they have the response header */
+  var = get_con_variable(con, "Ntrip-GGA");
+  if (var)
+    nearest_parse_line(nr, var);
+
+  greet_client(con, NULL);
+
+  timeout = get_time() + NEAREST_GGA_TIMEOUT;
+  while (!nr->fix && get_time() < timeout)
+    if ((readable_timeo(con->sock, 1) > 0) && (nearest_read(con, nr) < 0))
+      break;
+
+  if (!nr->fix) {
+    __atomic_add_fetch(&nearest_stats.failed, 1, __ATOMIC_RELAXED);
+    kick_not_connected(con, "No position from rover");
+    return;
+  }
+
+  nr->password = authenticate_user_password(con);
+
+  sourcecon = nearest_pick(con, nr, NULL, &km);
+  if (!sourcecon) {
+    __atomic_add_fetch(&nearest_stats.failed, 1, __ATOMIC_RELAXED);
+    write_log(LOG_DEFAULT, "No station near %.6f/%.6f for client %d", nr->lat, nr->lon, con->id);
+    kick_not_connected(con, "No nearest mountpoint");
+    return;
+  }
+  if (info.num_clients >= info.max_clients) {
+    thread_mutex_unlock(&info.source_mutex);
+    thread_mutex_unlock(&info.double_mutex);
+    kick_not_connected(con, "Server Full (too many listeners)");
+    return;
+  } else if (!check_ip_restrictions(con)) {
+    thread_mutex_unlock(&info.source_mutex);
+    thread_mutex_unlock(&info.double_mutex);
+    kick_not_connected(con, "Server Full (too many accesses from IP)");
+    return;
+  }
+
+  con->food.client->source = sourcecon->food.source;
+  nr->km = km;
+  nr->next_check = get_time() + info.nearest_interval;
+
+  thread_mutex_lock(&info.client_mutex);
+  avl_insert(info.clients, con);
+  thread_mutex_unlock(&info.client_mutex);
+
+  util_increase_total_clients();
+  CASTER_PROBE3(client_login, sourcecon->food.source->audiocast.mount, con->id, con_host (con));
+  pool_add(con);
+  __atomic_add_fetch(&nearest_stats.routed, 1, __ATOMIC_RELAXED);
+
+  write_log(LOG_DEFAULT, "Accepted http client %d from [%s] on mountpoint [%s] via [%s], %.1f km from %.6f/%.6f. %d clients connected",
+      con->id, con_host (con), sourcecon->food.source->audiocast.mount, req->path, km, nr->lat, nr->lon, info.num_clients);
+
+  thread_mutex_unlock(&info.source_mutex);
+  thread_mutex_unlock(&info.double_mutex);
+}
+
+/*
+ * Called by the thread of source. Reads the positions of its nearest_mount
+ * clients and, when their interval is due, moves them to a closer station.
+ * With force, because the source goes away, every such client is moved to
+ * the nearest station that is left, wherever it is in the stream.
+ */
+void nearest_check_clients(source_t *source, int force) {
+  avl_traverser trav = {0};
+  connection_t *clicon, *sourcecon;
+  client_t *client;
+  nearest_t *nr;
+  time_t now = get_time();
+  double km;
+
+  while ((clicon = avl_traverse(source->clients, &trav))) {
+    client = clicon->food.client;
+    nr = client->nearest;
+
+    if (!nr || (client->alive != CLIENT_ALIVE) || (!force && (now < nr->next_check)))
+      continue;
+
+    if (nearest_read(clicon, nr) < 0) {
+      kick_connection(clicon, "Client closed connection");
+      continue;
+    }
+
+    /* only between chunks, or the rover would get a broken message */
+    if (!force && ((client->virgin != 0) || (client->offset != 0) ||
+        ((clicon->trans_encoding == chunked_e) && (clicon->http_chunk->left > 0))))
+      continue;
+
+    nr->next_check = now + (info.nearest_interval > 0 ? info.nearest_interval : 3600);
+
+    if (!force && info.nearest_interval <= 0)
+      continue;
+
+    sourcecon = nearest_pick(clicon, nr, force ? NULL : source, &km);
+    if (!sourcecon)
+      continue;
+
+    write_log(LOG_DEFAULT, "Moving client %d [%s] from mountpoint [%s] to [%s], %.1f km from %.6f/%.6f",
+        clicon->id, con_host (clicon), source->audiocast.mount, sourcecon->food.source->audiocast.mount, km, nr->lat, nr->lon);
+
+    move_to(clicon, sourcecon);
+    nr->km = km;
+    nr->moves++;
+    __atomic_add_fetch(&nearest_stats.moves, 1, __ATOMIC_RELAXED);
+
+    thread_mutex_unlock(&info.source_mutex);
+    thread_mutex_unlock(&info.double_mutex);
+
+    zero_trav(&trav);
+  }
+}
+
+void nearest_get_stats(nearest_stats_t *stats) {
+  stats->routed = __atomic_load_n(&nearest_stats.routed, __ATOMIC_RELAXED);
+  stats->moves = __atomic_load_n(&nearest_stats.moves, __ATOMIC_RELAXED);
+  stats->failed = __atomic_load_n(&nearest_stats.failed, __ATOMIC_RELAXED);
+}
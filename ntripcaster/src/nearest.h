@@ -0,0 +1,71 @@
+/* nearest.h
+ * - Routing of rovers to the nearest station
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_NEAREST_H
+#define NTRIPCASTER_NEAREST_H
+
+#define NEAREST_GGA_TIMEOUT 10 /* seconds a rover has to send its first position */
+#define NEAREST_CANDIDATES 8   /* closest stations tried in turn */
+#define NEAREST_HYSTERESIS 0.9 /* a station must be this much closer before a rover is moved */
+#define NEAREST_BUFSIZE 256    /* NMEA sentences are at most 82 characters */
+
+/* Routing state of a client of the nearest_mount */
+typedef struct nearest_St {
+  char buf[NEAREST_BUFSIZE]; /* unfinished sentence */
+  int len;
+  int fix;                   /* lat and lon hold a position */
+  double lat;
+  double lon;
+  double km;                 /* distance to the current station */
+  int password;              /* the password of the rover is right */
+  time_t next_check;
+  unsigned long int moves;
+} nearest_t;
+
+typedef struct nearest_stats_St {
+  unsigned long int routed;  /* rovers attached to their nearest station */
+  unsigned long int moves;   /* rovers moved to a closer station */
+  unsigned long int failed;  /* rovers without position or station */
+} nearest_stats_t;
+
+int nearest_is_mount(const char *path);
+void nearest_client_login(connection_t *con, ntrip_request_t *req);
+void nearest_check_clients(source_t *source, int force);
+int nearest_parse_gga(const char *line, double *lat, double *lon);
+void nearest_get_stats(nearest_stats_t *stats);
+#endif
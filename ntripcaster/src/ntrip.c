@@ -126,7 +126,10 @@ ntrip_message_t ntrip1_0_message[] = {
 
 ntrip_message_t ntrip2_0_message[] = {
   { HTTP_GET_STREAM_OK, http_e, "OK", 200,      {102,103,8,100,101,105,3,5,-1} },
-  { HTTP_GET_SOURCETABLE_OK, http_e, "OK", 200,       {102,106,103,8,105,3,4,-1} },
+  { HTTP_GET_SOURCETABLE_OK, http_e, "OK", 200,       {102,106,103,8,110,3,4,-1} },
+  { HTTP_GET_SOURCETABLE_TAGGED, http_e, "OK", 200,   {102,106,103,8,110,3,9,109,4,-1} },
+  { HTTP_GET_SOURCETABLE_GZIP, http_e, "OK", 200,     {102,106,103,8,110,3,9,108,109,4,-1} },
+  { HTTP_NOT_MODIFIED, http_e, "Not Modified", 304,   {102,103,8,9,109,110,-1} },
   { HTTP_GET_STREAM_WRONG_MOUNT, http_e, "Not Found", 404,  {102,103,8,105,-1} },
   { HTTP_GET_NOT_AUTHORIZED, http_e, "Unauthorized", 401,   {102,103,8,7,105,-1} },
 
@@ -182,6 +185,7 @@ ntrip_header_element_t ntrip_header_element[] = {
   { 6, "Allow", "%s" },
   { 7, "WWW-Authenticate", "Basic realm=\"%s\"" },
   { 8, "Date", "%s" },
+  { 9, "ETag", "\"%s\"" },
 // do not change while runtime
   { 100, "Cache-Control", "no-store,no-cache,max-age=0" },
   { 101, "Pragma", "no-cache" },
@@ -191,6 +195,9 @@ ntrip_header_element_t ntrip_header_element[] = {
   { 105, "Connection", "close"},
   { 106, "Ntrip-Flags", "st_filter,st_auth,st_match,st_strict,rtsp,plain_rtp"},
   { 107, "Content-Type", "text/html" }, // Hack for Error Handling
+  { 108, "Content-Encoding", "gzip" },
+  { 109, "Vary", "Accept-Encoding" },
+  { 110, "Connection", NULL }, // keep-alive or close, see keepalive_header()
   { 200, "Connection", "close\r\n\r\n<!DOCTYPE html>\r\n<html><head><title>401 Unauthorized</title></head>" DEFAULT_BODY_TAG "\r\n<h1 style=\"text-align:center;\">The server does not recognize your privileges to the requested entity/stream</h1>\r\n</body></html>" },
 
   { -1, (char *)NULL, (char *)NULL }
@@ -303,19 +310,25 @@ ntrip_message_t *get_ntrip_message(int type, avl_tree *tree) {
   return me;
 }
 
-void add_header_string(int header_element[], char *buf) {
-  int i=0;
+/* Responses without the keep-alive element 110 always close the connection */
+void add_header_string(connection_t *con, int header_element[], char *buf) {
+  int i=0, keep = 0;
   char linebuf[BUFSIZE];
   ntrip_header_element_t *he;
 
   while (header_element[i] > -1) {
     he = get_header_element(header_element[i]);
-    if (he != NULL) {
+    if (he != NULL && he->index == 110) {
+      keep = 1;
+      keepalive_header(con, linebuf, BUFSIZE);
+      strcat(buf, linebuf);
+    } else if (he != NULL) {
       snprintf(linebuf, BUFSIZE, "%s: %s\r\n", he->name, he->value);
       strcat(buf, linebuf);
     }
     i++;
   }
+  if (!keep) con->keepalive = 0;
 }
 
 void ntrip_write_message(connection_t *con, int type, ...) {
@@ -340,7 +353,7 @@ void ntrip_write_message(connection_t *con, int type, ...) {
     snprintf(fmt, BUFSIZE, "%s\r\n", msg->message);
   }
 
-  add_header_string(msg->header_element, fmt);
+  add_header_string(con, msg->header_element, fmt);
 
   va_start (ap, type);
   vsnprintf(sendbuf, BUFSIZE, fmt, ap);
@@ -37,6 +37,9 @@
 #define HTTP_GET_SOURCETABLE_OK 2
 #define HTTP_GET_STREAM_WRONG_MOUNT 3
 #define HTTP_GET_NOT_AUTHORIZED 4
+#define HTTP_GET_SOURCETABLE_TAGGED 5
+#define HTTP_GET_SOURCETABLE_GZIP 6
+#define HTTP_NOT_MODIFIED 7
 #define HTTP_SOURCE_OK 10
 #define HTTP_SOURCE_MOUNT_CONFLICT 11
 #define HTTP_SOURCE_NOT_AUTHORIZED 12
@@ -105,7 +108,7 @@ typedef struct ntrip_message_St
   int protocol;
   char *message;
   int code;
-  int header_element[10]; // the indices in the ntrip_header_element_t array. ajd
+  int header_element[12]; // the indices in the ntrip_header_element_t array. ajd
 } ntrip_message_t;
 
 ntrip_method_t *get_ntrip_method(char *name, int protocol);
@@ -113,7 +116,7 @@ char *get_ntrip_method_string(char *buf);
 void ntrip_init();
 ntrip_header_element_t *get_header_element(int index);
 ntrip_message_t *get_ntrip_message(int type, avl_tree *tree);
-void add_header_string(int header_element[], char *buf);
+void add_header_string(connection_t *con, int header_element[], char *buf);
 void ntrip_write_message(connection_t *con, int type, ...);
 int ntrip_read_header(connection_t *con, char *header, ntrip_request_t *req);
 //int ntrip_read_old_source_header(connection_t *con, char *header, ntrip_request_t *req);
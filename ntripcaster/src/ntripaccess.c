@@ -0,0 +1,258 @@
+/* ntripaccess.c
+ * - Converts binary access log segments to CSV or JSON lines
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "accessformat.h"
+
+/*
+ * usage: ntripaccess [-j] segment...
+ *
+ * Prints the client records of the segments in the format of the CSV
+ * access file, or as one JSON object per line with -j. The segments are
+ * read up to their used size, so the segment the caster is writing can
+ * be exported, too.
+ */
+
+#define FORMAT_CSV 0
+#define FORMAT_JSON 1
+
+typedef struct segment_St {
+  char *data;
+  size_t used;
+  const char **strings;   /* by id */
+  uint32_t nstrings;
+} segment_t;
+
+static const char *get_string(segment_t *seg, uint32_t id, const char *none) {
+  if (id == 0 || id >= seg->nstrings || !seg->strings[id])
+    return none;
+  return seg->strings[id];
+}
+
+static void print_json_string(const char *key, const char *s) {
+  printf("\"%s\":", key);
+
+  if (!s) {
+    printf("null");
+    return;
+  }
+
+  putchar('"');
+  for (; *s; s++) {
+    unsigned char c = (unsigned char)*s;
+
+    if (c == '"' || c == '\\')
+      printf("\\%c", c);
+    else if (c < 0x20)
+      printf("\\u%04x", c);
+    else
+      putchar(c);
+  }
+  putchar('"');
+}
+
+static void print_csv(segment_t *seg, access_client_record_t *cr) {
+  char date[40], tm[40];
+  time_t t = (time_t)cr->disconnect_time;
+  struct tm *pmt = gmtime(&t);
+
+  if (!pmt || !strftime(date, sizeof(date), "%d/%b/%Y", pmt) || !strftime(tm, sizeof(tm), "%H:%M:%S", pmt)) {
+    strcpy(date, "error");
+    strcpy(tm, "error");
+  }
+
+  printf("%s,%s,%s,%s,%s,%s,%d,%lu\n", date, tm,
+      get_string(seg, cr->user, "(null)"), get_string(seg, cr->host, "?"),
+      get_string(seg, cr->mount, "n/a"), get_string(seg, cr->agent, "?"),
+      (int)(cr->disconnect_time - cr->connect_time), (unsigned long)cr->bytes);
+}
+
+static void print_json(segment_t *seg, access_client_record_t *cr) {
+  printf("{\"connect\":%lld,\"disconnect\":%lld,\"id\":%lld,",
+      (long long)cr->connect_time, (long long)cr->disconnect_time, (long long)cr->connection_id);
+  print_json_string("user", get_string(seg, cr->user, NULL));
+  putchar(',');
+  print_json_string("host", get_string(seg, cr->host, NULL));
+  putchar(',');
+  print_json_string("mount", get_string(seg, cr->mount, NULL));
+  putchar(',');
+  print_json_string("agent", get_string(seg, cr->agent, NULL));
+  putchar(',');
+  print_json_string("reason", get_string(seg, cr->reason, NULL));
+  printf(",\"seconds\":%lld,\"bytes\":%llu}\n",
+      (long long)(cr->disconnect_time - cr->connect_time), (unsigned long long)cr->bytes);
+}
+
+static int add_string(segment_t *seg, access_string_record_t *sr) {
+  if (sr->id == 0 || sizeof(access_string_record_t) + sr->length + 1 > sr->hdr.len)
+    return -1;
+
+  if (sr->id >= seg->nstrings) {
+    uint32_t n = seg->nstrings ? seg->nstrings : 64;
+    const char **strings;
+
+    while (n <= sr->id)
+      n *= 2;
+    if (!(strings = realloc(seg->strings, n * sizeof(char *))))
+      return -1;
+    memset(strings + seg->nstrings, 0, (n - seg->nstrings) * sizeof(char *));
+    seg->strings = strings;
+    seg->nstrings = n;
+  }
+
+  seg->strings[sr->id] = (const char *)(sr + 1);
+  return 0;
+}
+
+static int read_segment(const char *filename, segment_t *seg) {
+  access_segment_header_t hdr;
+  FILE *ifp;
+
+  if (!(ifp = fopen(filename, "rb"))) {
+    perror(filename);
+    return -1;
+  }
+
+  if (fread(&hdr, sizeof(hdr), 1, ifp) != 1 || memcmp(hdr.magic, ACCESS_SEGMENT_MAGIC, sizeof(hdr.magic)) != 0) {
+    fprintf(stderr, "%s: not an access log segment\n", filename);
+    fclose(ifp);
+    return -1;
+  }
+
+  if (hdr.byteorder != ACCESS_SEGMENT_BYTEORDER || hdr.version != ACCESS_SEGMENT_VERSION) {
+    fprintf(stderr, "%s: segment version %u of another byte order or version\n", filename, (unsigned int)hdr.version);
+    fclose(ifp);
+    return -1;
+  }
+
+  seg->used = hdr.used;
+  if (seg->used < sizeof(hdr) || !(seg->data = malloc(seg->used))) {
+    fprintf(stderr, "%s: invalid size %lu\n", filename, (unsigned long)seg->used);
+    fclose(ifp);
+    return -1;
+  }
+
+  memcpy(seg->data, &hdr, sizeof(hdr));
+  seg->used = sizeof(hdr) + fread(seg->data + sizeof(hdr), 1, seg->used - sizeof(hdr), ifp);
+  if (seg->used < hdr.used)
+    fprintf(stderr, "%s: truncated at %lu of %lu bytes\n", filename, (unsigned long)seg->used, (unsigned long)hdr.used);
+
+  fclose(ifp);
+  return 0;
+}
+
+static int export_segment(const char *filename, int format) {
+  segment_t seg = { NULL, 0, NULL, 0 };
+  size_t pos = sizeof(access_segment_header_t);
+  int ret = 0;
+
+  if (read_segment(filename, &seg) == -1)
+    return -1;
+
+  while (pos + sizeof(access_record_header_t) <= seg.used) {
+    access_record_header_t *rh = (access_record_header_t *)(seg.data + pos);
+
+    if (rh->len < sizeof(access_record_header_t) || (rh->len & 7) || pos + rh->len > seg.used) {
+      fprintf(stderr, "%s: broken record at %lu\n", filename, (unsigned long)pos);
+      ret = -1;
+      break;
+    }
+
+    if (rh->type == ACCESS_RECORD_STRING) {
+      if (add_string(&seg, (access_string_record_t *)rh) == -1) {
+        fprintf(stderr, "%s: broken string at %lu\n", filename, (unsigned long)pos);
+        ret = -1;
+        break;
+      }
+    } else if (rh->type == ACCESS_RECORD_CLIENT && rh->len >= sizeof(access_client_record_t)) {
+      if (format == FORMAT_JSON)
+        print_json(&seg, (access_client_record_t *)rh);
+      else
+        print_csv(&seg, (access_client_record_t *)rh);
+    }
+    /* Unknown records are skipped */
+
+    pos += rh->len;
+  }
+
+  free(seg.strings);
+  free(seg.data);
+  return ret;
+}
+
+static void usage(const char *name) {
+  fprintf(stderr, "usage: %s [-j] segment...\n", name);
+  fprintf(stderr, "Prints binary access log segments as CSV, or as JSON lines with -j\n");
+}
+
+int main(int argc, char **argv) {
+  int format = FORMAT_CSV;
+  int i = 1, ret = 0;
+
+  if (i < argc && strcmp(argv[i], "-j") == 0) {
+    format = FORMAT_JSON;
+    i++;
+  }
+
+  if (i >= argc || argv[i][0] == '-') {
+    usage(argv[0]);
+    return 2;
+  }
+
+  if (format == FORMAT_CSV)
+    printf("Date,Time,User,IP,Station,Client,Seconds,Bytes\n");
+
+  for (; i < argc; i++) {
+    if (export_segment(argv[i], format) == -1)
+      ret = 1;
+  }
+
+  return ret;
+}
@@ -60,6 +60,11 @@
 #define CONSOLE_LOG 2
 #define CONSOLE_BACKGROUND 3
 
+/* Formats of the access log */
+#define ACCESS_LOG_CSV 0
+#define ACCESS_LOG_BINARY 1
+#define ACCESS_LOG_BOTH 2
+
 /* Flags for the admin */
 #define NONE 0
 #define TAILING 1
@@ -136,6 +141,8 @@
 #define DEFAULT_KICK_RELAYS 0 /* Kick relays after this many seconds without clients */
 #define DEFAULT_RELAY_RECONNECT_TIME 60
 #define DEFAULT_RELAY_RECONNECT_TRIES -1
+#define DEFAULT_RELAY_HOST_CONNECTS 4
+#define DEFAULT_RELAY_BACKOFF_MAX 900
 #define DEFAULT_KICK_CLIENTS 1
 #define DEFAULT_NAME "EUREF"
 #define DEFAULT_NTRIP_INFO_URL "http://igs.bkg.bund.de/index_ntrip.htm"
@@ -143,6 +150,30 @@
 #define DEFAULT_OPERATOR_URL "https://www.bkg.bund.de/"
 #define DEFAULT_SESSION_TIMEOUT 300
 #define DEFAULT_HIDE_VERSION 0
+#define DEFAULT_INCREMENTAL_REHASH 1
+#define DEFAULT_LOGIN_FAILURES_HOST 10
+#define DEFAULT_LOGIN_FAILURES_USER 5
+#define DEFAULT_LOGIN_FAILURES_NAME 50
+#define DEFAULT_LOGIN_FAILURE_INTERVAL 30
+#define DEFAULT_LOGIN_BLOCK_TIME 600
+#define DEFAULT_ACCESS_LOG_FORMAT ACCESS_LOG_CSV
+#define DEFAULT_ACCESS_SEGMENT_SIZE 16384
+#define DEFAULT_LOCK_PROFILING 0
+#define DEFAULT_THREAD_STALL_BUDGET 30000
+#define DEFAULT_FILTER_CACHE_SIZE 64
+#define DEFAULT_NEAREST_MOUNT ""
+#define DEFAULT_NEAREST_INTERVAL 60
+#define DEFAULT_KEEPALIVE_TIMEOUT 15
+#define DEFAULT_KEEPALIVE_REQUESTS 100
+#define DEFAULT_STATUS_MAX_AGE 1
+#define DEFAULT_STREAM_ANALYSIS 0
+#define DEFAULT_STREAM_ANALYSIS_INTERVAL 60
+#define DEFAULT_LDAP_PORT 389
+#define DEFAULT_LDAP_POOL_SIZE 4
+#define DEFAULT_LDAP_TIMEOUT 5
+#define DEFAULT_LDAP_CACHE_TTL 300
+#define DEFAULT_LDAP_NEGATIVE_CACHE_TTL 30
+#define DEFAULT_LDAP_GRACE_PERIOD 3600
 
 #define NTRIP_VERSION "2.0"
 #undef NTRIP_NUMBER
@@ -150,6 +181,7 @@
 #define SHORT_CONNECTION 60 // in seconds.
 #define MAXNUM_SHORT_CONNECTION 2
 #define WATCHDOG_TIME 10 // in seconds.
+#define THREAD_SAMPLE_INTERVAL 5 // seconds between cpu samples and stall checks
 #define WATCHDOG 1 // undefine if you don't want a watchdog.
 #define DAILY_LOGFILES 1
 
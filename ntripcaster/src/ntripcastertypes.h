@@ -128,14 +128,6 @@ typedef int sock_t;
 typedef sock_t SOCKET;
 #endif
 
-typedef struct http_parsable_commandsSt
-{
-  char *name;         /* What will be substituted */
-  HttpFunction *func; /* Function to call for the substitution
-           * This function should return a pointer
-           * to where the parser should jump */
-} http_parsable_t;
-
 typedef struct http_variableSt
 {
   char *name;
@@ -193,8 +185,22 @@ typedef struct chunkSt
   char data[SOURCE_READSIZE];
   int len;
   int clients_left;
+  long long int ingest_ns; /* monotonic time the first byte was read */
 } chunk_t;
 
+/* Ingest to delivery delays in microseconds, see latency.c */
+#define LATENCY_SUB_BITS 2
+#define LATENCY_SUB_BUCKETS (1 << LATENCY_SUB_BITS)
+#define LATENCY_BUCKETS (26 * LATENCY_SUB_BUCKETS) /* up to about 2 minutes */
+
+typedef struct latency_hist_St
+{
+  unsigned long int count;
+  unsigned long long int sum_us;
+  unsigned long long int max_us;
+  unsigned long int buckets[LATENCY_BUCKETS];
+} latency_hist_t;
+
 typedef struct http_chunkSt {
   char buf[20]; // to store hex length.
   int off; // store offset in buf.
@@ -227,10 +233,33 @@ typedef struct audiocast_St {
   char *mount;    /* Name of this particular channel */
 } audiocast_t;
 
+/* gzip variant of a rendered sourcetable */
+typedef struct sourcetable_gzip_St {
+  int len;
+  char buf[1];
+} sourcetable_gzip_t;
+
+/* Visible sourcetable rendered once per change, see sourcetable_render() */
+typedef struct sourcetable_render_St {
+  int refcount;
+  unsigned long int version;
+  int len;      /* bytes in buf including the ENDSOURCETABLE line */
+  int body_len; /* bytes in buf without the ENDSOURCETABLE line */
+  char etag[20]; /* hash of buf, "-gz" is appended for the gzip variant */
+  sourcetable_gzip_t *gzip; /* built on the first request accepting it */
+  struct sourcetable_render_St *next; /* retired list */
+  char buf[1];
+} sourcetable_render_t;
+
 typedef struct sourcetable_St {
   int length;
   int lines;
   avl_tree *tree;
+  sourcetable_render_t *rendered; /* current snapshot, swapped atomically */
+  sourcetable_render_t *retired;  /* replaced snapshots waiting for readers */
+  int readers;                    /* readers between load and refcount */
+  struct sourcetable_index_St *index; /* STR positions and numeric fields, see stindex.h */
+  unsigned long int version;
 } sourcetable_t;
 
 typedef struct source_St {
@@ -241,6 +270,9 @@ typedef struct source_St {
   icethread_t thread;            /* Pointer to running thread */
   statistics_t stats;            /* Statistics for current connection */
   statistics_t *globalstats;     /* Statistics for the mounpoint */
+  latency_hist_t *latency;       /* Delivery delays for the mountpoint */
+  struct metrics_mount_St *metrics; /* Series of the mountpoint, see metrics.h */
+  struct rtcm_analyzer_St *analyzer; /* Stream analysis, NULL = off, see rtcm.h */
   unsigned long int num_clients; /* Number of current clients */
   chunk_t chunk[CHUNKLEN];
   int cid;
@@ -256,8 +288,32 @@ typedef struct client_St {
   unsigned long int write_bytes;  /* Number of bytes written to client */
   int virgin;     /* Need sync? */
   source_t *source;        /* Pointer back to the source (to avoid having to find it) */
+  struct nearest_St *nearest; /* Position of a nearest_mount client, see nearest.h */
 } client_t;
 
+/* Log lines waiting to be sent to a tailing admin, see flush_log_queue() */
+typedef struct logQueueSt {
+  mutex_t mutex;
+  char **lines;
+  int size;
+  int first;
+  int count;
+  unsigned long dropped;  /* lines lost because the queue was full */
+} log_queue_t;
+
+typedef struct logStatsSt {
+  unsigned long written;    /* records passed through the log writer thread */
+  unsigned long overflowed; /* written directly, the ring was full */
+  unsigned long dropped;    /* lines not sent to tailing admins */
+  int pending;              /* records in the ring */
+} log_stats_t;
+
+typedef struct {
+  unsigned long written;    /* binary access records */
+  unsigned long failed;     /* written as CSV, no segment open */
+  int segments;             /* segments created */
+} access_log_stats_t;
+
 typedef struct admin_St {
   unsigned int status:1; /* Show status information ? */
   unsigned int oper:1;
@@ -267,6 +323,7 @@ typedef struct admin_St {
   icethread_t thread;       /* Pointer to running thread */
   int debuglevel;
   scheme_t scheme;
+  log_queue_t *logqueue; /* filled by the log writer thread, sent by the admin thread */
 } admin_t;
 
 typedef struct nontripsource_St { // nontrip.
@@ -355,6 +412,7 @@ typedef struct connectionSt {
   http_chunk_t *http_chunk; // rtsp. used for chunked transfer encoding.
   rtp_t *rtp;
   char groupactive; /* valid for group count */
+  int keepalive; /* further requests allowed after this one, 0 = close */
 #ifdef HAVE_TLS
   SSL * tls_socket;
   SSL_CTX * tls_context;
@@ -386,6 +444,8 @@ typedef struct relay_St {
   time_t last_reconnect;          /* When was the last reconnect? */
   int reconnect_now;              /* Tell reconnector to reconnect this now */
   int pending;                    /* connection in progress ? */
+  int failures;                   /* Failed connects since the last successful one */
+  time_t next_attempt;            /* Earliest time of the next connect (backoff) */
   int ntrip2;                     /* connect in Ntrip2 mode */
 #ifdef HAVE_TLS
   int tls;                        /* connect in Ntrip2 HTTPS mode */
@@ -529,6 +589,8 @@ typedef struct {
   int kick_relays;   /* Kick relays when they are not relaying to any client (recommended) */
   int relay_reconnect_time; /* Seconds to wait before reconnecting dead relay */
   int relay_reconnect_tries; /* Number of tries before giving up reconnect (-1 means go on forever) */
+  int relay_host_connects; /* Concurrent relay connects to one upstream host (0 means no limit) */
+  int relay_backoff_max; /* Upper limit in seconds of the reconnect backoff after failed connects */
   int kick_clients;  /* Kick clients when their source dies, instead of moving them to the default */
 
   avl_tree *my_hostnames;
@@ -543,6 +605,24 @@ typedef struct {
   int allow_http_admin;
   int sourcetable_via_udp; /* send sourcetable via UDP, IMPORTANT: can be used for DDOS UDP amplification */
   int hide_version;
+  int incremental_rehash; /* keep authentication parts whose file did not change */
+  int login_failures_host; /* failed logins until a host is blocked, 0 = no limit */
+  int login_failures_user; /* failed logins until a user is blocked on a host, 0 = no limit */
+  int login_failures_name; /* failed logins until a user is blocked on all hosts, 0 = no limit */
+  int login_failure_interval; /* seconds until one more failed login is allowed */
+  int login_block_time; /* seconds */
+  int access_log_format; /* ACCESS_LOG_CSV, ACCESS_LOG_BINARY or ACCESS_LOG_BOTH */
+  int access_segment_size; /* KB */
+  int lock_profiling; /* count contention of the named mutexes */
+  int thread_stall_budget; /* ms a loop may go without progress, 0 = no check */
+  int filter_cache_size; /* compiled sourcetable filters kept, 0 = no cache */
+  char *nearest_mount; /* clients are routed to the nearest station, "" = off */
+  int nearest_interval; /* seconds between position checks, 0 = never move */
+  int keepalive_timeout; /* seconds between two requests on one connection */
+  int keepalive_requests; /* requests per connection, 0 = always close */
+  int status_max_age; /* seconds a status snapshot is shared by views */
+  int stream_analysis; /* keep STR fields current from the RTCM streams */
+  int stream_analysis_interval; /* seconds measured before STR fields are compared */
 
   /* Statistics */
   statistics_t hourly_stats;
@@ -559,6 +639,12 @@ typedef struct {
   char * ldap_server;
   char * ldap_uid_prefix;
   char * ldap_people_context;
+  int ldap_port;
+  int ldap_pool_size;
+  int ldap_timeout; /* seconds */
+  int ldap_cache_ttl; /* seconds */
+  int ldap_negative_cache_ttl; /* seconds */
+  int ldap_grace_period; /* seconds */
 #endif /* HAVE_LIBLDAP */
 
   int consoledebuglevel;
@@ -610,4 +696,26 @@ typedef struct string_buffer_St {
   char *buf;
 } string_buffer_t;
 
+/* A file read at once, see load_file() */
+typedef struct loaded_file_St {
+  char *data;
+  size_t size;
+  size_t pos;
+} loaded_file_t;
+
+typedef struct hash_entry_St {
+  const char *key;
+  void *data;
+  struct hash_entry_St *next;
+} hash_entry_t;
+
+/* String keyed hash table, keys are not copied */
+typedef struct hash_table_St {
+  unsigned int size;
+  unsigned int count;
+  hash_entry_t **buckets;
+} hash_table_t;
+
+typedef int hash_match_func(void *data, void *arg);
+
 #endif
@@ -83,6 +83,7 @@
 #include "ntripcaster.h"
 #include "log.h"
 #include "pool.h"
+#include "probes.h"
 
 extern server_info_t info;
 
@@ -99,6 +100,7 @@ pool_init ()
 {
   xa_debug (1, "DEBUG: Initializing Connection Pool.");
   thread_create_mutex (&pool_mutex);
+  thread_mutex_profile (&pool_mutex, "pool");
   pool = avl_create (compare_connection, &info);
 }
 
@@ -133,6 +135,8 @@ pool_add (connection_t *con)
     return ICE_ERROR_NOT_INITIALIZED;
   }
 
+  CASTER_PROBE1(pool_add, con->id);
+
   /* Acquire mutex lock */
   pool_lock_write ();
 
@@ -0,0 +1,74 @@
+/* probes.h
+ * - Static tracepoints (USDT) for bpftrace, perf and systemtap
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_PROBES_H
+#define NTRIPCASTER_PROBES_H
+
+/*
+ * With sys/sdt.h each probe is a single nop in the code plus a note in
+ * the binary. Its arguments are only evaluated where the probe sits, so
+ * they must be cheap. Without sys/sdt.h, or with --disable-probes, the
+ * probes vanish.
+ *
+ * Probes of provider "ntripcaster" (see scripts/bpftrace/):
+ *   chunk_commit  (mount, source id, cid, bytes)
+ *   chunk_send    (mount, client id, cid, bytes written, chunks behind)
+ *   source_login  (mount, source id, host)
+ *   client_login  (mount, client id, host)
+ *   kick          (connection id, type, reason)
+ *   pool_add      (client id)
+ *   client_attach (mount, client id)
+ *   relay_connect (host, port, path, local mount)
+ *   lock_wait     (lock name, ns waited), only with lock_profiling
+ */
+#ifdef USE_PROBES
+# include <sys/sdt.h>
+# define CASTER_PROBE1(name,a) DTRACE_PROBE1(ntripcaster, name, a)
+# define CASTER_PROBE2(name,a,b) DTRACE_PROBE2(ntripcaster, name, a, b)
+# define CASTER_PROBE3(name,a,b,c) DTRACE_PROBE3(ntripcaster, name, a, b, c)
+# define CASTER_PROBE4(name,a,b,c,d) DTRACE_PROBE4(ntripcaster, name, a, b, c, d)
+# define CASTER_PROBE5(name,a,b,c,d,e) DTRACE_PROBE5(ntripcaster, name, a, b, c, d, e)
+#else
+# define CASTER_PROBE1(name,a) do {} while (0)
+# define CASTER_PROBE2(name,a,b) do {} while (0)
+# define CASTER_PROBE3(name,a,b,c) do {} while (0)
+# define CASTER_PROBE4(name,a,b,c,d) do {} while (0)
+# define CASTER_PROBE5(name,a,b,c,d,e) do {} while (0)
+#endif
+
+#endif
@@ -88,10 +88,15 @@
 #include "source.h"
 #include "log.h"
 #include "memory.h"
+#include "metrics.h"
 #include "commands.h"
 #include "vars.h"
 #include "logtime.h"
 #include "pool.h"
+#include "probes.h"
+#ifdef HAVE_POLL_H
+#include <poll.h>
+#endif /* HAVE_POLL_H */
 #ifdef HAVE_TLS
 #include "tls.h"
 #include <openssl/err.h>
@@ -367,6 +372,8 @@ relay_create ()
   relay->type = relay_pull_e;
   relay->reconnect_now = 0;
   relay->pending = 0;
+  relay->failures = 0;
+  relay->next_attempt = (time_t) 0;
 
   zero_request(&relay->req);
   zero_request(&relay->proxy);
@@ -386,6 +393,8 @@ relay_t *relay_copy (relay_t *other) {
   relay->last_reconnect = other->last_reconnect;
   relay->type = other->type;
   relay->pending = other->pending;
+  relay->failures = other->failures;
+  relay->next_attempt = other->next_attempt;
   relay->ntrip2 = other->ntrip2;
 
   strcpy(relay->req.path, other->req.path);
@@ -400,8 +409,102 @@ relay_t *relay_copy (relay_t *other) {
 }
 
 /*
- * Run through the list of relays, and connect the not connected ones
- * according to relay type.
+ * Connect attempts of the relay connector thread. Only that thread
+ * touches them, so the list needs no lock. Each attempt works on a copy
+ * of its relay, the original is found again by request and mount.
+ */
+typedef enum { relay_attempt_queued_e, relay_attempt_connect_e, relay_attempt_tls_e,
+  relay_attempt_send_e, relay_attempt_read_e, relay_attempt_done_e } relay_attempt_state_t;
+
+typedef struct relay_attempt_St {
+  relay_t *rel;
+  connection_t *con;
+  relay_attempt_state_t state;
+  int events;                     /* RELAY_WANT_READ or RELAY_WANT_WRITE */
+  time_t deadline;
+  char buffer[BUFSIZE];           /* The request, then the response behind relay_refused */
+  int len;
+  int pos;
+  char last;
+  struct relay_attempt_St *next;
+} relay_attempt_t;
+
+#define RELAY_WANT_READ 1
+#define RELAY_WANT_WRITE 2
+#define RELAY_IO_WAIT -2
+
+static const char relay_refused[] = "Relay refused entrance: ";
+static relay_attempt_t *relay_attempts = NULL;
+static relay_stats_t relay_stats = {0, 0, 0, 0};
+
+/*
+ * The host a relay connects to, its proxy if it has one
+ * Assert Class: 0
+ */
+static const char *
+relay_target_host (relay_t *rel)
+{
+  if (rel->type != relay_nontrip_e && rel->proxy.host[0])
+    return rel->proxy.host;
+  return rel->req.host;
+}
+
+/*
+ * Number of connect attempts running to host
+ * Assert Class: 0
+ */
+static int
+relay_host_attempts (const char *host)
+{
+  relay_attempt_t *a;
+  int n = 0;
+
+  for (a = relay_attempts; a; a = a->next)
+    if (a->state != relay_attempt_done_e && !ntripcaster_strcasecmp (relay_target_host (a->rel), host))
+      n++;
+  return n;
+}
+
+/*
+ * Seconds to wait before the next connect of a relay: relay_reconnect_time,
+ * doubled for every failed connect up to relay_backoff_max, and randomly
+ * shortened by up to one half so relays failing together spread out.
+ * Assert Class: 0
+ */
+static long
+relay_backoff (int failures)
+{
+  long delay = info.relay_reconnect_time > 0 ? info.relay_reconnect_time : 1;
+  long max = info.relay_backoff_max > delay ? info.relay_backoff_max : delay;
+
+  while (failures-- > 0 && delay < max)
+    delay *= 2;
+  if (delay > max)
+    delay = max;
+
+  return delay - rand () % (delay / 2 + 1);
+}
+
+/*
+ * The stream of rel ended. Its next connect is due a random share of
+ * relay_reconnect_time from now, so relays dropping together (e.g. when
+ * their upstream caster restarts) don't all reconnect at once.
+ * Needs info.relay_mutex
+ * Assert Class: 1
+ */
+void
+relay_ended (relay_t *rel)
+{
+  long delay = info.relay_reconnect_time > 0 ? info.relay_reconnect_time : 1;
+
+  rel->con = NULL;
+  rel->next_attempt = get_time () + rand () % (delay + 1);
+}
+
+/*
+ * Run through the list of relays, and queue a connect attempt for the not
+ * connected ones which are due and whose upstream host has a free slot.
+ * The attempts are carried out by relay_poll_connects().
  * Assert Class: 2
  */
 void
@@ -409,17 +512,9 @@ relay_connect_all_relays ()
 {
   avl_traverser trav = {0};
   relay_t *rel = NULL;
-  time_t now;
-  int all = 0, unconnected = 0, started = 0;
-
-  xa_debug (4, "DEBUG: Reconnecting unconnected relays....");
-
-/* that's why the server hanged from time to time. it takes some time to connect all
- * relays and during that time the double_mutex was locked.
- * Locking (and unlocking) of double_mutex no longer needed because of unlocking and
- * locking relay_mutex in function 'relay_connect_pull()'. ajd
- */
-//  thread_mutex_lock (&info.double_mutex);
+  relay_attempt_t *a;
+  time_t now = get_time ();
+  int all = 0, unconnected = 0, started = 0, deferred = 0;
 
   if (!info.relays) {
     write_log (LOG_DEFAULT, "WARNING: info.relays is NULL, weird!");
@@ -429,37 +524,47 @@ relay_connect_all_relays ()
 
   while ((rel = avl_traverse (info.relays, &trav)))
   {
-    now = get_time ();
     ++all;
-    if (!relay_connected_or_pending (rel)) {
-      ++unconnected;
-      if (rel->reconnect_now) {
-        ++started;
-        xa_debug (3, "DEBUG: Immediately connecting relay");
-        rel->reconnects++;
-        rel->last_reconnect = now;
-        rel->reconnect_now = 0;
-        rel->pending = 1;
-        thread_create("Relay Connect List Item", relay_connect_list_item, (void *)relay_copy(rel));
-
-      } else if ((((rel->last_reconnect + info.relay_reconnect_time) < now)
-      || (rel->last_reconnect == 0)) && ((rel->reconnects
-      < info.relay_reconnect_tries) || (info.relay_reconnect_tries == -1))) {
-        ++started;
-        rel->reconnects++;
-        rel->last_reconnect = now;
-        rel->reconnect_now = 0;
-        rel->pending = 1;
-        thread_create("Relay Connect List Item", relay_connect_list_item, (void *)relay_copy(rel));
-      }
+    if (relay_connected_or_pending (rel))
+      continue;
+    ++unconnected;
+
+    if (!rel->reconnect_now) {
+      if (rel->next_attempt > now)
+        continue;
+      if ((rel->reconnects >= info.relay_reconnect_tries) && (info.relay_reconnect_tries != -1))
+        continue;
+    } else
+      xa_debug (3, "DEBUG: Immediately connecting relay");
+
+    if ((info.relay_host_connects > 0)
+    && (relay_host_attempts (relay_target_host (rel)) >= info.relay_host_connects)) {
+      ++deferred;
+      continue;
     }
+
+    ++started;
+    rel->reconnects++;
+    rel->last_reconnect = now;
+    rel->reconnect_now = 0;
+    rel->pending = 1;
+
+    a = (relay_attempt_t *) nmalloc (sizeof (relay_attempt_t));
+    memset (a, 0, sizeof (relay_attempt_t));
+    a->rel = relay_copy (rel);
+    a->rel->con = NULL;
+    a->state = relay_attempt_queued_e;
+    a->next = relay_attempts;
+    relay_attempts = a;
   }
 
   thread_mutex_unlock (&info.relay_mutex);
-//  thread_mutex_unlock (&info.double_mutex); // not recommendable (see above). ajd
 
-  xa_debug (4, "DEBUG: Done reconnecting relays all %d unconnected %d started %d.",
-  all, unconnected, started);
+  if (deferred)
+    __atomic_add_fetch (&relay_stats.deferred, deferred, __ATOMIC_RELAXED);
+  if (started || deferred)
+    xa_debug (4, "DEBUG: Done reconnecting relays all %d unconnected %d started %d deferred %d.",
+    all, unconnected, started, deferred);
 }
 
 /*
@@ -481,12 +586,410 @@ relay_connected_or_pending (relay_t *rel)
 }
 
 /*
- * Connect a single relay from the list, according to type
+ * Give up a connect attempt: kick its connection and schedule the next
+ * attempt of the relay with backoff
+ * Assert Class: 2
+ */
+static void
+relay_attempt_failed (relay_attempt_t *a, const char *reason)
+{
+  ntrip_request_t *relreq = &a->rel->req;
+  relay_t *relay;
+  long delay = 0;
+
+  /* a queued attempt has no connection yet */
+  if (a->con)
+    kick_connection (a->con, (void *) reason);
+
+  thread_mutex_lock (&info.relay_mutex);
+
+  relay = relay_find_with_req (relreq, a->rel->localmount);
+  if (relay) {
+    relay->pending = 0;
+    relay->failures++;
+    delay = relay_backoff (relay->failures);
+    relay->next_attempt = get_time () + delay;
+  }
+
+  thread_mutex_unlock (&info.relay_mutex);
+
+  xa_debug (2, "DEBUG: Connecting relay [%s:%d%s] failed, next try in %ld seconds",
+  relreq->host, relreq->port, relreq->path, delay);
+  __atomic_add_fetch (&relay_stats.failures, 1, __ATOMIC_RELAXED);
+
+  relay_dispose (a->rel);
+  a->rel = NULL;
+  a->con = NULL;
+  a->state = relay_attempt_done_e;
+}
+
+/*
+ * The remote side accepted the relay. Mark it connected and let a thread
+ * of its own log it in as a source.
+ * Assert Class: 2
+ */
+static void
+relay_attempt_established (relay_attempt_t *a)
+{
+  relay_t *relay;
+
+  sock_set_blocking (a->con->sock, SOCK_BLOCK);
+
+  thread_mutex_lock (&info.relay_mutex);
+
+  relay = relay_find_with_req (&a->rel->req, a->rel->localmount);
+  if (relay) {
+    relay->con = a->con;
+    relay->pending = 0;
+    relay->failures = 0;
+    relay->next_attempt = get_time () + relay_backoff (0);
+  }
+
+  thread_mutex_unlock (&info.relay_mutex);
+
+  __atomic_add_fetch (&relay_stats.connects, 1, __ATOMIC_RELAXED);
+
+  a->rel->con = a->con;
+  thread_create ("Relay Source Login", relay_source_thread, (void *) a->rel);
+
+  a->rel = NULL;
+  a->con = NULL;
+  a->state = relay_attempt_done_e;
+}
+
+/*
+ * Start the non blocking connect of a queued attempt
+ * Assert Class: 2
+ */
+static void
+relay_attempt_start (relay_attempt_t *a)
+{
+  relay_t *rel = a->rel;
+  ntrip_request_t *relreq = &rel->req;
+
+  xa_debug (2, "DEBUG: Reconnecting relay %s [%s:%d%s]", rel->localmount,
+  relreq->host, relreq->port, relreq->path);
+  CASTER_PROBE4(relay_connect, &relreq->host[0], relreq->port, &relreq->path[0], rel->localmount);
+
+/* Setup the connection with sockets and stuff.
+ * connection_t con must be closed and freed
+ * (in relay_attempt_failed(...) or relay_source_login(...))
+ */
+  a->con = relay_setup_connection (relreq);
+  relay_source_setmp (a->con, rel);
+
+  if (rel->type == relay_nontrip_e) {
+    /* Hide Server Version */
+    if (info.hide_version){
+      snprintf(a->buffer, BUFSIZE, "NTRIP Caster (direct access)");
+    } else{
+      snprintf(a->buffer, BUFSIZE, "NTRIP Caster/%s (direct access)", info.version);
+    }
+    add_varpair2(a->con->headervars, nstrdup("Source-Agent"), nstrdup(a->buffer));
+  }
+
+  a->con->connect_time = get_time ();
+  a->con->sock = sock_connect_start (relay_target_host (rel),
+  rel->type != relay_nontrip_e && rel->proxy.host[0] ? rel->proxy.port : relreq->port);
+  if (a->con->sock == INVALID_SOCKET) {
+    xa_debug (4, "WARNING: sock_connect_start() to [%s:%d] failed", relreq->host, relreq->port);
+    relay_attempt_failed (a, "Relay: Could not connect");
+    return;
+  }
+
+  a->state = relay_attempt_connect_e;
+  a->events = RELAY_WANT_WRITE;
+  a->deadline = get_time () + RELAY_CONNECT_TIMEOUT;
+}
+
+/*
+ * Read or write on the connection of an attempt without blocking.
+ * Returns the number of bytes, 0 on end of stream, -1 on errors or
+ * RELAY_IO_WAIT with the awaited event set in the attempt.
+ * Assert Class: 1
+ */
+static int
+relay_attempt_io (relay_attempt_t *a, char *buf, int len, int write)
+{
+  int res;
+
+#ifdef HAVE_TLS
+  if (a->rel->tls) {
+    res = write ? SSL_write (a->con->tls_socket, buf, len) : SSL_read (a->con->tls_socket, buf, len);
+    if (res > 0)
+      return res;
+    switch (SSL_get_error (a->con->tls_socket, res)) {
+      case SSL_ERROR_WANT_READ:
+        a->events = RELAY_WANT_READ;
+        return RELAY_IO_WAIT;
+      case SSL_ERROR_WANT_WRITE:
+        a->events = RELAY_WANT_WRITE;
+        return RELAY_IO_WAIT;
+      case SSL_ERROR_ZERO_RETURN:
+        return 0;
+      default:
+        return -1;
+    }
+  }
+#endif /* HAVE_TLS */
+
+  errno = 0;
+  res = write ? send (a->con->sock, buf, len, 0) : recv (a->con->sock, buf, len, 0);
+  if (res < 0 && is_recoverable (errno)) {
+    a->events = write ? RELAY_WANT_WRITE : RELAY_WANT_READ;
+    return RELAY_IO_WAIT;
+  }
+  return res;
+}
+
+/*
+ * Advance an attempt as far as its connection allows without blocking:
+ * connect, TLS handshake, send the request, read and check the response.
+ * Assert Class: 3
+ */
+static void
+relay_attempt_step (relay_attempt_t *a)
+{
+  connection_t *con = a->con;
+  relay_t *rel = a->rel;
+  int res;
+  char c;
+
+  for (;;) {
+    switch (a->state) {
+      case relay_attempt_connect_e:
+        if (sock_connect_finish (con->sock) < 0) {
+          xa_debug (4, "WARNING: connect to [%s:%d] failed", rel->req.host, rel->req.port);
+          relay_attempt_failed (a, "Relay: Could not connect");
+          return;
+        }
+        con->connect_time = get_time ();
+        if (rel->type == relay_nontrip_e) {
+          relay_attempt_established (a);
+          return;
+        }
+        a->deadline = get_time () + RELAY_LOGIN_TIMEOUT;
+#ifdef HAVE_TLS
+        if (rel->tls) {
+          xa_debug (4, "Setup TLS [%s:%d] Ntrip2 %s", rel->req.host, rel->req.port, rel->ntrip2 ? "Y" : "N");
+          if (tls_setup (con, rel->req.host) < 0) {
+            relay_attempt_failed (a, "Relay: Could not connect TLS (setup failed)");
+            return;
+          }
+          a->state = relay_attempt_tls_e;
+          break;
+        }
+#endif /* HAVE_TLS */
+        relay_login_request (rel, a->buffer);
+        a->len = strlen (a->buffer);
+        a->pos = 0;
+        a->state = relay_attempt_send_e;
+        break;
+#ifdef HAVE_TLS
+      case relay_attempt_tls_e:
+        res = SSL_connect (con->tls_socket);
+        if (res != 1) {
+          switch (SSL_get_error (con->tls_socket, res)) {
+            case SSL_ERROR_WANT_READ:
+              a->events = RELAY_WANT_READ;
+              return;
+            case SSL_ERROR_WANT_WRITE:
+              a->events = RELAY_WANT_WRITE;
+              return;
+            default:
+            {
+              const char *e = ERR_reason_error_string(ERR_peek_last_error());
+              xa_debug (4, "WARNING: tls_connect() to [%s:%d] failed; %s", rel->req.host, rel->req.port, e);
+              snprintf(a->buffer, BUFSIZE, "Relay: Could not connect TLS (%s)", e);
+              relay_attempt_failed (a, a->buffer);
+              return;
+            }
+          }
+        }
+        xa_debug (4, "Did Setup TLS [%s:%d] %p", rel->req.host, rel->req.port, con->tls_socket);
+        relay_login_request (rel, a->buffer);
+        a->len = strlen (a->buffer);
+        a->pos = 0;
+        a->state = relay_attempt_send_e;
+        break;
+#endif /* HAVE_TLS */
+      case relay_attempt_send_e:
+        res = relay_attempt_io (a, a->buffer + a->pos, a->len - a->pos, 1);
+        if (res == RELAY_IO_WAIT)
+          return;
+        if (res <= 0) {
+          relay_attempt_failed (a, "Relay: Error in write");
+          return;
+        }
+        a->pos += res;
+        if (a->pos < a->len)
+          break;
+        /* the response is read behind the prefix of the kick message */
+        a->len = strlen (relay_refused);
+        memcpy (a->buffer, relay_refused, a->len);
+        a->last = '\r';
+        a->state = relay_attempt_read_e;
+        break;
+      case relay_attempt_read_e:
+        /* byte by byte, so the stream data behind the header stays unread */
+        res = relay_attempt_io (a, &c, 1, 0);
+        if (res == RELAY_IO_WAIT)
+          return;
+        if (res < 0 || (res == 0 && a->len == (int) strlen (relay_refused))) {
+          relay_attempt_failed (a, "Relay: Error in read");
+          return;
+        }
+        if (res > 0 && c == '\r')
+          break;
+        /* Ntrip2 reads the header up to the empty line, Ntrip1 the status line */
+        if (res > 0 && !(c == '\n' && (!rel->ntrip2 || a->last == '\n'))) {
+          a->buffer[a->len++] = c;
+          a->last = c;
+          if (a->len < BUFSIZE - 1)
+            break;
+        }
+        a->buffer[a->len] = '\0';
+        xa_debug (2, "DEBUG: relay login got %d bytes: %s", a->len - (int) strlen (relay_refused),
+        a->buffer + strlen (relay_refused));
+        if (relay_login_response (con, a->buffer, a->buffer + strlen (relay_refused)) != OK) {
+          relay_attempt_failed (a, a->buffer);
+          return;
+        }
+        relay_attempt_established (a);
+        return;
+      default:
+        return;
+    }
+  }
+}
+
+/*
+ * Start the queued connect attempts, wait up to msec milliseconds for
+ * their connections and advance them. Returns the number of attempts
+ * still running.
+ * Assert Class: 3
+ */
+int
+relay_poll_connects (int msec)
+{
+  relay_attempt_t *a, **ap;
+  time_t now;
+  int n = 0, res;
+
+  for (a = relay_attempts; a; a = a->next) {
+    if (a->state == relay_attempt_queued_e)
+      relay_attempt_start (a);
+    if (a->state != relay_attempt_done_e)
+      n++;
+  }
+
+  if (n > 0) {
+#ifdef HAVE_POLL
+    struct pollfd *fds = (struct pollfd *) nmalloc (n * sizeof (struct pollfd));
+    int i = 0;
+
+    for (a = relay_attempts; a; a = a->next) {
+      if (a->state == relay_attempt_done_e)
+        continue;
+      fds[i].fd = a->con->sock;
+      fds[i].events = a->events == RELAY_WANT_READ ? POLLIN : POLLOUT;
+      fds[i].revents = 0;
+      i++;
+    }
+
+    res = poll (fds, n, msec);
+
+    i = 0;
+    for (a = relay_attempts; a && res > 0; a = a->next) {
+      if (a->state == relay_attempt_done_e)
+        continue;
+      if (fds[i++].revents)
+        relay_attempt_step (a);
+    }
+    nfree (fds);
+#else /* HAVE_POLL */
+    fd_set rfds, wfds;
+    struct timeval tv = { msec / 1000, (msec % 1000) * 1000 };
+    SOCKET maxfd = 0;
+
+    FD_ZERO(&rfds);
+    FD_ZERO(&wfds);
+    for (a = relay_attempts; a; a = a->next) {
+      if (a->state == relay_attempt_done_e)
+        continue;
+      FD_SET(a->con->sock, a->events == RELAY_WANT_READ ? &rfds : &wfds);
+      if (a->con->sock > maxfd)
+        maxfd = a->con->sock;
+    }
+
+    res = select (maxfd + 1, &rfds, &wfds, NULL, &tv);
+
+    for (a = relay_attempts; a && res > 0; a = a->next) {
+      if (a->state == relay_attempt_done_e)
+        continue;
+      if (FD_ISSET(a->con->sock, &rfds) || FD_ISSET(a->con->sock, &wfds))
+        relay_attempt_step (a);
+    }
+#endif /* HAVE_POLL */
+  }
+
+  now = get_time ();
+  n = 0;
+  ap = &relay_attempts;
+  while ((a = *ap)) {
+    if (a->state != relay_attempt_done_e && a->deadline < now)
+      relay_attempt_failed (a, a->state == relay_attempt_connect_e ?
+      "Relay: Could not connect" : "Relay: Timeout in login");
+    if (a->state == relay_attempt_done_e) {
+      *ap = a->next;
+      nfree (a);
+    } else {
+      ap = &a->next;
+      n++;
+    }
+  }
+
+  __atomic_store_n (&relay_stats.in_flight, n, __ATOMIC_RELAXED);
+
+  return n;
+}
+
+/*
+ * Give up the attempts still running, when the relay connector thread
+ * stops. Their connections are kicked like the ones of failed attempts.
+ * Assert Class: 3
+ */
+void
+relay_abort_connects ()
+{
+  relay_attempt_t *a;
+
+  while ((a = relay_attempts)) {
+    relay_attempts = a->next;
+    if (a->state != relay_attempt_done_e)
+      relay_attempt_failed (a, "Relay: Connector stopped");
+    nfree (a);
+  }
+
+  __atomic_store_n (&relay_stats.in_flight, 0, __ATOMIC_RELAXED);
+}
+
+void
+relay_get_stats (relay_stats_t *stats)
+{
+  stats->connects = __atomic_load_n (&relay_stats.connects, __ATOMIC_RELAXED);
+  stats->failures = __atomic_load_n (&relay_stats.failures, __ATOMIC_RELAXED);
+  stats->deferred = __atomic_load_n (&relay_stats.deferred, __ATOMIC_RELAXED);
+  stats->in_flight = __atomic_load_n (&relay_stats.in_flight, __ATOMIC_RELAXED);
+}
+
+/*
+ * Log in an established relay as a source
  * Assert Class: 1
  *
  */
 
-void *relay_connect_list_item (void *arg) // relay (arg) must be freed. ajd
+void *relay_source_thread (void *arg) // relay (arg) must be freed. ajd
 {
   relay_t *rel = (relay_t *)arg;
   relay_t *orginal;
@@ -494,17 +997,18 @@ void *relay_connect_list_item (void *arg) // relay (arg) must be freed. ajd
 
   thread_init();
 
-  xa_debug (2, "DEBUG: Reconnecting relay %s [%s:%d%s]", rel->localmount,
-  relreq->host, relreq->port, relreq->path);
-
   /* Does not return unless an error happens or the source dies. */
-  relay_connect_pull (rel);
+  relay_source_login (rel->con, rel);
+
+  xa_debug (4, "Relay connection ended.");
 
   thread_mutex_lock (&info.relay_mutex);
 
+  /* close_connection() may have ended it already, and a new
+     connect may be on its way meanwhile */
   orginal = relay_find_with_req (relreq, rel->localmount);
-  if (orginal != NULL) {
-    orginal->con = NULL;
+  if (orginal != NULL && orginal->con == rel->con) {
+    relay_ended (orginal);
     orginal->pending = 0;
   }
 
@@ -535,54 +1039,6 @@ void relay_source_setmp(connection_t *con, relay_t *rel)
   add_global_stats(source);
 }
 
-/*
- * Initiate a pulling relay connection, login and add to list of sources
- * Errors in err, one of following:
- * ICE_ERROR_INIT_FAILED - Failed to initialize relay resources
- * ICE_ERROR_INSERT_FAILED - Failed to insert new source in sourcetree (login failure...)
- * Assert Class: 4
- */
-int relay_connect_pull (relay_t *rel) {
-  connection_t *newcon;
-  int res;
-  relay_t *relay = NULL;
-  ntrip_request_t *relreq = &rel->req;
-
-/* Setup the connection with sockets and stuff.
- * connection_t newcon must be closed and freed
- * (in login_as_[nontrip_]client_on_server(...) or relay_source_login(...))
- */
-  newcon = relay_setup_connection (relreq);
-  relay_source_setmp(newcon, rel);
-
-  if (rel->type == relay_nontrip_e)
-    res = login_as_nontrip_client_on_server (newcon, rel);
-  else
-    res = login_as_client_on_server (newcon, rel);
-
-  if (res < 0) {
-    xa_debug (4, "WARNING: relay login as client failed (%d)", res);
-    return ICE_ERROR_CONNECT;
-  }
-
-  thread_mutex_lock (&info.relay_mutex);
-
-  relay = relay_find_with_req (relreq, rel->localmount);
-  if (relay) {
-    relay->con = newcon;
-    relay->pending = 0;
-  }
-
-  thread_mutex_unlock (&info.relay_mutex);
-
-  /* Does not return unless an error happens or the source dies. */
-  relay_source_login (newcon, rel);
-
-  xa_debug (4, "Relay connection ended.");
-
-  return OK;
-}
-
 void relay_source_login(connection_t *con, relay_t *rel) {
   source_t *source = con->food.source;
 
@@ -605,10 +1061,12 @@ void relay_source_login(connection_t *con, relay_t *rel) {
   add_source();
   source->connected = SOURCE_CONNECTED;
   avl_insert(info.sources, con);
+  metrics_source_attached (source->metrics);
 
   thread_mutex_unlock(&info.source_mutex);
 
   write_log (LOG_DEFAULT, "Accepted relay encoder on mountpoint %s from %s. %d sources connected", source->audiocast.mount, con_host(con), info.num_sources);
+  CASTER_PROBE3(source_login, source->audiocast.mount, con->id, con_host(con));
 
   thread_rename("Source Thread");
 
@@ -617,53 +1075,15 @@ void relay_source_login(connection_t *con, relay_t *rel) {
 
 
 /*
- * Login as a client on a given server
- * Returns OK or one of the following errors:
- * ICE_ERROR_CONNECT - Connection failed
- * ICE_ERROR_TRANSMISSION - Connect worked, but failed to read data
- * ICE_ERROR_HEADER - Invalid headers received from server
- * Assert Class: 3
+ * Write the request to log in as a client on the remote server into
+ * buffer (of BUFSIZE)
+ * Assert Class: 1
  */
-int
-login_as_client_on_server (connection_t *con, relay_t *rel)
+void
+relay_login_request (relay_t *rel, char *buffer)
 {
-  SOCKET sockfd;
-  const char *relaystr = "Relay refused entrance: ";
-  char buffer[BUFSIZE];
-  char line[BUFSIZE];
-  int res = 0, i;
-  char *recvbuf;
   ntrip_request_t *req = &rel->req;
 
-  if ((sockfd = sock_connect_wto (rel->proxy.host[0] ? rel->proxy.host : req->host,
-  rel->proxy.host[0] ? rel->proxy.port : req->port, 15)) == -1) {
-    xa_debug (4, "WARNING: sock_connect_wto() to [%s:%d] failed", req->host, req->port);
-    con->connect_time = get_time ();
-    kick_connection (con, "Relay: Could not connect");
-    return ICE_ERROR_CONNECT;
-  }
-
-  con->sock = sockfd;
-  con->connect_time = get_time ();
-
-#ifdef HAVE_TLS
-  if(rel->tls)
-  {
-    xa_debug (4, "Setup TLS [%s:%d] Ntrip2 %s", req->host, req->port, rel->ntrip2 ? "Y" : "N");
-    if(tls_connect(con, req->host) < 0)
-    {
-      const char *e = ERR_reason_error_string(ERR_peek_last_error());
-      xa_debug (4, "WARNING: tls_connect() to [%s:%d] failed; %s", req->host, req->port, e);
-      con->connect_time = get_time ();
-      snprintf(buffer, BUFSIZE, "Relay: Could not connect TLS (%s)", e);
-      kick_connection (con, buffer);
-      sock_close(sockfd);
-      return ICE_ERROR_CONNECT;
-    }
-    xa_debug (4, "Did Setup TLS [%s:%d] %p", req->host, req->port, con->tls_socket);
-  }
-#endif /* HAVE_TLS */
-
   if (rel->proxy.host[0]) {
     if(snprintf(buffer, BUFSIZE, "GET http://%s:%d%s HTTP/1.%d\r\nHost: %s\r\n",
     req->host, req->port, req->path, rel->ntrip2 ? 1 : 0, req->host) >= BUFSIZE)
@@ -681,32 +1101,22 @@ login_as_client_on_server (connection_t *con, relay_t *rel)
     catsnprintf(buffer, BUFSIZE, "User-Agent: NTRIP Caster/%s\r\nReferer: RELAY\r\nConnection: close\r\n", info.version);
   }
   if (rel->userID != NULL) catsnprintf(buffer, BUFSIZE, "Authorization: Basic %s\r\n", rel->userID);
+  catsnprintf(buffer, BUFSIZE, "\r\n");
+}
 
-#ifdef HAVE_TLS
-  if(rel->tls)
-    tls_write_line(con->tls_socket, buffer);
-  else
-#endif /*HAVE_TLS */
-  sock_write_line (sockfd, buffer);
-
-  i = strlen(relaystr);
-  recvbuf = buffer+i;
-  memcpy(buffer, relaystr, i);
-  if(rel->ntrip2)
-#ifdef HAVE_TLS
-    if(rel->tls)
-      res = tls_read_lines_with_timeout(con->tls_socket, recvbuf, sizeof(buffer)-i);
-    else
-#endif /*HAVE_TLS */
-          res = sock_read_lines_with_timeout(sockfd, recvbuf, sizeof(buffer)-i);
-  else
-          res = sock_read_line_with_timeout(sockfd, recvbuf, sizeof(buffer)-i);
-
-  if (res < 0) {
-    kick_connection (con, "Relay: Error in read");
-    return ICE_ERROR_TRANSMISSION;
-  }
-  xa_debug (2, "DEBUG: login_as_client_on_server() got %d bytes: %s", res, recvbuf);
+/*
+ * Check the response of the remote server in recvbuf, which is located in
+ * buffer (of BUFSIZE) behind the "Relay refused entrance: " prefix, and
+ * take over its headers. On errors buffer holds the reason for the kick.
+ * Returns OK or the following error:
+ * ICE_ERROR_HEADER - Invalid headers received from server
+ * Assert Class: 3
+ */
+int
+relay_login_response (connection_t *con, char *buffer, char *recvbuf)
+{
+  char line[BUFSIZE];
+  int i;
 
   /* Ntrip2 */
   if((!ntripcaster_strncmp (recvbuf, "HTTP/1.1 200 OK", 15)
@@ -716,14 +1126,14 @@ login_as_client_on_server (connection_t *con, relay_t *rel)
     int go_on = 1;
     do {
       if (splitc(line, recvbuf, '\n') == NULL) {
-        strncpy(line, recvbuf, BUFSIZE);
+        snprintf(line, BUFSIZE, "%s", recvbuf);
         go_on = 0;
       }
       extract_header_vars (line, con->headervars);
     } while (go_on);
 
     var = get_con_variable(con, "Transfer-Encoding");
-    xa_debug (2, "DEBUG: login_as_client_on_server() Ntrip2 chunked mode: %s",
+    xa_debug (2, "DEBUG: relay_login_response() Ntrip2 chunked mode: %s",
           var ? var : "<none>");
     if(var && !strcmp(var, "chunked")) {
       con->trans_encoding = chunked_e;
@@ -736,13 +1146,13 @@ login_as_client_on_server (connection_t *con, relay_t *rel)
     if(!var) {
         /* Hide Server Version */
         if (info.hide_version){
-          snprintf(buffer, sizeof(buffer), "NTRIP Caster (relay)");
+          snprintf(buffer, BUFSIZE, "NTRIP Caster (relay)");
         } else {
-          snprintf(buffer, sizeof(buffer), "NTRIP Caster/%s (relay)", info.version);
+          snprintf(buffer, BUFSIZE, "NTRIP Caster/%s (relay)", info.version);
         }
     }
     else {
-        snprintf(buffer, sizeof(buffer), "%s (relay v2)", var);
+        snprintf(buffer, BUFSIZE, "%s (relay v2)", var);
     }
     add_varpair2(con->headervars, nstrdup("Source-Agent"), nstrdup(buffer));
   }
@@ -750,17 +1160,16 @@ login_as_client_on_server (connection_t *con, relay_t *rel)
     for(i = 0; i < 100 && recvbuf[i] && recvbuf[i] >= 0x20 && recvbuf[i] < 0x7F; ++i)
       ;
     recvbuf[i] = 0;
-    /* we already appended the error text before, so send as one string */
-    kick_connection (con, buffer);
+    /* the error text is already appended to the prefix in buffer */
     return ICE_ERROR_HEADER;
   }
   else
   {
     /* Hide Server Version */
     if (info.hide_version){
-      snprintf(buffer, sizeof(buffer), "NTRIP Caster (relay)");
+      snprintf(buffer, BUFSIZE, "NTRIP Caster (relay)");
     } else{
-      snprintf(buffer, sizeof(buffer), "NTRIP Caster/%s (relay)", info.version);
+      snprintf(buffer, BUFSIZE, "NTRIP Caster/%s (relay)", info.version);
     }
     add_varpair2(con->headervars, nstrdup("Source-Agent"), nstrdup(buffer));
   }
@@ -768,36 +1177,6 @@ login_as_client_on_server (connection_t *con, relay_t *rel)
   return OK;
 }
 
-int login_as_nontrip_client_on_server (connection_t *con, relay_t *rel) {
-  SOCKET sockfd;
-  char buffer[50];
-  ntrip_request_t *req = &rel->req;
-  /* Hide Server Version */
-  if (info.hide_version)
-  {
-    strcpy(info.version, "*");
-  }
-  /* Hide Server Version */
-  if (info.hide_version){
-    snprintf(buffer, sizeof(buffer), "NTRIP Caster (direct access)");
-  } else{
-    snprintf(buffer, sizeof(buffer), "NTRIP Caster/%s (direct access)", info.version);
-  }
-  add_varpair2(con->headervars, nstrdup("Source-Agent"), nstrdup(buffer));
-
-  if ((sockfd = sock_connect_wto (req->host, req->port, 15)) == -1) {
-    xa_debug (4, "WARNING: sock_connect_wto() to [%s:%d] failed", req->host, req->port);
-    con->connect_time = get_time ();
-    kick_connection (con, "Relay: Could not connect");
-    return ICE_ERROR_CONNECT;
-  }
-
-  con->sock = sockfd;
-  con->connect_time = get_time ();
-
-  return OK;
-}
-
 /*
  * Allocate and innitiate a relay connection and request struct
  * Assert Class: 2
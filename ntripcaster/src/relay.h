@@ -39,6 +39,19 @@
 #ifndef __NTRIPCASTER_RELAY_H
 #define __NTRIPCASTER_RELAY_H
 
+/* Timeouts in seconds of the connect and of the login of a relay */
+#define RELAY_CONNECT_TIMEOUT 15
+#define RELAY_LOGIN_TIMEOUT 10
+/* Milliseconds the relay connector waits for its connections at most */
+#define RELAY_POLL_INTERVAL 500
+
+typedef struct relay_stats_St {
+  unsigned long int connects;  /* accepted by the remote side */
+  unsigned long int failures;  /* connect or login failed */
+  unsigned long int deferred;  /* waited for a slot of relay_host_connects */
+  int in_flight;
+} relay_stats_t;
+
 int relay_add_pull_to_list (char *arg);
 int relay_add_push_to_list (char *arg);
 int relay_insert (relay_t *relay);
@@ -46,16 +59,20 @@ void relay_dispose (relay_t *relay);
 relay_t *relay_create ();
 relay_t *relay_copy (relay_t *old);
 void relay_connect_all_relays ();
+int relay_poll_connects (int msec);
+void relay_abort_connects ();
+void relay_ended (relay_t *rel);
 int relay_connected_or_pending (relay_t *rel);
+void relay_get_stats (relay_stats_t *stats);
 
-void *relay_connect_list_item (void *arg);
+void *relay_source_thread (void *arg);
 //connection_t *relay_connect_push (relay_t *relay, int *err);
 int relay_pull (com_request_t *comreq, char *arg);
 //connection_t *relay_pull_stream (ntrip_request_t *req, int *err);
-int relay_connect_pull (relay_t *rel);
+void relay_source_setmp(connection_t *con, relay_t *rel);
 void relay_source_login(connection_t *con, relay_t *rel);
-int login_as_client_on_server (connection_t *con, relay_t *rel);
-int login_as_nontrip_client_on_server (connection_t *con, relay_t *rel);
+void relay_login_request (relay_t *rel, char *buffer);
+int relay_login_response (connection_t *con, char *buffer, char *recvbuf);
 connection_t *relay_setup_connection (ntrip_request_t *req);
 
 int relay_remove_with_con (connection_t *con);
@@ -0,0 +1,662 @@
+/* rtcm.c
+ * - Analysis of RTCM 3 streams for their STR entries
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <math.h>
+#include <time.h>
+
+#include "avl.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "sourcetable.h"
+#include "match.h"
+#include "stindex.h"
+#include "utility.h"
+#include "logtime.h"
+#include "log.h"
+#include "memory.h"
+#include "rtcm.h"
+
+extern server_info_t info;
+
+/*
+ * The source thread hands every chunk to rtcm_analyze(). Bytes between
+ * frames are skipped with memchr(), frames are copied whole and checked
+ * with the CRC-24Q, and only the first bits of a message are decoded.
+ * Every stream_analysis_interval seconds the message periods, satellite
+ * systems, bitrate and antenna position are compared with the STR entry
+ * of the mountpoint. The fields which are clearly off are queued, the
+ * timer thread rewrites the entries of all queued mountpoints and
+ * republishes the sourcetable once, see rtcm_apply_updates().
+ */
+static unsigned int crc24q[256];
+static rtcm_stats_t rtcm_stats;
+
+/* Fields of a STR entry waiting for rtcm_apply_updates() */
+typedef struct rtcm_update_St {
+  char *mount;
+  char *values[STR_FIELDS]; /* NULL keeps a field */
+} rtcm_update_t;
+
+static mutex_t update_mutex;
+static hash_table_t *updates; /* by mount */
+
+/* Message numbers by satellite system, observations, ephemerides and SSR */
+static const struct {
+  int first;
+  int last;
+  int system;
+} type_systems[] = {
+  { 1001, 1004, RTCM_GPS }, { 1019, 1019, RTCM_GPS }, { 1057, 1062, RTCM_GPS }, { 1071, 1077, RTCM_GPS },
+  { 1009, 1012, RTCM_GLO }, { 1020, 1020, RTCM_GLO }, { 1063, 1068, RTCM_GLO }, { 1081, 1087, RTCM_GLO },
+  { 1045, 1046, RTCM_GAL }, { 1091, 1097, RTCM_GAL }, { 1240, 1245, RTCM_GAL },
+  { 1042, 1042, RTCM_BDS }, { 1121, 1127, RTCM_BDS }, { 1258, 1263, RTCM_BDS },
+  { 1044, 1044, RTCM_QZS }, { 1111, 1117, RTCM_QZS }, { 1246, 1251, RTCM_QZS },
+  { 1043, 1043, RTCM_SBAS }, { 1101, 1107, RTCM_SBAS }, { 1252, 1257, RTCM_SBAS },
+  { 1041, 1041, RTCM_IRN }, { 1131, 1137, RTCM_IRN },
+  { 0, 0, 0 }
+};
+
+/* nav-system names, the first one of a system is written */
+static const struct {
+  const char *name;
+  int system;
+} system_names[] = {
+  { "GPS", RTCM_GPS }, { "GLO", RTCM_GLO }, { "GAL", RTCM_GAL }, { "BDS", RTCM_BDS },
+  { "QZS", RTCM_QZS }, { "SBAS", RTCM_SBAS }, { "IRN", RTCM_IRN },
+  { "GLONASS", RTCM_GLO }, { "Galileo", RTCM_GAL }, { "BeiDou", RTCM_BDS }, { "QZSS", RTCM_QZS },
+  { "SBS", RTCM_SBAS }, { "IRNSS", RTCM_IRN }, { "NavIC", RTCM_IRN },
+  { "Compass", RTCM_BDS }, { "BDS3", RTCM_BDS }, { "WAAS", RTCM_SBAS }, { "EGNOS", RTCM_SBAS },
+  { "MSAS", RTCM_SBAS }, { "GAGAN", RTCM_SBAS }, { "SDCM", RTCM_SBAS },
+  { NULL, 0 }
+};
+
+static const char *str_field_names[STR_FIELDS] = {
+  "type", "mountpoint", "identifier", "format", "format-details", "carrier", "nav-system", "network",
+  "country", "latitude", "longitude", "nmea", "solution", "generator", "compr-encryp", "authentication",
+  "fee", "bitrate", "misc" };
+
+void rtcm_init(void) {
+  unsigned int crc;
+  int i, j;
+
+  for (i = 0; i < 256; i++) {
+    crc = (unsigned int)i << 16;
+    for (j = 0; j < 8; j++)
+      crc = (crc & 0x800000) ? ((crc << 1) ^ 0x1864CFB) : (crc << 1);
+    crc24q[i] = crc & 0xFFFFFF;
+  }
+
+  thread_create_mutex(&update_mutex);
+  updates = hash_create(64);
+}
+
+static void free_update(rtcm_update_t *u) {
+  int i;
+
+  for (i = 0; i < STR_FIELDS; i++)
+    if (u->values[i]) {
+      nfree(u->values[i]);
+    }
+  nfree(u->mount);
+  nfree(u);
+}
+
+/* Only at shutdown, when the other threads are gone */
+void rtcm_cleanup(void) {
+  hash_destroy(updates, (ntripcaster_function *)free_update);
+  updates = NULL;
+  thread_mutex_destroy(&update_mutex);
+}
+
+rtcm_analyzer_t *rtcm_create(const char *mount) {
+  rtcm_analyzer_t *a = (rtcm_analyzer_t *)nmalloc(sizeof(rtcm_analyzer_t));
+
+  memset(a, 0, sizeof(rtcm_analyzer_t));
+  a->mount = nstrdup(mount ? mount : "");
+  a->station_id = -1;
+  a->summary.station_id = -1;
+
+  return a;
+}
+
+void rtcm_free(rtcm_analyzer_t *a) {
+  if (!a)
+    return;
+  nfree(a->mount);
+  nfree(a);
+}
+
+static unsigned long long int getbitu(const unsigned char *buf, int pos, int len) {
+  unsigned long long int v = 0;
+  int i;
+
+  for (i = pos; i < pos + len; i++)
+    v = (v << 1) | ((buf[i / 8] >> (7 - i % 8)) & 1);
+  return v;
+}
+
+static long long int getbits(const unsigned char *buf, int pos, int len) {
+  unsigned long long int v = getbitu(buf, pos, len);
+
+  if (v & (1ULL << (len - 1)))
+    return (long long int)(v - (1ULL << len));
+  return (long long int)v;
+}
+
+/* WGS84 latitude, longitude in degrees and height in metres */
+static void ecef_to_geodetic(double x, double y, double z, double *lat, double *lon, double *height) {
+  const double a = 6378137.0, f = 1.0 / 298.257223563, e2 = f * (2.0 - f);
+  double p = sqrt(x * x + y * y), phi = atan2(z, p * (1.0 - e2)), n = a, s;
+  int i;
+
+  for (i = 0; i < 5; i++) {
+    s = sin(phi);
+    n = a / sqrt(1.0 - e2 * s * s);
+    phi = atan2(z + e2 * n * s, p);
+  }
+  *lat = phi * 180.0 / M_PI;
+  *lon = atan2(y, x) * 180.0 / M_PI;
+  *height = p / cos(phi) - n;
+}
+
+static int type_system(int type) {
+  int i;
+
+  for (i = 0; type_systems[i].first; i++)
+    if ((type >= type_systems[i].first) && (type <= type_systems[i].last))
+      return type_systems[i].system;
+  return 0;
+}
+
+/* Message types starting with the reference station ID */
+static int has_station_id(int type) {
+  return ((type >= 1001) && (type <= 1013)) || (type == 1029) || (type == 1033) || (type == 1230)
+    || ((type >= 1071) && (type <= 1137));
+}
+
+static void count_type(rtcm_analyzer_t *a, int type, long long int now_ms) {
+  rtcm_type_t *t;
+  int i;
+
+  /* not a message type, and 0 marks a free slot in types */
+  if (type == 0)
+    return;
+
+  if (a->slot[type] == 0) {
+    for (i = 0; i < RTCM_MAX_TYPES; i++)
+      if (a->types[i].type == 0)
+        break;
+    if (i == RTCM_MAX_TYPES)
+      return;
+    t = &a->types[i];
+    memset(t, 0, sizeof(rtcm_type_t));
+    t->type = type;
+    t->first_ms = t->last_ms = now_ms;
+    a->slot[type] = i + 1;
+    return;
+  }
+
+  t = &a->types[a->slot[type] - 1];
+  t->count++;
+  t->last_ms = now_ms;
+}
+
+/* A frame with a valid CRC, payload after the 3 header bytes */
+static void handle_message(rtcm_analyzer_t *a, const unsigned char *payload, int len, long long int now_ms) {
+  int type;
+
+  if (len < 2)
+    return;
+
+  type = (int)getbitu(payload, 0, 12);
+  count_type(a, type, now_ms);
+
+  if ((len >= 3) && has_station_id(type))
+    a->station_id = (int)getbitu(payload, 12, 12);
+
+  /* antenna reference point, 0.1 mm */
+  if (((type == 1005) || (type == 1006)) && (len >= 19)) {
+    double x = getbits(payload, 34, 38) * 0.0001, y = getbits(payload, 74, 38) * 0.0001,
+      z = getbits(payload, 114, 38) * 0.0001;
+
+    if ((x != 0.0) || (y != 0.0) || (z != 0.0)) {
+      ecef_to_geodetic(x, y, z, &a->lat, &a->lon, &a->height);
+      if ((type == 1006) && (len >= 21))
+        a->height += getbitu(payload, 152, 16) * 0.0001;
+      a->has_arp = 1;
+    }
+  }
+}
+
+/* Drops frame bytes up to the next preamble at or after from */
+static void drop_to_preamble(rtcm_analyzer_t *a, int from) {
+  unsigned char *p = (from < a->have) ? memchr(a->frame + from, RTCM_PREAMBLE, a->have - from) : NULL;
+
+  if (p == NULL) {
+    a->have = 0;
+    return;
+  }
+  a->have -= p - a->frame;
+  memmove(a->frame, p, a->have);
+}
+
+/* Handles the complete frames in frame[], leaves an incomplete one */
+static void scan_frames(rtcm_analyzer_t *a, long long int now_ms) {
+  unsigned int crc;
+  int i, len;
+
+  while (a->have >= 3) {
+    /* 6 reserved bits and the payload length */
+    if (a->frame[1] & 0xFC) {
+      drop_to_preamble(a, 1);
+      continue;
+    }
+    len = ((a->frame[1] & 0x03) << 8) | a->frame[2];
+    a->need = len + 6;
+    if (a->have < a->need)
+      return;
+
+    crc = 0;
+    for (i = 0; i < len + 3; i++)
+      crc = ((crc << 8) & 0xFFFFFF) ^ crc24q[(crc >> 16) ^ a->frame[i]];
+
+    if (crc == (((unsigned int)a->frame[len + 3] << 16) | ((unsigned int)a->frame[len + 4] << 8) | a->frame[len + 5])) {
+      a->frames++;
+      handle_message(a, a->frame + 3, len, now_ms);
+      drop_to_preamble(a, a->need);
+    } else {
+      a->crc_errors++;
+      drop_to_preamble(a, 1);
+    }
+  }
+}
+
+/* Periods of the types seen lately, drops the ones gone. Returns the systems. */
+static int measure_types(rtcm_analyzer_t *a, long long int now_ms) {
+  long long int keep;
+  rtcm_type_t *t;
+  int i, systems = 0;
+
+  for (i = 0; i < RTCM_MAX_TYPES; i++) {
+    t = &a->types[i];
+    if (t->type == 0)
+      continue;
+
+    if (t->count > 0) {
+      t->period = (t->last_ms - t->first_ms) / 1000.0 / t->count;
+      t->first_ms = t->last_ms;
+      t->count = 0;
+    }
+
+    keep = (long long int)(RTCM_KEEP_PERIODS * 1000.0 * ((t->period > info.stream_analysis_interval) ? t->period : info.stream_analysis_interval));
+    if (now_ms - t->last_ms > keep) {
+      a->slot[t->type] = 0;
+      t->type = 0;
+      continue;
+    }
+    systems |= type_system(t->type);
+  }
+
+  return systems;
+}
+
+static int compare_types(const void *first, const void *second) {
+  return (*(const rtcm_type_t * const *)first)->type - (*(const rtcm_type_t * const *)second)->type;
+}
+
+/* Types with a known period in ascending order, returns their number */
+static int sorted_types(rtcm_analyzer_t *a, rtcm_type_t **sorted) {
+  int i, n = 0;
+
+  for (i = 0; i < RTCM_MAX_TYPES; i++)
+    if (a->types[i].type && (a->types[i].period > 0.0))
+      sorted[n++] = &a->types[i];
+  qsort(sorted, n, sizeof(rtcm_type_t *), compare_types);
+
+  return n;
+}
+
+/* Returns the number of types written, the ones not fitting are left out */
+static int format_details(rtcm_type_t **sorted, int n, char *buf, int size) {
+  char item[32];
+  int i, len = 0, itemlen;
+
+  buf[0] = '\0';
+  for (i = 0; i < n; i++) {
+    if (sorted[i]->period >= 0.95)
+      itemlen = snprintf(item, sizeof(item), "%s%d(%.0f)", i ? "," : "", sorted[i]->type, sorted[i]->period);
+    else
+      itemlen = snprintf(item, sizeof(item), "%s%d(%.1f)", i ? "," : "", sorted[i]->type, sorted[i]->period);
+    if (len + itemlen >= size)
+      break;
+    memcpy(buf + len, item, itemlen + 1);
+    len += itemlen;
+  }
+
+  return i;
+}
+
+/* Whether format-details "1004(1),1005(10),..." lists other types or periods */
+static int details_differ(const char *details, rtcm_type_t **sorted, int n) {
+  const char *p = details;
+  char *end;
+  double period;
+  int i, type, listed = 0;
+
+  while (*p) {
+    while (*p == ' ' || *p == ',') p++;
+    if (*p == '\0')
+      break;
+
+    type = (int)strtol(p, &end, 10);
+    if (end == p)
+      return 1;
+    p = end;
+    period = -1.0;
+    if (*p == '(') {
+      period = strtod(p + 1, &end);
+      if ((end == p + 1) || (*end != ')'))
+        return 1;
+      p = end + 1;
+    }
+
+    for (i = 0; i < n; i++)
+      if (sorted[i]->type == type)
+        break;
+    if ((i == n) || (period < 0.0) || (fabs(period - sorted[i]->period) > RTCM_PERIOD_TOLERANCE * sorted[i]->period))
+      return 1;
+    listed++;
+  }
+
+  return listed != n;
+}
+
+/* Systems of a nav-system field. Names not known are skipped, they
+   can't be measured anyway. */
+static int parse_systems(const char *nav) {
+  int i, len, systems = 0;
+
+  while (*nav) {
+    len = strcspn(nav, "+,/ ");
+    if (len > 0) {
+      for (i = 0; system_names[i].name; i++)
+        if ((strncasecmp(nav, system_names[i].name, len) == 0) && (system_names[i].name[len] == '\0'))
+          break;
+      systems |= system_names[i].system;
+    }
+    nav += len;
+    if (*nav) nav++;
+  }
+
+  return systems;
+}
+
+static void format_systems(int systems, char *buf, int size) {
+  int i, len = 0;
+
+  buf[0] = '\0';
+  for (i = 0; system_names[i].name && (len < size); i++)
+    if (systems & system_names[i].system) {
+      len += snprintf(buf + len, size - len, "%s%s", len ? "+" : "", system_names[i].name);
+      systems &= ~system_names[i].system;
+    }
+}
+
+/* Degrees apart, longitudes compared modulo 360 */
+static double angle_apart(double a, double b) {
+  double d = fmod(fabs(a - b), 360.0);
+
+  return (d > 180.0) ? 360.0 - d : d;
+}
+
+/* Queue values for the STR entry of mount, over the fields queued before */
+static void queue_update(const char *mount, const char *values[STR_FIELDS]) {
+  rtcm_update_t *u;
+  int i;
+
+  thread_mutex_lock(&update_mutex);
+
+  u = (rtcm_update_t *)hash_find(updates, mount);
+  if (!u) {
+    u = (rtcm_update_t *)nmalloc(sizeof(rtcm_update_t));
+    memset(u, 0, sizeof(rtcm_update_t));
+    u->mount = nstrdup(mount);
+    hash_replace(updates, u->mount, u);
+  }
+
+  for (i = 0; i < STR_FIELDS; i++)
+    if (values[i] != NULL) {
+      if (u->values[i]) {
+        nfree(u->values[i]);
+      }
+      u->values[i] = nstrdup(values[i]);
+    }
+
+  thread_mutex_unlock(&update_mutex);
+}
+
+/* End of a measurement: compare with the STR entry, queue the changes */
+static void publish(rtcm_analyzer_t *a, long long int now_ms) {
+  const char *values[STR_FIELDS];
+  char details[RTCM_DETAILS_SIZE], nav[64], bitrate[16], lat[16], lon[16];
+  rtcm_type_t *sorted[RTCM_MAX_TYPES];
+  sourcetable_entry_t *se;
+  int i, n, systems, measured, changed = 0;
+  double cur;
+
+  systems = measure_types(a, now_ms);
+  n = sorted_types(a, sorted);
+  n = format_details(sorted, n, details, sizeof(details));
+  format_systems(systems, nav, sizeof(nav));
+  measured = (int)(a->bytes * 8000.0 / (now_ms - a->window_ms));
+  /* written to 100 bit/s */
+  measured = ((measured + 50) / 100) * 100;
+
+  for (i = 0; i < STR_FIELDS; i++)
+    values[i] = NULL;
+
+  thread_mutex_lock(&info.sourcetable_mutex);
+
+  se = sourcetable_find_str(a->mount);
+  if (se != NULL) {
+    if (n > 0) {
+      if (details_differ(get_string_value_by_index(se->fields, STR_FORMAT_DETAILS), sorted, n))
+        values[STR_FORMAT_DETAILS] = details;
+      /* no system for the types seen, e.g. only station data */
+      if ((systems != 0) && (parse_systems(get_string_value_by_index(se->fields, STR_NAV_SYSTEM)) != systems))
+        values[STR_NAV_SYSTEM] = nav;
+    }
+
+    cur = get_integer_value_by_index(se->fields, STR_BITRATE);
+    if ((measured > 0) && ((cur <= 0) || (fabs(measured - cur) > RTCM_BITRATE_TOLERANCE * cur))) {
+      snprintf(bitrate, sizeof(bitrate), "%d", measured);
+      values[STR_BITRATE] = bitrate;
+    }
+
+    if (a->has_arp) {
+      cur = get_real_value_by_index(se->fields, STR_LONGITUDE);
+      if ((angle_apart(get_real_value_by_index(se->fields, STR_LATITUDE), a->lat) > RTCM_POSITION_TOLERANCE)
+          || (angle_apart(cur, a->lon) > RTCM_POSITION_TOLERANCE)) {
+        snprintf(lat, sizeof(lat), "%.2f", a->lat);
+        /* keep longitudes east from 0 to 360 if the entry has them so */
+        snprintf(lon, sizeof(lon), "%.2f", ((cur > 180.0) && (a->lon < 0.0)) ? a->lon + 360.0 : a->lon);
+        values[STR_LATITUDE] = lat;
+        values[STR_LONGITUDE] = lon;
+      }
+    }
+
+    for (i = 0; i < STR_FIELDS; i++)
+      if (values[i] != NULL)
+        changed = 1;
+  }
+
+  a->summary.station_id = a->station_id;
+  a->summary.has_arp = a->has_arp;
+  a->summary.lat = a->lat;
+  a->summary.lon = a->lon;
+  a->summary.height = a->height;
+  a->summary.bitrate = measured;
+  strcpy(a->summary.details, details);
+  strcpy(a->summary.nav, nav);
+
+  if (changed)
+    a->summary.updated = get_time();
+
+  thread_mutex_unlock(&info.sourcetable_mutex);
+
+  if (changed)
+    queue_update(a->mount, values);
+
+  __atomic_add_fetch(&rtcm_stats.frames, a->frames, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&rtcm_stats.crc_errors, a->crc_errors, __ATOMIC_RELAXED);
+  a->frames = a->crc_errors = 0;
+  a->bytes = 0;
+  a->window_ms = now_ms;
+}
+
+/* Rewrites the STR entry of u, counts the entries changed in *arg */
+static int apply_update(rtcm_update_t *u, void *arg) {
+  char fields[BUFSIZE];
+  sourcetable_entry_t *se;
+  int i;
+
+  se = sourcetable_find_str(u->mount);
+  if ((se == NULL) || !sourcetable_update_str(se, (const char **)u->values))
+    return 1;
+
+  fields[0] = '\0';
+  for (i = 0; i < STR_FIELDS; i++)
+    if (u->values[i] != NULL)
+      snprintf(fields + strlen(fields), sizeof(fields) - strlen(fields), "%s%s %s", fields[0] ? ", " : "",
+          str_field_names[i], u->values[i]);
+  write_log(LOG_DEFAULT, "Updated STR entry of mountpoint [%s] from the stream: %s", u->mount, fields);
+
+  (*(int *)arg)++;
+  return 1;
+}
+
+/*
+ * Called by the timer thread. Applies the queued STR changes of all
+ * mountpoints, then rebuilds the index and renders the sourcetable once.
+ */
+void rtcm_apply_updates(void) {
+  hash_table_t *pending;
+  int changed = 0;
+
+  thread_mutex_lock(&update_mutex);
+  if (updates->count == 0) {
+    thread_mutex_unlock(&update_mutex);
+    return;
+  }
+  pending = updates;
+  updates = hash_create(64);
+  thread_mutex_unlock(&update_mutex);
+
+  thread_mutex_lock(&info.sourcetable_mutex);
+  hash_remove_if(pending, (hash_match_func *)apply_update, &changed, (ntripcaster_function *)free_update);
+  if (changed) {
+    stindex_build();
+    sourcetable_render();
+  }
+  thread_mutex_unlock(&info.sourcetable_mutex);
+
+  hash_destroy(pending, (ntripcaster_function *)free_update);
+
+  if (changed)
+    __atomic_add_fetch(&rtcm_stats.updates, changed, __ATOMIC_RELAXED);
+}
+
+/* A chunk read from the source at now_ms */
+void rtcm_analyze(rtcm_analyzer_t *a, const unsigned char *data, int len, long long int now_ms) {
+  const unsigned char *p;
+  int n;
+
+  if (a->window_ms == 0)
+    a->window_ms = now_ms;
+  a->bytes += len;
+
+  while (len > 0) {
+    if (a->have == 0) {
+      if ((p = memchr(data, RTCM_PREAMBLE, len)) == NULL)
+        break;
+      len -= p - data;
+      data = p;
+    }
+
+    /* the header, then the rest of the frame */
+    n = (a->have < 3) ? 3 - a->have : a->need - a->have;
+    if (n > len)
+      n = len;
+    memcpy(a->frame + a->have, data, n);
+    a->have += n;
+    data += n;
+    len -= n;
+
+    scan_frames(a, now_ms);
+  }
+
+  if (now_ms - a->window_ms >= (info.stream_analysis_interval > 0 ? info.stream_analysis_interval : 1) * 1000LL)
+    publish(a, now_ms);
+}
+
+/* The last measurement, for describe */
+void rtcm_get_summary(rtcm_analyzer_t *a, rtcm_summary_t *summary) {
+  thread_mutex_lock(&info.sourcetable_mutex);
+  *summary = a->summary;
+  thread_mutex_unlock(&info.sourcetable_mutex);
+}
+
+void rtcm_get_stats(rtcm_stats_t *stats) {
+  stats->frames = __atomic_load_n(&rtcm_stats.frames, __ATOMIC_RELAXED);
+  stats->crc_errors = __atomic_load_n(&rtcm_stats.crc_errors, __ATOMIC_RELAXED);
+  stats->updates = __atomic_load_n(&rtcm_stats.updates, __ATOMIC_RELAXED);
+}
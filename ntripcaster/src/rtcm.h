@@ -0,0 +1,120 @@
+/* rtcm.h
+ * - Analysis of RTCM 3 streams for their STR entries
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_RTCM_H
+#define NTRIPCASTER_RTCM_H
+
+#define RTCM_PREAMBLE 0xD3
+#define RTCM_FRAME_MAX (3 + 1023 + 3) /* header, longest payload, CRC */
+#define RTCM_MAX_TYPES 64             /* message types followed per stream */
+#define RTCM_KEEP_PERIODS 3           /* a type is dropped after missing this many periods or intervals */
+#define RTCM_PERIOD_TOLERANCE 0.5     /* STR periods within this share of the measured one are kept */
+#define RTCM_BITRATE_TOLERANCE 0.2    /* STR bitrates within this share of the measured one are kept */
+#define RTCM_POSITION_TOLERANCE 0.01  /* degrees */
+#define RTCM_DETAILS_SIZE 512
+
+/* Satellite systems of the nav-system field */
+#define RTCM_GPS 0x01
+#define RTCM_GLO 0x02
+#define RTCM_GAL 0x04
+#define RTCM_BDS 0x08
+#define RTCM_QZS 0x10
+#define RTCM_SBAS 0x20
+#define RTCM_IRN 0x40
+
+/* A message type of the stream */
+typedef struct rtcm_type_St {
+  int type;                /* 0 = free slot */
+  unsigned int count;      /* messages after first_ms */
+  long long int first_ms;  /* message the period is measured from */
+  long long int last_ms;
+  double period;           /* seconds between two messages, 0 = not known yet */
+} rtcm_type_t;
+
+/* Last measurement of a stream, read under sourcetable_mutex */
+typedef struct rtcm_summary_St {
+  int station_id;          /* -1 = not seen */
+  int has_arp;
+  double lat;
+  double lon;
+  double height;
+  int bitrate;             /* bits per second */
+  char details[RTCM_DETAILS_SIZE];
+  char nav[64];
+  time_t updated;          /* last change of the STR entry queued, 0 = never */
+} rtcm_summary_t;
+
+/*
+ * Per source state, only touched by the source thread apart from the
+ * summary. Frames are collected in frame[], bytes outside of frames are
+ * skipped with memchr().
+ */
+typedef struct rtcm_analyzer_St {
+  char *mount;
+  unsigned char frame[RTCM_FRAME_MAX];
+  int have;                /* bytes in frame, 0 = looking for a preamble */
+  int need;                /* length of the frame once the header is complete */
+  long long int window_ms; /* start of the measurement */
+  unsigned long int bytes;
+  unsigned long int frames;
+  unsigned long int crc_errors;
+  int station_id;
+  int has_arp;
+  double lat;
+  double lon;
+  double height;
+  unsigned char slot[4096]; /* index + 1 in types by message number */
+  rtcm_type_t types[RTCM_MAX_TYPES];
+  rtcm_summary_t summary;
+} rtcm_analyzer_t;
+
+typedef struct rtcm_stats_St {
+  unsigned long int frames;     /* messages with a valid CRC */
+  unsigned long int crc_errors;
+  unsigned long int updates;    /* STR entries changed */
+} rtcm_stats_t;
+
+void rtcm_init(void);
+void rtcm_cleanup(void);
+rtcm_analyzer_t *rtcm_create(const char *mount);
+void rtcm_free(rtcm_analyzer_t *a);
+void rtcm_analyze(rtcm_analyzer_t *a, const unsigned char *data, int len, long long int now_ms);
+void rtcm_apply_updates(void);
+void rtcm_get_summary(rtcm_analyzer_t *a, rtcm_summary_t *summary);
+void rtcm_get_stats(rtcm_stats_t *stats);
+#endif
@@ -94,6 +94,7 @@
 #include "rtp.h"
 #include "logtime.h"
 #include "memory.h"
+#include "metrics.h"
 #include "avl_functions.h"
 #include "vars.h"
 #include "authenticate/basic.h"
@@ -779,6 +780,7 @@ int rtsp_post(connection_t *con, ntrip_request_t *req) {
 
     add_source();
     avl_insert(info.sources, session->con);
+    metrics_source_attached (session->con->food.source->metrics);
 
     thread_create("Source Thread", source_rtsp_function, (void *)session->con);
   }
@@ -107,6 +107,7 @@ int deny_severity = LOG_WARNING;
 #include "memory.h"
 #include "http.h"
 #include "rtp.h"
+#include "logtime.h"
 
 #ifdef _WIN32
 #define read _read
@@ -547,6 +548,67 @@ sock_write_bytes_or_kick(SOCKET sockfd, connection_t * clicon, const char *buff,
   return res;
 }
 
+/*
+ * Everything the current thread writes to sockfd, with the sock_write
+ * and fd_write functions, is collected until sock_capture_stop(). Used
+ * to send a response of unknown length with a Content-Length, so the
+ * connection can stay open for the next request.
+ */
+static __thread sock_capture_t *capture = NULL;
+
+void sock_capture_start(SOCKET sockfd)
+{
+  sock_capture_t *c = (sock_capture_t *)nmalloc(sizeof(sock_capture_t));
+
+  c->sock = sockfd;
+  c->size = BUFSIZE;
+  c->len = 0;
+  c->buf = (char *)nmalloc(c->size);
+  c->buf[0] = '\0';
+  capture = c;
+}
+
+/* The collected bytes, free with nfree(), NULL if nothing was captured */
+char *sock_capture_stop(int *len)
+{
+  sock_capture_t *c = capture;
+  char *buf;
+
+  *len = 0;
+  if (c == NULL)
+    return NULL;
+
+  capture = NULL;
+  buf = c->buf;
+  *len = c->len;
+  nfree(c);
+  return buf;
+}
+
+/* Returns 1 if buff was collected instead of written to sockfd */
+int sock_capture(SOCKET sockfd, const char *buff, int len)
+{
+  sock_capture_t *c = capture;
+  char *grown;
+
+  if (c == NULL || c->sock != sockfd)
+    return 0;
+
+  if (c->len + len + 1 > c->size) {
+    while (c->len + len + 1 > c->size)
+      c->size *= 2;
+    grown = (char *)nmalloc(c->size);
+    memcpy(grown, c->buf, c->len);
+    nfree(c->buf);
+    c->buf = grown;
+  }
+
+  memcpy(c->buf + c->len, buff, len);
+  c->len += len;
+  c->buf[c->len] = '\0';
+  return 1;
+}
+
 /*
  * Write len bytes from buf to the socket.
  * Returns the return value from send()
@@ -570,6 +632,9 @@ int sock_write_bytes(SOCKET sockfd, const char *buff, int len)
     return -1;
   }
 
+  if (sock_capture(sockfd, buff, len))
+    return len;
+
   for(t=0 ; len > 0 ; ) {
     int n=send(sockfd, buff+t, len, 0);
 
@@ -631,6 +696,9 @@ int sock_write_string(SOCKET sockfd, const char *buff)
     return -1;
   }
 
+  if (sock_capture(sockfd, buff, len))
+    return 1;
+
   /*
    * Never use send() to sockets 0 or 1 in Win32. What about 2 (stderr?).
    * Also, if the server is running, and is used as an  admin console, or an
@@ -804,7 +872,7 @@ int sock_read_line_with_timeout(SOCKET sockfd, char *buff, const int len) {
   int read_bytes;
   int pos = 0;
   int maxpos = len-1;
-  long timeout = time(NULL) + SOCK_READ_LINE_TIMEOUT;
+  long timeout = get_time() + SOCK_READ_LINE_TIMEOUT;
 
   if (!sock_valid(sockfd)) {
     xa_debug(1, "ERROR: sock_read_line() called with invalid socket");
@@ -840,7 +908,7 @@ int sock_read_line_with_timeout(SOCKET sockfd, char *buff, const int len) {
     read_bytes = recv(sockfd, &c, 1, 0);
 
     while (read_bytes < 0) {
-      if (time(NULL) > timeout) {
+      if (get_time() > timeout) {
         timeout = -1;
         break;
       }
@@ -865,7 +933,7 @@ int sock_read_lines_with_timeout(SOCKET sockfd, char *buff, const int len) {
   int read_bytes;
   int pos = 0;
   int maxpos = len-1;
-  long timeout = time(NULL) + SOCK_READ_LINES_TIMEOUT;
+  long timeout = get_time() + SOCK_READ_LINES_TIMEOUT;
 
   if (!sock_valid(sockfd)) {
     xa_debug(1, "ERROR: sock_read_lines_with_timeout() called with invalid socket");
@@ -909,7 +977,7 @@ int sock_read_lines_with_timeout(SOCKET sockfd, char *buff, const int len) {
     read_bytes = recv(sockfd, &c, 1, 0);
 
     while (read_bytes < 0) {
-      if (time(NULL) > timeout) {
+      if (get_time() > timeout) {
         timeout = -1;
         break;
       }
@@ -1073,14 +1141,15 @@ SOCKET sock_get_server_socket(const int port, int udp)
 }
 
 /*
- * Connect to hostname on specified port and return the created socket.
+ * Create a socket for an outgoing connection to hostname on the
+ * specified port and fill in the address of the remote side.
  * Assert Class: 3
  */
-SOCKET sock_connect_wto(const char *hostname, const int port,
-      const int timeout)
+static SOCKET sock_connect_prepare(const char *hostname, const int port,
+      struct sockaddr_in *server)
 {
   SOCKET sockfd;
-  struct sockaddr_in sin, server;
+  struct sockaddr_in sin;
   struct hostent *host;
   struct hostent hostinfo;
   char buf[BUFSIZE];
@@ -1125,7 +1194,7 @@ SOCKET sock_connect_wto(const char *hostname, const int port,
   }
 
   memset(&sin, 0, sizeof (sin));
-  memset(&server, 0, sizeof (struct sockaddr_in));
+  memset(server, 0, sizeof (struct sockaddr_in));
 
   if (isdigit((int) hostname[0])
       && isdigit((int) hostname[ntripcaster_strlen(hostname) - 1])) {
@@ -1136,7 +1205,7 @@ SOCKET sock_connect_wto(const char *hostname, const int port,
       sock_close(sockfd);
       return INVALID_SOCKET;
     }
-    memcpy(&server.sin_addr, &sin.sin_addr, sizeof (sin.sin_addr));
+    memcpy(&server->sin_addr, &sin.sin_addr, sizeof (sin.sin_addr));
   } else {
     host = ntripcaster_gethostbyname(hostname, &hostinfo, buf, BUFSIZE, &error);
     if (host == NULL) {
@@ -1146,20 +1215,84 @@ SOCKET sock_connect_wto(const char *hostname, const int port,
       ntripcaster_clean_hostent();
       return INVALID_SOCKET;
     }
-    memcpy(&server.sin_addr, host->h_addr, host->h_length);
+    memcpy(&server->sin_addr, host->h_addr, host->h_length);
     ntripcaster_clean_hostent();
   }
 
-  server.sin_family = AF_INET;
-  server.sin_port = htons(port);
+  server->sin_family = AF_INET;
+  server->sin_port = htons(port);
 
   {
     char buf[50];
 
-    makeasciihost(&server.sin_addr, buf);
+    makeasciihost(&server->sin_addr, buf);
     xa_debug(1, "Trying to connect to %s:%d", buf, port);
   }
 
+  return sockfd;
+}
+
+/*
+ * Start a non blocking connect to hostname on specified port and return
+ * the created socket, which is left in non blocking mode. Use
+ * sock_connect_finish() once the socket got writable.
+ * Assert Class: 3
+ */
+SOCKET sock_connect_start(const char *hostname, const int port)
+{
+  SOCKET sockfd;
+  struct sockaddr_in server;
+
+  if ((sockfd = sock_connect_prepare(hostname, port, &server)) == INVALID_SOCKET)
+    return INVALID_SOCKET;
+
+  sock_set_blocking(sockfd, SOCK_BLOCKNOT);
+  if (connect(sockfd, (struct sockaddr *) &server, sizeof (server)) == 0) {
+    xa_debug(3, "DEBUG: sock_connect(): non blocking connect returned 0!");
+    return sockfd;
+  }
+#ifdef _WIN32
+  if (WSAGetLastError() == WSAEINPROGRESS) {
+#else
+  if (!is_recoverable(errno)) {
+#endif
+    xa_debug(3, "DEBUG: sock_connect(): connect didn't return EINPROGRESS!, was: %d", errno);
+    sock_close(sockfd);
+    return SOCKET_ERROR;
+  }
+
+  return sockfd;
+}
+
+/*
+ * Check the result of a connect started by sock_connect_start().
+ * Returns 0 when connected, -1 when the connect failed.
+ * Assert Class: 1
+ */
+int sock_connect_finish(SOCKET sockfd)
+{
+  int retval, val;
+  socklen_t valsize = sizeof (int);
+
+  retval = getsockopt(sockfd, SOL_SOCKET, SO_ERROR, (void *) &val,
+  (socklen_t *) & valsize);
+  if ((retval == 0) && (val == 0))
+    return 0;
+
+  xa_debug(3, "DEBUG: sock_connect(): getsockopt returned %i, val = %i,"
+  " valsize = %i, errno = %i!", retval, val, valsize, errno);
+  return -1;
+}
+
+/*
+ * Connect to hostname on specified port and return the created socket.
+ * Assert Class: 3
+ */
+SOCKET sock_connect_wto(const char *hostname, const int port,
+      const int timeout)
+{
+  SOCKET sockfd;
+
   /*
    * if we have a timeout, use select, if not, use connect straight.
    */
@@ -1172,23 +1305,9 @@ SOCKET sock_connect_wto(const char *hostname, const int port,
 
     xa_debug(3, "DEBUG: sock_connect(): doing a connection w/ timeout");
 
-    sock_set_blocking(sockfd, SOCK_BLOCKNOT);
-    retval = connect(sockfd, (struct sockaddr *) &server, sizeof (server));
-    if (retval == 0) {
-      xa_debug(3, "DEBUG: sock_connect(): non blocking connect returned 0!");
-      sock_set_blocking(sockfd, SOCK_BLOCK);
+    sockfd = sock_connect_start(hostname, port);
+    if (sockfd == INVALID_SOCKET)
       return sockfd;
-    } else {
-#ifdef _WIN32
-      if (WSAGetLastError() == WSAEINPROGRESS) {
-#else
-      if (!is_recoverable(errno)) {
-#endif
-        xa_debug(3, "DEBUG: sock_connect(): connect didn't return EINPROGRESS!, was: %d", errno);
-        sock_close(sockfd);
-        return SOCKET_ERROR;
-      }
-    }
 
 #ifdef HAVE_POLL
     {
@@ -1207,16 +1326,10 @@ SOCKET sock_connect_wto(const char *hostname, const int port,
     }
 #endif /* HAVE_POLL */
     if (retval) {
-      int val;
-      socklen_t valsize = sizeof (int);
-      retval = getsockopt(sockfd, SOL_SOCKET, SO_ERROR, (void *) &val,
-      (socklen_t *) & valsize);
-      if ((retval == 0) && (val == 0)) {
+      if (sock_connect_finish(sockfd) == 0) {
         sock_set_blocking(sockfd, SOCK_BLOCK);
         return sockfd;
       } else {
-        xa_debug(3, "DEBUG: sock_connect(): getsockopt returned %i, val = %i,"
-        " valsize = %i, errno = %i!", retval, val, valsize, errno);
         sock_close(sockfd);
         return SOCKET_ERROR;
       }
@@ -1226,6 +1339,10 @@ SOCKET sock_connect_wto(const char *hostname, const int port,
       return SOCKET_ERROR;
     }
   } else {
+    struct sockaddr_in server;
+
+    if ((sockfd = sock_connect_prepare(hostname, port, &server)) == INVALID_SOCKET)
+      return INVALID_SOCKET;
     if (connect(sockfd, (struct sockaddr *) &server, sizeof (server)) == 0) {
       return sockfd;
     } else {
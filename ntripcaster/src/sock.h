@@ -53,6 +53,14 @@ typedef struct ntripcaster_socket_St
   int busy;
 } ntripcaster_socket_t;
 
+/* Output collected instead of written, see sock_capture_start() */
+typedef struct sock_capture_St {
+  SOCKET sock;
+  char *buf;
+  int len;
+  int size;
+} sock_capture_t;
+
 #ifndef _WIN32
 #define INVALID_SOCKET -1
 #define SOCKET_ERROR -1
@@ -91,6 +99,8 @@ void sock_dump_fd (SOCKET s, int ffd, int size);
 /* Connection related socket functions */
 SOCKET sock_get_server_socket(const int port, int udp);
 SOCKET sock_connect_wto(const char *hostname, const int port, const int timeout);
+SOCKET sock_connect_start(const char *hostname, const int port);
+int sock_connect_finish(SOCKET sockfd);
 
 /* Socket write functions */
 int sock_write_bytes(SOCKET sockfd, const char *buff, int len);
@@ -104,6 +114,11 @@ int sock_write_con(connection_t *con, const char *fmt, ...);
 int sock_write_line_con (connection_t *con, const char *fmt, ...);
 int sock_write_string_con (connection_t *con, const char *buff);
 
+/* Collecting a response of unknown length */
+void sock_capture_start (SOCKET sockfd);
+char *sock_capture_stop (int *len);
+int sock_capture (SOCKET sockfd, const char *buff, int len);
+
 /* Socket read functions */
 int sock_read_line (SOCKET sockfd, char *string, const int len);
 int sock_read_line_with_timeout(SOCKET sockfd, char *buff, const int len);
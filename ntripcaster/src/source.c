@@ -106,6 +106,11 @@
 #include "logtime.h"
 #include "vars.h"
 #include "authenticate/basic.h"
+#include "probes.h"
+#include "latency.h"
+#include "metrics.h"
+#include "rtcm.h"
+#include "nearest.h"
 #ifdef HAVE_TLS
 #include "tls.h"
 #endif /* HAVE_TLS */
@@ -147,6 +152,9 @@ void add_global_stats(source_t *source)
 
   stats->source_connections++;
   source->globalstats = stats;
+  source->metrics = metrics_mount (source->audiocast.mount);
+  metrics_add (source->metrics->connections, 1);
+  source->latency = &source->metrics->latency;
 }
 
 void http_source_login(connection_t *con, ntrip_request_t *req) {
@@ -221,11 +229,13 @@ void http_source_login(connection_t *con, ntrip_request_t *req) {
   add_source();
   source->connected = SOURCE_CONNECTED;
   avl_insert(info.sources, con);
+  metrics_source_attached (source->metrics);
 
   num_sources = info.num_sources; // store it, so we can unlock before write_log() call
   thread_mutex_unlock(&info.source_mutex);
 
   write_log (LOG_DEFAULT, "Accepted encoder on mountpoint %s from %s. %d sources connected", source->audiocast.mount, con_host(con), num_sources);
+  CASTER_PROBE3(source_login, source->audiocast.mount, con->id, con_host(con));
 
   thread_rename("Source Thread");
 
@@ -237,13 +247,18 @@ int authenticate_source_request(connection_t *con, ntrip_request_t *req) {
 
   if (con->com_protocol == ntrip1_0_e) {
     var = get_con_variable(con, "Authorization");
-    if (var == NULL) return 0;
+    if (var == NULL) {
+      metrics_login(con, source_e, req->path, metrics_login_no_credentials_e);
+      return 0;
+    }
 
     xa_debug(1, "DEBUG: authenticate_source_request(): NTRIP1.0: checking pass %s", var);
 
 xa_debug(2, "DEBUG: Enc %s", info.encoder_pass);
-    if (strncmp(info.encoder_pass, var, BUFSIZE) == 0)
+    if (strncmp(info.encoder_pass, var, BUFSIZE) == 0) {
+      metrics_login(con, source_e, req->path, metrics_login_ok_e);
       return 1;
+    }
     return authenticate_user_request_ntrip1upload(con, req, var);
   } else {
     xa_debug(1, "DEBUG: authenticate_source_request(): NTRIP2.0: checking source user");
@@ -287,6 +302,9 @@ source_func(void *conarg)
 
   sourcetable_add_source(source);
 
+  if (info.stream_analysis)
+    source->analyzer = rtcm_create (source->audiocast.mount);
+
   while (thread_alive (mt) && ((source->connected == SOURCE_CONNECTED) || (source->connected == SOURCE_PAUSED)))
   {
     source_get_new_clients (source);
@@ -309,13 +327,16 @@ source_func(void *conarg)
 
       }
 
-      if (mt->ping == 1)
-        mt->ping = 0;
+      thread_progress (mt);
     }
     kick_dead_clients (source); //-> client_mutex, authentication_mutex (in close_connection) locked inside.
+
+    nearest_check_clients (source, 0);
   }
   sourcetable_remove_source(source);
 
+  nearest_check_clients (source, 1); // move nearest_mount clients before the stream ends.
+
   thread_mutex_lock (&info.double_mutex);
   thread_mutex_lock (&info.source_mutex);
 
@@ -347,6 +368,9 @@ put_source(connection_t *con)
   con->food.source = source;
   zero_stats (&source->stats);
   source->globalstats = NULL;
+  source->latency = NULL;
+  source->metrics = NULL;
+  source->analyzer = NULL;
   source->connected = SOURCE_UNUSED;
   source->type = unknown_source_e;
   source->audiocast.name = NULL;
@@ -513,6 +537,7 @@ add_chunk (connection_t *con)
   int len = -1;
   int tries = 0;
   int maxread = (int)(0.5 * SOURCE_READSIZE);
+  long long int ingest_ns = 0;
 
   if (con->food.source->connected == SOURCE_KILLED) return;
 
@@ -616,7 +641,7 @@ add_chunk (connection_t *con)
       }
       case udp_e:
       {
-        time_t ct = time(0);
+        time_t ct = get_time();
         thread_mutex_lock(&con->udpbuffers->buffer_mutex);
 
         if (con->udpbuffers && ct-con->udpbuffers->lastsend > 20)
@@ -659,8 +684,12 @@ add_chunk (connection_t *con)
 
     if (len > 0)
     {
+      if (!ingest_ns)
+        ingest_ns = get_time_ns();
+
       stat_add_read(&con->food.source->stats, len);
       stat_add_read(con->food.source->globalstats, len);
+      metrics_add (con->food.source->metrics->received, len);
 
       internal_lock_mutex (&info.misc_mutex);
       info.hourly_stats.read_bytes += len;
@@ -702,6 +731,10 @@ add_chunk (connection_t *con)
 
   con->food.source->chunk[con->food.source->cid].len = read_bytes;
   con->food.source->chunk[con->food.source->cid].clients_left = con->food.source->num_clients;
+  con->food.source->chunk[con->food.source->cid].ingest_ns = ingest_ns;
+  if (con->food.source->analyzer)
+    rtcm_analyze (con->food.source->analyzer, (unsigned char *)con->food.source->chunk[con->food.source->cid].data, read_bytes, ingest_ns / 1000000);
+  CASTER_PROBE4(chunk_commit, con->food.source->audiocast.mount, con->id, con->food.source->cid, read_bytes);
   con->food.source->cid = (con->food.source->cid + 1) % CHUNKLEN;
 
   if (con->trans_encoding == chunked_e)
@@ -711,6 +744,30 @@ add_chunk (connection_t *con)
   }
 }
 
+/* Ingest to delivery delays of all mountpoints */
+static latency_hist_t delivery_latency;
+
+/* A client got the whole chunk */
+void
+source_record_delivery (source_t *source, const chunk_t *chunk)
+{
+  long long int us;
+
+  if (!chunk->ingest_ns)
+    return;
+
+  us = (get_time_ns () - chunk->ingest_ns) / 1000;
+  latency_record (&delivery_latency, us);
+  if (source->latency)
+    latency_record (source->latency, us);
+}
+
+void
+source_get_latency (latency_hist_t *h)
+{
+  latency_copy (h, &delivery_latency);
+}
+
 void
 write_chunk(source_t *source, connection_t *clicon)
 {
@@ -785,11 +842,14 @@ write_chunk(source_t *source, connection_t *clicon)
       }
     }
 
+    CASTER_PROBE5(chunk_send, source->audiocast.mount, clicon->id, clicon->food.client->cid, write_bytes,
+                  (source->cid - clicon->food.client->cid + CHUNKLEN) % CHUNKLEN);
+
 #ifndef NTRIP_NUMBER
     xa_debug (4, "DEBUG: client %d in write_chunk() on mountpoint [%s]. %d of %d bytes written, client on chunk %d (+%d), source on chunk %d", clicon->id, source->audiocast.mount, write_bytes, source->chunk[clicon->food.client->cid].len - clicon->food.client->offset, clicon->food.client->cid, clicon->food.client->offset, source->cid);
 #endif
 
-    if (clicon->udpbuffers && time(0)-clicon->udpbuffers->lastactive > 60)
+    if (clicon->udpbuffers && get_time()-clicon->udpbuffers->lastactive > 60)
     {
       kick_connection(clicon, "UDP connection timeout");
       break;
@@ -807,6 +867,7 @@ write_chunk(source_t *source, connection_t *clicon)
       clicon->food.client->write_bytes += write_bytes;
       stat_add_write (&source->stats, write_bytes);
       stat_add_write (source->globalstats, write_bytes);
+      metrics_add (source->metrics->sent, write_bytes);
 
       internal_lock_mutex (&info.misc_mutex);
       info.hourly_stats.write_bytes += write_bytes;
@@ -814,6 +875,7 @@ write_chunk(source_t *source, connection_t *clicon)
 
       if (write_bytes + clicon->food.client->offset >= source->chunk[clicon->food.client->cid].len)
       {
+        source_record_delivery (source, &source->chunk[clicon->food.client->cid]);
         source->chunk[clicon->food.client->cid].clients_left--;
         clicon->food.client->cid = (clicon->food.client->cid + 1) % CHUNKLEN;
         clicon->food.client->offset = 0;
@@ -988,6 +1050,30 @@ describe_source (const com_request_t *req, const connection_t *sourcecon)
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_SOURCE_MISC, "Average client connect time: %s", connect_average (source->stats.client_connect_time, source->stats.client_connections, buf));
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_SOURCE_MISC, "Average client transfer: %lu", transfer_average (source->stats.write_kilos, source->stats.client_connections));
 
+  if (source->latency)
+  {
+    latency_hist_t h;
+
+    latency_copy (&h, source->latency);
+    admin_write_line (req, ADMIN_SHOW_DESCRIBE_SOURCE_MISC, "Delivery delay: %lu chunks, avg %.1f ms, p50 %.1f ms, p90 %.1f ms, p99 %.1f ms, max %.1f ms",
+          h.count, h.count ? h.sum_us / 1000.0 / h.count : 0.0, latency_percentile (&h, 0.5) / 1000.0,
+          latency_percentile (&h, 0.9) / 1000.0, latency_percentile (&h, 0.99) / 1000.0, h.max_us / 1000.0);
+  }
+
+  if (source->analyzer)
+  {
+    rtcm_summary_t rs;
+
+    rtcm_get_summary (source->analyzer, &rs);
+    admin_write_line (req, ADMIN_SHOW_DESCRIBE_SOURCE_MISC, "Stream analysis: station %d, %d bit/s, %s, %s", rs.station_id, rs.bitrate,
+          rs.nav[0] ? rs.nav : "no satellite system", rs.details[0] ? rs.details : "no message types");
+    if (rs.has_arp)
+      admin_write_line (req, ADMIN_SHOW_DESCRIBE_SOURCE_MISC, "Antenna reference point: %.6f/%.6f, %.3f m", rs.lat, rs.lon, rs.height);
+    if (rs.updated)
+      get_string_time (buf, rs.updated, REGULAR_DATETIME);
+    admin_write_line (req, ADMIN_SHOW_DESCRIBE_SOURCE_MISC, "STR entry updated: %s", rs.updated ? buf : "never");
+  }
+
   admin_write_line (req, ADMIN_SHOW_DESCRIBE_SOURCE_END, "End of source info");
 }
 
@@ -1040,6 +1126,7 @@ source_write_to_client (source_t *source, connection_t *clicon)
     thread_mutex_lock(&info.source_mutex);
     source->num_clients++;
     thread_mutex_unlock(&info.source_mutex);
+    metrics_add (source->metrics->clients, 1);
   }
 
   if (client->alive == CLIENT_UNPAUSED) {
@@ -1066,10 +1153,12 @@ source_get_new_clients (source_t *source)
   while ((clicon = pool_get_my_clients (source)))
   {
     xa_debug (1, "DEBUG: source_get_new_clients(): Accepted client %d", clicon->id);
+    CASTER_PROBE2(client_attach, source->audiocast.mount, clicon->id);
     avl_insert (source->clients, clicon);
 
     source->stats.client_connections++;
     source->globalstats->client_connections++;
+    metrics_add (source->metrics->client_connections, 1);
   }
 }
 
@@ -1131,6 +1220,7 @@ int source_fill_chunks(source_t *source, const char *buf, int len) {
     memcpy(source->chunk[source->cid].data, buf + p, SOURCE_READSIZE);
     source->chunk[source->cid].len = SOURCE_READSIZE;
     source->chunk[source->cid].clients_left = source->num_clients;
+    source->chunk[source->cid].ingest_ns = get_time_ns();
     source->cid = (source->cid + 1) % CHUNKLEN;
     len -= SOURCE_READSIZE;
     p += SOURCE_READSIZE;
@@ -55,6 +55,8 @@ connection_t *get_default_mount();
 void add_chunk (connection_t *sourcecon);
 void write_chunk (source_t *source, connection_t *clicon);
 void kick_trailing_clients(source_t *source);
+void source_record_delivery (source_t *source, const chunk_t *chunk);
+void source_get_latency (latency_hist_t *h);
 void kick_clients_on_cid(source_t *source);
 void kick_dead_clients (source_t *source);
 //void move_clients_to_default_mount (connection_t *con);
@@ -79,6 +79,10 @@
 #include <netinet/in.h>
 #endif
 
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+
 #include "avl.h"
 #include "avl_functions.h"
 #include "threads.h"
@@ -96,9 +100,14 @@
 #include "logtime.h"
 #include "alias.h"
 #include "match.h"
+#include "filtercache.h"
+#include "stindex.h"
+#include "vars.h"
 
 extern server_info_t info;
 
+static sourcetable_response_stats_t response_stats;
+
 sourcetable_field_t stream_entry_fields[] = {
   { string_e, "", NULL },
   { string_e, "", NULL },
@@ -151,108 +160,392 @@ sourcetable_field_t network_entry_fields[] = {
   { unknown_type_e, NULL, NULL }
 };
 
-void send_sourcetable (connection_t *con) {
+static sourcetable_render_t *create_sourcetable_render(int bytes)
+{
+  sourcetable_render_t *r = (sourcetable_render_t *)nmalloc(sizeof(sourcetable_render_t) + bytes + 16);
+
+  r->refcount = 1;
+  r->version = 0;
+  r->len = r->body_len = 0;
+  r->etag[0] = '\0';
+  r->gzip = NULL;
+  r->next = NULL;
+
+  return r;
+}
+
+/* r must have room for the line, see create_sourcetable_render(). */
+static void render_add_line(sourcetable_render_t *r, sourcetable_entry_t *se)
+{
+  memcpy(&r->buf[r->body_len], se->line, se->linelen);
+  r->body_len += se->linelen;
+  r->buf[r->body_len++] = '\r';
+  r->buf[r->body_len++] = '\n';
+}
+
+static void render_finish(sourcetable_render_t *r)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  int i;
+
+  memcpy(&r->buf[r->body_len], "ENDSOURCETABLE\r\n", 16);
+  r->len = r->body_len + 16;
+  r->buf[r->len] = '\0';
+
+  /* FNV-1a, equal content gives an equal ETag across versions and restarts */
+  for (i = 0; i < r->len; i++)
+    hash = (hash ^ (unsigned char)r->buf[i]) * 1099511628211ULL;
+  snprintf(r->etag, sizeof(r->etag), "%016llx", hash);
+}
+
+static int compare_entry_serial(const void *a, const void *b)
+{
+  const sourcetable_entry_t *s1 = *(sourcetable_entry_t * const *)a;
+  const sourcetable_entry_t *s2 = *(sourcetable_entry_t * const *)b;
+
+  return (s1->serial > s2->serial) - (s1->serial < s2->serial);
+}
+
+/* Drop the publishing reference of replaced snapshots. Only safe when no
+   reader is between loading the pointer and taking its reference, else
+   they stay on the retired list until the next render.
+   must have sourcetable_mutex. */
+static void sourcetable_release_retired(void)
+{
+  sourcetable_render_t *r;
+
+  if (info.sourcetable.retired == NULL || __atomic_load_n(&info.sourcetable.readers, __ATOMIC_SEQ_CST) != 0)
+    return;
+
+  while ((r = info.sourcetable.retired) != NULL) {
+    info.sourcetable.retired = r->next;
+    sourcetable_release(r);
+  }
+}
+
+/* Render the visible entries in file order into a new immutable snapshot
+   and publish it. must have sourcetable_mutex. */
+void sourcetable_render(void)
+{
   avl_traverser trav = {0};
-  sourcetable_entry_t *se;
-  string_buffer_t *sb;
-  char time[50];
-  const char *datatype = "text/plain";
+  sourcetable_entry_t *se, **visible = NULL;
+  sourcetable_render_t *r, *old;
+  int count = 0, bytes = 0, i;
 
-  thread_mutex_lock(&info.sourcetable_mutex);
+  while ((se = avl_traverse (info.sourcetable.tree, &trav))) if (se->show == 1) {
+    count++;
+    bytes += se->linelen + 2;
+  }
+
+  if (count > 0) {
+    visible = (sourcetable_entry_t **)nmalloc(count * sizeof(sourcetable_entry_t *));
+    i = 0;
+    while ((se = avl_traverse (info.sourcetable.tree, &trav))) if (se->show == 1) visible[i++] = se;
+    qsort(visible, count, sizeof(sourcetable_entry_t *), compare_entry_serial);
+  }
+
+  r = create_sourcetable_render(bytes);
 
-  sb = string_buffer_create(info.sourcetable.length+(info.sourcetable.lines*2)+1);
+  for (i = 0; i < count; i++) render_add_line(r, visible[i]);
+  render_finish(r);
+  r->version = ++info.sourcetable.version;
 
+  if (visible)
   {
-    int found=0;
-    int minfound=-1;
-    int oldmin;
-
-    while ((se = avl_traverse (info.sourcetable.tree, &trav))) if (se->show == 1) {
-      if (!found) minfound = se->serial;
-      found=1;
-      minfound = ( minfound <= se->serial) ? minfound : se->serial;
-    }
+    nfree(visible);
+  }
 
-    while(found) {
-      while ((se = avl_traverse (info.sourcetable.tree, &trav)))
-      if (se->show == 1 &&  se->serial==minfound) {
+  old = __atomic_exchange_n(&info.sourcetable.rendered, r, __ATOMIC_SEQ_CST);
+  if (old != NULL) {
+    old->next = info.sourcetable.retired;
+    info.sourcetable.retired = old;
+  }
+  sourcetable_release_retired();
 
-        write_line_to_buffer(sb, se->line);
-        found=0;
-      }
+  xa_debug (2, "DEBUG: sourcetable_render: version %lu, %d lines, %d bytes", r->version, count, r->len);
+}
 
-      oldmin=minfound;
-      minfound = 0x7fffff;
+/* Reference the current snapshot without taking sourcetable_mutex.
+   Release with sourcetable_release(). */
+sourcetable_render_t *sourcetable_acquire(void)
+{
+  sourcetable_render_t *r;
 
-      while ((se = avl_traverse (info.sourcetable.tree, &trav)))
-      if (se->show == 1 && se->serial > oldmin && se->serial < minfound) {
-        found=1;
-        minfound = se->serial;
-      }
+  __atomic_add_fetch(&info.sourcetable.readers, 1, __ATOMIC_SEQ_CST);
+  r = __atomic_load_n(&info.sourcetable.rendered, __ATOMIC_SEQ_CST);
+  if (r != NULL)
+    __atomic_add_fetch(&r->refcount, 1, __ATOMIC_SEQ_CST);
+  __atomic_sub_fetch(&info.sourcetable.readers, 1, __ATOMIC_SEQ_CST);
+
+  return r;
+}
+
+void sourcetable_release(sourcetable_render_t *r)
+{
+  if (r != NULL && __atomic_sub_fetch(&r->refcount, 1, __ATOMIC_ACQ_REL) == 0)
+  {
+    if (r->gzip) {
+      nfree(r->gzip);
     }
+    nfree(r);
   }
+}
 
-  thread_mutex_unlock(&info.sourcetable_mutex);
+unsigned long int sourcetable_get_version(void)
+{
+  return __atomic_load_n(&info.sourcetable.version, __ATOMIC_RELAXED);
+}
 
-  if (con->com_protocol == ntrip2_0_e && !strncasecmp(get_user_agent(con), "ntrip", 5))
-    datatype = "gnss/sourcetable";
-  ntrip_write_message(con, HTTP_GET_SOURCETABLE_OK, get_formatted_time(HEADER_TIME, time), datatype, sb->pos+16);
+#ifdef HAVE_LIBZ
+/* The gzip variant of r, compressed by the first request accepting it.
+   NULL if compression failed. */
+static sourcetable_gzip_t *render_gzip(sourcetable_render_t *r)
+{
+  sourcetable_gzip_t *gz, *expected = NULL;
+  z_stream zs;
+  int bound;
+
+  gz = __atomic_load_n(&r->gzip, __ATOMIC_ACQUIRE);
+  if (gz != NULL)
+    return gz;
+
+  memset(&zs, 0, sizeof(zs));
+  if (deflateInit2(&zs, Z_BEST_COMPRESSION, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+    return NULL;
+
+  bound = deflateBound(&zs, r->len);
+  gz = (sourcetable_gzip_t *)nmalloc(sizeof(sourcetable_gzip_t) + bound);
+  zs.next_in = (Bytef *)r->buf;
+  zs.avail_in = r->len;
+  zs.next_out = (Bytef *)gz->buf;
+  zs.avail_out = bound;
+
+  if (deflate(&zs, Z_FINISH) != Z_STREAM_END) {
+    deflateEnd(&zs);
+    nfree(gz);
+    return NULL;
+  }
+  gz->len = zs.total_out;
+  deflateEnd(&zs);
 
-  if(con->udpbuffers)
-    con->rtp->datagram->pt = 96;
+  /* another request may have been quicker */
+  if (!__atomic_compare_exchange_n(&r->gzip, &expected, gz, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+    nfree(gz);
+    return expected;
+  }
+  return gz;
+}
+
+/* Accept-Encoding lists gzip without q=0 */
+static int accepts_gzip(const char *value)
+{
+  const char *p = value, *q;
+  int len;
+
+  while (*p) {
+    while (*p == ' ' || *p == ',') p++;
+    len = strcspn(p, ",;");
+    if ((len == 4 && !strncasecmp(p, "gzip", 4)) || (len == 6 && !strncasecmp(p, "x-gzip", 6))) {
+      q = p + len;
+      while (*q == ';' || *q == ' ') q++;
+      return !(strncasecmp(q, "q=", 2) == 0 && atof(q + 2) == 0.0);
+    }
+    p += strcspn(p, ",");
+  }
+  return 0;
+}
+#endif
+
+/* If-None-Match names the representation tagged etag (weak comparison) */
+static int etag_matches(const char *value, const char *etag, int gzip)
+{
+  char tag[32];
 
-  sock_write_string_con(con, sb->buf);
+  while (*value == ' ') value++;
+  if (!strcmp(value, "*"))
+    return 1;
+  snprintf(tag, sizeof(tag), "\"%s%s\"", etag, gzip ? "-gz" : "");
+  return strstr(value, tag) != NULL;
+}
 
-  dispose_string_buffer(sb);
+static void send_sourcetable_render(connection_t *con, sourcetable_render_t *r, const char *datatype)
+{
+  char time[50], etag[24];
+  const char *var;
+  int gzip = 0;
 
-  sock_write_line_con (con, "ENDSOURCETABLE");
   if(con->udpbuffers)
   {
+    ntrip_write_message(con, HTTP_GET_SOURCETABLE_OK, get_formatted_time(HEADER_TIME, time), datatype, r->len);
+    con->rtp->datagram->pt = 96;
+    if (r->body_len > 0)
+      sock_write_bytes_con(con, r->buf, r->body_len);
+    sock_write_line_con (con, "ENDSOURCETABLE");
     con->rtp->datagram->pt = 98;
     sock_write_string_con(con, "");
+    return;
+  }
+
+  /* NTRIP 1.0 has no conditional or compressed responses */
+  if (con->com_protocol != ntrip2_0_e)
+  {
+    ntrip_write_message(con, HTTP_GET_SOURCETABLE_OK, get_formatted_time(HEADER_TIME, time), datatype, r->len);
+    sock_write_bytes_con(con, r->buf, r->len);
+    __atomic_add_fetch(&response_stats.full, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&response_stats.bytes, r->len, __ATOMIC_RELAXED);
+    return;
+  }
+
+#ifdef HAVE_LIBZ
+  var = get_con_variable(con, "Accept-Encoding");
+  gzip = var && accepts_gzip(var);
+#endif
+  snprintf(etag, sizeof(etag), "%s%s", r->etag, gzip ? "-gz" : "");
+
+  var = get_con_variable(con, "If-None-Match");
+  if (var && etag_matches(var, r->etag, gzip))
+  {
+    ntrip_write_message(con, HTTP_NOT_MODIFIED, get_formatted_time(HEADER_TIME, time), etag);
+    __atomic_add_fetch(&response_stats.not_modified, 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+#ifdef HAVE_LIBZ
+  if (gzip)
+  {
+    sourcetable_gzip_t *gz = render_gzip(r);
+
+    if (gz != NULL)
+    {
+      ntrip_write_message(con, HTTP_GET_SOURCETABLE_GZIP, get_formatted_time(HEADER_TIME, time), datatype, etag, gz->len);
+      sock_write_bytes_con(con, gz->buf, gz->len);
+      __atomic_add_fetch(&response_stats.gzip, 1, __ATOMIC_RELAXED);
+      __atomic_add_fetch(&response_stats.bytes, gz->len, __ATOMIC_RELAXED);
+      return;
+    }
+    snprintf(etag, sizeof(etag), "%s", r->etag);
+  }
+#endif
+
+  ntrip_write_message(con, HTTP_GET_SOURCETABLE_TAGGED, get_formatted_time(HEADER_TIME, time), datatype, etag, r->len);
+  sock_write_bytes_con(con, r->buf, r->len);
+  __atomic_add_fetch(&response_stats.full, 1, __ATOMIC_RELAXED);
+  __atomic_add_fetch(&response_stats.bytes, r->len, __ATOMIC_RELAXED);
+}
+
+void sourcetable_get_response_stats(sourcetable_response_stats_t *stats)
+{
+  stats->full = __atomic_load_n(&response_stats.full, __ATOMIC_RELAXED);
+  stats->gzip = __atomic_load_n(&response_stats.gzip, __ATOMIC_RELAXED);
+  stats->not_modified = __atomic_load_n(&response_stats.not_modified, __ATOMIC_RELAXED);
+  stats->bytes = __atomic_load_n(&response_stats.bytes, __ATOMIC_RELAXED);
+}
+
+void send_sourcetable (connection_t *con) {
+  sourcetable_render_t *r;
+  const char *datatype = "text/plain";
+
+  r = sourcetable_acquire();
+  if (r == NULL) {
+    /* nothing published yet (no sourcetable file) */
+    thread_mutex_lock(&info.sourcetable_mutex);
+    if (info.sourcetable.rendered == NULL)
+      sourcetable_render();
+    thread_mutex_unlock(&info.sourcetable_mutex);
+    r = sourcetable_acquire();
   }
+
+  if (con->com_protocol == ntrip2_0_e && !strncasecmp(get_user_agent(con), "ntrip", 5))
+    datatype = "gnss/sourcetable";
+  send_sourcetable_render(con, r, datatype);
+
+  sourcetable_release(r);
 }
 
+/* The compiled filter and its last result come from the filter cache,
+   sourcetable_mutex is only held while scanning, not while sending. */
 void send_sourcetable_filtered(connection_t *con, char *filter, int matchonly) {
   avl_traverser trav = {0};
-  sourcetable_entry_t *se;
-  string_buffer_t *sb;
-  list_t *l;
-  char time[50];
+  sourcetable_entry_t *se, **candidates;
+  filter_cache_entry_t *fe;
+  sourcetable_render_t *r;
+  int count, i;
 
-  l = get_filter_expression_list(filter,matchonly);
+  fe = filtercache_get(filter, matchonly);
 
-  thread_mutex_lock(&info.sourcetable_mutex);
+  r = filtercache_get_result(fe, sourcetable_get_version());
+  if (r == NULL) {
+    thread_mutex_lock(&info.sourcetable_mutex);
 
-  sb = string_buffer_create(info.sourcetable.length+(info.sourcetable.lines*2)+1);
+    r = create_sourcetable_render(info.sourcetable.length+(info.sourcetable.lines*2));
+    r->version = info.sourcetable.version;
 
-  while ((se = avl_traverse (info.sourcetable.tree, &trav))) {
-    if (match_sourcetable_entry(l, se) == 1)
-      write_line_to_buffer(sb, se->line);
+    /* a range on a numeric STR field only needs the entries inside it */
+    count = stindex_filter_candidates(fe->filter, &candidates);
+    if (count >= 0) {
+      for (i = 0; i < count; i++) {
+        if (match_compiled_filter(fe->filter, candidates[i]) == 1)
+          render_add_line(r, candidates[i]);
+      }
+      if (candidates)
+      {
+        nfree(candidates);
+      }
+    } else {
+      while ((se = avl_traverse (info.sourcetable.tree, &trav))) {
+        if (match_compiled_filter(fe->filter, se) == 1)
+          render_add_line(r, se);
+      }
+    }
+
+    thread_mutex_unlock(&info.sourcetable_mutex);
+
+    render_finish(r);
+    filtercache_set_result(fe, r);
   }
 
+  filtercache_release(fe);
+
   if (con->com_protocol == ntrip2_0_e)
-    ntrip_write_message(con, HTTP_GET_SOURCETABLE_OK, get_formatted_time(HEADER_TIME, time),"gnss/sourcetable",sb->pos+16);
+    send_sourcetable_render(con, r, "gnss/sourcetable");
   else
-    ntrip_write_message(con, HTTP_GET_SOURCETABLE_OK, get_formatted_time(HEADER_TIME, time),"text/plain",sb->pos+16);
+    send_sourcetable_render(con, r, "text/plain");
 
-  if(con->udpbuffers)
-    con->rtp->datagram->pt = 96;
+  sourcetable_release(r);
+}
 
-  sock_write_string_con(con, sb->buf);
+/* /?nearest<lat>;<lon>[;<count>[;<km>]]: the online STR entries nearest to
+   a position, nearest first. */
+void send_sourcetable_nearest(connection_t *con, char *args) {
+  sourcetable_entry_t *found[NEAREST_MAX];
+  double km[NEAREST_MAX], lat = 0.0, lon = 0.0, maxkm = 0.0;
+  sourcetable_render_t *r;
+  int n = NEAREST_DEFAULT, count = 0, bytes = 0, i;
 
-  dispose_string_buffer(sb);
+  if (sscanf(args, "%lf;%lf;%d;%lf", &lat, &lon, &n, &maxkm) < 2) n = 0;
+  if (n > NEAREST_MAX) n = NEAREST_MAX;
+
+  thread_mutex_lock(&info.sourcetable_mutex);
+
+  if (n > 0) count = stindex_nearest(lat, lon, n, maxkm, found, km);
+  for (i = 0; i < count; i++) bytes += found[i]->linelen + 2;
+
+  r = create_sourcetable_render(bytes);
+  r->version = info.sourcetable.version;
+  for (i = 0; i < count; i++) render_add_line(r, found[i]);
 
   thread_mutex_unlock(&info.sourcetable_mutex);
 
-  sock_write_line_con (con, "ENDSOURCETABLE");
-  if(con->udpbuffers)
-  {
-    con->rtp->datagram->pt = 98;
-    sock_write_string_con(con, "");
-  }
+  render_finish(r);
+
+  xa_debug (2, "DEBUG: send_sourcetable_nearest: %d stations around %f/%f, nearest %f km", count, lat, lon, count ? km[0] : 0.0);
 
-  list_dispose_with_data(l, dispose_parse_tree );
+  if (con->com_protocol == ntrip2_0_e)
+    send_sourcetable_render(con, r, "gnss/sourcetable");
+  else
+    send_sourcetable_render(con, r, "text/plain");
+
+  sourcetable_release(r);
 }
 
 static void freesourcetableentry(sourcetable_entry_t *st, void *param)
@@ -263,17 +556,20 @@ static void freesourcetableentry(sourcetable_entry_t *st, void *param)
 
 void read_sourcetable(void) {
         static int serial = 0;
-  int st;
+  loaded_file_t *st;
   char pathandfile[BUFSIZE], line[BUFSIZE];
   sourcetable_entry_t *newste = NULL, *oldste = NULL;
+  long long start = get_time_ms();
+  int lines = 0;
 
   get_ntripcaster_file (info.sourcetablefile, conf_file_e, R_OK, pathandfile);
-  st = open_for_reading(pathandfile);
+  st = load_file(pathandfile);
 
-  if (st > -1) {
+  if (st) {
     thread_mutex_lock(&info.sourcetable_mutex);
 
-    while (fd_read_line (st, line, BUFSIZE)) {
+    while (loaded_file_read_line (st, line, BUFSIZE)) {
+      lines++;
       newste = create_sourcetable_entry();
       newste->line = nstrdup(line);
       newste->linelen = strlen(line);
@@ -309,38 +605,92 @@ void read_sourcetable(void) {
       info.sourcetable.lines++;
     }
 
+    stindex_build();
+    sourcetable_render();
+
     thread_mutex_unlock(&info.sourcetable_mutex);
 
-    fd_close(st);
+    unload_file(st);
+
+    write_log(LOG_DEFAULT, "Loaded sourcetable in %lld ms: %d lines", get_time_ms() - start, lines);
   } else write_log(LOG_DEFAULT, "WARNING: Could not open %s !", info.sourcetablefile);
 }
 
-void sourcetable_add_source(source_t *source) {
-  sourcetable_entry_t search, *found = NULL;
+/* The STR entry of mount or NULL. must have sourcetable_mutex. */
+sourcetable_entry_t *sourcetable_find_str(const char *mount) {
+  sourcetable_entry_t search;
 
   memset(&search, 0, sizeof(search));
-  search.id = source->audiocast.mount;
+  search.id = (char *)mount;
   search.type = str_e;
 
+  return avl_find(info.sourcetable.tree, &search);
+}
+
+/* Replaces the fields of se given in values, NULL keeps a field. The
+   caller publishes the changes with stindex_build() and
+   sourcetable_render(), once for a batch of entries. Returns 0 if the
+   line would get too long. must have sourcetable_mutex. */
+int sourcetable_update_str(sourcetable_entry_t *se, const char *values[STR_FIELDS]) {
+  const char *field[STR_FIELDS], *p = se->line, *end;
+  int flen[STR_FIELDS], i, len = 0, n;
+  char line[BUFSIZE];
+
+  /* fields missing at the end of the line are empty, misc is the rest */
+  for (i = 0; i < STR_FIELDS; i++) {
+    end = (i < STR_FIELDS - 1) ? strchr(p, ';') : NULL;
+    if (end == NULL) end = p + strlen(p);
+    field[i] = p;
+    flen[i] = end - p;
+    p = (*end == ';') ? end + 1 : end;
+  }
+
+  for (i = 0; i < STR_FIELDS; i++) {
+    if (values[i] != NULL)
+      n = snprintf(line + len, BUFSIZE - len, "%s%s", i ? ";" : "", values[i]);
+    else
+      n = snprintf(line + len, BUFSIZE - len, "%s%.*s", i ? ";" : "", flen[i], field[i]);
+    if (n >= BUFSIZE - len)
+      return 0;
+    len += n;
+  }
+
+  info.sourcetable.length += len - se->linelen;
+  nfree(se->line);
+  se->line = nstrdup(line);
+  se->linelen = len;
+
+  free_entry_fields(se->type, se->fields);
+  nfree(se->fields);
+  se->fields = create_entry_fields(se->type, se->line);
+
+  return 1;
+}
+
+void sourcetable_add_source(source_t *source) {
+  sourcetable_entry_t *found = NULL;
+
   thread_mutex_lock(&info.sourcetable_mutex);
 
-  found = avl_find(info.sourcetable.tree, &search);
-  if (found != NULL) found->show = 1;
+  found = sourcetable_find_str(source->audiocast.mount);
+  if (found != NULL && found->show != 1) {
+    found->show = 1;
+    sourcetable_render();
+  }
 
   thread_mutex_unlock(&info.sourcetable_mutex);
 }
 
 void sourcetable_remove_source(source_t *source) {
-  sourcetable_entry_t search, *found = NULL;
-
-  memset(&search, 0, sizeof(search));
-  search.id = source->audiocast.mount;
-  search.type = str_e;
+  sourcetable_entry_t *found = NULL;
 
   thread_mutex_lock(&info.sourcetable_mutex);
 
-  found = avl_find(info.sourcetable.tree, &search);
-  if (found != NULL) found->show = 0;
+  found = sourcetable_find_str(source->audiocast.mount);
+  if (found != NULL && found->show != 0) {
+    found->show = 0;
+    sourcetable_render();
+  }
 
   thread_mutex_unlock(&info.sourcetable_mutex);
 }
@@ -350,6 +700,9 @@ void cleanup_sourcetable(void)
   thread_mutex_lock(&info.sourcetable_mutex);
   if (info.sourcetable.tree)
     avl_destroy(info.sourcetable.tree, (avl_node_func)freesourcetableentry);
+  stindex_free();
+  sourcetable_release(__atomic_exchange_n(&info.sourcetable.rendered, NULL, __ATOMIC_SEQ_CST));
+  sourcetable_release_retired();
   thread_mutex_unlock(&info.sourcetable_mutex);
 }
 
@@ -367,6 +720,8 @@ void sourcetable_set_show_status(void) {
     found = avl_find(info.sourcetable.tree, &search);
     if (found != NULL) found->show = 1;
   }
+
+  sourcetable_render();
 }
 
 /* must have sourcetable_mutex. */
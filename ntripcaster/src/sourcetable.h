@@ -41,6 +41,14 @@
 
 typedef enum { cas_e = 1, net_e = 2, str_e = 3, all_e = 4, unknown_e = -1 } sourcetable_entry_type_t;
 
+/* Fields of an STR entry, see stream_entry_fields[] */
+#define STR_FIELDS 19
+#define STR_FORMAT_DETAILS 4
+#define STR_NAV_SYSTEM 6
+#define STR_LATITUDE 9
+#define STR_LONGITUDE 10
+#define STR_BITRATE 17
+
 typedef struct sourcetable_entry_St {
   sourcetable_entry_type_t type;
   void *fields;
@@ -57,12 +65,28 @@ typedef struct sourcetable_field_St {
   void *data;
 } sourcetable_field_t;
 
+/* Sourcetable responses by kind, body bytes of all of them */
+typedef struct sourcetable_response_stats_St {
+  unsigned long int full;
+  unsigned long int gzip;
+  unsigned long int not_modified;
+  unsigned long int bytes;
+} sourcetable_response_stats_t;
+
 void send_sourcetable (connection_t *con);
+void sourcetable_render(void);
+sourcetable_render_t *sourcetable_acquire(void);
+void sourcetable_release(sourcetable_render_t *r);
+unsigned long int sourcetable_get_version(void);
+void sourcetable_get_response_stats(sourcetable_response_stats_t *stats);
 void send_sourcetable_filtered(connection_t *con, char *filter, int matchonly);
+void send_sourcetable_nearest(connection_t *con, char *args);
 void read_sourcetable(void);
 void cleanup_sourcetable(void);
 void sourcetable_add_source(source_t *source);
 void sourcetable_remove_source(source_t *source);
+sourcetable_entry_t *sourcetable_find_str(const char *mount);
+int sourcetable_update_str(sourcetable_entry_t *se, const char *values[STR_FIELDS]);
 //void rehash_sourcetable();
 //void free_sourcetable_tree(avl_tree *tree, sourcetable_entry_type_t type);
 void sourcetable_set_show_status(void);
@@ -0,0 +1,313 @@
+/* status.c
+ * - snapshots of the connection trees for status output
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "avl.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "utility.h"
+#include "ntripcaster_string.h"
+#include "sourcetable.h"
+#include "match.h"
+#include "connection.h"
+#include "client.h"
+#include "source.h"
+#include "logtime.h"
+#include "authenticate/basic.h"
+#include "authenticate/user.h"
+#include "memory.h"
+#include "status.h"
+
+extern server_info_t info;
+
+/*
+ * Admin views, status pages and metrics used to walk the source, client
+ * and admin trees while writing every row to the (possibly slow) admin,
+ * holding the tree mutex all the time. Now they render from a snapshot,
+ * and the mutexes are held only while the fields are copied. A snapshot
+ * is shared by all views within status_max_age seconds.
+ */
+static mutex_t status_mutex;
+static status_snapshot_t *current = NULL;
+static unsigned long int serial = 0;
+static status_stats_t status_stats;
+
+static void free_snapshot(status_snapshot_t *s) {
+  status_block_t *b;
+
+  while ((b = s->blocks)) {
+    s->blocks = b->next;
+    nfree(b);
+  }
+  if (s->sources) {
+    nfree(s->sources);
+  }
+  if (s->clients) {
+    nfree(s->clients);
+  }
+  if (s->admins) {
+    nfree(s->admins);
+  }
+  nfree(s);
+}
+
+/* Copy of str in the blocks of s, NULL stays NULL */
+static const char *copy_string(status_snapshot_t *s, const char *str) {
+  status_block_t *b = s->blocks;
+  char *res;
+  int len;
+
+  if (!str)
+    return NULL;
+
+  len = strlen(str) + 1;
+  if (!b || (b->used + len > b->size)) {
+    int size = (len > STATUS_BLOCK_SIZE) ? len : STATUS_BLOCK_SIZE;
+
+    b = (status_block_t *)nmalloc(sizeof(status_block_t) + size);
+    b->used = 0;
+    b->size = size;
+    b->next = s->blocks;
+    s->blocks = b;
+  }
+
+  res = b->data + b->used;
+  memcpy(res, str, len);
+  b->used += len;
+  return res;
+}
+
+static void copy_sources(status_snapshot_t *s) {
+  avl_traverser trav = {0};
+  connection_t *con;
+  status_source_t *e;
+  int n;
+
+  thread_mutex_lock(&info.source_mutex);
+  if ((n = avl_count(info.sources)) > 0)
+    s->sources = (status_source_t *)nmalloc(n * sizeof(status_source_t));
+
+  while ((s->num_sources < n) && (con = avl_traverse(info.sources, &trav))) {
+    e = &s->sources[s->num_sources++];
+    e->id = con->id;
+    e->sock = con->sock;
+    e->connect_time = con->connect_time;
+    e->host = copy_string(s, con->host);
+    e->hostname = copy_string(s, con->hostname);
+    e->agent = copy_string(s, get_source_agent(con));
+    e->type = source_type(con);
+    e->mount = copy_string(s, con->food.source->audiocast.mount);
+    e->state = con->food.source->connected;
+    e->priority = con->food.source->priority;
+    e->clients = con->food.source->num_clients;
+    e->read_kilos = con->food.source->stats.read_kilos;
+    e->write_kilos = con->food.source->stats.write_kilos;
+    e->client_connections = con->food.source->stats.client_connections;
+  }
+  thread_mutex_unlock(&info.source_mutex);
+}
+
+static void copy_clients(status_snapshot_t *s) {
+  avl_traverser trav = {0};
+  connection_t *con;
+  ntripcaster_user_t *user;
+  status_client_t *e;
+  int n;
+
+  thread_mutex_lock(&info.client_mutex);
+  if ((n = avl_count(info.clients)) > 0)
+    s->clients = (status_client_t *)nmalloc(n * sizeof(status_client_t));
+
+  while ((s->num_clients < n) && (con = avl_traverse(info.clients, &trav))) {
+    e = &s->clients[s->num_clients++];
+    e->id = con->id;
+    e->connect_time = con->connect_time;
+    e->host = copy_string(s, con->host);
+    e->hostname = copy_string(s, con->hostname);
+    e->mount = copy_string(s, con->food.client->source ? con->food.client->source->audiocast.mount : NULL);
+    e->user_agent = copy_string(s, get_user_agent(con));
+    e->type = client_type(con);
+    e->write_bytes = con->food.client->write_bytes;
+    e->errors = client_errors(con->food.client);
+    e->lag_ms = client_lag_ms(con->food.client);
+
+    user = con_get_user(con);
+    e->user = copy_string(s, user ? user->name : NULL);
+    if (user) {
+      nfree(user->name);
+      nfree(user->pass);
+      nfree(user);
+    }
+  }
+  thread_mutex_unlock(&info.client_mutex);
+}
+
+static void copy_admins(status_snapshot_t *s) {
+  avl_traverser trav = {0};
+  connection_t *con;
+  status_admin_t *e;
+  int n;
+
+  thread_mutex_lock(&info.admin_mutex);
+  if ((n = avl_count(info.admins)) > 0)
+    s->admins = (status_admin_t *)nmalloc(n * sizeof(status_admin_t));
+
+  while ((s->num_admins < n) && (con = avl_traverse(info.admins, &trav))) {
+    e = &s->admins[s->num_admins++];
+    e->id = con->id;
+    e->connect_time = con->connect_time;
+    e->host = copy_string(s, con->host);
+    e->hostname = copy_string(s, con->hostname);
+    e->commands = con->food.admin->commands;
+  }
+  thread_mutex_unlock(&info.admin_mutex);
+}
+
+static status_snapshot_t *take_snapshot(void) {
+  status_snapshot_t *s;
+  long long int start = get_time_ns();
+
+  s = (status_snapshot_t *)nmalloc(sizeof(status_snapshot_t));
+  memset(s, 0, sizeof(status_snapshot_t));
+  s->taken = get_time();
+  s->serial = ++serial;
+
+  /* One tree at a time, no mutex is held together with another */
+  copy_sources(s);
+  copy_clients(s);
+  copy_admins(s);
+
+  status_stats.builds++;
+  status_stats.build_us += (get_time_ns() - start) / 1000;
+  return s;
+}
+
+void status_init(void) {
+  thread_create_mutex(&status_mutex);
+  thread_mutex_profile(&status_mutex, "status snapshot");
+  memset(&status_stats, 0, sizeof(status_stats));
+}
+
+void status_cleanup(void) {
+  thread_mutex_lock(&status_mutex);
+  if (current) {
+    current->current = 0;
+    if (current->refcount == 0)
+      free_snapshot(current);
+    current = NULL;
+  }
+  thread_mutex_unlock(&status_mutex);
+  thread_mutex_destroy(&status_mutex);
+}
+
+/*
+ * Snapshot for one view, taken now unless the current one is younger
+ * than status_max_age. Must be given back with status_release().
+ */
+status_snapshot_t *status_acquire(void) {
+  status_snapshot_t *s;
+
+  /* Views arriving together wait for one snapshot instead of taking their own */
+  thread_mutex_lock(&status_mutex);
+  if (current && (get_time() - current->taken < info.status_max_age)) {
+    status_stats.reuses++;
+  } else {
+    if (current) {
+      current->current = 0;
+      if (current->refcount == 0)
+        free_snapshot(current);
+    }
+    current = take_snapshot();
+    current->current = 1;
+  }
+  s = current;
+  s->refcount++;
+  thread_mutex_unlock(&status_mutex);
+
+  return s;
+}
+
+void status_release(status_snapshot_t *s) {
+  if (!s)
+    return;
+
+  thread_mutex_lock(&status_mutex);
+  s->refcount--;
+  if ((s->refcount == 0) && !s->current)
+    free_snapshot(s);
+  thread_mutex_unlock(&status_mutex);
+}
+
+/* Name of a snapshot host like con_host() */
+const char *status_host(const char *host, const char *hostname) {
+  if (hostname)
+    return hostname;
+  return host ? host : "(null)";
+}
+
+/* hostmatch() for a snapshot entry */
+int status_hostmatch(const char *host, const char *hostname, const char *pattern) {
+  if (!pattern)
+    return 0;
+  if (host && wild_match((unsigned char *)pattern, (unsigned char *)host))
+    return 1;
+  if (hostname && wild_match((unsigned char *)pattern, (unsigned char *)hostname))
+    return 1;
+  return 0;
+}
+
+void status_get_stats(status_stats_t *stats) {
+  thread_mutex_lock(&status_mutex);
+  *stats = status_stats;
+  thread_mutex_unlock(&status_mutex);
+}
@@ -0,0 +1,123 @@
+/* status.h
+ * - snapshots of the connection trees for status output, function headers
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_STATUS_H
+#define NTRIPCASTER_STATUS_H
+
+/* Strings of a snapshot are packed into blocks of this size */
+#define STATUS_BLOCK_SIZE 16384
+
+typedef struct status_source_St {
+  unsigned long int id;
+  int sock;
+  time_t connect_time;
+  const char *host;           /* IP */
+  const char *hostname;       /* NULL if not resolved */
+  const char *agent;
+  const char *type;
+  const char *mount;
+  int state;
+  int priority;
+  unsigned long int clients;
+  unsigned long int read_kilos;
+  unsigned long int write_kilos;
+  unsigned long int client_connections;
+} status_source_t;
+
+typedef struct status_client_St {
+  unsigned long int id;
+  time_t connect_time;
+  const char *host;
+  const char *hostname;
+  const char *user;           /* NULL without Authorization */
+  const char *mount;
+  const char *user_agent;
+  const char *type;
+  unsigned long int write_bytes;
+  int errors;
+  long int lag_ms;
+} status_client_t;
+
+typedef struct status_admin_St {
+  unsigned long int id;
+  time_t connect_time;
+  const char *host;
+  const char *hostname;
+  int commands;
+} status_admin_t;
+
+typedef struct status_block_St {
+  struct status_block_St *next;
+  int used;
+  int size;
+  char data[1];
+} status_block_t;
+
+/*
+ * Copy of the sources, clients and admins, taken
+ * holding each mutex only while copying. Never changed once built, so it
+ * is read and written out without any lock.
+ */
+typedef struct status_snapshot_St {
+  time_t taken;
+  unsigned long int serial;
+  status_source_t *sources;
+  int num_sources;
+  status_client_t *clients;
+  int num_clients;
+  status_admin_t *admins;
+  int num_admins;
+  status_block_t *blocks;     /* strings of all entries */
+  int refcount;               /* views using the snapshot */
+  int current;                /* still handed out by status_acquire() */
+} status_snapshot_t;
+
+typedef struct status_stats_St {
+  unsigned long int builds;   /* snapshots taken */
+  unsigned long int reuses;   /* views served from an existing snapshot */
+  unsigned long int build_us; /* time spent taking them */
+} status_stats_t;
+
+void status_init(void);
+void status_cleanup(void);
+status_snapshot_t *status_acquire(void);
+void status_release(status_snapshot_t *s);
+const char *status_host(const char *host, const char *hostname);
+int status_hostmatch(const char *host, const char *hostname, const char *pattern);
+void status_get_stats(status_stats_t *stats);
+#endif
@@ -0,0 +1,363 @@
+/* stindex.c
+ * - index over the STR entries of the sourcetable
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/types.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "avl.h"
+#include "avl_functions.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "sourcetable.h"
+#include "match.h"
+#include "utility.h"
+#include "log.h"
+#include "memory.h"
+#include "stindex.h"
+
+extern server_info_t info;
+extern sourcetable_field_t stream_entry_fields[];
+
+/*
+ * Built by read_sourcetable() over all STR entries, and like the tree only
+ * used with sourcetable_mutex held. Positions go into a k-d tree of points
+ * on the unit sphere, where the chord length grows with the great circle
+ * distance, so nearest neighbour searches need no special cases at the
+ * poles or the date line. Every numeric STR field gets a sorted column,
+ * filters restricting one of them by a range only check the entries
+ * inside it.
+ */
+typedef struct nearest_state_St {
+  double q[3];
+  int n;
+  int found;
+  double maxd2;
+  sourcetable_entry_t **out;
+  double *d2;
+} nearest_state_t;
+
+static void to_unit_vector(double lat, double lon, double *v) {
+  double la = lat * M_PI / 180.0, lo = lon * M_PI / 180.0;
+
+  v[0] = cos(la) * cos(lo);
+  v[1] = cos(la) * sin(lo);
+  v[2] = sin(la);
+}
+
+static double chord2(const double *a, const double *b) {
+  double dx = a[0] - b[0], dy = a[1] - b[1], dz = a[2] - b[2];
+
+  return dx * dx + dy * dy + dz * dz;
+}
+
+static double chord2_to_km(double d2) {
+  double c = sqrt(d2) / 2.0;
+
+  return 2.0 * asin(c > 1.0 ? 1.0 : c) * EARTH_RADIUS_KM;
+}
+
+static double get_numeric_value(sourcetable_field_t *field) {
+  if (field->type == integer_e) return get_integer_value(field);
+  return get_real_value(field);
+}
+
+/* moves the k-th smallest point by axis to p[k], smaller ones before it */
+static void kd_select(stindex_point_t *p, int n, int k, int axis) {
+  int lo = 0, hi = n - 1, i, j;
+  stindex_point_t t;
+  double pivot;
+
+  while (lo < hi) {
+    pivot = p[(lo + hi) / 2].v[axis];
+    i = lo;
+    j = hi;
+    while (i <= j) {
+      while (p[i].v[axis] < pivot) i++;
+      while (p[j].v[axis] > pivot) j--;
+      if (i <= j) {
+        t = p[i]; p[i] = p[j]; p[j] = t;
+        i++;
+        j--;
+      }
+    }
+    if (k <= j) hi = j;
+    else if (k >= i) lo = i;
+    else return;
+  }
+}
+
+static void kd_build(stindex_point_t *p, int n, int depth) {
+  int mid = n / 2;
+
+  if (n <= 1) return;
+
+  kd_select(p, n, mid, depth % 3);
+  kd_build(p, mid, depth + 1);
+  kd_build(p + mid + 1, n - mid - 1, depth + 1);
+}
+
+static void nearest_add(nearest_state_t *st, sourcetable_entry_t *entry, double d2) {
+  int i;
+
+  if (d2 > st->maxd2) return;
+  if ((st->found == st->n) && (d2 >= st->d2[st->n - 1])) return;
+
+  i = (st->found < st->n) ? st->found++ : st->n - 1;
+  while ((i > 0) && (st->d2[i - 1] > d2)) {
+    st->d2[i] = st->d2[i - 1];
+    st->out[i] = st->out[i - 1];
+    i--;
+  }
+  st->d2[i] = d2;
+  st->out[i] = entry;
+}
+
+static void kd_nearest(stindex_point_t *p, int n, int depth, nearest_state_t *st) {
+  int mid = n / 2, axis = depth % 3;
+  double diff, limit;
+
+  if (n <= 0) return;
+
+  if (p[mid].entry->show == 1)
+    nearest_add(st, p[mid].entry, chord2(st->q, p[mid].v));
+
+  diff = st->q[axis] - p[mid].v[axis];
+  if (diff < 0) {
+    kd_nearest(p, mid, depth + 1, st);
+  } else {
+    kd_nearest(p + mid + 1, n - mid - 1, depth + 1, st);
+  }
+
+  limit = (st->found == st->n) ? st->d2[st->n - 1] : st->maxd2;
+  if (diff * diff <= limit) {
+    if (diff < 0)
+      kd_nearest(p + mid + 1, n - mid - 1, depth + 1, st);
+    else
+      kd_nearest(p, mid, depth + 1, st);
+  }
+}
+
+static stindex_column_t *column_sort_base;
+
+static int compare_column_rows(const void *a, const void *b) {
+  double va = column_sort_base->values[*(const int *)a], vb = column_sort_base->values[*(const int *)b];
+
+  return (va > vb) - (va < vb);
+}
+
+static int compare_entries_tree_order(const void *a, const void *b) {
+  return compare_sourcetable_entrys(*(sourcetable_entry_t * const *)a, *(sourcetable_entry_t * const *)b, NULL);
+}
+
+/* first row with a value >= lo (upper = 0) or > hi (upper = 1) */
+static int column_bound(stindex_column_t *c, int count, double value, int upper) {
+  int lo = 0, hi = count, mid;
+
+  while (lo < hi) {
+    mid = (lo + hi) / 2;
+    if (upper ? (c->values[mid] <= value) : (c->values[mid] < value)) lo = mid + 1;
+    else hi = mid;
+  }
+
+  return lo;
+}
+
+/* must have sourcetable_mutex. */
+void stindex_free(void) {
+  sourcetable_index_t *idx = info.sourcetable.index;
+  int i;
+
+  if (idx == NULL) return;
+
+  for (i = 0; i < idx->ncolumns; i++) {
+    nfree(idx->columns[i].values);
+    nfree(idx->columns[i].entries);
+  }
+  if (idx->columns)
+  {
+    nfree(idx->columns);
+  }
+  if (idx->points)
+  {
+    nfree(idx->points);
+  }
+  nfree(idx);
+  info.sourcetable.index = NULL;
+}
+
+/* must have sourcetable_mutex. */
+void stindex_build(void) {
+  avl_traverser trav = {0};
+  sourcetable_index_t *idx;
+  sourcetable_entry_t *se, **entries;
+  sourcetable_field_t *fields;
+  stindex_column_t *c;
+  int i, j, *rows, nfields = get_field_array_length(stream_entry_fields);
+
+  stindex_free();
+
+  idx = nmalloc(sizeof(sourcetable_index_t));
+  idx->count = 0;
+  idx->points = NULL;
+  idx->ncolumns = 0;
+  idx->columns = NULL;
+
+  while ((se = avl_traverse (info.sourcetable.tree, &trav)))
+    if ((se->type == str_e) && (se->fields != NULL)) idx->count++;
+
+  info.sourcetable.index = idx;
+  if (idx->count == 0) return;
+
+  entries = nmalloc(idx->count * sizeof(sourcetable_entry_t *));
+  idx->points = nmalloc(idx->count * sizeof(stindex_point_t));
+  i = 0;
+  while ((se = avl_traverse (info.sourcetable.tree, &trav))) if ((se->type == str_e) && (se->fields != NULL)) {
+    entries[i] = se;
+    idx->points[i].entry = se;
+    to_unit_vector(get_real_value_by_index(se->fields, STR_LATITUDE), get_real_value_by_index(se->fields, STR_LONGITUDE), idx->points[i].v);
+    i++;
+  }
+  kd_build(idx->points, idx->count, 0);
+
+  for (j = 0; j < nfields; j++)
+    if ((stream_entry_fields[j].type == integer_e) || (stream_entry_fields[j].type == real_e)) idx->ncolumns++;
+  idx->columns = nmalloc(idx->ncolumns * sizeof(stindex_column_t));
+  rows = nmalloc(idx->count * sizeof(int));
+
+  c = idx->columns;
+  for (j = 0; j < nfields; j++) {
+    if ((stream_entry_fields[j].type != integer_e) && (stream_entry_fields[j].type != real_e)) continue;
+
+    c->field = j;
+    c->values = nmalloc(idx->count * sizeof(double));
+    c->entries = nmalloc(idx->count * sizeof(sourcetable_entry_t *));
+    for (i = 0; i < idx->count; i++) {
+      fields = (sourcetable_field_t *)entries[i]->fields;
+      c->values[i] = get_numeric_value(&fields[j]);
+      rows[i] = i;
+    }
+    column_sort_base = c;
+    qsort(rows, idx->count, sizeof(int), compare_column_rows);
+    for (i = 0; i < idx->count; i++) c->entries[i] = entries[rows[i]];
+    for (i = 0; i < idx->count; i++) c->values[i] = get_numeric_value(&((sourcetable_field_t *)c->entries[i]->fields)[j]);
+    c++;
+  }
+
+  nfree(rows);
+  nfree(entries);
+
+  xa_debug (2, "DEBUG: stindex_build: %d STR entries, %d numeric columns", idx->count, idx->ncolumns);
+}
+
+/* STR entries a filter can match, in the order of the sourcetable tree.
+ * Returns -1 if the filter is not restricted to STR entries with a range
+ * on a numeric field, the caller has to scan the whole tree then.
+ * must have sourcetable_mutex. */
+int stindex_filter_candidates(compiled_filter_t *cf, sourcetable_entry_t ***out) {
+  sourcetable_index_t *idx = info.sourcetable.index;
+  stindex_column_t *best = NULL;
+  int i, first, last, bestfirst = 0, bestcount = -1;
+  double lo, hi;
+
+  *out = NULL;
+  if ((idx == NULL) || !filter_field_is(cf, 0, "STR")) return -1;
+
+  for (i = 0; i < idx->ncolumns; i++) {
+    if (!filter_field_range(cf, idx->columns[i].field, &lo, &hi)) continue;
+    first = column_bound(&idx->columns[i], idx->count, lo, 0);
+    last = column_bound(&idx->columns[i], idx->count, hi, 1);
+    if (last < first) last = first;
+    if ((bestcount < 0) || (last - first < bestcount)) {
+      best = &idx->columns[i];
+      bestfirst = first;
+      bestcount = last - first;
+    }
+  }
+
+  if ((best == NULL) || (bestcount == 0)) return (best == NULL) ? -1 : 0;
+
+  *out = nmalloc(bestcount * sizeof(sourcetable_entry_t *));
+  memcpy(*out, &best->entries[bestfirst], bestcount * sizeof(sourcetable_entry_t *));
+  qsort(*out, bestcount, sizeof(sourcetable_entry_t *), compare_entries_tree_order);
+
+  return bestcount;
+}
+
+/* Up to n online STR entries nearest to lat/lon and no further than maxkm
+ * (0 = any distance), nearest first, with their distance in km.
+ * must have sourcetable_mutex. */
+int stindex_nearest(double lat, double lon, int n, double maxkm, sourcetable_entry_t **out, double *km) {
+  sourcetable_index_t *idx = info.sourcetable.index;
+  nearest_state_t st;
+  double d2[NEAREST_MAX], c;
+  int i;
+
+  if ((idx == NULL) || (idx->count == 0) || (n <= 0)) return 0;
+  if (n > NEAREST_MAX) n = NEAREST_MAX;
+
+  to_unit_vector(lat, lon, st.q);
+  st.n = n;
+  st.found = 0;
+  st.out = out;
+  st.d2 = d2;
+  st.maxd2 = 5.0;
+  if ((maxkm > 0) && (maxkm < M_PI * EARTH_RADIUS_KM)) {
+    c = 2.0 * sin(maxkm / EARTH_RADIUS_KM / 2.0);
+    st.maxd2 = c * c;
+  }
+
+  kd_nearest(idx->points, idx->count, 0, &st);
+
+  for (i = 0; i < st.found; i++) km[i] = chord2_to_km(d2[i]);
+
+  return st.found;
+}
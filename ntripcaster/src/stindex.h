@@ -0,0 +1,70 @@
+/* stindex.h
+ * - index over the STR entries of the sourcetable, function headers
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_STINDEX_H
+#define NTRIPCASTER_STINDEX_H
+
+#define NEAREST_DEFAULT 10 /* stations returned by /?nearest without a count */
+#define NEAREST_MAX 100
+#define EARTH_RADIUS_KM 6371.0
+
+/* STR entry as a point on the unit sphere */
+typedef struct stindex_point_St {
+  double v[3];
+  sourcetable_entry_t *entry;
+} stindex_point_t;
+
+/* STR entries sorted by the value of one numeric field */
+typedef struct stindex_column_St {
+  int field;
+  double *values;
+  sourcetable_entry_t **entries;
+} stindex_column_t;
+
+typedef struct sourcetable_index_St {
+  int count;
+  stindex_point_t *points; /* k-d tree, median of each range at its middle */
+  int ncolumns;
+  stindex_column_t *columns;
+} sourcetable_index_t;
+
+void stindex_build(void);
+void stindex_free(void);
+int stindex_filter_candidates(compiled_filter_t *cf, sourcetable_entry_t ***out);
+int stindex_nearest(double lat, double lon, int n, double maxkm, sourcetable_entry_t **out, double *km);
+#endif
@@ -0,0 +1,691 @@
+/* template.c
+ * - compiled html templates for the admin and status pages
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifdef HAVE_CONFIG_H
+#ifdef _WIN32
+#include <win32config.h>
+#else
+#include <config.h>
+#endif
+#endif
+
+#include "definitions.h"
+
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <stdlib.h>
+#include <time.h>
+
+#ifdef HAVE_UNISTD_H
+#include <unistd.h>
+#endif
+
+#include "avl.h"
+#include "threads.h"
+#include "ntripcastertypes.h"
+#include "ntripcaster.h"
+#include "utility.h"
+#include "ntripcaster_string.h"
+#include "connection.h"
+#include "sock.h"
+#include "log.h"
+#include "logtime.h"
+#include "vars.h"
+#include "http.h"
+#include "memory.h"
+#include "template.h"
+#include "status.h"
+
+extern server_info_t info;
+
+/*
+ * Template files are read and compiled once into a list of ops (literal
+ * text, variables, loops, includes) and kept until their modification
+ * time or size changes. Pages are rendered into a buffer that is written
+ * out in TEMPLATE_FLUSH_SIZE pieces. Loops run over a status snapshot
+ * taken for the page, so no mutex is held while writing.
+ */
+static mutex_t template_mutex;
+static hash_table_t *templates = NULL;
+static template_stats_t template_stats;
+
+/* A row of a running @FOREACH@ */
+typedef struct template_row_St {
+  const char *ident;
+  template_loop_t loop;
+  int index;
+  const status_source_t *source;  /* entry of the loop type */
+  const status_client_t *client;
+  const status_admin_t *admin;
+  struct template_row_St *outer;
+} template_row_t;
+
+typedef struct template_out_St {
+  connection_t *clicon;
+  int fd;            /* < 0: clicon->sock */
+  vartree_t *variables;
+  char *buf;
+  int len;
+  int size;
+  status_snapshot_t *snap; /* taken by the first loop of the page */
+  int depth;         /* @INCLUDE@ nesting */
+} template_out_t;
+
+static void free_template(template_t *t) {
+  int i;
+
+  for (i = 0; i < t->nops; i++) {
+    if (t->ops[i].name) {
+      nfree(t->ops[i].name);
+    }
+    if (t->ops[i].arg) {
+      nfree(t->ops[i].arg);
+    }
+  }
+  if (t->ops) {
+    nfree(t->ops);
+  }
+  nfree(t->text);
+  nfree(t->path);
+  nfree(t);
+}
+
+void template_init(void) {
+  thread_create_mutex(&template_mutex);
+  thread_mutex_profile(&template_mutex, "template cache");
+  templates = hash_create(32);
+  memset(&template_stats, 0, sizeof(template_stats));
+}
+
+static void free_cached_template(void *data) {
+  template_t *t = (template_t *)data;
+
+  t->cached = 0;
+  if (t->refcount == 0) free_template(t);
+}
+
+/* Only at shutdown, when the other threads are gone */
+void template_cleanup(void) {
+  thread_mutex_lock(&template_mutex);
+  hash_destroy(templates, (ntripcaster_function *)free_cached_template);
+  templates = NULL;
+  template_stats.entries = 0;
+  thread_mutex_unlock(&template_mutex);
+  thread_mutex_destroy(&template_mutex);
+}
+
+void template_get_stats(template_stats_t *stats) {
+  thread_mutex_lock(&template_mutex);
+  *stats = template_stats;
+  thread_mutex_unlock(&template_mutex);
+}
+
+/* Compiling */
+
+typedef struct template_compile_St {
+  template_t *t;
+  int size;                          /* allocated ops */
+  int loops[TEMPLATE_MAX_LOOPS];     /* open @FOREACH@ ops */
+  int nloops;
+  int pending;                       /* EVEN/ODD targets not yet passed */
+} template_compile_t;
+
+static template_op_t *add_op(template_compile_t *c, template_op_type_t type, int offset) {
+  template_op_t *op;
+
+  if (c->t->nops == c->size) {
+    template_op_t *grown;
+
+    c->size = c->size ? c->size * 2 : 32;
+    grown = (template_op_t *)nmalloc(c->size * sizeof(template_op_t));
+    if (c->t->nops > 0) memcpy(grown, c->t->ops, c->t->nops * sizeof(template_op_t));
+    if (c->t->ops) {
+      nfree(c->t->ops);
+    }
+    c->t->ops = grown;
+  }
+
+  op = &c->t->ops[c->t->nops++];
+  memset(op, 0, sizeof(template_op_t));
+  op->type = type;
+  op->offset = offset;
+  op->target = -1;
+  return op;
+}
+
+/* Literal text, split where an EVEN/ODD false branch continues */
+static void add_text(template_compile_t *c, int start, int end) {
+  template_op_t *op;
+  int i, split;
+
+  while (start < end) {
+    split = end;
+    for (i = 0; c->pending && i < c->t->nops; i++) {
+      int target = c->t->ops[i].target;
+      if ((target > start) && (target < split)) split = target;
+    }
+    op = add_op(c, template_text_e, start);
+    op->len = split - start;
+    start = split;
+  }
+}
+
+/* the part of a tag after its first blank, or all of it */
+static char *tag_argument(const char *tag) {
+  const char *blank = strchr(tag, ' ');
+
+  return nstrdup(blank ? blank + 1 : tag);
+}
+
+static void add_tag(template_compile_t *c, char *tag, int start, int end) {
+  template_t *t = c->t;
+  template_op_t *op;
+
+  if (strncmp(tag, "FOREACH", 7) == 0) {
+    char *ident, *type;
+
+    if (((ident = strchr(tag, ' ')) == NULL) || ((type = strchr(ident + 1, ' ')) == NULL))
+      return;
+    *type++ = '\0';
+
+    op = add_op(c, template_foreach_e, start);
+    op->name = nstrdup(ident + 1);
+    if (ntripcaster_strcasecmp(type, "SOURCES") == 0)
+      op->loop = template_loop_sources_e;
+    else if (ntripcaster_strcasecmp(type, "LISTENERS") == 0)
+      op->loop = template_loop_listeners_e;
+    else if (ntripcaster_strcasecmp(type, "ADMINS") == 0)
+      op->loop = template_loop_admins_e;
+    else {
+      op->loop = template_loop_unknown_e;
+      op->arg = nstrdup(type);
+    }
+
+    if ((op->loop != template_loop_unknown_e) && (c->nloops < TEMPLATE_MAX_LOOPS))
+      c->loops[c->nloops++] = t->nops - 1;
+  } else if (strncmp(tag, "INCLUDE", 7) == 0) {
+    op = add_op(c, template_include_e, start);
+    op->name = tag_argument(tag);
+  } else if ((strncmp(tag, "EVEN", 4) == 0) || (strncmp(tag, "ODD", 3) == 0)) {
+    const char *nl;
+
+    op = add_op(c, (tag[0] == 'E') ? template_even_e : template_odd_e, start);
+    op->name = tag_argument(tag);
+    /* a false condition skips the next two lines */
+    if (((nl = strchr(t->text + end, '\n')) != NULL) && ((nl = strchr(nl + 1, '\n')) != NULL)) {
+      op->target = nl + 1 - t->text;
+      c->pending++;
+    }
+  } else if (strncmp(tag, "ENDFOR", 6) == 0) {
+    if (c->nloops > 0)
+      t->ops[c->loops[--c->nloops]].jump = t->nops;
+    else
+      add_op(c, template_end_e, start);
+  } else {
+    op = add_op(c, template_var_e, start);
+    op->name = nstrdup(tag);
+  }
+}
+
+static void compile_template(template_t *t) {
+  template_compile_t c;
+  char tag[BUFSIZE];
+  const char *text = t->text, *close;
+  int pos = 0, literal = 0, start, i, j;
+
+  memset(&c, 0, sizeof(c));
+  c.t = t;
+
+  while (text[pos]) {
+    if ((text[pos] != '@') || ((close = strchr(text + pos + 1, '@')) == NULL) || (close - (text + pos) >= BUFSIZE)) {
+      pos++;
+      continue;
+    }
+
+    add_text(&c, literal, pos);
+    start = pos;
+    memcpy(tag, text + start + 1, close - (text + start + 1));
+    tag[close - (text + start + 1)] = '\0';
+    pos = literal = close + 1 - text;
+    add_tag(&c, tag, start, pos);
+  }
+  add_text(&c, literal, pos);
+
+  /* loops without @ENDFOR@ run to the end */
+  while (c.nloops > 0)
+    t->ops[c.loops[--c.nloops]].jump = t->nops;
+
+  for (i = 0; i < t->nops; i++) {
+    if ((t->ops[i].type != template_even_e) && (t->ops[i].type != template_odd_e))
+      continue;
+    t->ops[i].jump = i + 1;
+    if (t->ops[i].target < 0)
+      continue;
+    for (j = i + 1; (j < t->nops) && (t->ops[j].offset < t->ops[i].target); j++);
+    t->ops[i].jump = j;
+  }
+}
+
+static template_t *read_template(const char *path, struct stat *st) {
+  template_t *t;
+  char *text;
+  int ffd, count = 0, readlen;
+
+  if ((ffd = open_for_reading(path)) < 0)
+    return NULL;
+
+  text = (char *)nmalloc(st->st_size + 1);
+  while (count < st->st_size) {
+    readlen = read(ffd, text + count, st->st_size - count);
+    if (readlen <= 0) {
+      xa_debug (1, "Read error while parsing %s", path);
+      fd_close(ffd);
+      nfree(text);
+      return NULL;
+    }
+    count += readlen;
+  }
+  text[count] = '\0';
+  fd_close(ffd);
+
+  t = (template_t *)nmalloc(sizeof(template_t));
+  memset(t, 0, sizeof(template_t));
+  t->path = nstrdup(path);
+  t->mtime = st->st_mtime;
+  t->size = st->st_size;
+  t->text = text;
+  compile_template(t);
+
+  xa_debug (2, "DEBUG: read_template: compiled [%s], %d bytes into %d ops", path, count, t->nops);
+
+  return t;
+}
+
+/* Compiled template of a file, release with release_template() */
+static template_t *get_template(const char *path) {
+  template_t *t, *old;
+  struct stat st;
+
+  if (stat(path, &st) == -1)
+    return NULL;
+
+  thread_mutex_lock(&template_mutex);
+  t = hash_find(templates, path);
+  if ((t != NULL) && (t->mtime == st.st_mtime) && (t->size == st.st_size)) {
+    t->refcount++;
+    template_stats.hits++;
+    thread_mutex_unlock(&template_mutex);
+    return t;
+  }
+  thread_mutex_unlock(&template_mutex);
+
+  if ((t = read_template(path, &st)) == NULL)
+    return NULL;
+  t->refcount = 1;
+
+  thread_mutex_lock(&template_mutex);
+  template_stats.compiles++;
+  old = hash_remove(templates, path);
+  if (old != NULL) {
+    template_stats.entries--;
+    free_cached_template(old);
+  }
+  hash_replace(templates, t->path, t);
+  t->cached = 1;
+  template_stats.entries++;
+  thread_mutex_unlock(&template_mutex);
+
+  return t;
+}
+
+static void release_template(template_t *t) {
+  thread_mutex_lock(&template_mutex);
+  t->refcount--;
+  if ((t->refcount == 0) && !t->cached) free_template(t);
+  thread_mutex_unlock(&template_mutex);
+}
+
+/* Rendering */
+
+static void out_flush(template_out_t *out) {
+  if (out->len <= 0)
+    return;
+  if (out->fd < 0)
+    sock_write_bytes(out->clicon->sock, out->buf, out->len);
+  else
+    fd_write_bytes(out->fd, out->buf, out->len);
+  out->len = 0;
+}
+
+static void out_write(template_out_t *out, const char *data, int len) {
+  if (out->len + len > out->size)
+    out_flush(out);
+
+  if (len > out->size) {
+    char *grown;
+
+    while (len > out->size)
+      out->size *= 2;
+    grown = (char *)nmalloc(out->size);
+    memcpy(grown, out->buf, out->len);
+    nfree(out->buf);
+    out->buf = grown;
+  }
+
+  memcpy(out->buf + out->len, data, len);
+  out->len += len;
+}
+
+static void out_printf(template_out_t *out, const char *fmt, ...) {
+  char buf[BUFSIZE];
+  va_list ap;
+
+  va_start(ap, fmt);
+  vsnprintf(buf, BUFSIZE, fmt, ap);
+  va_end(ap);
+
+  out_write(out, buf, strlen(buf));
+}
+
+static void out_string(template_out_t *out, const char *s) {
+  out_write(out, s, strlen(s));
+}
+
+/* Field of a loop row, 0 if name is not one of the row */
+static int row_variable(template_out_t *out, template_row_t *row, const char *name) {
+  char buf[BUFSIZE];
+  const char *field, *host;
+  time_t connect_time;
+  int len;
+
+  for (; row; row = row->outer) {
+    len = strlen(row->ident);
+    if (strncmp(name, row->ident, len) != 0)
+      continue;
+    if (name[len] == '\0') {
+      out_printf(out, "%d", row->index);
+      return 1;
+    }
+    if (name[len] != '.')
+      continue;
+    field = name + len + 1;
+
+    if (row->source) {
+      host = status_host(row->source->host, row->source->hostname);
+      connect_time = row->source->connect_time;
+    } else if (row->client) {
+      host = status_host(row->client->host, row->client->hostname);
+      connect_time = row->client->connect_time;
+    } else {
+      host = status_host(row->admin->host, row->admin->hostname);
+      connect_time = row->admin->connect_time;
+    }
+
+    if (strcmp(field, "host") == 0)
+      out_string(out, host);
+    else if (strcmp(field, "connecttime") == 0)
+      out_string(out, nntripcaster_time(get_time() - connect_time, buf));
+    else if (row->source && (strcmp(field, "clients") == 0))
+      out_printf(out, "%lu", row->source->clients);
+    else if (row->source && (strcmp(field, "mount") == 0))
+      out_string(out, nullcheck_string(row->source->mount));
+    else if (row->client && (strcmp(field, "id") == 0))
+      out_printf(out, "%lu", row->client->id);
+    else if (row->client && (strcmp(field, "user_agent") == 0))
+      out_string(out, nullcheck_string(row->client->user_agent));
+    else if (row->client && (strcmp(field, "writebytes") == 0))
+      out_printf(out, "%lu", row->client->write_bytes);
+    else
+      continue;
+    return 1;
+  }
+  return 0;
+}
+
+static void render_variable(template_out_t *out, template_row_t *row, const char *name) {
+  const http_variable_t *var;
+  const char *value;
+
+  if (row_variable(out, row, name))
+    return;
+
+  if (out->variables && ((value = get_variable(out->variables, name)) != NULL)) {
+    out_string(out, value);
+    return;
+  }
+
+  if ((var = find_http_variable(name, http_variables)) == NULL) {
+    /* @something@ that is output as is */
+    out_printf(out, "@%s@", name);
+    return;
+  }
+
+  if (var->type == integer_e)
+    out_printf(out, "%d", *(int *)var->valueptr);
+  else if (var->type == real_e) {
+    if (out->fd < 0)
+      out_printf(out, "%d", (int)*(double *)var->valueptr);
+    else
+      out_printf(out, "%f", *(double *)var->valueptr);
+  } else if (var->type == function_e) {
+    char *ptr = (char *)((*((HttpFunction *) (var->valueptr))) ());
+    out_string(out, ptr);
+    nfree(ptr);
+  } else {
+    char *ptr = var->valueptr ? *(char **)var->valueptr : NULL;
+    out_string(out, ptr ? ptr : "(null)");
+  }
+}
+
+/* Value of the variable of @EVEN@ and @ODD@, 0 if it does not exist */
+static int parity_value(template_out_t *out, template_row_t *row, const char *name, int *value) {
+  const http_variable_t *var;
+  const char *s;
+
+  for (; row; row = row->outer) {
+    if (strcmp(name, row->ident) == 0) {
+      *value = row->index;
+      return 1;
+    }
+  }
+
+  if (out->variables && ((s = get_variable(out->variables, name)) != NULL)) {
+    *value = atoi(s);
+    return 1;
+  }
+
+  if ((var = find_http_variable(name, http_variables)) != NULL) {
+    *value = (var->type == integer_e) ? *(int *)var->valueptr : 0;
+    return 1;
+  }
+  return 0;
+}
+
+static void render_ops(template_out_t *out, template_t *t, int from, int to, template_row_t *row);
+
+static void render_loop(template_out_t *out, template_t *t, int at, template_row_t *outer) {
+  template_op_t *op = &t->ops[at];
+  template_row_t row;
+  const char *none;
+  int count;
+
+  if (op->loop == template_loop_unknown_e) {
+    xa_debug (1, "WARNING: Unknown Traverse type for FOREACH [%s]", op->arg);
+    out_printf(out, "Unknown Traverse type [%s]", op->arg);
+    return;
+  }
+
+  if (!out->snap)
+    out->snap = status_acquire();
+
+  switch (op->loop) {
+    case template_loop_sources_e:
+      count = out->snap->num_sources;
+      none = "No sources available<br>";
+      break;
+    case template_loop_listeners_e:
+      count = out->snap->num_clients;
+      none = "No listeners available<br>";
+      break;
+    default:
+      count = out->snap->num_admins;
+      none = "No admins available<br>";
+      break;
+  }
+
+  if (count <= 0) {
+    out_string(out, none);
+    return;
+  }
+
+  memset(&row, 0, sizeof(row));
+  row.ident = op->name;
+  row.loop = op->loop;
+  row.outer = outer;
+
+  for (row.index = 0; row.index < count; row.index++) {
+    if (op->loop == template_loop_sources_e)
+      row.source = &out->snap->sources[row.index];
+    else if (op->loop == template_loop_listeners_e)
+      row.client = &out->snap->clients[row.index];
+    else
+      row.admin = &out->snap->admins[row.index];
+    render_ops(out, t, at + 1, op->jump, &row);
+  }
+}
+
+static void render_include(template_out_t *out, template_row_t *row, const char *name) {
+  char filename[BUFSIZE];
+  template_t *t;
+
+  if (out->depth >= TEMPLATE_MAX_DEPTH) {
+    xa_debug (1, "ERROR: Template files included too deep at [%s]", name);
+    return;
+  }
+
+  if (get_ntripcaster_file(name, template_file_e, R_OK, filename) == NULL) {
+    xa_debug (1, "ERROR: Cannot find template file [%s]", name);
+    out_printf(out, "ERROR: Cannot find template file %s\r\n", name);
+    return;
+  }
+
+  if ((t = get_template(filename)) == NULL) {
+    xa_debug (1, "ERROR: Cannot open file [%s]", filename);
+    out_printf(out, "ERROR: Cannot open file [%s]\r\n", filename);
+    return;
+  }
+
+  out->depth++;
+  render_ops(out, t, 0, t->nops, row);
+  out->depth--;
+
+  release_template(t);
+}
+
+static void render_ops(template_out_t *out, template_t *t, int from, int to, template_row_t *row) {
+  template_op_t *op;
+  int i = from, value;
+
+  while (i < to) {
+    op = &t->ops[i];
+    switch (op->type) {
+      case template_text_e:
+        out_write(out, t->text + op->offset, op->len);
+        i++;
+        break;
+      case template_var_e:
+        render_variable(out, row, op->name);
+        i++;
+        break;
+      case template_foreach_e:
+        render_loop(out, t, i, row);
+        i = (op->loop == template_loop_unknown_e) ? i + 1 : op->jump;
+        break;
+      case template_even_e:
+      case template_odd_e:
+        if (!parity_value(out, row, op->name, &value)) {
+          out_printf(out, "No such variable [%s]\r\n", op->name);
+          i++;
+        } else if ((value % 2 == 0) == (op->type == template_even_e))
+          i++;
+        else
+          i = op->jump;
+        break;
+      case template_include_e:
+        render_include(out, row, op->name);
+        i++;
+        break;
+      case template_end_e:
+        return;
+    }
+  }
+}
+
+/*
+ * Renders a template file to the socket of clicon (fd < 0) or to fd.
+ * variables are looked up before the server variables of http.c.
+ */
+int template_render_file(connection_t *clicon, const char *path, int fd, vartree_t *variables) {
+  template_out_t out;
+  template_t *t;
+
+  if ((t = get_template(path)) == NULL) {
+    xa_debug (1, "ERROR: Cannot open file [%s]", path);
+    if (fd < 0)
+      sock_write_line (clicon->sock, "ERROR: Cannot open file [%s]", path);
+    return 0;
+  }
+
+  memset(&out, 0, sizeof(out));
+  out.clicon = clicon;
+  out.fd = fd;
+  out.variables = variables;
+  out.size = TEMPLATE_FLUSH_SIZE;
+  out.buf = (char *)nmalloc(out.size);
+
+  render_ops(&out, t, 0, t->nops, NULL);
+  out_flush(&out);
+
+  status_release(out.snap);
+  nfree(out.buf);
+  release_template(t);
+  return 1;
+}
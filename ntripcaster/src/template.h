@@ -0,0 +1,98 @@
+/* template.h
+ * - compiled html templates, function headers
+ *
+ * Copyright (c) 2003
+ * German Federal Agency for Cartography and Geodesy (BKG)
+ *
+ * Developed for Networked Transport of RTCM via Internet Protocol (NTRIP)
+ * for streaming GNSS data over the Internet.
+ *
+ * Designed by Informatik Centrum Dortmund http://www.icd.de
+ *
+ * The BKG disclaims any liability nor responsibility to any person or entity
+ * with respect to any loss or damage caused, or alleged to be caused,
+ * directly or indirectly by the use and application of the NTRIP technology.
+ *
+ * For latest information and updates, access:
+ * http://igs.ifag.de/index_ntrip.htm
+ *
+ * Georg Weber
+ * BKG, Frankfurt, Germany, June 2003-06-13
+ * E-mail: euref-ip@bkg.bund.de
+ *
+ * Based on the GNU General Public License published Icecast 1.3.12
+ *
+ * This program is free software; you can redistribute it and/or
+ * modify it under the terms of the GNU General Public License
+ * as published by the Free Software Foundation; either version 3
+ * of the License, or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program. If not, see <https://www.gnu.org/licenses/>.
+*/
+
+#ifndef NTRIPCASTER_TEMPLATE_H
+#define NTRIPCASTER_TEMPLATE_H
+
+/* Rendered bytes collected before they are written out */
+#define TEMPLATE_FLUSH_SIZE 16384
+/* Limit for @INCLUDE@ nesting */
+#define TEMPLATE_MAX_DEPTH 8
+/* Limit for @FOREACH@ nesting */
+#define TEMPLATE_MAX_LOOPS 16
+
+typedef enum {
+  template_text_e,    /* literal text */
+  template_var_e,     /* @name@ */
+  template_foreach_e, /* @FOREACH ident SOURCES|LISTENERS|ADMINS@ */
+  template_even_e,    /* @EVEN var@ */
+  template_odd_e,     /* @ODD var@ */
+  template_include_e, /* @INCLUDE file@ */
+  template_end_e      /* @ENDFOR@ outside of a loop, ends the template */
+} template_op_type_t;
+
+typedef enum {
+  template_loop_unknown_e,
+  template_loop_sources_e,
+  template_loop_listeners_e,
+  template_loop_admins_e
+} template_loop_t;
+
+typedef struct template_op_St {
+  template_op_type_t type;
+  int offset;        /* of the text or the tag in the template file */
+  int len;           /* template_text_e */
+  char *name;        /* variable, loop ident or included file */
+  char *arg;         /* unknown loop type */
+  template_loop_t loop;
+  int target;        /* EVEN/ODD: offset the false branch continues at, -1 = none */
+  int jump;          /* op after the loop body or after the skipped lines */
+} template_op_t;
+
+typedef struct template_St {
+  char *path;
+  time_t mtime;      /* of the file the ops were compiled from */
+  off_t size;
+  char *text;
+  template_op_t *ops;
+  int nops;
+  int refcount;      /* pages being rendered from it */
+  int cached;        /* still in the table */
+} template_t;
+
+typedef struct template_stats_St {
+  unsigned long int hits;     /* compiled template found unchanged */
+  unsigned long int compiles; /* template file read and compiled */
+  int entries;
+} template_stats_t;
+
+void template_init(void);
+void template_cleanup(void);
+int template_render_file(connection_t *clicon, const char *path, int fd, vartree_t *variables);
+void template_get_stats(template_stats_t *stats);
+#endif
@@ -77,6 +77,10 @@
 #include <netinet/in.h>
 #endif
 
+#ifdef __linux__
+#include <sys/syscall.h>
+#endif
+
 #include "avl.h"
 #include "avl_functions.h"
 #include "threads.h"
@@ -89,11 +93,47 @@
 #include "logtime.h"
 #include "main.h"
 #include "memory.h"
+#include "probes.h"
 
 extern server_info_t info;
 
 mutex_t library_mutex = {MUTEX_STATE_UNINIT};
 
+/*
+ * The mythread_t of the running thread. Set before the start routine of
+ * a thread runs, so the thread tree is only needed for listing and
+ * killing threads.
+ */
+#ifdef _WIN32
+static __declspec(thread) mythread_t *current_thread = NULL;
+#else
+static __thread mythread_t *current_thread = NULL;
+#endif
+
+typedef struct threadStartSt {
+  mythread_t *mt;
+  void *(*start_routine)(void *);
+  void *arg;
+} thread_start_t;
+
+static void *thread_start(void *arg)
+{
+  thread_start_t *ts = (thread_start_t *)arg;
+  void *(*start_routine)(void *) = ts->start_routine;
+  void *start_arg = ts->arg;
+
+  /* Set here, the creating thread must not touch mt once we run */
+  internal_lock_mutex(&info.thread_mutex);
+  ts->mt->thread = thread_self();
+  internal_unlock_mutex(&info.thread_mutex);
+
+  current_thread = ts->mt;
+  current_thread->tid = thread_kernel_id();
+  nfree(ts);
+
+  return start_routine(start_arg);
+}
+
 #ifdef DEBUG_MEMORY
 void thread_mem_check(mythread_t *thread)
 {
@@ -122,7 +162,10 @@ icethread_t thread_create_c(char *name, void *(*start_routine)(void *), void *ar
   HANDLE ret;
 #endif
   mythread_t *mt = (mythread_t *)nmalloc(sizeof(mythread_t));
+  thread_start_t *ts = (thread_start_t *)nmalloc(sizeof(thread_start_t));
 
+  /* thread is set by the new thread, keep it from matching before */
+  memset(mt, 0, sizeof(mythread_t));
   mt->line = line;
   mt->file = nstrdup(file);
 
@@ -135,8 +178,21 @@ icethread_t thread_create_c(char *name, void *(*start_routine)(void *), void *ar
   mt->ping = 0;
   mt->running = THREAD_CREATED;
 
+  ts->mt = mt;
+  ts->start_routine = start_routine;
+  ts->arg = arg;
+
+  /* Insert before starting, the thread may exit right away */
+  internal_lock_mutex(&info.thread_mutex);
+  if (avl_insert(info.threads, mt))
+  {
+    write_log (LOG_DEFAULT, "WARNING: Inserting thread resulted in duplicate.. sheit!");
+  }
+        id = mt->id;
+  internal_unlock_mutex(&info.thread_mutex);
+
 #ifdef _WIN32
-  ret = CreateThread(NULL, STACKSIZE, (LPTHREAD_START_ROUTINE)start_routine, arg, 0, &mt->thread);
+  ret = CreateThread(NULL, STACKSIZE, (LPTHREAD_START_ROUTINE)thread_start, ts, 0, &thread);
 #else
   pthread_attr_init(&attr);
 
@@ -153,10 +209,10 @@ icethread_t thread_create_c(char *name, void *(*start_routine)(void *), void *ar
   for (i = 0; i < 10; i++) {
 # ifdef hpux
     if (pthread_create ((pthread_t *) &thread, pthread_attr_default,
-            (pthread_startroutine_t) start_routine,
-            (pthread_addr_t) arg) == 0)
+            (pthread_startroutine_t) thread_start,
+            (pthread_addr_t) ts) == 0)
 # else
-          if (pthread_create(&thread, &attr, start_routine, arg) == 0)
+          if (pthread_create(&thread, &attr, thread_start, ts) == 0)
 # endif
       break;
     else
@@ -172,23 +228,16 @@ icethread_t thread_create_c(char *name, void *(*start_routine)(void *), void *ar
   if (i >= 10) {
 #endif
     write_log(LOG_DEFAULT, "System won't let me create more threads, giving up");
+    internal_lock_mutex(&info.thread_mutex);
+    avl_delete(info.threads, mt);
+    internal_unlock_mutex(&info.thread_mutex);
+    nfree(ts);
+    nfree(mt->file);
+    nfree(mt->name);
+    nfree(mt);
     clean_resync(&info);
   }
 
-#ifndef _WIN32
-  mt->thread = thread;
-#else
-  thread = mt->thread;
-#endif
-
-  internal_lock_mutex(&info.thread_mutex);
-  if (avl_insert(info.threads, mt))
-  {
-    write_log (LOG_DEFAULT, "WARNING: Inserting thread resulted in duplicate.. sheit!");
-  }
-        id = mt->id;
-  internal_unlock_mutex(&info.thread_mutex);
-
         xa_debug (3, "DEBUG: Adding thread %d started at [%s:%d]", id, file, line);
 
 #ifndef _WIN32
@@ -213,6 +262,7 @@ thread_create_mutex_nl (mutex_t *mutex)
 
   mutex->thread_id = MUTEX_STATE_NEVERLOCKED;
   mutex->lineno = -1;
+  mutex->stats = NULL;
 #ifdef _WIN32
   InitializeCriticalSection(&mutex->mutex);
 #else
@@ -239,6 +289,7 @@ thread_create_mutex_c (mutex_t *mutex, int line, char *file)
 
   mutex->thread_id = MUTEX_STATE_NEVERLOCKED;
   mutex->lineno = -1;
+  mutex->stats = NULL;
 
 #ifdef _WIN32
   InitializeCriticalSection(&mutex->mutex);
@@ -428,6 +479,7 @@ thread_exit_c (void *val, int line, char *file)
     internal_lock_mutex(&info.thread_mutex);
     out = avl_delete (info.threads, mt);
     internal_unlock_mutex(&info.thread_mutex);
+    current_thread = NULL;
 
     if (out) {
       if (out->id == 0)
@@ -511,26 +563,18 @@ thread_catch_signals ()
 void
 thread_init()
 {
+  /* thread_start() set it before the start routine was called */
   mythread_t *mt = thread_check_created ();
-  int max = 600;
 
   thread_block_signals ();
 
-  while (!mt && (max > 0)) /* Not inserted in the thread tree yet */
-  {
-    my_sleep (40000);
-    mt = thread_check_created ();
-    max--;
-  }
-
-  if (max == 0 || !mt)
+  if (!mt)
   {
     log_no_thread (1, "DEBUG: Thread never made it to life.. weird");
     thread_exit (13); /* Didn't not make it in.. weiiiiiird */
   }
 
-  if (mt)
-    mt->running = THREAD_RUNNING;
+  mt->running = THREAD_RUNNING;
 }
 
 icethread_t thread_self()
@@ -569,36 +613,26 @@ thread_mutex_new ()
 mythread_t *
 thread_get_mythread()
 {
-  avl_traverser trav = {0};
-  mythread_t *mt;
-  icethread_t t = thread_self ();
-
-  internal_lock_mutex(&info.thread_mutex);
-
-  if (info.threads == NULL)
-  {
-    fprintf (stderr, "WARNING: Thread tree is empty, this must be wrong!");
-    internal_unlock_mutex (&info.thread_mutex);
-    return NULL;
-  }
+  mythread_t *mt = thread_check_created ();
 
-  while ((mt = avl_traverse(info.threads, &trav))) {
-    if (thread_equal(t, mt->thread)) {
-      internal_unlock_mutex(&info.thread_mutex);
-      return mt;
-    }
-  }
-  internal_unlock_mutex (&info.thread_mutex);
-  write_log (LOG_DEFAULT, "WARNING: Nonexistent thread alive...");
-  return NULL;
+  if (!mt)
+    write_log (LOG_DEFAULT, "WARNING: Nonexistent thread alive...");
+  return mt;
 }
 
+/*
+ * Only threads not started by thread_create() (the main thread) need to
+ * search the thread tree, once.
+ */
 mythread_t *
 thread_check_created()
 {
   avl_traverser trav = {0};
   mythread_t *mt;
-  icethread_t t = thread_self ();
+  icethread_t t;
+
+  if (current_thread)
+    return current_thread;
 
   if (info.threads == NULL)
   {
@@ -606,11 +640,14 @@ thread_check_created()
     return NULL;
   }
 
+  t = thread_self ();
+
   internal_lock_mutex(&info.thread_mutex);
 
   while ((mt = avl_traverse(info.threads, &trav))) {
     if (thread_equal(t, mt->thread)) {
       internal_unlock_mutex(&info.thread_mutex);
+      current_thread = mt;
       return mt;
     }
   }
@@ -633,12 +670,377 @@ thread_rename(const char *name)
   mt->name = nstrdup(name);
 }
 
+/* Stall detector, written by the calendar thread only */
+static int threads_stalled = 0;
+static unsigned long int thread_stalls = 0;
+static long long int threads_sampled = 0;
+
+long thread_kernel_id()
+{
+#if defined(__linux__) && defined(SYS_gettid)
+  return syscall(SYS_gettid);
+#else
+  return 0;
+#endif
+}
+
+/* Called once per iteration by every long-lived loop */
+void thread_progress(mythread_t *mt)
+{
+  long long int now = get_time_ns() / 1000000;
+  long long int last = mt->last_progress;
+
+  if (last) {
+    long long int took = now - last;
+
+    mt->loops++;
+    mt->loop_total += took;
+    if (took > __atomic_load_n(&mt->loop_max, __ATOMIC_RELAXED))
+      __atomic_store_n(&mt->loop_max, took, __ATOMIC_RELAXED);
+  }
+  __atomic_store_n(&mt->last_progress, now, __ATOMIC_RELAXED);
+
+  if (mt->ping == 1)
+    mt->ping = 0;
+}
+
+/* Sleep on purpose, without being taken for stalled */
+void thread_progress_sleep(mythread_t *mt, long usec)
+{
+  thread_progress(mt);
+  __atomic_store_n(&mt->idle_until, mt->last_progress + usec / 1000, __ATOMIC_RELAXED);
+  my_sleep(usec);
+  thread_progress(mt);
+}
+
+void thread_create_wakeup(wakeup_t *w)
+{
+#ifdef _WIN32
+  InitializeCriticalSection(&w->mutex);
+  InitializeConditionVariable(&w->cond);
+#else
+  pthread_mutex_init(&w->mutex, NULL);
+  pthread_cond_init(&w->cond, NULL);
+#endif
+  w->pending = 0;
+}
+
+void thread_destroy_wakeup(wakeup_t *w)
+{
+#ifdef _WIN32
+  DeleteCriticalSection(&w->mutex);
+#else
+  pthread_cond_destroy(&w->cond);
+  pthread_mutex_destroy(&w->mutex);
+#endif
+}
+
+/* Wake the waiting thread, or make its next wait return at once */
+void thread_wakeup(wakeup_t *w)
+{
+#ifdef _WIN32
+  EnterCriticalSection(&w->mutex);
+  w->pending = 1;
+  WakeConditionVariable(&w->cond);
+  LeaveCriticalSection(&w->mutex);
+#else
+  pthread_mutex_lock(&w->mutex);
+  w->pending = 1;
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->mutex);
+#endif
+}
+
+/* Like thread_progress_sleep(), but returns early on thread_wakeup() */
+void thread_wait_wakeup(mythread_t *mt, wakeup_t *w, long usec)
+{
+#ifndef _WIN32
+  struct timespec until;
+
+  clock_gettime(CLOCK_REALTIME, &until);
+  until.tv_sec += usec / 1000000;
+  until.tv_nsec += (usec % 1000000) * 1000;
+  if (until.tv_nsec >= 1000000000) {
+    until.tv_sec++;
+    until.tv_nsec -= 1000000000;
+  }
+#endif
+
+  thread_progress(mt);
+  __atomic_store_n(&mt->idle_until, mt->last_progress + usec / 1000, __ATOMIC_RELAXED);
+
+#ifdef _WIN32
+  EnterCriticalSection(&w->mutex);
+  if (!w->pending)
+    SleepConditionVariableCS(&w->cond, &w->mutex, usec / 1000);
+  w->pending = 0;
+  LeaveCriticalSection(&w->mutex);
+#else
+  pthread_mutex_lock(&w->mutex);
+  while (!w->pending)
+    if (pthread_cond_timedwait(&w->cond, &w->mutex, &until) == ETIMEDOUT)
+      break;
+  w->pending = 0;
+  pthread_mutex_unlock(&w->mutex);
+#endif
+
+  thread_progress(mt);
+}
+
+/* User and system time of a thread in clock ticks */
+static int thread_read_cpu(long tid, unsigned long int *ticks)
+{
+#ifdef __linux__
+  char path[64], buf[512], *p;
+  unsigned long int utime, stime;
+  FILE *f;
+  size_t n;
+
+  if (tid <= 0)
+    return 0;
+
+  snprintf(path, sizeof(path), "/proc/self/task/%ld/stat", tid);
+  if (!(f = fopen(path, "r")))
+    return 0;
+  n = fread(buf, 1, sizeof(buf) - 1, f);
+  fclose(f);
+  buf[n] = '\0';
+
+  /* the name in parentheses may contain spaces */
+  if (!(p = strrchr(buf, ')')))
+    return 0;
+  if (sscanf(p + 1, " %*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %lu %lu", &utime, &stime) != 2)
+    return 0;
+  *ticks = utime + stime;
+  return 1;
+#else
+  return 0;
+#endif
+}
+
+/*
+ * Sample the cpu time of all threads and log the loops which made no
+ * progress for more than thread_stall_budget ms. Called by the calendar
+ * thread every THREAD_SAMPLE_INTERVAL seconds.
+ */
+void thread_check_progress()
+{
+  avl_traverser trav = {0};
+  mythread_t *mt;
+  long long int now = get_time_ns() / 1000000;
+  double elapsed = threads_sampled ? (now - threads_sampled) / 1000.0 : 0.0;
+  long int hz = 100;
+  unsigned long int ticks;
+  int stalled = 0;
+
+#ifdef _SC_CLK_TCK
+  hz = sysconf(_SC_CLK_TCK);
+  if (hz <= 0)
+    hz = 100;
+#endif
+
+  internal_lock_mutex(&info.thread_mutex);
+
+  while ((mt = avl_traverse(info.threads, &trav))) {
+    long long int progress = __atomic_load_n(&mt->last_progress, __ATOMIC_RELAXED);
+    long long int idle = __atomic_load_n(&mt->idle_until, __ATOMIC_RELAXED);
+
+    if (thread_read_cpu(mt->tid, &ticks)) {
+      if (mt->cpu_ticks && elapsed > 0)
+        mt->cpu_usage = 100.0 * (ticks - mt->cpu_ticks) / hz / elapsed;
+      mt->cpu_ticks = ticks;
+    }
+
+    mt->loop_max_last = __atomic_exchange_n(&mt->loop_max, 0, __ATOMIC_RELAXED);
+
+    if (progress == 0 || info.thread_stall_budget <= 0)
+      continue;
+
+    if (idle > progress)
+      progress = idle;
+
+    if (now - progress > info.thread_stall_budget) {
+      stalled++;
+      if (!mt->stalled) {
+        mt->stalled = 1;
+        __atomic_store_n(&thread_stalls, thread_stalls + 1, __ATOMIC_RELAXED);
+        write_log(LOG_DEFAULT, "WARNING: Thread %ld [%s] made no progress for %lld ms", mt->id, nullcheck_string(mt->name), now - progress);
+      }
+    } else if (mt->stalled) {
+      mt->stalled = 0;
+      write_log(LOG_DEFAULT, "Thread %ld [%s] is making progress again", mt->id, nullcheck_string(mt->name));
+    }
+  }
+
+  internal_unlock_mutex(&info.thread_mutex);
+
+  threads_sampled = now;
+  __atomic_store_n(&threads_stalled, stalled, __ATOMIC_RELAXED);
+}
+
+void thread_get_stall_stats(int *stalled, unsigned long int *stalls)
+{
+  *stalled = __atomic_load_n(&threads_stalled, __ATOMIC_RELAXED);
+  *stalls = __atomic_load_n(&thread_stalls, __ATOMIC_RELAXED);
+}
+
+/* Lock profiling. The counters of a mutex are only written by the thread
+ * holding it, readers may see them a little behind. */
+#define LOCK_STAT_ADD(x,n) __atomic_store_n(&(x), (x) + (n), __ATOMIC_RELAXED)
+
+static mutex_t *profiled_mutexes[LOCK_PROFILE_MAX];
+static mutex_stats_t profiled_stats[LOCK_PROFILE_MAX];
+static int profiled_count = 0;
+
+static int lock_hist_bucket(long long int ns)
+{
+  unsigned long long int us = ns > 0 ? ns / 1000 : 0;
+  int i = 0;
+
+  while (us > 0 && i < LOCK_HIST_BUCKETS - 1) {
+    us >>= 1;
+    i++;
+  }
+  return i;
+}
+
+/* Collect statistics for mutex under name, while lock_profiling is set */
+void thread_mutex_profile(mutex_t *mutex, const char *name)
+{
+  int i = __atomic_fetch_add(&profiled_count, 1, __ATOMIC_RELAXED);
+
+  if (i >= LOCK_PROFILE_MAX) {
+    __atomic_fetch_sub(&profiled_count, 1, __ATOMIC_RELAXED);
+    return;
+  }
+  profiled_stats[i].name = name;
+  profiled_mutexes[i] = mutex;
+  __atomic_store_n(&mutex->stats, &profiled_stats[i], __ATOMIC_RELEASE);
+}
+
+/* Copy the statistics of up to max profiled mutexes, returns the number copied */
+int thread_mutex_get_stats(mutex_stats_t *stats, int max)
+{
+  int i, j, count = __atomic_load_n(&profiled_count, __ATOMIC_RELAXED);
+
+  if (count > LOCK_PROFILE_MAX)
+    count = LOCK_PROFILE_MAX;
+  if (count > max)
+    count = max;
+
+  for (i = 0; i < count; i++) {
+    mutex_stats_t *ms = &profiled_stats[i];
+
+    stats[i].name = ms->name;
+    stats[i].acquired = __atomic_load_n(&ms->acquired, __ATOMIC_RELAXED);
+    stats[i].contended = __atomic_load_n(&ms->contended, __ATOMIC_RELAXED);
+    stats[i].wait_ns = __atomic_load_n(&ms->wait_ns, __ATOMIC_RELAXED);
+    stats[i].hold_ns = __atomic_load_n(&ms->hold_ns, __ATOMIC_RELAXED);
+    stats[i].hold_samples = __atomic_load_n(&ms->hold_samples, __ATOMIC_RELAXED);
+    for (j = 0; j < LOCK_HIST_BUCKETS; j++) {
+      stats[i].wait_hist[j] = __atomic_load_n(&ms->wait_hist[j], __ATOMIC_RELAXED);
+      stats[i].hold_hist[j] = __atomic_load_n(&ms->hold_hist[j], __ATOMIC_RELAXED);
+    }
+    stats[i].locked_at = 0;
+  }
+  return count;
+}
+
+void thread_mutex_reset_stats()
+{
+  int i, count = __atomic_load_n(&profiled_count, __ATOMIC_RELAXED);
+
+  for (i = 0; i < count && i < LOCK_PROFILE_MAX; i++) {
+    mutex_stats_t *ms = &profiled_stats[i];
+    const char *name = ms->name;
+
+    /* taken without the profiling path, the holder owns the counters */
+#ifdef _WIN32
+    EnterCriticalSection(&profiled_mutexes[i]->mutex);
+#else
+    pthread_mutex_lock(&profiled_mutexes[i]->mutex);
+#endif
+    memset(ms, 0, sizeof(mutex_stats_t));
+    ms->name = name;
+#ifdef _WIN32
+    LeaveCriticalSection(&profiled_mutexes[i]->mutex);
+#else
+    pthread_mutex_unlock(&profiled_mutexes[i]->mutex);
+#endif
+  }
+}
+
+/* Upper bound in microseconds of the bucket holding the p-th fraction of hist */
+unsigned long int lock_hist_percentile(const unsigned long int *hist, double p)
+{
+  unsigned long int total = 0, seen = 0, target;
+  int i;
+
+  for (i = 0; i < LOCK_HIST_BUCKETS; i++)
+    total += hist[i];
+  if (total == 0)
+    return 0;
+
+  target = (unsigned long int)(total * p);
+  if (target < 1)
+    target = 1;
+  for (i = 0; i < LOCK_HIST_BUCKETS - 1; i++) {
+    seen += hist[i];
+    if (seen >= target)
+      break;
+  }
+  return 1UL << i;
+}
+
+/* Try the lock first, only a contended acquisition reads the clock twice */
+static void lock_mutex_profiled(mutex_t *mutex, mutex_stats_t *ms)
+{
+  long long int start = 0, now = 0;
+
+#ifdef _WIN32
+  if (!TryEnterCriticalSection(&mutex->mutex)) {
+    start = get_time_ns();
+    EnterCriticalSection(&mutex->mutex);
+  }
+#else
+  if (pthread_mutex_trylock(&mutex->mutex) != 0) {
+    start = get_time_ns();
+    if (pthread_mutex_lock(&mutex->mutex) == EINVAL) {
+      fprintf (stderr, "WARNING: Locking unitialized mutex\n");
+      return;
+    }
+  }
+#endif
+
+  LOCK_STAT_ADD(ms->acquired, 1);
+  if (start) {
+    now = get_time_ns();
+    LOCK_STAT_ADD(ms->contended, 1);
+    LOCK_STAT_ADD(ms->wait_ns, now - start);
+    LOCK_STAT_ADD(ms->wait_hist[lock_hist_bucket(now - start)], 1);
+    CASTER_PROBE2(lock_wait, ms->name, now - start);
+  }
+
+  if (ms->acquired % LOCK_HOLD_SAMPLE == 0)
+    ms->locked_at = now ? now : get_time_ns();
+  else
+    ms->locked_at = 0;
+}
+
 void internal_lock_mutex(mutex_t *mutex)
 {
+  mutex_stats_t *ms;
+
   if (!mutex) {
     fprintf (stderr, "ERROR: internal_lock_mutex() called with NULL pointer!");
   }
 
+  ms = mutex->stats;
+  if (ms && info.lock_profiling) {
+    lock_mutex_profiled(mutex, ms);
+    return;
+  }
+
 #ifdef _WIN32
   EnterCriticalSection(&mutex->mutex);
 #else
@@ -657,6 +1059,18 @@ void internal_lock_mutex(mutex_t *mutex)
 
 void internal_unlock_mutex(mutex_t *mutex)
 {
+  mutex_stats_t *ms = mutex->stats;
+
+  /* a sampled hold is finished also if profiling was switched off meanwhile */
+  if (ms && ms->locked_at) {
+    long long int held = get_time_ns() - ms->locked_at;
+
+    ms->locked_at = 0;
+    LOCK_STAT_ADD(ms->hold_samples, 1);
+    LOCK_STAT_ADD(ms->hold_ns, held);
+    LOCK_STAT_ADD(ms->hold_hist[lock_hist_bucket(held)], 1);
+  }
+
 #ifdef _WIN32
   LeaveCriticalSection(&mutex->mutex);
 #else
@@ -681,6 +1095,7 @@ void thread_lib_init()
   info.mutexes = avl_create_nl (compare_mutexes, &info);
   thread_create_mutex_nl (&info.mutex_mutex);
   thread_create_mutex (&library_mutex);
+  thread_mutex_profile (&library_mutex, "library");
 }
 
 void thread_library_lock()
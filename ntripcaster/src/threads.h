@@ -53,6 +53,25 @@ typedef CRITICAL_SECTION win32_mutex_t;
 typedef pthread_t icethread_t;
 #endif
 
+/* Wait and hold time histograms, bucket i counts below 2^i microseconds */
+#define LOCK_HIST_BUCKETS 24
+/* Hold times are measured for one in LOCK_HOLD_SAMPLE acquisitions */
+#define LOCK_HOLD_SAMPLE 16
+#define LOCK_PROFILE_MAX 32
+
+typedef struct mutex_stats_St
+{
+  const char *name;
+  unsigned long int acquired;
+  unsigned long int contended;
+  unsigned long long int wait_ns; /* sum over the contended acquisitions */
+  unsigned long int wait_hist[LOCK_HIST_BUCKETS];
+  unsigned long long int hold_ns; /* sum over the sampled holds */
+  unsigned long int hold_samples;
+  unsigned long int hold_hist[LOCK_HIST_BUCKETS];
+  long long int locked_at; /* ns, 0 when this hold is not sampled */
+} mutex_stats_t;
+
 typedef struct icemutex_St
 {
   long int thread_id;
@@ -64,8 +83,22 @@ typedef struct icemutex_St
   long int mutexid;
   int lineno;
   long int id;
+  mutex_stats_t *stats; /* NULL if not profiled */
 } mutex_t;
 
+/* Wakes a thread waiting in thread_wait_wakeup(), see thread_wakeup() */
+typedef struct icewakeup_St
+{
+#ifndef _WIN32
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+#else
+  CRITICAL_SECTION mutex;
+  CONDITION_VARIABLE cond;
+#endif
+  int pending;
+} wakeup_t;
+
 
 #define thread_create(n,x,y) thread_create_c (n,x,y,__LINE__,__FILE__);
 #define thread_create_mutex(x) thread_create_mutex_c (x,__LINE__,__FILE__);
@@ -92,6 +125,20 @@ typedef struct mythread_st
   time_t created;
   int ping;
   int running;
+  long int tid; /* kernel thread id, 0 if unknown */
+
+  /* Loop progress, see thread_progress(). Times in ms of the monotonic clock */
+  long long int last_progress; /* 0 if the thread has no loop */
+  long long int idle_until; /* sleeping on purpose until then */
+  unsigned long int loops;
+  long long int loop_total;
+  long long int loop_max; /* since the last sample */
+  long long int loop_max_last; /* of the last sample interval */
+  int stalled;
+
+  /* Sampled by thread_check_progress() */
+  unsigned long int cpu_ticks;
+  double cpu_usage; /* percent of one cpu in the last sample interval */
 } mythread_t;
 
 void thread_lib_init();
@@ -104,6 +151,12 @@ void thread_exit_c(void *val, int line, char *file);
 void internal_lock_mutex(mutex_t *mutex);
 void internal_unlock_mutex(mutex_t *mutex);
 
+/* lock profiling, see lock_profiling */
+void thread_mutex_profile(mutex_t *mutex, const char *name);
+int thread_mutex_get_stats(mutex_stats_t *stats, int max);
+void thread_mutex_reset_stats();
+unsigned long int lock_hist_percentile(const unsigned long int *hist, double p);
+
 /* added. ajd */
 int thread_kill (int pid);
 void thread_force_mutex_unlock(char *arg);
@@ -130,4 +183,15 @@ mythread_t *thread_check_created();
 void thread_mem_check (mythread_t *mt);
 void thread_rename(const char *name); /* renames current thread */
 
+/* loop latency, cpu time and the stall detector, see thread_stall_budget */
+long thread_kernel_id();
+void thread_progress(mythread_t *mt);
+void thread_progress_sleep(mythread_t *mt, long usec);
+void thread_create_wakeup(wakeup_t *w);
+void thread_destroy_wakeup(wakeup_t *w);
+void thread_wakeup(wakeup_t *w);
+void thread_wait_wakeup(mythread_t *mt, wakeup_t *w, long usec);
+void thread_check_progress();
+void thread_get_stall_stats(int *stalled, unsigned long int *stalls);
+
 #endif
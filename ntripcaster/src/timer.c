@@ -98,6 +98,7 @@
 #include "commands.h"
 #include "relay.h"
 #include "source.h"
+#include "rtcm.h"
 #include "authenticate/basic.h"
 
 #ifndef MSG_DONTWAIT
@@ -172,13 +173,19 @@ void *startup_timer_thread(void *arg)
 
     timer_handle_transfer_statistics (stime, &trottime, &justone, &trotstat);
 
+    update_debug_level ();
+
 #ifdef CHANGE5
 #ifdef DAILY_LOGFILES
     timer_check_date(); // start_new_day in handle_transfer_statistics?
 #endif
 #endif
 
-    if (mt->ping == 1) mt->ping = 0;
+    timer_check_threads (stime);
+
+    rtcm_apply_updates ();
+
+    thread_progress (mt);
 
     my_sleep(400000);
   }
@@ -198,6 +205,17 @@ timer_handle_status_lines (time_t stime)
   }
 }
 
+void
+timer_check_threads (time_t stime)
+{
+  static time_t lasttime = 0;
+
+  if ((stime - lasttime) >= THREAD_SAMPLE_INTERVAL) {
+    lasttime = stime;
+    thread_check_progress ();
+  }
+}
+
 void
 timer_handle_transfer_statistics (time_t stime, time_t *trottime, time_t *justone, statistics_t *trotstat)
 {
@@ -533,12 +551,14 @@ void *startup_relay_connector_thread(void *arg)
   while (thread_alive (mt))
   {
     relay_connect_all_relays ();
-    my_sleep ((info.relay_reconnect_time / 2) * 1000000);
-
-    if (mt->ping == 1)
-      mt->ping = 0;
+    if (relay_poll_connects (RELAY_POLL_INTERVAL) == 0)
+      thread_progress_sleep (mt, RELAY_POLL_INTERVAL * 1000);
+    else
+      thread_progress (mt);
   }
 
+  relay_abort_connects ();
+
   thread_exit (2);
   return NULL;
 }
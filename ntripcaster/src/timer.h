@@ -63,6 +63,7 @@ void *startup_watchdog_thread(void *arg); // added. ajd
 //void timer_update_stats_files (time_t stime);
 //void timer_handle_directory_servers (time_t stime);
 void timer_handle_status_lines (time_t stime);
+void timer_check_threads (time_t stime);
 void timer_handle_transfer_statistics (time_t stime, time_t *trottime, time_t *justone, statistics_t *trotstat);
 void timer_kick_abandoned_relays (time_t stime);
 void timer_check_date();
@@ -49,16 +49,18 @@
 #include "sock.h"
 #include "tls.h"
 #include "utility.h"
+#include "logtime.h"
 
 #include <openssl/err.h>
 #if OPENSSL_VERSION_NUMBER >= 0x10002000L
 #include <openssl/x509v3.h>
 #endif
 
-int tls_connect(connection_t *con, const char *host)
+/* Prepare the client side TLS state of con, the handshake is left to
+ * SSL_connect(), which also works on non blocking sockets */
+int tls_setup(connection_t *con, const char *host)
 {
   BIO *sslbio;
-  int res;
 #if OPENSSL_VERSION_NUMBER >= 0x10100000L
   con->tls_context = SSL_CTX_new(TLS_method());
 #else
@@ -96,7 +98,15 @@ int tls_connect(connection_t *con, const char *host)
 #if OPENSSL_VERSION_NUMBER >= 0x10000000L
   SSL_set_tlsext_host_name(con->tls_socket, host);
 #endif
+  return 0;
+}
+
+int tls_connect(connection_t *con, const char *host)
+{
+  int res;
 
+  if(tls_setup(con, host) < 0)
+    return -1;
   res = SSL_connect(con->tls_socket);
   if(res < 0)
   {
@@ -224,7 +234,7 @@ int tls_read_lines_with_timeout(SSL *tls, char *buff, const int len)
   int read_bytes;
   int pos = 0;
   int maxpos = len-1;
-  long timeout = time(NULL) + SOCK_READ_LINES_TIMEOUT;
+  long timeout = get_time() + SOCK_READ_LINES_TIMEOUT;
 
   if (!tls) {
     xa_debug(1, "ERROR: tls_read_lines_with_timeout() called with invalid socket");
@@ -257,7 +267,7 @@ int tls_read_lines_with_timeout(SSL *tls, char *buff, const int len)
     read_bytes = tls_recv(tls, &c, 1);
 
     while (read_bytes < 0) {
-      if (time(NULL) > timeout) {
+      if (get_time() > timeout) {
         timeout = -1;
         break;
       }
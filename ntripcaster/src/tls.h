@@ -39,6 +39,7 @@
 
 #include "ntripcastertypes.h"
 
+int tls_setup(connection_t *con, const char *host);
 int tls_connect(connection_t *con, const char *host);
 void tls_free(connection_t *con);
 
@@ -106,12 +106,15 @@
 #include "alias.h"
 #include "timer.h"
 #include "memory.h"
+#include "metrics.h"
+#include "rtcm.h"
 #include "string.h"
 #include "vars.h"
 #include "connection.h"
 #include "relay.h"
 #include "restrict.h"
 #include "rtp.h"
+#include "probes.h"
 #ifdef HAVE_TLS
 #include "tls.h"
 #endif /* HAVE_TLS */
@@ -280,6 +283,8 @@ kick_connection(void *conarg, void *reasonarg)
     return;
   }
 
+  CASTER_PROBE3(kick, con->id, con->type, reason);
+
   switch (con->type) {
     case client_e:
       write_log (LOG_DEFAULT,
@@ -288,6 +293,8 @@ kick_connection(void *conarg, void *reasonarg)
            nntripcaster_time (get_time () - con->connect_time, timebuf),
            con->food.client->source->audiocast.mount, // added. ajd
            con->food.client->write_bytes, info.num_clients - 1);
+      if (con->food.client->alive != CLIENT_DEAD)
+        metrics_kick (con->food.client->source->metrics, client_e, reason);
       con->food.client->alive = CLIENT_DEAD;
       if(con->udpbuffers)
       {
@@ -295,7 +302,7 @@ kick_connection(void *conarg, void *reasonarg)
         sock_write_string_con(con, "");
       }
 
-      write_clf (con, con->food.client->source);
+      write_clf (con, con->food.client->source, reason);
       return;
       break;
     case admin_e:
@@ -321,6 +328,8 @@ kick_connection(void *conarg, void *reasonarg)
            con->food.source->audiocast.mount,
            con->food.source->stats.read_bytes, num);
       }
+      if (con->food.source->connected != SOURCE_KILLED)
+        metrics_kick (con->food.source->metrics, source_e, reason);
       if(con->udpbuffers)
       {
         con->rtp->datagram->pt = 98;
@@ -438,6 +447,7 @@ close_connection(void *data)
     avl_delete (info.admins, con);
 
     free_con (con); /* Free:s stuff that all connections have */
+    free_log_queue (con->food.admin->logqueue);
     nfree (con->food.admin);
     nfree (con);
     return;
@@ -469,6 +479,9 @@ close_connection(void *data)
     rtsp_remove_connection_from_session(con, con->session_id); // rtsp. ajd
 
     free_con (con); /* Free:s stuff that all connections have */
+    if (con->food.client->nearest) {
+      nfree (con->food.client->nearest);
+    }
     nfree (con->food.client);
     nfree (con);
     return;
@@ -501,7 +514,7 @@ close_connection(void *data)
         thread_mutex_lock (&info.relay_mutex);  // was thread_mutex. DEADLOCK, because thread_mutex_lock:get_my thread locks it too. ajd
         rel = relay_find_with_con (con);
         if (rel) {
-          rel->con = NULL;
+          relay_ended (rel);
           rel->pending = 0;
         }
         thread_mutex_unlock (&info.relay_mutex);
@@ -514,7 +527,7 @@ close_connection(void *data)
         } else
           rel = relay_find_with_con (con);
 
-        if (rel) rel->con = NULL;
+        if (rel) relay_ended (rel);
 #endif
       }
 
@@ -529,11 +542,13 @@ close_connection(void *data)
     {
       del_source();
       avl_delete (info.sources, con);
+      metrics_source_detached (source->metrics);
     }
 
     rtsp_remove_connection_from_session(con, con->session_id);
 
     free_con (con); /* Free:s stuff that all connections have */
+    rtcm_free(source->analyzer);
     nfree(source);
     nfree(con);
     return;
@@ -558,9 +573,13 @@ kick_not_connected (connection_t *con, char *reason)
       avl_destroy (con->food.source->clients, NULL);
       nfree (con->food.source);
   } else if (con->type == client_e) {
+    if (con->food.client->nearest) {
+      nfree (con->food.client->nearest);
+    }
     nfree (con->food.client);
   }
   else if (con->type == admin_e) {
+    free_log_queue (con->food.admin->logqueue);
     nfree (con->food.admin);
   }
 
@@ -1333,12 +1352,14 @@ void init_thread_tree(int line, char *file)
   info.threads = avl_create(compare_threads, &info);
 
   /* Some luxury just to make the main thread show up in com_threads() */
+  memset(mt, 0, sizeof(mythread_t));
   mt->id = 0;
   mt->line = line;
   mt->file = strdup(file);
   mt->thread = thread_self();
   mt->created = get_time();
   mt->name = strdup("Main Thread");
+  mt->tid = thread_kernel_id();
 
   if (avl_insert(info.threads, mt)) {
     fprintf (stderr, "WARNING: Could not insert main thread into the thread tree, DAMN!\n");
@@ -1346,6 +1367,7 @@ void init_thread_tree(int line, char *file)
   }
 
   thread_create_mutex(&info.thread_mutex);
+  thread_mutex_profile(&info.thread_mutex, "thread");
 
   /* On platforms where it is supported, this enables this thread to be
      cancelable */
@@ -1968,6 +1990,147 @@ list_enum_t *list_get_enum(list_t *l) {
   return new;
 }
 
+unsigned int hash_string(const char *key) {
+  unsigned int h = 2166136261U; /* FNV-1a */
+
+  while (*key) {
+    h ^= (unsigned char)*key++;
+    h *= 16777619U;
+  }
+
+  return h;
+}
+
+/* size is the expected number of entries, the table grows beyond it */
+hash_table_t *hash_create(unsigned int size) {
+  hash_table_t *h = (hash_table_t *)nmalloc(sizeof(hash_table_t));
+
+  h->size = 16;
+  while (h->size < size && h->size < (1U << 30))
+    h->size <<= 1;
+  h->count = 0;
+  h->buckets = (hash_entry_t **)nmalloc(h->size * sizeof(hash_entry_t *));
+  memset(h->buckets, 0, h->size * sizeof(hash_entry_t *));
+
+  return h;
+}
+
+void hash_destroy(hash_table_t *h, ntripcaster_function *free_func) {
+  hash_entry_t *e, *next;
+  unsigned int i;
+
+  if (!h) return;
+
+  for (i = 0; i < h->size; i++) {
+    for (e = h->buckets[i]; e; e = next) {
+      next = e->next;
+      if (free_func && e->data) ((*(free_func))(e->data));
+      nfree(e);
+    }
+  }
+  nfree(h->buckets);
+  nfree(h);
+}
+
+void *hash_find(hash_table_t *h, const char *key) {
+  hash_entry_t *e;
+
+  if (!h || !key) return NULL;
+
+  for (e = h->buckets[hash_string(key) & (h->size - 1)]; e; e = e->next)
+    if (strcmp(e->key, key) == 0) return e->data;
+
+  return NULL;
+}
+
+/* Double the buckets, at most one entry per bucket on average is kept */
+static void hash_grow(hash_table_t *h) {
+  hash_entry_t **buckets, *e, *next;
+  unsigned int i, size = h->size << 1;
+
+  buckets = (hash_entry_t **)nmalloc(size * sizeof(hash_entry_t *));
+  memset(buckets, 0, size * sizeof(hash_entry_t *));
+
+  for (i = 0; i < h->size; i++) {
+    for (e = h->buckets[i]; e; e = next) {
+      next = e->next;
+      e->next = buckets[hash_string(e->key) & (size - 1)];
+      buckets[hash_string(e->key) & (size - 1)] = e;
+    }
+  }
+
+  nfree(h->buckets);
+  h->buckets = buckets;
+  h->size = size;
+}
+
+/* Insert data under key, return the data it replaced or NULL */
+void *hash_replace(hash_table_t *h, const char *key, void *data) {
+  hash_entry_t *e, **bucket;
+  void *old;
+
+  bucket = &h->buckets[hash_string(key) & (h->size - 1)];
+  for (e = *bucket; e; e = e->next) {
+    if (strcmp(e->key, key) == 0) {
+      old = e->data;
+      e->key = key;
+      e->data = data;
+      return old;
+    }
+  }
+
+  if (h->count >= h->size && h->size < (1U << 30)) {
+    hash_grow(h);
+    bucket = &h->buckets[hash_string(key) & (h->size - 1)];
+  }
+
+  e = (hash_entry_t *)nmalloc(sizeof(hash_entry_t));
+  e->key = key;
+  e->data = data;
+  e->next = *bucket;
+  *bucket = e;
+  h->count++;
+
+  return NULL;
+}
+
+void *hash_remove(hash_table_t *h, const char *key) {
+  hash_entry_t *e, **prev;
+  void *old;
+
+  prev = &h->buckets[hash_string(key) & (h->size - 1)];
+  for (e = *prev; e; prev = &e->next, e = e->next) {
+    if (strcmp(e->key, key) == 0) {
+      *prev = e->next;
+      old = e->data;
+      nfree(e);
+      h->count--;
+      return old;
+    }
+  }
+
+  return NULL;
+}
+
+/* Remove and free the entries for which match(data, arg) is true */
+void hash_remove_if(hash_table_t *h, hash_match_func *match, void *arg, ntripcaster_function *free_func) {
+  hash_entry_t *e, **prev;
+  unsigned int i;
+
+  for (i = 0; i < h->size; i++) {
+    prev = &h->buckets[i];
+    while ((e = *prev)) {
+      if (match(e->data, arg)) {
+        *prev = e->next;
+        if (free_func && e->data) ((*(free_func))(e->data));
+        nfree(e);
+        h->count--;
+      } else
+        prev = &e->next;
+    }
+  }
+}
+
 string_buffer_t *string_buffer_create(int size) {
   string_buffer_t *sb = (string_buffer_t *)nmalloc(sizeof(string_buffer_t));
 
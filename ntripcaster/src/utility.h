@@ -126,6 +126,14 @@ void *list_next(list_enum_t *l);
 list_enum_t *list_get_enum(list_t *l);
 void list_reset(list_enum_t *l);
 
+hash_table_t *hash_create(unsigned int size);
+void hash_destroy(hash_table_t *h, ntripcaster_function *free_func);
+void *hash_find(hash_table_t *h, const char *key);
+void *hash_replace(hash_table_t *h, const char *key, void *data);
+void *hash_remove(hash_table_t *h, const char *key);
+void hash_remove_if(hash_table_t *h, hash_match_func *match, void *arg, ntripcaster_function *free_func);
+unsigned int hash_string(const char *key);
+
 string_buffer_t *string_buffer_create(int size);
 void dispose_string_buffer(string_buffer_t *sb);
 int write_string_to_buffer(string_buffer_t *sb, char *string);